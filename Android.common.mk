@@ -127,7 +127,13 @@ LOCAL_CPPFLAGS += \
 
 LOCAL_CPPFLAGS += -DVA_SUPPORT_COLOR_RANGE
 
-ifeq ($(strip $(BOARD_USES_VULKAN)), true)
+ifeq ($(strip $(BOARD_USES_SOFTWARE_COMPOSITOR)), true)
+LOCAL_CPPFLAGS += \
+	-DUSE_SW
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/common/compositor/sw
+else ifeq ($(strip $(BOARD_USES_VULKAN)), true)
 LOCAL_SHARED_LIBRARIES += \
 	libvulkan
 
@@ -63,6 +63,7 @@ endif
 
 LOCAL_SRC_FILES := \
         compositor/compositor.cpp \
+        compositor/compositorpool.cpp \
         compositor/compositorthread.cpp \
         compositor/factory.cpp \
         compositor/nativesurface.cpp \
@@ -75,16 +76,37 @@ LOCAL_SRC_FILES := \
 	core/logicaldisplaymanager.cpp \
 	core/mosaicdisplay.cpp \
         core/overlaylayer.cpp \
+        display/damagehistory.cpp \
         display/displayplanemanager.cpp \
 	display/displayplanestate.cpp \
+        display/planeassignmentcache.cpp \
+        display/presentscheduler.cpp \
+        display/presentsequencer.cpp \
         display/displayqueue.cpp \
         display/vblankeventhandler.cpp \
         display/virtualdisplay.cpp \
         utils/fdhandler.cpp \
+        utils/framearena.cpp \
         utils/hwcevent.cpp \
         utils/hwcthread.cpp \
         utils/hwcutils.cpp \
-        utils/disjoint_layers.cpp
+        utils/disjoint_layers.cpp \
+        utils/synctimeline.cpp
+
+ifeq ($(strip $(ENABLE_PIPELINED_COMMIT)), true)
+LOCAL_CPPFLAGS += \
+	-DENABLE_PIPELINED_COMMIT
+endif
+
+ifeq ($(strip $(ENABLE_BATCHED_PLANE_VALIDATION)), true)
+LOCAL_CPPFLAGS += \
+	-DENABLE_BATCHED_PLANE_VALIDATION
+endif
+
+ifeq ($(strip $(DISABLE_PROGRAM_PREWARM)), true)
+LOCAL_CPPFLAGS += \
+	-DDISABLE_PROGRAM_PREWARM
+endif
 
 ifeq ($(strip $(ENABLE_HYPER_DMABUF_SHARING)), true)
 LOCAL_CPPFLAGS += -DENABLE_PANORAMA
@@ -142,19 +164,34 @@ LOCAL_CPPFLAGS += \
 
 LOCAL_CPPFLAGS += -DVA_SUPPORT_COLOR_RANGE
 
-ifeq ($(strip $(BOARD_USES_VULKAN)), true)
+ifeq ($(strip $(BOARD_USES_SOFTWARE_COMPOSITOR)), true)
+LOCAL_CPPFLAGS += \
+        -DUSE_SW
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/compositor/sw
+
+LOCAL_SRC_FILES += \
+        compositor/sw/nativeswresource.cpp \
+        compositor/sw/swkernels.cpp \
+        compositor/sw/swrenderer.cpp \
+        compositor/sw/swshim.cpp \
+        compositor/sw/swsurface.cpp
+else ifeq ($(strip $(BOARD_USES_VULKAN)), true)
 LOCAL_SHARED_LIBRARIES += \
         libvulkan
 
 LOCAL_CPPFLAGS += \
         -DUSE_VK \
-        -DDISABLE_EXPLICIT_SYNC
+        -DDISABLE_EXPLICIT_SYNC \
+        -DPROGRAM_CACHE_DIR='"/data/vendor/hwc/program_cache"'
 
 LOCAL_C_INCLUDES += \
         $(LOCAL_PATH)/compositor/vk \
         $(LOCAL_PATH)/../../mesa/include
 
 LOCAL_SRC_FILES += \
+        compositor/vk/vkpipelinecache.cpp \
         compositor/vk/vkprogram.cpp \
         compositor/vk/vkrenderer.cpp \
         compositor/vk/vksurface.cpp \
@@ -163,10 +200,13 @@ LOCAL_SRC_FILES += \
 else
 LOCAL_CPPFLAGS += \
         -DUSE_GL \
-        -DPREBUILT_SHADER_FILE_PATH='"/vendor/etc"'
+        -DPREBUILT_SHADER_FILE_PATH='"/vendor/etc"' \
+        -DPROGRAM_CACHE_DIR='"/data/vendor/hwc/program_cache"'
 
 LOCAL_SRC_FILES += \
         compositor/gl/glprogram.cpp \
+        compositor/gl/glprogramcache.cpp \
+        compositor/gl/glprogramwarmer.cpp \
         compositor/gl/glrenderer.cpp \
         compositor/gl/glsurface.cpp \
         compositor/gl/egloffscreencontext.cpp \
@@ -18,6 +18,8 @@
 
 #include <xf86drmMode.h>
 
+#include <string.h>
+
 #include <algorithm>
 
 #include "disjoint_layers.h"
@@ -27,6 +29,7 @@
 #include "hwcutils.h"
 #include "nativegpuresource.h"
 #include "nativesurface.h"
+#include "overlaybuffer.h"
 #include "overlaylayer.h"
 #include "renderer.h"
 
@@ -58,14 +61,24 @@ void Compositor::Reset() {
 
 bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
                       std::vector<OverlayLayer> &layers,
-                      const std::vector<HwcRect<int>> &display_frame) {
+                      const std::vector<HwcRect<int>> &display_frame,
+                      bool async, int64_t deadline) {
   CTRACE();
+  drawn_pixels_ = 0;
+  sampled_pixels_ = 0;
+  clears_avoided_ = 0;
+  clear_bytes_saved_ = 0;
   const DisplayPlaneState *comp = NULL;
-  std::vector<size_t> dedicated_layers;
-  std::vector<DrawState> draw_state;
-  std::vector<DrawState> media_state;
-  std::vector<OverlayBuffer *> draw_buffers;
-
+  ArenaVector<size_t> dedicated_layers(
+      (ArenaAllocator<size_t>(frame_arena_)));
+  // Draw states are reused across frames, CompositorThread hands back the
+  // ones of the previous frame when it takes the new ones.
+  size_t num_draw_states = 0;
+  size_t num_media_states = 0;
+  ArenaVector<OverlayBuffer *> draw_buffers(
+      (ArenaAllocator<OverlayBuffer *>(frame_arena_)));
+
+  draw_buffers.reserve(layers.size());
   for (auto &layer : layers) {
     draw_buffers.emplace_back(layer.GetBuffer());
   }
@@ -89,9 +102,11 @@ bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
       dedicated_layers.insert(dedicated_layers.end(),
                               plane.GetSourceLayers().begin(),
                               plane.GetSourceLayers().end());
-      media_state.emplace_back();
+      if (num_media_states == media_states_.size())
+        media_states_.emplace_back();
       plane.SwapSurfaceIfNeeded();
-      DrawState &state = media_state.back();
+      DrawState &state = media_states_[num_media_states++];
+      state.Reset();
       state.surface_ = plane.GetOffScreenTarget();
       MediaState &media_state = state.media_state_;
       lock_.lock();
@@ -116,60 +131,111 @@ bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
       plane.SwapSurfaceIfNeeded();
       std::vector<CompositionRegion> &comp_regions =
           plane.GetCompositionRegion();
-      bool regions_empty = comp_regions.empty();
       NativeSurface *surface = plane.GetOffScreenTarget();
       if (surface == NULL) {
         ETRACE("GetOffScreenTarget() returned NULL pointer 'surface'.");
         return false;
       }
-      if (!regions_empty &&
-          (surface->ClearSurface() || surface->IsPartialClear() ||
-           surface->IsSurfaceDamageChanged())) {
-        plane.ResetCompositionRegion();
-        regions_empty = true;
-      }
 
       if (surface->ClearSurface()) {
         plane.UpdateDamage(plane.GetDisplayFrame());
       }
 
-      if (regions_empty) {
-        SeparateLayers(dedicated_layers, comp->GetSourceLayers(), display_frame,
-                       surface->GetSurfaceDamage(), comp_regions);
+      bool use_plane_transform = false;
+      if (plane.GetRotationType() ==
+          DisplayPlaneState::RotationType::kGPURotation) {
+        use_plane_transform = true;
+      }
+
+      // Regions and render states only depend on the geometry of the
+      // layers and the damage. Re-use them as long as that is unchanged,
+      // the buffers are bound by CompositorThread.
+      std::vector<RenderState> &render_states = plane.GetRenderStates();
+      uint64_t geometry_hash =
+          GeometryHash(layers, display_frame, dedicated_layers, plane,
+                       surface->GetSurfaceDamageRegion(), use_plane_transform);
+      if (geometry_hash != plane.GetGeometryHash()) {
+        plane.ResetCompositionRegion();
+        // Rects of the damage region don't overlap, so neither do the
+        // composition regions of different rects.
+        size_t num_regions = 0;
+        for (const HwcRect<int> &damage : surface->GetSurfaceDamageRegion()) {
+          SeparateLayers(layers, dedicated_layers, comp->GetSourceLayers(),
+                         display_frame, damage, comp_regions, &num_regions);
+        }
+
+        comp_regions.resize(num_regions);
+
+        CalculateRenderState(layers, comp_regions, render_states,
+                             plane.GetDownScalingFactor(),
+                             plane.IsUsingPlaneScalar(), use_plane_transform);
+        plane.SetGeometryHash(geometry_hash);
       }
 
-      std::vector<size_t>().swap(dedicated_layers);
-      if (comp_regions.empty())
+      dedicated_layers.clear();
+      if (render_states.empty())
         continue;
 
-      draw_state.emplace_back();
-      DrawState &state = draw_state.back();
+      if (num_draw_states == draw_states_.size())
+        draw_states_.emplace_back();
+      DrawState &state = draw_states_[num_draw_states++];
+      state.Reset();
       state.surface_ = surface;
-      size_t num_regions = comp_regions.size();
-      state.states_.reserve(num_regions);
-      bool use_plane_transform = false;
-      if (plane.GetRotationType() ==
-          DisplayPlaneState::RotationType::kGPURotation) {
-        use_plane_transform = true;
+      state.states_ = render_states;
+      for (RenderState &render_state : state.states_) {
+        for (RenderState::LayerState &layer_state :
+             render_state.layer_state_) {
+          layer_state.solid_color_array_ =
+              layers.at(layer_state.layer_index_).GetSolidColorArray();
+        }
       }
 
-      CalculateRenderState(layers, comp_regions, state,
-                           plane.GetDownScalingFactor(),
-                           plane.IsUsingPlaneScalar(), use_plane_transform);
+      CollectAcquireFences(layers, comp_regions, state);
+      CalculateClearRegion(surface, render_states);
 
-      if (state.states_.empty()) {
-        draw_state.pop_back();
+      for (const RenderState &render_state : render_states) {
+        uint64_t pixels = (uint64_t)render_state.width_ * render_state.height_;
+        drawn_pixels_ += pixels;
+        sampled_pixels_ += pixels * render_state.layer_state_.size();
       }
     }
   }
 
+  draw_states_.resize(num_draw_states);
+  media_states_.resize(num_media_states);
   bool status = true;
-  if (!draw_state.empty() || !media_state.empty())
-    status = thread_->Draw(draw_state, media_state, draw_buffers);
+  if (!draw_states_.empty() || !media_states_.empty())
+    status = thread_->Draw(draw_states_, media_states_, draw_buffers, async,
+                           deadline);
 
   return status;
 }
 
+bool Compositor::WaitForPendingDraw() {
+  if (!thread_)
+    return true;
+
+  return thread_->WaitForPendingDraw();
+}
+
+int32_t Compositor::TakeDeferredDrawFence() {
+  if (!thread_)
+    return -1;
+
+  return thread_->TakeDeferredDrawFence();
+}
+
+bool Compositor::ShouldMigrate() {
+  if (!thread_)
+    return false;
+
+  return thread_->ShouldMigrate();
+}
+
+void Compositor::Migrate() {
+  thread_->Migrate();
+}
+
 bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
                                const std::vector<HwcRect<int>> &display_frame,
                                const std::vector<size_t> &source_layers,
@@ -177,7 +243,7 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
                                uint32_t width, uint32_t height,
                                HWCNativeHandle output_handle,
                                int32_t acquire_fence, int32_t *retire_fence) {
-  std::vector<OverlayBuffer *> draw_buffers;
+  ArenaVector<OverlayBuffer *> draw_buffers;
   OverlayBuffer *nullbuffer = NULL;
   for (auto &layer : layers) {
     if (layer.IsProtected()) {
@@ -187,8 +253,11 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
   }
 
   std::vector<CompositionRegion> comp_regions;
-  SeparateLayers(std::vector<size_t>(), source_layers, display_frame,
-                 HwcRect<int>(0, 0, width, height), comp_regions);
+  size_t num_regions = 0;
+  SeparateLayers(layers, ArenaVector<size_t>(), source_layers, display_frame,
+                 HwcRect<int>(0, 0, width, height), comp_regions,
+                 &num_regions);
+  comp_regions.resize(num_regions);
   if (comp_regions.empty()) {
     ETRACE(
         "Failed to prepare offscreen buffer. "
@@ -197,22 +266,23 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
     return false;
   }
 
-  NativeSurface *surface = Create3DSurface(width, height);
-  surface->InitializeForOffScreenRendering(output_handle, resource_manager);
   std::vector<DrawState> draw;
   std::vector<DrawState> media;
   draw.emplace_back();
   DrawState &draw_state = draw.back();
-  draw_state.destroy_surface_ = true;
-  draw_state.surface_ = surface;
-  size_t num_regions = comp_regions.size();
-  draw_state.states_.reserve(num_regions);
-  CalculateRenderState(layers, comp_regions, draw_state, 1, false);
+  CalculateRenderState(layers, comp_regions, draw_state.states_, 1, false);
+  CollectAcquireFences(layers, comp_regions, draw_state);
 
   if (draw_state.states_.empty()) {
     return true;
   }
 
+  NativeSurface *surface = Create3DSurface(width, height);
+  surface->InitializeForOffScreenRendering(output_handle, resource_manager);
+  draw_state.destroy_surface_ = true;
+  draw_state.surface_ = surface;
+  CalculateClearRegion(surface, draw_state.states_);
+
   if (acquire_fence > 0) {
     draw_state.acquire_fences_.emplace_back(acquire_fence);
   }
@@ -229,27 +299,44 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
 
 void Compositor::FreeResources() {
   thread_->FreeResources();
+  std::vector<DrawState>().swap(draw_states_);
+  std::vector<DrawState>().swap(media_states_);
 }
 
 void Compositor::CalculateRenderState(
     std::vector<OverlayLayer> &layers,
-    const std::vector<CompositionRegion> &comp_regions, DrawState &draw_state,
-    uint32_t downscaling_factor, bool uses_display_up_scaling,
-    bool use_plane_transform) {
+    const std::vector<CompositionRegion> &comp_regions,
+    std::vector<RenderState> &states, uint32_t downscaling_factor,
+    bool uses_display_up_scaling, bool use_plane_transform) {
   CTRACE();
   size_t num_regions = comp_regions.size();
+  states.reserve(num_regions);
+  // States are drawn in reverse order of comp_regions. Fill them in order
+  // and reverse at the end, inserting at the front is quadratic. Existing
+  // states are overwritten to keep the storage of their layer states.
+  size_t num_states = 0;
   for (size_t region_index = 0; region_index < num_regions; region_index++) {
     const CompositionRegion &region = comp_regions.at(region_index);
-    RenderState state;
+    if (num_states == states.size())
+      states.emplace_back();
+    RenderState &state = states[num_states];
+    state.layer_state_.clear();
     state.ConstructState(layers, region, downscaling_factor,
                          uses_display_up_scaling, use_plane_transform);
-    if (state.layer_state_.empty()) {
-      continue;
-    }
+    if (!state.layer_state_.empty())
+      num_states++;
+  }
+
+  states.resize(num_states);
+  std::reverse(states.begin(), states.end());
+}
 
-    draw_state.states_.emplace(draw_state.states_.begin(), state);
-    const std::vector<size_t> &source = region.source_layers;
-    for (size_t texture_index : source) {
+void Compositor::CollectAcquireFences(
+    std::vector<OverlayLayer> &layers,
+    const std::vector<CompositionRegion> &comp_regions,
+    DrawState &draw_state) {
+  for (const CompositionRegion &region : comp_regions) {
+    for (size_t texture_index : region.source_layers) {
       OverlayLayer &layer = layers.at(texture_index);
       int32_t fence = layer.ReleaseAcquireFence();
       if (fence > 0) {
@@ -259,6 +346,70 @@ void Compositor::CalculateRenderState(
   }
 }
 
+static void HashValue(uint64_t &hash, uint32_t value) {
+  // FNV-1a
+  for (uint32_t i = 0; i < 4; i++) {
+    hash ^= (value >> (i * 8)) & 0xff;
+    hash *= 1099511628211ULL;
+  }
+}
+
+static void HashRect(uint64_t &hash, const HwcRect<int> &rect) {
+  for (int i = 0; i < 4; i++)
+    HashValue(hash, static_cast<uint32_t>(rect.bounds[i]));
+}
+
+static void HashRect(uint64_t &hash, const HwcRect<float> &rect) {
+  for (int i = 0; i < 4; i++) {
+    uint32_t bits;
+    memcpy(&bits, &rect.bounds[i], sizeof(bits));
+    HashValue(hash, bits);
+  }
+}
+
+uint64_t Compositor::GeometryHash(
+    const std::vector<OverlayLayer> &layers,
+    const std::vector<HwcRect<int>> &display_frame,
+    const ArenaVector<size_t> &dedicated_layers,
+    const DisplayPlaneState &plane, const HwcRegion &damage_region,
+    bool use_plane_transform) {
+  uint64_t hash = 14695981039346656037ULL;
+  HashValue(hash, plane.GetDownScalingFactor());
+  HashValue(hash, plane.IsUsingPlaneScalar());
+  HashValue(hash, use_plane_transform);
+  HashValue(hash, damage_region.size());
+  for (const HwcRect<int> &rect : damage_region)
+    HashRect(hash, rect);
+
+  HashValue(hash, dedicated_layers.size());
+  for (size_t layer_index : dedicated_layers) {
+    HashValue(hash, layer_index);
+    HashRect(hash, display_frame[layer_index]);
+  }
+
+  const std::vector<size_t> &source_layers = plane.GetSourceLayers();
+  HashValue(hash, source_layers.size());
+  for (size_t layer_index : source_layers) {
+    const OverlayLayer &layer = layers.at(layer_index);
+    HashValue(hash, layer_index);
+    HashRect(hash, display_frame[layer_index]);
+    HashRect(hash, layer.GetDisplayFrame());
+    HashRect(hash, layer.GetSourceCrop());
+    HashValue(hash, layer.GetTransform());
+    HashValue(hash, layer.GetPlaneTransform());
+    HashValue(hash, layer.GetAlpha());
+    HashValue(hash, static_cast<uint32_t>(layer.GetBlending()));
+    // Depends on the buffer format and solid color too.
+    HashValue(hash, layer.IsOpaque());
+    // Crop bounds are normalized to the buffer size.
+    OverlayBuffer *buffer = layer.GetBuffer();
+    HashValue(hash, buffer ? buffer->GetWidth() : 0);
+    HashValue(hash, buffer ? buffer->GetHeight() : 0);
+  }
+
+  return hash;
+}
+
 void Compositor::SetVideoScalingMode(uint32_t mode) {
   lock_.lock();
   scaling_mode_ = mode;
@@ -298,74 +449,114 @@ void Compositor::RestoreVideoDefaultDeinterlace() {
   lock_.unlock();
 }
 
-// Below code is taken from drm_hwcomposer adopted to our needs.
-static std::vector<size_t> SetBitsToVector(
-    uint64_t in, const std::vector<size_t> &index_map) {
-  std::vector<size_t> out;
-  size_t msb = sizeof(in) * 8 - 1;
-  uint64_t mask = (uint64_t)1 << msb;
-  for (size_t i = msb; mask != (uint64_t)0; i--, mask >>= 1)
-    if (in & mask)
-      out.emplace_back(index_map[i]);
-  return out;
+static uint64_t RegionArea(const HwcRegion &region) {
+  uint64_t area = 0;
+  for (const HwcRect<int> &rect : region)
+    area += (uint64_t)(rect.right - rect.left) * (rect.bottom - rect.top);
+
+  return area;
 }
 
-void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
-                                const std::vector<size_t> &source_layers,
-                                const std::vector<HwcRect<int>> &display_frame,
-                                const HwcRect<int> &damage_region,
-                                std::vector<CompositionRegion> &comp_regions) {
-  CTRACE();
-  if (source_layers.size() > 64) {
-    ETRACE("Failed to separate layers because there are more than 64");
+void Compositor::CalculateClearRegion(
+    NativeSurface *surface, const std::vector<RenderState> &render_states) {
+  if (!surface->ClearSurface() && !surface->IsPartialClear())
     return;
+
+  // Same area the renderer used to clear. Surfaces which aren't on screen
+  // yet are cleared entirely.
+  HwcRegion clear_region;
+  const HwcRect<int> &damage = surface->GetSurfaceDamage();
+  int width = surface->GetWidth();
+  int height = surface->GetHeight();
+  if (surface->IsOnScreen() && ((damage.right - damage.left != width) ||
+                                (damage.bottom - damage.top != height))) {
+    clear_region = surface->GetSurfaceDamageRegion();
+  } else {
+    clear_region.emplace_back(0, 0, width, height);
   }
 
-  size_t num_exclude_rects = 0;
+  uint64_t clear_pixels = RegionArea(clear_region);
+
+  // Renderers don't blend with the contents of the surface, every pixel of
+  // a render state is overwritten whether its layers are opaque or not.
+  for (const RenderState &state : render_states) {
+    SubtractRectFromRegion(
+        HwcRect<int>(state.scissor_x_, state.scissor_y_,
+                     state.scissor_x_ + state.scissor_width_,
+                     state.scissor_y_ + state.scissor_height_),
+        clear_region);
+    if (clear_region.empty())
+      break;
+  }
+
+  if (clear_region.empty())
+    clears_avoided_++;
+
+  // Composition targets use 32 bit formats.
+  clear_bytes_saved_ += (clear_pixels - RegionArea(clear_region)) * 4;
+  surface->SetClearRegion(clear_region);
+}
+
+// Below code is taken from drm_hwcomposer adopted to our needs.
+void Compositor::SeparateLayers(const std::vector<OverlayLayer> &layers,
+                                const ArenaVector<size_t> &dedicated_layers,
+                                const std::vector<size_t> &all_source_layers,
+                                const std::vector<HwcRect<int>> &display_frame,
+                                const HwcRect<int> &damage_region,
+                                std::vector<CompositionRegion> &comp_regions,
+                                size_t *num_regions) {
+  CTRACE();
   // Index at which the actual layers begin
   size_t layer_offset = dedicated_layers.size();
-  if (source_layers.size() + layer_offset > 64) {
-    WTRACE(
-        "Exclusion rectangles are being truncated to make the rectangle count "
-        "fit into 64");
-    num_exclude_rects = 64 - source_layers.size() - dedicated_layers.size();
+
+  // Layers hidden entirely by an opaque layer above them would only split
+  // regions, leave them out.
+  ArenaVector<size_t> source_layers((ArenaAllocator<size_t>(frame_arena_)));
+  size_t total_layers = all_source_layers.size();
+  source_layers.reserve(total_layers);
+  for (size_t i = 0; i < total_layers; i++) {
+    const HwcRect<int> &frame = display_frame[all_source_layers[i]];
+    bool hidden = false;
+    for (size_t j = i + 1; j < total_layers && !hidden; j++) {
+      size_t above = all_source_layers[j];
+      hidden = layers.at(above).IsOpaque() &&
+               IsEnclosedBy(frame, display_frame[above]);
+    }
+
+    if (!hidden)
+      source_layers.emplace_back(all_source_layers[i]);
   }
 
-  // We inject all the exclude rects into the rects list. Any resulting rect
-  // that includes ANY of the first num_exclude_rects is rejected. After the
-  // exclude rects, we add the lower layers. The rects that intersect with
-  // these layers will be inspected and only those which are to be composited
-  // above the layer will be included in the composition regions.
-  std::vector<HwcRect<int>> layer_rects(source_layers.size() + layer_offset);
-  std::transform(
-      dedicated_layers.begin(), dedicated_layers.end(),
-      layer_rects.begin() + num_exclude_rects,
-      [=](size_t layer_index) { return display_frame[layer_index]; });
-  std::transform(source_layers.begin(), source_layers.end(),
-                 layer_rects.begin() + layer_offset, [=](size_t layer_index) {
-                   return display_frame[layer_index];
-                 });
-
-  std::vector<RectSet<int>> separate_regions;
-  get_draw_regions(layer_rects, damage_region, &separate_regions);
-  uint64_t exclude_mask = ((uint64_t)1 << num_exclude_rects) - 1;
-  uint64_t dedicated_mask = (((uint64_t)1 << dedicated_layers.size()) - 1)
-                            << num_exclude_rects;
+  // We first add the dedicated layers and then the source layers. The rects
+  // that intersect with the dedicated layers will be inspected and only
+  // those which are to be composited above the layer will be included in
+  // the composition regions.
+  ArenaVector<HwcRect<int>> layer_rects(
+      (ArenaAllocator<HwcRect<int>>(frame_arena_)));
+  layer_rects.reserve(source_layers.size() + layer_offset);
+  for (size_t layer_index : dedicated_layers) {
+    layer_rects.emplace_back(display_frame[layer_index]);
+  }
 
-  for (RectSet<int> &region : separate_regions) {
-    if (region.id_set.getBits() & exclude_mask)
-      continue;
+  for (size_t layer_index : source_layers) {
+    layer_rects.emplace_back(display_frame[layer_index]);
+  }
+
+  ArenaVector<RectSet<int>> separate_regions(
+      (ArenaAllocator<RectSet<int>>(frame_arena_)));
+  get_draw_regions(layer_rects.data(), layer_rects.size(), damage_region,
+                   &separate_regions);
 
+  std::vector<RectIDs::TId> &ids = region_ids_;
+  for (RectSet<int> &region : separate_regions) {
     // If a rect intersects one of the dedicated layers, we need to remove the
     // layers from the composition region which appear *below* the dedicated
     // layer. This effectively punches a hole through the composition layer such
     // that the dedicated layer can be placed below the composition and not
     // be occluded.
-    uint64_t dedicated_intersect = region.id_set.getBits() & dedicated_mask;
-    for (size_t i = 0; dedicated_intersect && i < dedicated_layers.size();
-         ++i) {
+    for (size_t i = 0; i < dedicated_layers.size(); ++i) {
       // Only exclude layers if they intersect this particular dedicated layer
-      if (!(dedicated_intersect & (1 << (i + num_exclude_rects))))
+      if (!region.id_set.has(i))
         continue;
 
       for (size_t j = 0; j < source_layers.size(); ++j) {
@@ -374,12 +565,29 @@ void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
       }
     }
 
-    if (!(region.id_set.getBits() >> layer_offset))
+    ids.clear();
+    region.id_set.getIds(&ids);
+    if (*num_regions == comp_regions.size())
+      comp_regions.emplace_back();
+    CompositionRegion &comp_region = comp_regions[*num_regions];
+    std::vector<size_t> &region_layers = comp_region.source_layers;
+    region_layers.clear();
+    // Top most layer comes first.
+    for (auto it = ids.rbegin(); it != ids.rend() && *it >= layer_offset;
+         ++it) {
+      size_t layer_index = source_layers[*it - layer_offset];
+      region_layers.emplace_back(layer_index);
+      // Every layer of the region covers it, nothing below an opaque one
+      // is visible.
+      if (layers.at(layer_index).IsOpaque())
+        break;
+    }
+
+    if (region_layers.empty())
       continue;
 
-    comp_regions.emplace_back(CompositionRegion{
-        region.rect, SetBitsToVector(region.id_set.getBits() >> layer_offset,
-                                     source_layers)});
+    comp_region.frame = region.rect;
+    (*num_regions)++;
   }
 }
 
@@ -24,6 +24,7 @@
 
 #include "compositionregion.h"
 #include "compositorthread.h"
+#include "disjoint_layers.h"
 #include "displayplanestate.h"
 #include "factory.h"
 #include "renderstate.h"
@@ -42,10 +43,51 @@ class Compositor {
   ~Compositor();
 
   void Init(ResourceManager *buffer_manager, uint32_t gpu_fd);
+
+  // Arena used for temporaries of Draw. It's expected to be reset by the
+  // caller once per frame.
+  void SetFrameArena(FrameArena *arena) {
+    frame_arena_ = arena;
+  }
   void Reset();
   void BeginFrame(bool disable_explicit_sync);
+  // When async is true, Draw may return before the GPU work has been
+  // submitted. WaitForPendingDraw needs to be called before touching the
+  // surfaces of planes again. deadline is passed on to
+  // CompositorThread::Draw.
   bool Draw(DisplayPlaneStateList &planes, std::vector<OverlayLayer> &layers,
-            const std::vector<HwcRect<int>> &display_frame);
+            const std::vector<HwcRect<int>> &display_frame,
+            bool async = false, int64_t deadline = -1);
+  bool WaitForPendingDraw();
+
+  // See CompositorThread::TakeDeferredDrawFence.
+  int32_t TakeDeferredDrawFence();
+
+  // See CompositorThread::ShouldMigrate.
+  bool ShouldMigrate();
+  void Migrate();
+
+  // Area of all composition regions drawn by the last call to Draw.
+  uint64_t GetDrawnPixels() const {
+    return drawn_pixels_;
+  }
+
+  // Layer pixels read by the last Draw, each drawn pixel counts once for
+  // every layer sampled for it.
+  uint64_t GetSampledPixels() const {
+    return sampled_pixels_;
+  }
+
+  // Surface clears the last Draw skipped since the surface was rendered
+  // to entirely, and the bytes not cleared by skipped or reduced clears.
+  uint32_t GetClearsAvoided() const {
+    return clears_avoided_;
+  }
+
+  uint64_t GetClearBytesSaved() const {
+    return clear_bytes_saved_;
+  }
+
   bool DrawOffscreen(std::vector<OverlayLayer> &layers,
                      const std::vector<HwcRect<int>> &display_frame,
                      const std::vector<size_t> &source_layers,
@@ -66,17 +108,46 @@ class Compositor {
  private:
   void CalculateRenderState(std::vector<OverlayLayer> &layers,
                             const std::vector<CompositionRegion> &comp_regions,
-                            DrawState &state, uint32_t downscaling_factor,
+                            std::vector<RenderState> &states,
+                            uint32_t downscaling_factor,
                             bool uses_display_up_scaling,
                             bool use_plane_transform = false);
-  void SeparateLayers(const std::vector<size_t> &dedicated_layers,
+  void CollectAcquireFences(std::vector<OverlayLayer> &layers,
+                            const std::vector<CompositionRegion> &comp_regions,
+                            DrawState &draw_state);
+  // Hash of everything the composition regions and render states of plane
+  // depend on, except for the contents of the layers.
+  uint64_t GeometryHash(const std::vector<OverlayLayer> &layers,
+                        const std::vector<HwcRect<int>> &display_frame,
+                        const ArenaVector<size_t> &dedicated_layers,
+                        const DisplayPlaneState &plane,
+                        const HwcRegion &damage_region,
+                        bool use_plane_transform);
+  // Sets the clear region of surface to the part of the area to be cleared
+  // which isn't rendered to by render_states.
+  void CalculateClearRegion(NativeSurface *surface,
+                            const std::vector<RenderState> &render_states);
+  // Layers below an opaque layer are left out of the regions it covers.
+  // Regions are stored from index *num_regions of comp_regions on, reusing
+  // existing entries, and *num_regions is advanced past them.
+  void SeparateLayers(const std::vector<OverlayLayer> &layers,
+                      const ArenaVector<size_t> &dedicated_layers,
                       const std::vector<size_t> &source_layers,
                       const std::vector<HwcRect<int>> &display_frame,
                       const HwcRect<int> &damage_region,
-                      std::vector<CompositionRegion> &comp_regions);
+                      std::vector<CompositionRegion> &comp_regions,
+                      size_t *num_regions);
 
   std::unique_ptr<CompositorThread> thread_;
   SpinLock lock_;
+  FrameArena *frame_arena_ = NULL;
+  std::vector<DrawState> draw_states_;
+  std::vector<DrawState> media_states_;
+  std::vector<RectIDs::TId> region_ids_;
+  uint64_t drawn_pixels_ = 0;
+  uint64_t sampled_pixels_ = 0;
+  uint32_t clears_avoided_ = 0;
+  uint64_t clear_bytes_saved_ = 0;
   HWCColorMap colors_;
   uint32_t scaling_mode_ = 0;
   HWCDeinterlaceProp deinterlace_;
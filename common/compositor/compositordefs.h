@@ -23,6 +23,8 @@
 #include "shim.h"
 #elif USE_VK
 #include "vkshim.h"
+#elif USE_SW
+#include <stddef.h>
 #endif
 
 #include <platformdefines.h>
@@ -75,6 +77,26 @@ typedef struct vk_import {
 } ResourceHandle;
 
 typedef VkDevice GpuDisplay;
+#elif USE_SW
+// A linear buffer mapped into our address space. planes_ point into the
+// mappings of sw_import, fds_ are the dma-bufs they belong to.
+typedef struct sw_image {
+  uint8_t* planes_[3] = {};
+  uint32_t pitches_[3] = {};
+  int fds_[3] = {-1, -1, -1};
+  uint32_t format_ = 0;
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  bool writable_ = false;
+} GpuResourceHandle;
+typedef struct sw_import {
+  struct sw_image image_;
+  void* maps_[4] = {};
+  size_t map_sizes_[4] = {};
+  HWCNativeHandle handle_ = 0;
+  uint32_t drm_fd_ = 0;
+} ResourceHandle;
+typedef void* GpuDisplay;
 #else
 typedef unsigned GpuResourceHandle;
 typedef void* ResourceHandle;
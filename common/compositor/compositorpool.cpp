@@ -0,0 +1,239 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "compositorpool.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+static const int64_t kOneSecondNs = 1000 * 1000 * 1000;
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * kOneSecondNs + ts.tv_nsec;
+}
+
+CompositorWorker::CompositorWorker(uint32_t gpu_fd)
+    : HWCThread(-8, "CompositorWorker") {
+  resources_.gpu_fd_ = gpu_fd;
+}
+
+CompositorWorker::~CompositorWorker() {
+  HWCThread::Exit();
+}
+
+bool CompositorWorker::Start() {
+  return InitWorker();
+}
+
+void CompositorWorker::AddClient(CompositorThread *client) {
+  ScopedSpinLock lock(lock_);
+  clients_.emplace_back(client);
+  if (reserved_clients_ > 0)
+    reserved_clients_--;
+}
+
+void CompositorWorker::ReserveClient() {
+  ScopedSpinLock lock(lock_);
+  reserved_clients_++;
+}
+
+void CompositorWorker::RemoveClient(CompositorThread *client) {
+  ScopedSpinLock lock(lock_);
+  clients_.erase(std::remove(clients_.begin(), clients_.end(), client),
+                 clients_.end());
+  jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(),
+                             [client](const Job &job) {
+                               return job.client_ == client;
+                             }),
+              jobs_.end());
+  std::make_heap(jobs_.begin(), jobs_.end(), RunsLater);
+}
+
+bool CompositorWorker::RunsLater(const Job &lhs, const Job &rhs) {
+  if (lhs.deadline_ != rhs.deadline_)
+    return lhs.deadline_ > rhs.deadline_;
+
+  return lhs.sequence_ > rhs.sequence_;
+}
+
+size_t CompositorWorker::Queue(CompositorThread *client, int64_t deadline) {
+  if (deadline < 0)
+    deadline = GetTimeNs();
+
+  lock_.lock();
+  bool queued = false;
+  for (Job &job : jobs_) {
+    if (job.client_ == client) {
+      // All pending tasks of client run together, by the earlier of the
+      // two deadlines.
+      job.deadline_ = std::min(job.deadline_, deadline);
+      deadline = job.deadline_;
+      std::make_heap(jobs_.begin(), jobs_.end(), RunsLater);
+      queued = true;
+      break;
+    }
+  }
+
+  if (!queued) {
+    jobs_.emplace_back(Job{deadline, sequence_++, client});
+    std::push_heap(jobs_.begin(), jobs_.end(), RunsLater);
+  }
+
+  size_t ahead = 0;
+  for (const Job &job : jobs_) {
+    if (job.client_ != client && job.deadline_ <= deadline)
+      ahead++;
+  }
+
+  if (running_ && running_ != client)
+    ahead++;
+  lock_.unlock();
+
+  Resume();
+  return ahead;
+}
+
+size_t CompositorWorker::GetQueueDepth() const {
+  ScopedSpinLock lock(lock_);
+  return jobs_.size() + (running_ ? 1 : 0);
+}
+
+size_t CompositorWorker::GetClientCount() const {
+  ScopedSpinLock lock(lock_);
+  return clients_.size() + reserved_clients_;
+}
+
+void CompositorWorker::HandleRoutine() {
+  while (true) {
+    lock_.lock();
+    if (jobs_.empty()) {
+      running_ = NULL;
+      lock_.unlock();
+      break;
+    }
+
+    std::pop_heap(jobs_.begin(), jobs_.end(), RunsLater);
+    running_ = jobs_.back().client_;
+    jobs_.pop_back();
+    lock_.unlock();
+
+    running_->RunTasks();
+  }
+
+  // Render fences of all clients are polled by our thread.
+  lock_.lock();
+  for (CompositorThread *client : clients_)
+    client->SignalCompletedRenderFences();
+  lock_.unlock();
+}
+
+void CompositorWorker::HandleExit() {
+  resources_.Reset();
+}
+
+CompositorPool::CompositorPool(uint32_t max_workers)
+    : max_workers_(std::max(max_workers, 1u)) {
+}
+
+CompositorPool::~CompositorPool() {
+}
+
+CompositorWorker *CompositorPool::StartWorker(uint32_t gpu_fd) {
+  if (workers_.size() >= max_workers_)
+    return NULL;
+
+  std::unique_ptr<CompositorWorker> spawned(new CompositorWorker(gpu_fd));
+  if (!spawned->Start()) {
+    ETRACE("Failed to start CompositorWorker. %s", PRINTERROR());
+    return NULL;
+  }
+
+  workers_.emplace_back(std::move(spawned));
+  return workers_.back().get();
+}
+
+CompositorWorker *CompositorPool::Attach(CompositorThread *client,
+                                         uint32_t gpu_fd) {
+  ScopedSpinLock lock(lock_);
+  CompositorWorker *worker = NULL;
+  size_t least_depth = 0;
+  size_t least_clients = 0;
+  for (std::unique_ptr<CompositorWorker> &candidate : workers_) {
+    size_t depth = candidate->GetQueueDepth();
+    size_t clients = candidate->GetClientCount();
+    if (!worker || depth < least_depth ||
+        (depth == least_depth && clients < least_clients)) {
+      worker = candidate.get();
+      least_depth = depth;
+      least_clients = clients;
+    }
+  }
+
+  if (!worker || least_depth > 0) {
+    CompositorWorker *spawned = StartWorker(gpu_fd);
+    if (spawned)
+      worker = spawned;
+  }
+
+  if (worker)
+    worker->AddClient(client);
+
+  return worker;
+}
+
+CompositorWorker *CompositorPool::FindIdleWorker(CompositorWorker *current,
+                                                 uint32_t gpu_fd) {
+  ScopedSpinLock lock(lock_);
+  // Clients we would stop getting in the way of. Moving to a worker with
+  // as many only makes us trade places with them.
+  size_t others = current->GetClientCount();
+  if (others <= 1)
+    return NULL;
+
+  others--;
+  CompositorWorker *worker = NULL;
+  size_t least_clients = 0;
+  for (std::unique_ptr<CompositorWorker> &candidate : workers_) {
+    if (candidate.get() == current || candidate->GetQueueDepth() > 0)
+      continue;
+
+    size_t clients = candidate->GetClientCount();
+    if (clients >= others)
+      continue;
+
+    if (!worker || clients < least_clients) {
+      worker = candidate.get();
+      least_clients = clients;
+    }
+  }
+
+  if (!worker)
+    worker = StartWorker(gpu_fd);
+
+  if (worker)
+    worker->ReserveClient();
+
+  return worker;
+}
+
+}  // namespace hwcomposer
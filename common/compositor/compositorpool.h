@@ -0,0 +1,130 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_COMPOSITORPOOL_H_
+#define COMMON_COMPOSITOR_COMPOSITORPOOL_H_
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "compositorthread.h"
+#include "hwcthread.h"
+
+namespace hwcomposer {
+
+// Thread and context running the draws of several CompositorThreads.
+// Renderers, and with them compiled programs and imported buffers, are
+// shared by all of them. Queued draws are run earliest deadline first.
+class CompositorWorker : public HWCThread {
+ public:
+  explicit CompositorWorker(uint32_t gpu_fd);
+  ~CompositorWorker() override;
+
+  bool Start();
+
+  void AddClient(CompositorThread* client);
+
+  // Called on the worker's thread, once client has released everything
+  // it had in our context.
+  void RemoveClient(CompositorThread* client);
+
+  // Runs the pending tasks of client. deadline is in CLOCK_MONOTONIC ns,
+  // -1 to run them after the tasks already queued by then. Returns the
+  // number of jobs of other clients which run before them, counting the
+  // one running right now.
+  size_t Queue(CompositorThread* client, int64_t deadline);
+
+  // Only to be used on the worker's thread.
+  RenderResources* GetResources() {
+    return &resources_;
+  }
+
+  FDHandler* GetFenceHandler() {
+    return &fd_handler_;
+  }
+
+  // Jobs queued or running.
+  size_t GetQueueDepth() const;
+
+  // Clients, including the ones the pool picked us for which are yet to
+  // call AddClient.
+  size_t GetClientCount() const;
+
+  void ReserveClient();
+
+ protected:
+  void HandleRoutine() override;
+  void HandleExit() override;
+
+ private:
+  struct Job {
+    int64_t deadline_;
+    // Orders jobs with the same deadline by queueing time.
+    uint64_t sequence_;
+    CompositorThread* client_;
+  };
+
+  static bool RunsLater(const Job& lhs, const Job& rhs);
+
+  RenderResources resources_;
+  mutable SpinLock lock_;
+  // Protected by lock_. Kept as a heap, earliest deadline at the front.
+  std::vector<Job> jobs_;
+  std::vector<CompositorThread*> clients_;
+  CompositorThread* running_ = NULL;
+  size_t reserved_clients_ = 0;
+  uint64_t sequence_ = 0;
+};
+
+// Bounded set of CompositorWorkers shared by the compositors of all
+// displays. Workers are only started once displays keep waiting for
+// each other's draws, so that threads and contexts grow with the
+// composition workload rather than with the number of displays.
+class CompositorPool {
+ public:
+  explicit CompositorPool(uint32_t max_workers);
+  ~CompositorPool();
+
+  CompositorPool(const CompositorPool&) = delete;
+  CompositorPool& operator=(const CompositorPool&) = delete;
+
+  // Returns the worker client is to run on, NULL if none could be
+  // started. Prefers workers with nothing queued, a new one is only
+  // started if there are none.
+  CompositorWorker* Attach(CompositorThread* client, uint32_t gpu_fd);
+
+  // Returns a worker other than current with nothing queued and fewer
+  // clients than current has besides the caller, starting one if needed
+  // and possible. NULL if moving wouldn't take the caller out of the way
+  // of other clients. The worker counts the caller as its client till it
+  // calls AddClient.
+  CompositorWorker* FindIdleWorker(CompositorWorker* current,
+                                   uint32_t gpu_fd);
+
+ private:
+  // Called with lock_ held.
+  CompositorWorker* StartWorker(uint32_t gpu_fd);
+
+  SpinLock lock_;
+  uint32_t max_workers_;
+  std::vector<std::unique_ptr<CompositorWorker>> workers_;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_COMPOSITORPOOL_H_
@@ -17,6 +17,7 @@
 #include "compositorthread.h"
 
 #include <nativebufferhandler.h>
+#include "compositorpool.h"
 #include "displayplanemanager.h"
 #include "framebuffermanager.h"
 #include "gpudevice.h"
@@ -30,6 +31,52 @@
 
 namespace hwcomposer {
 
+// Draws queued behind those of other displays for this many frames in a
+// row make us look for a worker of our own.
+static const uint32_t kContendedFrames = 8;
+
+RenderResources::RenderResources() {
+}
+
+RenderResources::~RenderResources() {
+}
+
+Renderer *RenderResources::Get3DRenderer() {
+  if (!gl_renderer_) {
+    gl_renderer_.reset(Create3DRenderer());
+    if (!gl_renderer_->Init()) {
+      ETRACE("Failed to initialize OpenGL compositor %s", PRINTERROR());
+      gl_renderer_.reset(nullptr);
+    }
+  }
+
+  return gl_renderer_.get();
+}
+
+Renderer *RenderResources::GetMediaRenderer() {
+  if (!media_renderer_) {
+    media_renderer_.reset(CreateMediaRenderer());
+    if (!media_renderer_->Init(gpu_fd_)) {
+      ETRACE("Failed to initialize Media Renderer %s", PRINTERROR());
+      media_renderer_.reset(nullptr);
+    }
+  }
+
+  return media_renderer_.get();
+}
+
+NativeGpuResource *RenderResources::GetGpuResourceHandler() {
+  if (!gpu_resource_handler_)
+    gpu_resource_handler_.reset(CreateNativeGpuResourceHandler());
+
+  return gpu_resource_handler_.get();
+}
+
+void RenderResources::Reset() {
+  gl_renderer_.reset(nullptr);
+  gpu_resource_handler_.reset(nullptr);
+}
+
 CompositorThread::CompositorThread() : HWCThread(-8, "CompositorThread") {
   if (!cevent_.Initialize())
     return;
@@ -38,21 +85,65 @@ CompositorThread::CompositorThread() : HWCThread(-8, "CompositorThread") {
 }
 
 CompositorThread::~CompositorThread() {
+  // Workers of the pool outlive us, don't leave them with a dangling
+  // client.
+  if (worker_)
+    ExitThread();
+
+  if (deferred_draw_fence_ >= 0)
+    close(deferred_draw_fence_);
 }
 
 void CompositorThread::Initialize(ResourceManager *resource_manager,
                                   uint32_t gpu_fd) {
   fb_manager_ = GpuDevice::getInstance().GetFrameBufferManager();
   tasks_lock_.lock();
-  if (!gpu_resource_handler_)
-    gpu_resource_handler_.reset(CreateNativeGpuResourceHandler());
-
   resource_manager_ = resource_manager;
-  gpu_fd_ = gpu_fd;
+  own_resources_.gpu_fd_ = gpu_fd;
   tasks_lock_.unlock();
-  if (!InitWorker()) {
-    ETRACE("Failed to initalize CompositorThread. %s", PRINTERROR());
+#if defined(ENABLE_PIPELINED_COMMIT) && defined(USE_GL)
+  timeline_.Initialize();
+#endif
+}
+
+bool CompositorThread::EnsureStarted() {
+  // FreeResources may be called from other threads than Draw.
+  ScopedSpinLock lock(tasks_lock_);
+  if (started_)
+    return true;
+
+  // Settings of GpuDevice are only known once it's initialized, which
+  // happens after displays initialize their compositors.
+  CompositorPool *pool = GpuDevice::getInstance().GetCompositorPool();
+  if (pool) {
+    worker_ = pool->Attach(this, own_resources_.gpu_fd_);
+    if (!worker_) {
+      ETRACE("Failed to find a compositor worker.");
+      return false;
+    }
+
+    resources_ = worker_->GetResources();
+    fence_handler_ = worker_->GetFenceHandler();
+  } else {
+    if (!InitWorker()) {
+      ETRACE("Failed to initalize CompositorThread. %s", PRINTERROR());
+      return false;
+    }
+
+    resources_ = &own_resources_;
+    fence_handler_ = &fd_handler_;
   }
+
+  started_ = true;
+  return true;
+}
+
+size_t CompositorThread::Schedule(int64_t deadline) {
+  if (worker_)
+    return worker_->Queue(this, deadline);
+
+  Resume();
+  return 0;
 }
 
 void CompositorThread::SetDisableExplicitSync(bool disable_explicit_sync) {
@@ -60,10 +151,13 @@ void CompositorThread::SetDisableExplicitSync(bool disable_explicit_sync) {
 }
 
 void CompositorThread::FreeResources() {
+  if (!EnsureStarted())
+    return;
+
   tasks_lock_.lock();
   tasks_ |= kReleaseResources;
   tasks_lock_.unlock();
-  Resume();
+  Schedule(-1);
 }
 
 void CompositorThread::Wait() {
@@ -81,12 +175,53 @@ void CompositorThread::Wait() {
 
 bool CompositorThread::Draw(std::vector<DrawState> &states,
                             std::vector<DrawState> &media_states,
-                            const std::vector<OverlayBuffer *> &buffers) {
+                            const ArenaVector<OverlayBuffer *> &buffers,
+                            bool async, int64_t deadline) {
+  if (!EnsureStarted())
+    return false;
+
+  // states_ of the previous frame are swapped back to the caller below, make
+  // sure we are done with them.
+  if (!WaitForPendingDraw()) {
+    ETRACE("Previous queued draw failed.");
+    async = false;
+  }
+
+  if (!media_states.empty() || disable_explicit_sync_ || !timeline_.IsValid())
+    async = false;
+
+  if (deferred_draw_fence_ >= 0) {
+    close(deferred_draw_fence_);
+    deferred_draw_fence_ = -1;
+  }
+
+  if (async) {
+    int32_t last_fence = -1;
+    for (DrawState &state : states) {
+      if (state.destroy_surface_)
+        continue;
+
+      int32_t fence = timeline_.CreateFence("hwc composition");
+      if (fence < 0) {
+        async = false;
+        break;
+      }
+
+      state.surface_->DeferNativeFence(fence);
+      state.deferred_fence_ = true;
+      last_fence = fence;
+    }
+
+    // Fences of the timeline signal in order.
+    if (async && last_fence >= 0)
+      deferred_draw_fence_ = dup(last_fence);
+  }
+
   states_.swap(states);
   tasks_lock_.lock();
 
   if (!states_.empty()) {
-    buffers_ = buffers;
+    buffers_.assign(buffers.begin(), buffers.end());
     tasks_ |= kRender3D;
   }
 
@@ -106,27 +241,127 @@ bool CompositorThread::Draw(std::vector<DrawState> &states,
     return draw_succeeded_;
   }
 
-  Resume();
+  if (Schedule(deadline) > 0) {
+    contended_frames_++;
+  } else {
+    contended_frames_ = 0;
+  }
+
+  if (async) {
+    pending_draw_ = true;
+    return true;
+  }
+
   Wait();
   return draw_succeeded_;
 }
 
+bool CompositorThread::WaitForPendingDraw() {
+  if (!pending_draw_)
+    return true;
+
+  pending_draw_ = false;
+  Wait();
+  return draw_succeeded_;
+}
+
+int32_t CompositorThread::TakeDeferredDrawFence() {
+  int32_t fence = deferred_draw_fence_;
+  deferred_draw_fence_ = -1;
+  return fence;
+}
+
+bool CompositorThread::ShouldMigrate() {
+  if (!worker_ || contended_frames_ < kContendedFrames)
+    return false;
+
+  contended_frames_ = 0;
+  CompositorPool *pool = GpuDevice::getInstance().GetCompositorPool();
+  next_worker_ = pool->FindIdleWorker(worker_, own_resources_.gpu_fd_);
+  return next_worker_ != NULL;
+}
+
+void CompositorThread::Migrate() {
+  if (!next_worker_)
+    return;
+
+  WaitForPendingDraw();
+  // The old worker releases what was imported into its context and
+  // forgets about us before signalling.
+  tasks_lock_.lock();
+  tasks_ |= kMigrate;
+  tasks_lock_.unlock();
+  worker_->Queue(this, -1);
+  Wait();
+
+  tasks_lock_.lock();
+  worker_ = next_worker_;
+  next_worker_ = NULL;
+  resources_ = worker_->GetResources();
+  fence_handler_ = worker_->GetFenceHandler();
+  tasks_lock_.unlock();
+  worker_->AddClient(this);
+  // Picks up the fences of draws still in flight.
+  worker_->Queue(this, -1);
+}
+
 void CompositorThread::ExitThread() {
-  HWCThread::Exit();
+  WaitForPendingDraw();
+  if (worker_) {
+    // The worker releases our resources in its context and forgets about
+    // us before signalling.
+    tasks_lock_.lock();
+    tasks_ |= kDetach;
+    tasks_lock_.unlock();
+    worker_->Queue(this, -1);
+    Wait();
+    worker_ = NULL;
+  } else {
+    HWCThread::Exit();
+  }
+
+  started_ = false;
+  resources_ = NULL;
+  fence_handler_ = NULL;
   std::vector<DrawState>().swap(states_);
   std::vector<OverlayBuffer *>().swap(buffers_);
 }
 
+void CompositorThread::ReleaseRenderFences() {
+  // Don't leave anyone waiting on fences of draws which are still in flight.
+  while (!render_fences_.empty()) {
+    int32_t fence = render_fences_.front();
+    if (fence > 0) {
+      if (fences_watched_)
+        fence_handler_->RemoveFd(fence);
+
+      close(fence);
+    }
+
+    render_fences_.pop_front();
+  }
+
+  fences_watched_ = true;
+
+  timeline_.SignalAll();
+}
+
 void CompositorThread::HandleExit() {
+  ReleaseRenderFences();
   HandleReleaseRequest();
-  gl_renderer_.reset(nullptr);
-  gpu_resource_handler_.reset(nullptr);
+  own_resources_.Reset();
 }
 
 void CompositorThread::HandleRoutine() {
+  RunTasks();
+  SignalCompletedRenderFences();
+}
+
+void CompositorThread::RunTasks() {
   bool signal = false;
   if (tasks_ & kRender3D) {
     Handle3DDrawRequest();
+    QueueRenderFences();
     signal = true;
   }
 
@@ -139,11 +374,95 @@ void CompositorThread::HandleRoutine() {
     HandleReleaseRequest();
   }
 
+  if (tasks_ & kDetach) {
+    tasks_lock_.lock();
+    tasks_ &= ~kDetach;
+    tasks_lock_.unlock();
+    ReleaseRenderFences();
+    HandleReleaseRequest();
+    worker_->RemoveClient(this);
+    // We may be gone as soon as this is signalled.
+    cevent_.Signal();
+    return;
+  }
+
+  if (tasks_ & kMigrate) {
+    tasks_lock_.lock();
+    tasks_ &= ~kMigrate;
+    tasks_lock_.unlock();
+    // Fences of draws in flight are polled by the next worker.
+    if (fences_watched_) {
+      for (int32_t fence : render_fences_) {
+        if (fence > 0)
+          fence_handler_->RemoveFd(fence);
+      }
+
+      fences_watched_ = false;
+    }
+
+    HandleReleaseRequest();
+    worker_->RemoveClient(this);
+    cevent_.Signal();
+    return;
+  }
+
   if (signal) {
     cevent_.Signal();
   }
 }
 
+void CompositorThread::WatchRenderFences() {
+  if (fences_watched_)
+    return;
+
+  for (int32_t &fence : render_fences_) {
+    if (fence > 0 && !fence_handler_->AddFd(fence)) {
+      close(fence);
+      fence = -1;
+    }
+  }
+
+  fences_watched_ = true;
+}
+
+void CompositorThread::QueueRenderFences() {
+  WatchRenderFences();
+  for (DrawState &draw_state : states_) {
+    if (!draw_state.deferred_fence_)
+      continue;
+
+    // We will not have a fence in case this draw failed or was skipped, in
+    // which case the kms fence is signalled right away.
+    int32_t fence = draw_state.surface_->ReleaseRenderFence();
+    if (fence > 0 && !fence_handler_->AddFd(fence)) {
+      close(fence);
+      fence = -1;
+    }
+
+    render_fences_.emplace_back(fence);
+  }
+}
+
+void CompositorThread::SignalCompletedRenderFences() {
+  // Fences of one context signal in order, it's enough to look at the
+  // oldest one. Fences added after the last poll are picked up when
+  // HandleWait wakes us up next.
+  WatchRenderFences();
+  while (!render_fences_.empty()) {
+    int32_t fence = render_fences_.front();
+    if (fence > 0) {
+      if (fence_handler_->IsReady(fence) == 0)
+        break;
+
+      fence_handler_->RemoveFd(fence);
+      close(fence);
+    }
+
+    render_fences_.pop_front();
+    timeline_.Signal();
+  }
+}
+
 void CompositorThread::HandleReleaseRequest() {
   ScopedSpinLock lock(tasks_lock_);
   tasks_ &= ~kReleaseResources;
@@ -156,9 +475,10 @@ void CompositorThread::HandleReleaseRequest() {
   size_t purged_size = purged_gl_resources.size();
 
   if (purged_size != 0) {
-    if (has_gpu_resource) {
-      Ensure3DRenderer();
-      gpu_resource_handler_->ReleaseGPUResources(purged_gl_resources);
+    // GPU resources need a current context.
+    if (has_gpu_resource && resources_->Get3DRenderer()) {
+      resources_->GetGpuResourceHandler()->ReleaseGPUResources(
+          purged_gl_resources);
     }
 
     const NativeBufferHandler *handler =
@@ -181,8 +501,9 @@ void CompositorThread::HandleReleaseRequest() {
   purged_size = purged_media_resources.size();
 
   if (purged_size != 0) {
-    EnsureMediaRenderer();
-    media_renderer_->DestroyMediaResources(purged_media_resources);
+    Renderer *media_renderer = resources_->GetMediaRenderer();
+    if (media_renderer)
+      media_renderer->DestroyMediaResources(purged_media_resources);
 
     const NativeBufferHandler *handler =
         resource_manager_->GetNativeBufferHandler();
@@ -206,15 +527,17 @@ void CompositorThread::Handle3DDrawRequest() {
   tasks_ &= ~kRender3D;
   tasks_lock_.unlock();
 
-  Ensure3DRenderer();
-  if (!gl_renderer_) {
+  Renderer *gl_renderer = resources_->Get3DRenderer();
+  if (!gl_renderer) {
     draw_succeeded_ = false;
     return;
   }
 
-  gl_renderer_->SetDisableExplicitSync(disable_explicit_sync_);
+  gl_renderer->SetDisableExplicitSync(disable_explicit_sync_);
 
-  if (!gpu_resource_handler_->PrepareResources(buffers_)) {
+  NativeGpuResource *gpu_resource_handler =
+      resources_->GetGpuResourceHandler();
+  if (!gpu_resource_handler->PrepareResources(buffers_)) {
     ETRACE(
         "Failed to prepare GPU resources for compositing the frame, "
         "error: %s",
@@ -232,18 +555,18 @@ void CompositorThread::Handle3DDrawRequest() {
 
       for (RenderState::LayerState &temp : layer_state) {
         temp.handle_ =
-            gpu_resource_handler_->GetResourceHandle(temp.layer_index_);
+            gpu_resource_handler->GetResourceHandle(temp.layer_index_);
       }
     }
 
     const std::vector<int32_t> &fences = draw_state.acquire_fences_;
     for (int32_t fence : fences) {
-      gl_renderer_->InsertFence(fence);
+      gl_renderer->InsertFence(fence);
     }
 
-    std::vector<int32_t>().swap(draw_state.acquire_fences_);
+    draw_state.acquire_fences_.clear();
 
-    if (!gl_renderer_->Draw(draw_state.states_, draw_state.surface_)) {
+    if (!gl_renderer->Draw(draw_state.states_, draw_state.surface_)) {
       ETRACE(
           "Failed to Draw: "
           "error: %s",
@@ -263,7 +586,7 @@ void CompositorThread::Handle3DDrawRequest() {
   }
 
   if (disable_explicit_sync_)
-    gl_renderer_->InsertFence(-1);
+    gl_renderer->InsertFence(-1);
 }
 
 void CompositorThread::HandleMediaDrawRequest() {
@@ -271,8 +594,8 @@ void CompositorThread::HandleMediaDrawRequest() {
   tasks_ &= ~kRenderMedia;
   tasks_lock_.unlock();
 
-  EnsureMediaRenderer();
-  if (!media_renderer_) {
+  Renderer *media_renderer = resources_->GetMediaRenderer();
+  if (!media_renderer) {
     draw_succeeded_ = false;
     return;
   }
@@ -280,7 +603,7 @@ void CompositorThread::HandleMediaDrawRequest() {
   size_t size = media_states_.size();
   for (size_t i = 0; i < size; i++) {
     DrawState &draw_state = media_states_[i];
-    if (!media_renderer_->Draw(draw_state.media_state_, draw_state.surface_)) {
+    if (!media_renderer->Draw(draw_state.media_state_, draw_state.surface_)) {
       ETRACE(
           "Failed to render the frame by VA, "
           "error: %s\n",
@@ -291,24 +614,4 @@ void CompositorThread::HandleMediaDrawRequest() {
   }
 }
 
-void CompositorThread::Ensure3DRenderer() {
-  if (!gl_renderer_) {
-    gl_renderer_.reset(Create3DRenderer());
-    if (!gl_renderer_->Init()) {
-      ETRACE("Failed to initialize OpenGL compositor %s", PRINTERROR());
-      gl_renderer_.reset(nullptr);
-    }
-  }
-}
-
-void CompositorThread::EnsureMediaRenderer() {
-  if (!media_renderer_) {
-    media_renderer_.reset(CreateMediaRenderer());
-    if (!media_renderer_->Init(gpu_fd_)) {
-      ETRACE("Failed to initialize Media Renderer %s", PRINTERROR());
-      media_renderer_.reset(nullptr);
-    }
-  }
-}
-
 }  // namespace hwcomposer
@@ -20,12 +20,15 @@
 #include <platformdefines.h>
 #include <spinlock.h>
 
+#include <deque>
 #include <memory>
 #include <vector>
 
 #include "factory.h"
+#include "framearena.h"
 #include "hwcthread.h"
 #include "renderstate.h"
+#include "synctimeline.h"
 
 #include "fdhandler.h"
 #include "hwcevent.h"
@@ -37,7 +40,29 @@ class DisplayPlaneManager;
 class ResourceManager;
 class NativeBufferHandler;
 class FrameBufferManager;
+class CompositorWorker;
 
+// Renderers of one context and the GPU resources imported into it.
+// Created on first use, on the thread doing the rendering.
+struct RenderResources {
+  RenderResources();
+  ~RenderResources();
+
+  Renderer* Get3DRenderer();
+  Renderer* GetMediaRenderer();
+  NativeGpuResource* GetGpuResourceHandler();
+  void Reset();
+
+  std::unique_ptr<Renderer> gl_renderer_;
+  std::unique_ptr<Renderer> media_renderer_;
+  std::unique_ptr<NativeGpuResource> gpu_resource_handler_;
+  uint32_t gpu_fd_ = 0;
+};
+
+// Runs the draws of one Compositor. By default on a thread and context
+// of its own, or, when GpuDevice has a CompositorPool, on one of the
+// pool's workers. The worker is picked on first use and changed by
+// Migrate once our draws keep waiting behind those of other displays.
 class CompositorThread : public HWCThread {
  public:
   CompositorThread();
@@ -45,45 +70,103 @@ class CompositorThread : public HWCThread {
 
   void Initialize(ResourceManager* resource_manager, uint32_t gpu_fd);
 
+  // In case async is true and sw_sync is available, returns as soon as
+  // the draw has been queued. Offscreen surfaces get a fence as their
+  // acquire fence, which is signalled once the GPU is done rendering to
+  // them. deadline is the CLOCK_MONOTONIC time in ns by which the draw
+  // should be done, -1 if unknown. Workers shared by several displays
+  // run the draw with the earliest deadline first.
   bool Draw(std::vector<DrawState>& states,
             std::vector<DrawState>& media_states,
-            const std::vector<OverlayBuffer*>& buffers);
+            const ArenaVector<OverlayBuffer*>& buffers, bool async = false,
+            int64_t deadline = -1);
+
+  // Blocks till the last asynchronous Draw has been submitted. Returns
+  // false if it failed.
+  bool WaitForPendingDraw();
+
+  // Returns a fence signalled once the GPU is done with the last Draw, in
+  // case it returned before the draw was submitted, -1 otherwise. The
+  // caller owns the fence.
+  int32_t TakeDeferredDrawFence();
 
   void SetDisableExplicitSync(bool disable_explicit_sync);
   void FreeResources();
 
+  // True once our draws have been queued behind those of other clients
+  // of our worker for several frames in a row and the pool found a worker
+  // to move them to. The caller is then to call ReleaseGpuResources on
+  // all buffers and surfaces it had us render with, PreparePurgedResources
+  // on its ResourceManager and Migrate, all between two Draws.
+  bool ShouldMigrate();
+
+  // Releases the purged resources in the context of our worker and moves
+  // us to the one ShouldMigrate picked.
+  void Migrate();
+
   void HandleRoutine() override;
   void HandleExit() override;
   void ExitThread();
 
  private:
+  friend class CompositorWorker;
+
   enum Tasks {
     kNone = 0,           // No tasks
     kRender3D = 1 << 1,  // Render content.
     kRenderMedia = 1 << 2,
-    kReleaseResources = 1 << 3  // Release surfaces from plane manager.
+    kReleaseResources = 1 << 3,  // Release surfaces from plane manager.
+    kDetach = 1 << 4,            // Leave the worker we are running on.
+    kMigrate = 1 << 5  // Leave the worker, keeping draws in flight.
   };
 
+  // Starts our own thread or picks a worker of the pool, if not done yet.
+  bool EnsureStarted();
+  // Wakes up whoever runs our tasks. Returns the number of jobs of other
+  // clients of the worker which run before ours.
+  size_t Schedule(int64_t deadline);
+  // Runs pending tasks. Called on our own thread or the worker's.
+  void RunTasks();
   void Handle3DDrawRequest();
   void HandleMediaDrawRequest();
   void HandleReleaseRequest();
   void Wait();
-  void Ensure3DRenderer();
-  void EnsureMediaRenderer();
+  void QueueRenderFences();
+  // Hands render fences of draws submitted on another worker to
+  // fence_handler_.
+  void WatchRenderFences();
+  void SignalCompletedRenderFences();
+  void ReleaseRenderFences();
 
   SpinLock tasks_lock_;
-  std::unique_ptr<Renderer> gl_renderer_;
-  std::unique_ptr<Renderer> media_renderer_;
-  std::unique_ptr<NativeGpuResource> gpu_resource_handler_;
+  // Points to own_resources_ or the ones of worker_.
+  RenderResources* resources_ = NULL;
+  RenderResources own_resources_;
+  CompositorWorker* worker_ = NULL;
+  // Worker picked by ShouldMigrate.
+  CompositorWorker* next_worker_ = NULL;
+  // Frames in a row our draws were queued behind those of other clients.
+  uint32_t contended_frames_ = 0;
+  // Fences are polled by the thread running our tasks.
+  FDHandler* fence_handler_ = NULL;
+  bool started_ = false;
   std::vector<OverlayBuffer*> buffers_;
   std::vector<DrawState> states_;
   std::vector<DrawState> media_states_;
   std::vector<ResourceHandle> purged_resources_;
   bool disable_explicit_sync_ = false;
   bool draw_succeeded_ = false;
+  // Set when the last Draw returned before being submitted.
+  bool pending_draw_ = false;
+  // Duplicate of the fence of the pending draw which signals last.
+  int32_t deferred_draw_fence_ = -1;
+  // Fences of asynchronous draws, in the order they were submitted.
+  std::deque<int32_t> render_fences_;
+  // False while render_fences_ are yet to be added to fence_handler_.
+  bool fences_watched_ = true;
+  SyncTimeline timeline_;
   ResourceManager* resource_manager_ = NULL;
   uint32_t tasks_ = kNone;
-  uint32_t gpu_fd_ = 0;
   FDHandler fd_chandler_;
   HWCEvent cevent_;
   FrameBufferManager* fb_manager_ = NULL;
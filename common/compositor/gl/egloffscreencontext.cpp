@@ -30,12 +30,14 @@ EGLOffScreenContext::~EGLOffScreenContext() {
       ETRACE("Failed to destroy OpenGL ES Context.");
 }
 
-bool EGLOffScreenContext::Init() {
+bool EGLOffScreenContext::Init(EGLContext share_context, bool low_priority) {
   EGLint num_configs;
   EGLConfig egl_config;
-  static const EGLint context_attribs[] = {
+  const EGLint context_attribs[] = {
       EGL_CONTEXT_CLIENT_VERSION, 3, EGL_CONTEXT_PRIORITY_LEVEL_IMG,
-      EGL_CONTEXT_PRIORITY_HIGH_IMG, EGL_NONE};
+      low_priority ? EGL_CONTEXT_PRIORITY_LOW_IMG
+                   : EGL_CONTEXT_PRIORITY_HIGH_IMG,
+      EGL_NONE};
 
   static const EGLint config_attribs[] = {EGL_SURFACE_TYPE, EGL_DONT_CARE,
                                           EGL_NONE};
@@ -57,7 +59,7 @@ bool EGLOffScreenContext::Init() {
     return false;
   }
 
-  egl_ctx_ = eglCreateContext(egl_display_, egl_config, EGL_NO_CONTEXT,
+  egl_ctx_ = eglCreateContext(egl_display_, egl_config, share_context,
                               context_attribs);
 
   if (egl_ctx_ == EGL_NO_CONTEXT) {
@@ -26,7 +26,10 @@ class EGLOffScreenContext {
   EGLOffScreenContext();
   ~EGLOffScreenContext();
 
-  bool Init();
+  // Objects are shared with share_context, if given. A low priority
+  // context is requested for background work.
+  bool Init(EGLContext share_context = EGL_NO_CONTEXT,
+            bool low_priority = false);
 
   EGLint GetSyncFD();
 
@@ -34,6 +37,10 @@ class EGLOffScreenContext {
     return egl_display_;
   }
 
+  EGLContext GetContext() const {
+    return egl_ctx_;
+  }
+
   bool MakeCurrent();
 
  private:
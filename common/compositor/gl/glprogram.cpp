@@ -19,6 +19,7 @@
 #include <string>
 #include <sstream>
 
+#include "glprogramcache.h"
 #include "hwctrace.h"
 #include "renderstate.h"
 
@@ -83,6 +84,38 @@ static std::string GenerateVertexShader(int layer_count) {
   return vertex_shader_stream.str();
 }
 
+// Instanced variant of the vertex shader. Each instance is one region,
+// with its viewport and the crop of every layer as per-instance
+// attributes. Vertex inputs can't be arrays in GLSL ES 3.00.
+static std::string GenerateInstancedVertexShader(int layer_count) {
+  std::ostringstream vertex_shader_stream;
+  vertex_shader_stream << "#version 300 es\n"
+                       << "#define LAYER_COUNT " << layer_count << "\n"
+                       << "precision mediump int;\n"
+                       << "uniform mat2 uTexMatrix[LAYER_COUNT];\n"
+                       << "in vec2 vPosition;\n"
+                       << "in vec2 vTexCoords;\n"
+                       << "in vec4 vViewport;\n";
+  for (int i = 0; i < layer_count; ++i)
+    vertex_shader_stream << "in vec4 vLayerCrop" << i << ";\n";
+  vertex_shader_stream << "out vec2 fTexCoords[LAYER_COUNT];\n"
+                       << "void main() {\n"
+                       << "  vec2 tempCoords;\n";
+  for (int i = 0; i < layer_count; ++i) {
+    vertex_shader_stream << "  tempCoords = vTexCoords * uTexMatrix[" << i
+                         << "];\n"
+                         << "  fTexCoords[" << i << "] =\n"
+                         << "      vLayerCrop" << i << ".xy + tempCoords * "
+                         << "vLayerCrop" << i << ".zw;\n";
+  }
+  vertex_shader_stream
+      << "  vec2 scaledPosition = vViewport.xy + vPosition * vViewport.zw;\n"
+      << "  gl_Position =\n"
+      << "      vec4(scaledPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
+      << "}\n";
+  return vertex_shader_stream.str();
+}
+
 static std::string GenerateFragmentShader(int layer_count) {
   std::ostringstream fragment_shader_stream;
   fragment_shader_stream << "#version 300 es\n"
@@ -158,11 +191,74 @@ static GLint LoadPreBuiltBinary(GLint gl_program, void *binary, long size) {
 #include "glprebuiltshaderarray.h"
 #endif
 
-static GLint GenerateProgram(unsigned num_textures,
-                             std::ostringstream *shader_log) {
+static GLint LinkProgram(GLint program, unsigned num_textures,
+                         bool instanced, GLProgramCache *cache,
+                         std::ostringstream *shader_log) {
   GLint status;
+  std::string vertex_shader_string =
+      instanced ? GenerateInstancedVertexShader(num_textures)
+                : GenerateVertexShader(num_textures);
+  std::string fragment_shader_string = GenerateFragmentShader(num_textures);
+  if (cache && cache->Load(program, vertex_shader_string,
+                           fragment_shader_string))
+    return program;
+
+  const GLchar *vertex_shader_source = vertex_shader_string.c_str();
+  GLint vertex_shader = CompileAndCheckShader(
+      GL_VERTEX_SHADER, 1, &vertex_shader_source, shader_log);
+  if (!vertex_shader)
+    return 0;
+
+  const GLchar *fragment_shader_source = fragment_shader_string.c_str();
+  GLint fragment_shader = CompileAndCheckShader(
+      GL_FRAGMENT_SHADER, 1, &fragment_shader_source, shader_log);
+  if (!fragment_shader) {
+    glDeleteShader(vertex_shader);
+    return 0;
+  }
+
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glBindAttribLocation(program, 0, "vPosition");
+  glBindAttribLocation(program, 1, "vTexCoords");
+  if (instanced) {
+    glBindAttribLocation(program, 2, "vViewport");
+    for (unsigned i = 0; i < num_textures; i++) {
+      std::ostringstream crop_name_formatter;
+      crop_name_formatter << "vLayerCrop" << i;
+      glBindAttribLocation(program, 3 + i, crop_name_formatter.str().c_str());
+    }
+  }
+  glLinkProgram(program);
+  glDetachShader(program, vertex_shader);
+  glDetachShader(program, fragment_shader);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+  if (!status) {
+    if (shader_log) {
+      GLint log_length;
+      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+      std::string program_log(log_length, ' ');
+      glGetProgramInfoLog(program, log_length, NULL, &program_log.front());
+      *shader_log << "Failed to link program:\n" << program_log.c_str() << "\n";
+    }
+    return 0;
+  }
+
+  if (cache)
+    cache->Store(program, vertex_shader_string, fragment_shader_string);
+
+  return program;
+}
+
+static GLint GenerateProgram(unsigned num_textures, GLProgramCache *cache,
+                             std::ostringstream *shader_log) {
   GLint program = glCreateProgram();
 #if defined(LOAD_PREBUILT_SHADER_FILE) || defined(USE_PREBUILT_SHADER_BIN_ARRAY)
+  GLint status;
   void *binary_prog;
   long binary_sz;
 #endif
@@ -252,46 +348,7 @@ fail_file_open:
                 << "now trying run-time build\n";
 #endif
 
-  std::string vertex_shader_string = GenerateVertexShader(num_textures);
-  const GLchar *vertex_shader_source = vertex_shader_string.c_str();
-  GLint vertex_shader = CompileAndCheckShader(
-      GL_VERTEX_SHADER, 1, &vertex_shader_source, shader_log);
-  if (!vertex_shader)
-    return 0;
-
-  std::string fragment_shader_string = GenerateFragmentShader(num_textures);
-  const GLchar *fragment_shader_source = fragment_shader_string.c_str();
-  GLint fragment_shader = CompileAndCheckShader(
-      GL_FRAGMENT_SHADER, 1, &fragment_shader_source, shader_log);
-  if (!fragment_shader) {
-    glDeleteShader(vertex_shader);
-    return 0;
-  }
-
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glBindAttribLocation(program, 0, "vPosition");
-  glBindAttribLocation(program, 1, "vTexCoords");
-  glLinkProgram(program);
-  glDetachShader(program, vertex_shader);
-  glDetachShader(program, fragment_shader);
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
-
-  glGetProgramiv(program, GL_LINK_STATUS, &status);
-
-  if (!status) {
-    if (shader_log) {
-      GLint log_length;
-      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
-      std::string program_log(log_length, ' ');
-      glGetProgramInfoLog(program, log_length, NULL, &program_log.front());
-      *shader_log << "Failed to link program:\n" << program_log.c_str() << "\n";
-    }
-    return 0;
-  }
-
-  return program;
+  return LinkProgram(program, num_textures, false, cache, shader_log);
 }
 
 GLProgram::GLProgram()
@@ -309,9 +366,21 @@ GLProgram::~GLProgram() {
     glDeleteProgram(program_);
 }
 
-bool GLProgram::Init(unsigned texture_count) {
+bool GLProgram::Init(unsigned texture_count, bool instanced,
+                     GLProgramCache *cache) {
   std::ostringstream shader_log;
-  program_ = GenerateProgram(texture_count, &shader_log);
+  if (instanced) {
+    // Prebuilt binaries only exist for the non-instanced variants.
+    program_ = glCreateProgram();
+    if (program_ &&
+        !LinkProgram(program_, texture_count, true, cache, &shader_log)) {
+      glDeleteProgram(program_);
+      program_ = 0;
+    }
+  } else {
+    program_ = GenerateProgram(texture_count, cache, &shader_log);
+  }
+
   if (!program_) {
     ETRACE("%s", shader_log.str().c_str());
     return false;
@@ -320,27 +389,55 @@ bool GLProgram::Init(unsigned texture_count) {
   return true;
 }
 
-void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
-                           GLuint viewport_height) {
-  glUseProgram(program_);
+void GLProgram::InitializeLocations(unsigned texture_count) {
+  viewport_loc_ = glGetUniformLocation(program_, "uViewport");
+  crop_loc_ = glGetUniformLocation(program_, "uLayerCrop");
+  alpha_loc_ = glGetUniformLocation(program_, "uLayerAlpha");
+  premult_loc_ = glGetUniformLocation(program_, "uLayerPremult");
+  tex_matrix_loc_ = glGetUniformLocation(program_, "uTexMatrix");
+  solid_color_loc_ = glGetUniformLocation(program_, "uLayerColor");
+  for (unsigned src_index = 0; src_index < texture_count; src_index++) {
+    std::ostringstream texture_name_formatter;
+    texture_name_formatter << "uLayerTexture" << src_index;
+    GLuint tex_loc =
+        glGetUniformLocation(program_, texture_name_formatter.str().c_str());
+    glUniform1i(tex_loc, src_index);
+  }
+
+  initialized_ = true;
+}
+
+void GLProgram::SetLayerUniforms(
+    const RenderState &state, std::vector<GpuResourceHandle> &bound_textures) {
   unsigned size = state.layer_state_.size();
-  if (!initialized_) {
-    viewport_loc_ = glGetUniformLocation(program_, "uViewport");
-    crop_loc_ = glGetUniformLocation(program_, "uLayerCrop");
-    alpha_loc_ = glGetUniformLocation(program_, "uLayerAlpha");
-    premult_loc_ = glGetUniformLocation(program_, "uLayerPremult");
-    tex_matrix_loc_ = glGetUniformLocation(program_, "uTexMatrix");
-    solid_color_loc_ = glGetUniformLocation(program_, "uLayerColor");
-    for (unsigned src_index = 0; src_index < size; src_index++) {
-      std::ostringstream texture_name_formatter;
-      texture_name_formatter << "uLayerTexture" << src_index;
-      GLuint tex_loc =
-          glGetUniformLocation(program_, texture_name_formatter.str().c_str());
-      glUniform1i(tex_loc, src_index);
-    }
+  if (bound_textures.size() < size)
+    bound_textures.resize(size, 0);
 
-    initialized_ = true;
+  for (unsigned src_index = 0; src_index < size; src_index++) {
+    const RenderState::LayerState &src = state.layer_state_[src_index];
+    glUniform1f(alpha_loc_ + src_index, src.alpha_);
+    glUniform1f(premult_loc_ + src_index, src.premult_);
+    glUniformMatrix2fv(tex_matrix_loc_ + src_index, 1, GL_FALSE,
+                       src.texture_matrix_);
+    if (bound_textures[src_index] != src.handle_) {
+      glActiveTexture(GL_TEXTURE0 + src_index);
+      glBindTexture(GL_TEXTURE_EXTERNAL_OES, src.handle_);
+      bound_textures[src_index] = src.handle_;
+    }
+    glUniform4f(solid_color_loc_ + src_index, (float)src.solid_color_array_[3],
+                (float)src.solid_color_array_[2],
+                (float)src.solid_color_array_[1],
+                (float)src.solid_color_array_[0]);
   }
+}
+
+void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
+                           GLuint viewport_height,
+                           std::vector<GpuResourceHandle> &bound_textures) {
+  glUseProgram(program_);
+  unsigned size = state.layer_state_.size();
+  if (!initialized_)
+    InitializeLocations(size);
 
   glUniform4f(viewport_loc_, state.x_ / (float)viewport_width,
               state.y_ / (float)viewport_height,
@@ -349,20 +446,21 @@ void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
 
   for (unsigned src_index = 0; src_index < size; src_index++) {
     const RenderState::LayerState &src = state.layer_state_[src_index];
-    glUniform1f(alpha_loc_ + src_index, src.alpha_);
-    glUniform1f(premult_loc_ + src_index, src.premult_);
     glUniform4f(crop_loc_ + src_index, src.crop_bounds_[0], src.crop_bounds_[1],
                 src.crop_bounds_[2] - src.crop_bounds_[0],
                 src.crop_bounds_[3] - src.crop_bounds_[1]);
-    glUniformMatrix2fv(tex_matrix_loc_ + src_index, 1, GL_FALSE,
-                       src.texture_matrix_);
-    glActiveTexture(GL_TEXTURE0 + src_index);
-    glBindTexture(GL_TEXTURE_EXTERNAL_OES, src.handle_);
-    glUniform4f(solid_color_loc_ + src_index, (float)src.solid_color_array_[3],
-                (float)src.solid_color_array_[2],
-                (float)src.solid_color_array_[1],
-                (float)src.solid_color_array_[0]);
   }
+
+  SetLayerUniforms(state, bound_textures);
+}
+
+void GLProgram::UseInstancedProgram(
+    const RenderState &state, std::vector<GpuResourceHandle> &bound_textures) {
+  glUseProgram(program_);
+  if (!initialized_)
+    InitializeLocations(state.layer_state_.size());
+
+  SetLayerUniforms(state, bound_textures);
 }
 
 }  // namespace hwcomposer
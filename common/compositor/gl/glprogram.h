@@ -19,10 +19,12 @@
 
 #include <vector>
 
+#include "compositordefs.h"
 #include "shim.h"
 
 namespace hwcomposer {
 
+class GLProgramCache;
 struct RenderState;
 
 class GLProgram {
@@ -33,11 +35,27 @@ class GLProgram {
 
   ~GLProgram();
 
-  bool Init(unsigned texture_count);
+  // Instanced programs take the viewport and layer crops of each region as
+  // per-instance vertex attributes, at locations 2 and 3 onwards. Binaries
+  // are loaded from and stored to cache if it isn't NULL.
+  bool Init(unsigned texture_count, bool instanced = false,
+            GLProgramCache* cache = NULL);
+
+  // bound_textures holds the texture bound to each unit and is updated by
+  // these calls, textures which are already bound aren't bound again.
   void UseProgram(const RenderState& cmd, GLuint viewport_width,
-                  GLuint viewport_height);
+                  GLuint viewport_height,
+                  std::vector<GpuResourceHandle>& bound_textures);
+
+  // Sets the uniforms shared by all regions drawn by one instanced call.
+  void UseInstancedProgram(const RenderState& cmd,
+                           std::vector<GpuResourceHandle>& bound_textures);
 
  private:
+  void InitializeLocations(unsigned texture_count);
+  void SetLayerUniforms(const RenderState& cmd,
+                        std::vector<GpuResourceHandle>& bound_textures);
+
   GLint program_;
   GLint viewport_loc_;
   GLint crop_loc_;
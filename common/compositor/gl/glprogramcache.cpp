@@ -0,0 +1,274 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "glprogramcache.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+// "HWCP"
+static const uint32_t kCacheMagic = 0x50435748;
+// Bump when the file layout changes.
+static const uint32_t kCacheVersion = 1;
+// Binaries are a few hundred KB at most, anything bigger is corrupt.
+static const uint32_t kMaxBinarySize = 16 * 1024 * 1024;
+
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t length;
+  uint64_t driver_hash;
+  uint64_t source_hash;
+  uint64_t binary_hash;
+};
+
+static void HashBytes(uint64_t &hash, const void *data, size_t size) {
+  // FNV-1a
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+static void HashString(uint64_t &hash, const char *str) {
+  if (str)
+    HashBytes(hash, str, strlen(str) + 1);
+}
+
+// Hashes the GNU build id of loaded libraries which look like part of the
+// GL driver, so that a driver update invalidates the cache even if
+// GL_VERSION stays the same.
+static int HashDriverBuildId(struct dl_phdr_info *info, size_t /*size*/,
+                             void *data) {
+  const char *name = info->dlpi_name;
+  if (!name || !*name)
+    return 0;
+
+  const char *base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  if (!strstr(base, "dri") && !strstr(base, "gallium") &&
+      !strstr(base, "mesa") && !strstr(base, "EGL") && !strstr(base, "GLES"))
+    return 0;
+
+  uint64_t &hash = *static_cast<uint64_t *>(data);
+  for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_NOTE)
+      continue;
+
+    const uint8_t *note =
+        reinterpret_cast<const uint8_t *>(info->dlpi_addr + phdr.p_vaddr);
+    const uint8_t *end = note + phdr.p_memsz;
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr) *header = reinterpret_cast<const ElfW(Nhdr) *>(note);
+      const uint8_t *note_name = note + sizeof(ElfW(Nhdr));
+      const uint8_t *desc = note_name + ((header->n_namesz + 3) & ~3);
+      note = desc + ((header->n_descsz + 3) & ~3);
+      if (note > end)
+        break;
+
+      if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+          !memcmp(note_name, "GNU", 4)) {
+        HashString(hash, base);
+        HashBytes(hash, desc, header->n_descsz);
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Creates directory and its parents if needed.
+static bool CreateDirectory(const std::string &directory) {
+  for (size_t pos = 1; pos <= directory.size(); pos++) {
+    if (pos != directory.size() && directory[pos] != '/')
+      continue;
+
+    std::string parent = directory.substr(0, pos);
+    if (mkdir(parent.c_str(), 0755) && errno != EEXIST)
+      return false;
+  }
+
+  return true;
+}
+
+bool GLProgramCache::Init() {
+  const char *directory = getenv("HWC_PROGRAM_CACHE_DIR");
+#ifdef PROGRAM_CACHE_DIR
+  if (!directory)
+    directory = PROGRAM_CACHE_DIR;
+#endif
+  if (!directory || !*directory)
+    return false;
+
+  if (!glGetProgramBinaryOES || !glProgramBinaryOES)
+    return false;
+
+  const char *extensions =
+      reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+  if (!extensions || !strstr(extensions, "GL_OES_get_program_binary"))
+    return false;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+  if (formats <= 0)
+    return false;
+
+  directory_ = directory;
+  if (!CreateDirectory(directory_)) {
+    ETRACE("Failed to create program cache directory %s.", directory);
+    return false;
+  }
+
+  driver_hash_ = 14695981039346656037ULL;
+  HashString(driver_hash_,
+             reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+  HashString(driver_hash_,
+             reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+  dl_iterate_phdr(HashDriverBuildId, &driver_hash_);
+
+  enabled_ = true;
+  return true;
+}
+
+std::string GLProgramCache::GetPath(const std::string &vertex_source,
+                                    const std::string &fragment_source,
+                                    uint64_t *source_hash) const {
+  uint64_t hash = 14695981039346656037ULL;
+  HashString(hash, vertex_source.c_str());
+  HashString(hash, fragment_source.c_str());
+  *source_hash = hash;
+
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%016llx.bin",
+           static_cast<unsigned long long>(driver_hash_),
+           static_cast<unsigned long long>(hash));
+  return directory_ + name;
+}
+
+bool GLProgramCache::Load(GLuint program, const std::string &vertex_source,
+                          const std::string &fragment_source) {
+  if (!enabled_)
+    return false;
+
+  uint64_t source_hash;
+  std::string path = GetPath(vertex_source, fragment_source, &source_hash);
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+
+  CacheHeader header;
+  std::vector<uint8_t> binary;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == kCacheMagic &&
+               header.version == kCacheVersion &&
+               header.driver_hash == driver_hash_ &&
+               header.source_hash == source_hash && header.length > 0 &&
+               header.length <= kMaxBinarySize;
+  if (valid) {
+    binary.resize(header.length);
+    uint64_t binary_hash = 14695981039346656037ULL;
+    valid = fread(binary.data(), 1, header.length, file) == header.length &&
+            fgetc(file) == EOF;
+    if (valid) {
+      HashBytes(binary_hash, binary.data(), binary.size());
+      valid = binary_hash == header.binary_hash;
+    }
+  }
+
+  fclose(file);
+
+  if (valid) {
+    GLint status = 0;
+    glProgramBinaryOES(program, header.format, binary.data(), header.length);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    valid = status;
+    // Clear errors of a rejected binary, the program is built from source
+    // instead.
+    glGetError();
+  }
+
+  // Stale or corrupt, Store replaces it once the program is built.
+  if (!valid)
+    unlink(path.c_str());
+
+  return valid;
+}
+
+void GLProgramCache::Store(GLuint program, const std::string &vertex_source,
+                           const std::string &fragment_source) {
+  if (!enabled_)
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0 || static_cast<uint32_t>(length) > kMaxBinarySize)
+    return;
+
+  std::vector<uint8_t> binary(length);
+  GLsizei written = 0;
+  GLenum format = 0;
+  glGetProgramBinaryOES(program, length, &written, &format, binary.data());
+  if (written <= 0)
+    return;
+
+  CacheHeader header;
+  header.magic = kCacheMagic;
+  header.version = kCacheVersion;
+  header.format = format;
+  header.length = written;
+  header.driver_hash = driver_hash_;
+  header.binary_hash = 14695981039346656037ULL;
+  HashBytes(header.binary_hash, binary.data(), written);
+  std::string path = GetPath(vertex_source, fragment_source,
+                             &header.source_hash);
+
+  // Write to a temporary file and rename it, so that a concurrent Load
+  // never sees a partial entry.
+  std::string temp_path = path + ".XXXXXX";
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0)
+    return;
+
+  FILE *file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    unlink(temp_path.c_str());
+    return;
+  }
+
+  bool written_ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                    fwrite(binary.data(), 1, written, file) ==
+                        static_cast<size_t>(written);
+  if (fclose(file) || !written_ok || rename(temp_path.c_str(), path.c_str()))
+    unlink(temp_path.c_str());
+}
+
+}  // namespace hwcomposer
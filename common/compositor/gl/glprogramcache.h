@@ -0,0 +1,64 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_GL_GLPROGRAMCACHE_H_
+#define COMMON_COMPOSITOR_GL_GLPROGRAMCACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "shim.h"
+
+namespace hwcomposer {
+
+// On-disk cache of linked program binaries, using GL_OES_get_program_binary.
+// Entries are keyed by GL_RENDERER, GL_VERSION, the build ids of the
+// loaded GL driver libraries and the shader sources, and are checked
+// again when loaded. Any failure leaves the caller to compile from source.
+class GLProgramCache {
+ public:
+  GLProgramCache() = default;
+  GLProgramCache(const GLProgramCache& rhs) = delete;
+  GLProgramCache& operator=(const GLProgramCache& rhs) = delete;
+
+  // Needs a current context. The directory is taken from
+  // HWC_PROGRAM_CACHE_DIR, or PROGRAM_CACHE_DIR set at configure time.
+  // Returns false if there is no directory or the driver can't provide
+  // program binaries, in which case Load and Store do nothing.
+  bool Init();
+
+  // Loads the binary of the program built from vertex_source and
+  // fragment_source into program. Returns true if program is linked.
+  bool Load(GLuint program, const std::string& vertex_source,
+            const std::string& fragment_source);
+
+  // Stores the binary of the linked program.
+  void Store(GLuint program, const std::string& vertex_source,
+             const std::string& fragment_source);
+
+ private:
+  std::string GetPath(const std::string& vertex_source,
+                      const std::string& fragment_source,
+                      uint64_t* source_hash) const;
+
+  std::string directory_;
+  uint64_t driver_hash_ = 0;
+  bool enabled_ = false;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_GL_GLPROGRAMCACHE_H_
@@ -0,0 +1,145 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "glprogramwarmer.h"
+
+#include <algorithm>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+GLProgramWarmer::GLProgramWarmer()
+    : HWCThread(10, "GLProgramWarmer"),
+      requested_(-1),
+      done_(false),
+      stop_(false) {
+  for (auto &programs : programs_) {
+    for (std::atomic<GLProgram *> &program : programs)
+      program.store(NULL, std::memory_order_relaxed);
+  }
+
+  for (auto &failed : failed_) {
+    for (std::atomic<bool> &fail : failed)
+      fail.store(false, std::memory_order_relaxed);
+  }
+}
+
+GLProgramWarmer::~GLProgramWarmer() {
+  stop_.store(true);
+  HWCThread::Exit();
+}
+
+bool GLProgramWarmer::Start(const EGLOffScreenContext &share_context,
+                            unsigned first_layers,
+                            unsigned max_instanced_layers,
+                            GLProgramCache *cache) {
+  if (!context_.Init(share_context.GetContext(), true)) {
+    ETRACE("Failed to create shared EGLContext.");
+    return false;
+  }
+
+  if (!published_.Initialize())
+    return false;
+
+  cache_ = cache;
+  first_layers_ = std::max(first_layers, 1u);
+  max_instanced_layers_ = std::min(max_instanced_layers, kMaxLayers);
+  if (!InitWorker())
+    return false;
+
+  Resume();
+  return true;
+}
+
+GLProgram *GLProgramWarmer::GetProgram(unsigned texture_count,
+                                       bool instanced) {
+  if (texture_count < first_layers_ || texture_count > kMaxLayers ||
+      (instanced && texture_count > max_instanced_layers_))
+    return NULL;
+
+  unsigned index = texture_count - 1;
+  GLProgram *program =
+      programs_[instanced][index].load(std::memory_order_acquire);
+  if (program)
+    return program;
+
+  // Move it to the front of the queue, so that we don't wait for the
+  // programs of other texture counts on a low priority thread.
+  requested_.store(instanced * kMaxLayers + index, std::memory_order_relaxed);
+  while (true) {
+    program = programs_[instanced][index].load(std::memory_order_acquire);
+    if (program || failed_[instanced][index].load(std::memory_order_relaxed) ||
+        done_.load(std::memory_order_acquire))
+      return program;
+
+    published_.Wait();
+  }
+}
+
+void GLProgramWarmer::Publish(unsigned texture_count, bool instanced) {
+  unsigned index = texture_count - 1;
+  if (programs_[instanced][index].load(std::memory_order_relaxed) ||
+      failed_[instanced][index].load(std::memory_order_relaxed))
+    return;
+
+  std::unique_ptr<GLProgram> &owned = owned_[instanced][index];
+  owned.reset(new GLProgram());
+  if (!owned->Init(texture_count, instanced, cache_)) {
+    ETRACE("Failed to pre-warm GL program for %u textures.", texture_count);
+    owned.reset();
+    failed_[instanced][index].store(true, std::memory_order_relaxed);
+  } else {
+    // The renderer's context may only use the program once it's complete.
+    glFinish();
+    programs_[instanced][index].store(owned.get(), std::memory_order_release);
+  }
+
+  published_.Signal();
+}
+
+void GLProgramWarmer::PublishRequested() {
+  int requested = requested_.exchange(-1, std::memory_order_relaxed);
+  if (requested >= 0)
+    Publish(requested % kMaxLayers + 1,
+            requested >= static_cast<int>(kMaxLayers));
+}
+
+void GLProgramWarmer::HandleRoutine() {
+  if (done_.load() || !context_.MakeCurrent()) {
+    done_.store(true, std::memory_order_release);
+    published_.Signal();
+    return;
+  }
+
+  // Fewest textures first, they are the most common.
+  for (unsigned count = first_layers_; count <= kMaxLayers && !stop_.load();
+       count++) {
+    PublishRequested();
+    Publish(count, false);
+    if (count <= max_instanced_layers_ && !stop_.load()) {
+      PublishRequested();
+      Publish(count, true);
+    }
+  }
+
+  eglMakeCurrent(context_.GetDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  done_.store(true, std::memory_order_release);
+  published_.Signal();
+}
+
+}  // namespace hwcomposer
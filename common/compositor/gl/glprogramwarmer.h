@@ -0,0 +1,79 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
+#define COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
+
+#include <atomic>
+#include <memory>
+
+#include "egloffscreencontext.h"
+#include "glprogram.h"
+#include "hwcevent.h"
+#include "hwcthread.h"
+
+namespace hwcomposer {
+
+class GLProgramCache;
+
+// Compiles the GL programs of every texture count from first_layers up to
+// kMaxLayers on a low priority thread, in a context sharing objects with
+// the renderer's, so that the first Draw using them doesn't have to.
+class GLProgramWarmer : public HWCThread {
+ public:
+  // Same limit as the prebuilt shader binaries.
+  static const unsigned kMaxLayers = 16;
+
+  GLProgramWarmer();
+  ~GLProgramWarmer() override;
+
+  // Starts compiling. Programs with fewer than first_layers textures are
+  // left to the caller. Instanced programs are compiled for up to
+  // max_instanced_layers textures. cache must outlive this object.
+  bool Start(const EGLOffScreenContext &share_context, unsigned first_layers,
+             unsigned max_instanced_layers, GLProgramCache *cache);
+
+  // Returns the program for texture_count textures. If it isn't compiled
+  // yet, the warming thread compiles it next and this waits only for it
+  // and the one in progress. Returns NULL if the program isn't pre-warmed
+  // or failed to compile.
+  GLProgram *GetProgram(unsigned texture_count, bool instanced);
+
+ protected:
+  void HandleRoutine() override;
+
+ private:
+  void Publish(unsigned texture_count, bool instanced);
+  void PublishRequested();
+
+  EGLOffScreenContext context_;
+  GLProgramCache *cache_ = NULL;
+  unsigned first_layers_ = 1;
+  unsigned max_instanced_layers_ = 0;
+  // Owned programs, only touched by the warming thread till done_ is set.
+  std::unique_ptr<GLProgram> owned_[2][kMaxLayers];
+  std::atomic<GLProgram *> programs_[2][kMaxLayers];
+  std::atomic<bool> failed_[2][kMaxLayers];
+  // Index in programs_ of the one the renderer waits for, -1 if none.
+  std::atomic<int> requested_;
+  // Signaled whenever a program is published or fails, and when done.
+  HWCEvent published_;
+  std::atomic<bool> done_;
+  std::atomic<bool> stop_;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
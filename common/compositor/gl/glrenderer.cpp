@@ -16,6 +16,8 @@
 
 #include "glrenderer.h"
 
+#include <string.h>
+
 #include "glprogram.h"
 #include "hwctrace.h"
 #include "nativesurface.h"
@@ -35,6 +37,12 @@ GLRenderer::~GLRenderer() {
 
   if (vertex_array_)
     glDeleteVertexArraysOES(1, &vertex_array_);
+
+  if (instanced_vertex_array_)
+    glDeleteVertexArraysOES(1, &instanced_vertex_array_);
+
+  if (instance_buffer_)
+    glDeleteBuffers(1, &instance_buffer_);
 }
 
 bool GLRenderer::Init() {
@@ -53,6 +61,7 @@ bool GLRenderer::Init() {
   }
 
   InitializeShims();
+  program_cache_.Init();
 
   // generate the VAO & bind
   GLuint vertex_array;
@@ -64,11 +73,6 @@ bool GLRenderer::Init() {
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
   glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
-  std::unique_ptr<GLProgram> program(new GLProgram());
-  if (program->Init(1)) {
-    programs_.emplace_back(std::move(program));
-  }
-
   glEnableVertexAttribArray(0);
   glEnableVertexAttribArray(1);
 
@@ -80,9 +84,74 @@ bool GLRenderer::Init() {
 
   vertex_array_ = vertex_array;
 
+  InitializeInstancing();
+
+#ifndef DISABLE_PROGRAM_PREWARM
+  for (unsigned count = 1; count <= kPrelinkedLayers; count++) {
+    GetProgram(count);
+    if (count <= max_batched_layers_)
+      GetProgram(count, true);
+  }
+
+  warmer_.reset(new GLProgramWarmer());
+  if (warmer_->Start(context_, kPrelinkedLayers + 1, max_batched_layers_,
+                     &program_cache_))
+    return true;
+
+  ETRACE("Failed to start pre-warming of GL programs.");
+  warmer_.reset();
+#endif
+
+  std::unique_ptr<GLProgram> program(new GLProgram());
+  if (program->Init(1, false, &program_cache_)) {
+    programs_.emplace_back(std::move(program));
+  }
+
   return true;
 }
 
+void GLRenderer::InitializeInstancing() {
+  if (!glVertexAttribDivisorEXT || !glDrawArraysInstancedEXT)
+    return;
+
+  // Instanced regions are drawn as quads covering exactly the region, as
+  // the scissor can't change between instances.
+  // clang-format off
+  const GLfloat quad_verts[] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,
+                                1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  // clang-format on
+  GLint max_attribs = 0;
+  glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attribs);
+  if (max_attribs <= 3)
+    return;
+
+  max_batched_layers_ = max_attribs - 3;
+
+  glGenVertexArraysOES(1, &instanced_vertex_array_);
+  glBindVertexArrayOES(instanced_vertex_array_);
+
+  GLuint vertex_buffer;
+  glGenBuffers(1, &vertex_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad_verts), quad_verts,
+               GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, NULL);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4,
+                        (void *)(sizeof(float) * 2));
+
+  glGenBuffers(1, &instance_buffer_);
+  glEnableVertexAttribArray(2);
+  for (GLint attrib = 2; attrib < max_attribs; attrib++)
+    glVertexAttribDivisorEXT(attrib, 1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArrayOES(vertex_array_);
+
+  batching_ = true;
+}
+
 bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
                       NativeSurface *surface) {
   GLuint frame_width = surface->GetWidth();
@@ -106,21 +175,15 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
 
   glViewport(left, top, frame_width, frame_height);
 
+  glEnable(GL_SCISSOR_TEST);
   if (clear_surface || partial_clear) {
-    const HwcRect<int> &damage = surface->GetSurfaceDamage();
-    GLuint clear_width = damage.right - damage.left;
-    GLuint clear_height = damage.bottom - damage.top;
-    if (surface->IsOnScreen() &&
-        ((frame_width != clear_width) || (frame_height != clear_height))) {
-      glEnable(GL_SCISSOR_TEST);
-      glScissor(damage.left, damage.top, clear_width, clear_height);
-      glClear(GL_COLOR_BUFFER_BIT);
-    } else {
+    // Only the parts of the damage which no region renders to, computed
+    // by Compositor. Empty if the regions cover it all.
+    for (const HwcRect<int> &rect : surface->GetClearRegion()) {
+      glScissor(rect.left, rect.top, rect.right - rect.left,
+                rect.bottom - rect.top);
       glClear(GL_COLOR_BUFFER_BIT);
-      glEnable(GL_SCISSOR_TEST);
     }
-  } else {
-    glEnable(GL_SCISSOR_TEST);
   }
 
 #ifdef COMPOSITOR_TRACING
@@ -135,13 +198,12 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
       damage.left, damage.top, damage.right - damage.left,
       damage.bottom - damage.top);
 #endif
+  batches_.clear();
+  state_batch_.clear();
+  state_batch_.reserve(render_states.size());
+  bound_textures_.clear();
+  glBindVertexArrayOES(vertex_array_);
   for (const RenderState &state : render_states) {
-    unsigned size = state.layer_state_.size();
-    GLProgram *program = GetProgram(size);
-    if (!program)
-      continue;
-
-    program->UseProgram(state, frame_width, frame_height);
 #ifdef COMPOSITOR_TRACING
     ICOMPOSITORTRACE(
         "scissor_x_: %d state.scissor_y_: %d scissor_width_: %d "
@@ -159,19 +221,25 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
       ICOMPOSITORTRACE("ALERT: Rendering Layer outside Damaged Region. \n");
     }
 #endif
-    glScissor(state.scissor_x_, state.scissor_y_, state.scissor_width_,
-              state.scissor_height_);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    for (unsigned src_index = 0; src_index < size; src_index++) {
-      glActiveTexture(GL_TEXTURE0 + src_index);
-      glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
-    }
+    int batch = AddToBatch(state);
+    state_batch_.emplace_back(batch);
+    if (batch < 0)
+      DrawRegion(state, frame_width, frame_height);
   }
 
   glDisable(GL_SCISSOR_TEST);
 
+  if (!batches_.empty())
+    DrawBatches(render_states, frame_width, frame_height);
+
+  for (size_t unit = 0; unit < bound_textures_.size(); unit++) {
+    if (!bound_textures_[unit])
+      continue;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+  }
+
   if (!disable_explicit_sync_)
     surface->SetNativeFence(context_.GetSyncFD());
 
@@ -211,23 +279,149 @@ void GLRenderer::SetDisableExplicitSync(bool disable_explicit_sync) {
   disable_explicit_sync_ = disable_explicit_sync;
 }
 
-GLProgram *GLRenderer::GetProgram(unsigned texture_count) {
-  if (programs_.size() >= texture_count) {
-    GLProgram *program = programs_[texture_count - 1].get();
+void GLRenderer::EnableBatching(bool enable) {
+  batching_ = enable && instanced_vertex_array_;
+}
+
+GLProgram *GLRenderer::GetProgram(unsigned texture_count, bool instanced) {
+  std::vector<std::unique_ptr<GLProgram>> &programs =
+      instanced ? instanced_programs_ : programs_;
+  if (programs.size() >= texture_count) {
+    GLProgram *program = programs[texture_count - 1].get();
     if (program != 0)
       return program;
   }
 
+  if (warmer_) {
+    GLProgram *program = warmer_->GetProgram(texture_count, instanced);
+    if (program)
+      return program;
+  }
+
   std::unique_ptr<GLProgram> program(new GLProgram());
-  if (program->Init(texture_count)) {
-    if (programs_.size() < texture_count)
-      programs_.resize(texture_count);
+  if (program->Init(texture_count, instanced, &program_cache_)) {
+    if (programs.size() < texture_count)
+      programs.resize(texture_count);
 
-    programs_[texture_count - 1] = std::move(program);
-    return programs_[texture_count - 1].get();
+    programs[texture_count - 1] = std::move(program);
+    return programs[texture_count - 1].get();
   }
 
   return 0;
 }
 
+static bool HasSameLayers(const RenderState &lhs, const RenderState &rhs) {
+  size_t size = lhs.layer_state_.size();
+  if (size != rhs.layer_state_.size())
+    return false;
+
+  for (size_t i = 0; i < size; i++) {
+    const RenderState::LayerState &left = lhs.layer_state_[i];
+    const RenderState::LayerState &right = rhs.layer_state_[i];
+    if (left.handle_ != right.handle_ || left.alpha_ != right.alpha_ ||
+        left.premult_ != right.premult_ ||
+        memcmp(left.texture_matrix_, right.texture_matrix_,
+               sizeof(left.texture_matrix_)) ||
+        memcmp(left.solid_color_array_, right.solid_color_array_, 4))
+      return false;
+  }
+
+  return true;
+}
+
+int GLRenderer::AddToBatch(const RenderState &state) {
+  size_t size = state.layer_state_.size();
+  if (!batching_ || !size || size > max_batched_layers_)
+    return -1;
+
+  for (size_t i = 0; i < batches_.size(); i++) {
+    Batch &batch = batches_[i];
+    if (HasSameLayers(*batch.state_, state)) {
+      batch.count_++;
+      return i;
+    }
+  }
+
+  batches_.emplace_back(Batch{&state, 1, 0});
+  return batches_.size() - 1;
+}
+
+void GLRenderer::DrawRegion(const RenderState &state, GLuint frame_width,
+                            GLuint frame_height) {
+  unsigned size = state.layer_state_.size();
+  GLProgram *program = GetProgram(size);
+  if (!program)
+    return;
+
+  program->UseProgram(state, frame_width, frame_height, bound_textures_);
+  glScissor(state.scissor_x_, state.scissor_y_, state.scissor_width_,
+            state.scissor_height_);
+
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void GLRenderer::DrawBatches(const std::vector<RenderState> &render_states,
+                             GLuint frame_width, GLuint frame_height) {
+  // Per instance: viewport followed by the crop of every layer.
+  size_t total = 0;
+  for (Batch &batch : batches_) {
+    batch.offset_ = total;
+    total += batch.count_ * (batch.state_->layer_state_.size() + 1) * 4;
+  }
+
+  instance_data_.resize(total);
+  // Offsets are advanced while filling and restored afterwards.
+  for (size_t i = 0; i < render_states.size(); i++) {
+    if (state_batch_[i] < 0)
+      continue;
+
+    const RenderState &state = render_states[i];
+    float *data = &instance_data_[batches_[state_batch_[i]].offset_];
+    *data++ = state.x_ / (float)frame_width;
+    *data++ = state.y_ / (float)frame_height;
+    *data++ = state.width_ / (float)frame_width;
+    *data++ = state.height_ / (float)frame_height;
+    for (const RenderState::LayerState &src : state.layer_state_) {
+      *data++ = src.crop_bounds_[0];
+      *data++ = src.crop_bounds_[1];
+      *data++ = src.crop_bounds_[2] - src.crop_bounds_[0];
+      *data++ = src.crop_bounds_[3] - src.crop_bounds_[1];
+    }
+
+    batches_[state_batch_[i]].offset_ = data - instance_data_.data();
+  }
+
+  glBindVertexArrayOES(instanced_vertex_array_);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, total * sizeof(float), instance_data_.data(),
+               GL_STREAM_DRAW);
+
+  for (Batch &batch : batches_) {
+    unsigned size = batch.state_->layer_state_.size();
+    GLsizei stride = (size + 1) * 4 * sizeof(float);
+    batch.offset_ -= batch.count_ * (size + 1) * 4;
+    GLProgram *program = GetProgram(size, true);
+    if (!program)
+      continue;
+
+    program->UseInstancedProgram(*batch.state_, bound_textures_);
+    for (unsigned attrib = 0; attrib <= size; attrib++) {
+      glVertexAttribPointer(
+          2 + attrib, 4, GL_FLOAT, GL_FALSE, stride,
+          (void *)((batch.offset_ + attrib * 4) * sizeof(float)));
+    }
+
+    for (unsigned i = enabled_crop_attribs_; i < size; i++)
+      glEnableVertexAttribArray(3 + i);
+    for (unsigned i = size; i < enabled_crop_attribs_; i++)
+      glDisableVertexAttribArray(3 + i);
+    enabled_crop_attribs_ = size;
+
+    glDrawArraysInstancedEXT(GL_TRIANGLE_STRIP, 0, 4, batch.count_);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArrayOES(vertex_array_);
+}
+
 }  // namespace hwcomposer
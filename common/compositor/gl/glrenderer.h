@@ -24,6 +24,8 @@
 
 #include "egloffscreencontext.h"
 #include "glprogram.h"
+#include "glprogramcache.h"
+#include "glprogramwarmer.h"
 
 namespace hwcomposer {
 
@@ -40,14 +42,55 @@ class GLRenderer : public Renderer {
 
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
 
+  // Draws regions with the same layers with one instanced call. Enabled
+  // by default when the context supports instancing.
+  void EnableBatching(bool enable);
+
  private:
-  GLProgram *GetProgram(unsigned texture_count);
+  struct Batch {
+    // First region of the batch, all others share its layers.
+    const RenderState *state_;
+    uint32_t count_;
+    // Offset of the instance data of this batch, in floats.
+    size_t offset_;
+  };
+
+  void InitializeInstancing();
+  // Programs of up to kPrelinkedLayers textures are linked in Init, the
+  // others come from warmer_. Compiles on the spot only without warmer_.
+  GLProgram *GetProgram(unsigned texture_count, bool instanced = false);
+  // Adds state to the batch of regions with the same layers. Returns the
+  // index of the batch or -1 if state can't be batched.
+  int AddToBatch(const RenderState &state);
+  void DrawBatches(const std::vector<RenderState> &render_states,
+                   GLuint frame_width, GLuint frame_height);
+  void DrawRegion(const RenderState &state, GLuint frame_width,
+                  GLuint frame_height);
+
+  // Most frames compose a few layers, their programs are linked before
+  // Init returns.
+  static const unsigned kPrelinkedLayers = 4;
 
   EGLOffScreenContext context_;
 
+  GLProgramCache program_cache_;
+  // Declared after context_ and program_cache_, which it uses.
+  std::unique_ptr<GLProgramWarmer> warmer_;
   std::vector<std::unique_ptr<GLProgram>> programs_;
+  std::vector<std::unique_ptr<GLProgram>> instanced_programs_;
   GLuint vertex_array_ = 0;
+  GLuint instanced_vertex_array_ = 0;
+  GLuint instance_buffer_ = 0;
+  // Layers of instanced programs are limited by vertex attributes.
+  unsigned max_batched_layers_ = 0;
+  unsigned enabled_crop_attribs_ = 0;
+  bool batching_ = false;
   bool disable_explicit_sync_ = false;
+  // Scratch space of Draw, kept to avoid allocations every frame.
+  std::vector<Batch> batches_;
+  std::vector<int> state_batch_;
+  std::vector<float> instance_data_;
+  std::vector<GpuResourceHandle> bound_textures_;
 };
 
 }  // namespace hwcomposer
@@ -81,4 +81,10 @@ bool GLSurface::MakeCurrent() {
   return true;
 }
 
+void GLSurface::ReleaseGpuResources() {
+  // fb_ is the one of our buffer, it's deleted along with it.
+  NativeSurface::ReleaseGpuResources();
+  fb_ = 0;
+}
+
 }  // namespace hwcomposer
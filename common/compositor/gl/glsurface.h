@@ -30,6 +30,7 @@ class GLSurface : public NativeSurface {
   GLSurface(uint32_t width, uint32_t height);
 
   bool MakeCurrent() override;
+  void ReleaseGpuResources() override;
 
  private:
   bool InitializeGPUResources();
@@ -42,6 +42,11 @@ bool InitializeShims() {
   get_proc(glGenVertexArraysOES, PFNGLGENVERTEXARRAYSOESPROC);
   get_proc(glBindVertexArrayOES, PFNGLBINDVERTEXARRAYOESPROC);
   get_proc(glProgramBinaryOES, PFNGLPROGRAMBINARYOESPROC);
+  get_proc(glGetProgramBinaryOES, PFNGLGETPROGRAMBINARYOESPROC);
+  glVertexAttribDivisorEXT = (PFNGLVERTEXATTRIBDIVISOREXTPROC)eglGetProcAddress(
+      "glVertexAttribDivisor");
+  glDrawArraysInstancedEXT = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)eglGetProcAddress(
+      "glDrawArraysInstanced");
 #ifndef USE_ANDROID_SHIM
   get_proc(eglDupNativeFenceFDANDROID, PFNEGLDUPNATIVEFENCEFDANDROIDPROC);
 #endif
@@ -61,6 +66,9 @@ PFNGLDELETEVERTEXARRAYSOESPROC glDeleteVertexArraysOES;
 PFNGLGENVERTEXARRAYSOESPROC glGenVertexArraysOES;
 PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayOES;
 PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
+PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+PFNGLVERTEXATTRIBDIVISOREXTPROC glVertexAttribDivisorEXT;
+PFNGLDRAWARRAYSINSTANCEDEXTPROC glDrawArraysInstancedEXT;
 #ifndef USE_ANDROID_SHIM
 PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 #endif
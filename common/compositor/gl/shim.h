@@ -42,6 +42,10 @@ extern PFNGLDELETEVERTEXARRAYSOESPROC glDeleteVertexArraysOES;
 extern PFNGLGENVERTEXARRAYSOESPROC glGenVertexArraysOES;
 extern PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayOES;
 extern PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
+extern PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+// Core in GLES 3.0, NULL if the context doesn't provide them.
+extern PFNGLVERTEXATTRIBDIVISOREXTPROC glVertexAttribDivisorEXT;
+extern PFNGLDRAWARRAYSINSTANCEDEXTPROC glDrawArraysInstancedEXT;
 #ifndef USE_ANDROID_SHIM
 extern PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 #endif
@@ -36,6 +36,9 @@ NativeSurface::NativeSurface(uint32_t width, uint32_t height)
 }
 
 NativeSurface::~NativeSurface() {
+  if (render_fence_ > 0)
+    close(render_fence_);
+
   if (resource_manager_ && native_handle_) {
     ResourceHandle temp;
     temp.handle_ = native_handle_;
@@ -102,10 +105,37 @@ bool NativeSurface::InitializeForOffScreenRendering(
   return true;
 }
 
+void NativeSurface::ReleaseGpuResources() {
+  OverlayBuffer *buffer = layer_.GetBuffer();
+  if (buffer)
+    buffer->ReleaseGpuResources();
+}
+
 void NativeSurface::SetNativeFence(int32_t fd) {
+  if (defer_native_fence_) {
+    defer_native_fence_ = false;
+    if (render_fence_ > 0)
+      close(render_fence_);
+
+    render_fence_ = fd;
+    return;
+  }
+
   layer_.SetAcquireFence(fd);
 }
 
+void NativeSurface::DeferNativeFence(int32_t kms_fence) {
+  layer_.SetAcquireFence(kms_fence);
+  defer_native_fence_ = true;
+}
+
+int32_t NativeSurface::ReleaseRenderFence() {
+  int32_t fence = render_fence_;
+  render_fence_ = -1;
+  defer_native_fence_ = false;
+  return fence;
+}
+
 void NativeSurface::SetClearSurface(ClearType clear_surface) {
   if (clear_surface_ != clear_surface) {
     clear_surface_ = clear_surface;
@@ -136,8 +166,11 @@ void NativeSurface::SetPlaneTarget(const DisplayPlaneState &plane) {
   HwcRect<int> &current_damage = layer_.GetSurfaceDamage();
   CalculateRect(layer_.GetDisplayFrame(), current_damage);
   CalculateRect(plane.GetDisplayFrame(), current_damage);
-  previous_damage_ = current_damage;
-  previous_nc_damage_ = current_damage;
+  HwcRegion &damage_region = layer_.GetSurfaceDamageRegion();
+  damage_region.clear();
+  AddRectToRegion(current_damage, damage_region);
+  previous_damage_ = damage_region;
+  rendered_frame_ = 0;
   clear_surface_ = kFullClear;
   damage_changed_ = true;
   on_screen_ = false;
@@ -155,57 +188,98 @@ void NativeSurface::ResetSourceCrop(const HwcRect<float> &source_crop) {
   layer_.SetSourceCrop(source_crop);
 }
 
+void NativeSurface::ClipDamage(const HwcRegion &damage,
+                               HwcRegion &region) const {
+  for (HwcRect<int> rect : damage) {
+    if (rect.right > width_) {
+      rect.right = width_;
+    }
+
+    if (rect.bottom > height_) {
+      rect.bottom = height_;
+    }
+
+    AddRectToRegion(rect, region);
+  }
+}
+
 void NativeSurface::UpdateSurfaceDamage(
     const HwcRect<int> &currentsurface_damage, bool force) {
-  HwcRect<int> current_damage = currentsurface_damage;
-  if (current_damage.right > width_) {
-    current_damage.right = width_;
-  }
+  HwcRegion damage_region;
+  AddRectToRegion(currentsurface_damage, damage_region);
+  UpdateSurfaceDamage(damage_region, force);
+}
 
-  if (current_damage.bottom > height_) {
-    current_damage.bottom = height_;
-  }
+void NativeSurface::UpdateSurfaceDamage(
+    const HwcRegion &currentsurface_damage, bool force) {
+  HwcRegion current_damage;
+  ClipDamage(currentsurface_damage, current_damage);
 
   HwcRect<int> &surface_damage = layer_.GetSurfaceDamage();
+  HwcRegion &damage_region = layer_.GetSurfaceDamageRegion();
   if (reset_damage_) {
     reset_damage_ = false;
     surface_damage.reset();
+    damage_region.clear();
   }
 
-  if (surface_damage.empty()) {
-    surface_damage = current_damage;
+  if (damage_region.empty()) {
+    damage_region = current_damage;
     damage_changed_ = true;
 
-    if (!surface_damage.empty()) {
-      CalculateRect(previous_nc_damage_, surface_damage);
-
-      previous_nc_damage_ = current_damage;
-    }
-
-    if (!force && (previous_damage_ == surface_damage))
+    ResetRectToRegion(damage_region, surface_damage);
+    if (!force && (previous_damage_ == damage_region))
       damage_changed_ = false;
 
     return;
   }
 
-  CalculateRect(current_damage, previous_nc_damage_);
+  // Nothing to do if all of current_damage is part of the damage already.
+  bool enclosed = true;
+  for (const HwcRect<int> &rect : current_damage) {
+    enclosed = false;
+    for (const HwcRect<int> &damage : damage_region) {
+      if (IsEnclosedBy(rect, damage)) {
+        enclosed = true;
+        break;
+      }
+    }
+
+    if (!enclosed)
+      break;
+  }
 
-  if (current_damage == surface_damage) {
+  if (enclosed) {
     return;
   }
 
-  CalculateRect(current_damage, surface_damage);
+  CalculateRegion(current_damage, damage_region);
+  ResetRectToRegion(damage_region, surface_damage);
 
   if (!damage_changed_) {
     damage_changed_ = true;
-    if (!force && (previous_damage_ == surface_damage))
+    if (!force && (previous_damage_ == damage_region))
       damage_changed_ = false;
   }
 }
 
+void NativeSurface::AddMissedDamage(const HwcRegion &damage) {
+  HwcRegion &damage_region = layer_.GetSurfaceDamageRegion();
+  if (reset_damage_) {
+    reset_damage_ = false;
+    damage_region.clear();
+  }
+
+  ClipDamage(damage, damage_region);
+
+  ResetRectToRegion(damage_region, layer_.GetSurfaceDamage());
+  if (!(previous_damage_ == damage_region))
+    damage_changed_ = true;
+}
+
 void NativeSurface::ResetDamage() {
   reset_damage_ = true;
-  previous_damage_ = layer_.GetSurfaceDamage();
+  previous_damage_ = layer_.GetSurfaceDamageRegion();
   damage_changed_ = false;
 }
 
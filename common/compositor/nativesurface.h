@@ -53,6 +53,10 @@ class NativeSurface {
     return false;
   }
 
+  // Drops what was imported into the context last rendering to us, see
+  // OverlayBuffer::ReleaseGpuResources.
+  virtual void ReleaseGpuResources();
+
   int GetWidth() const {
     return width_;
   }
@@ -67,6 +71,13 @@ class NativeSurface {
 
   void SetNativeFence(int32_t fd);
 
+  // Sets kms_fence as acquire fence of this surface before rendering has
+  // been submitted. Fence created by the renderer for the next draw is
+  // kept aside instead, till it's taken with ReleaseRenderFence().
+  void DeferNativeFence(int32_t kms_fence);
+
+  int32_t ReleaseRenderFence();
+
   void SetClearSurface(NativeSurface::ClearType clear_surface);
 
   // Set's the no of frames before this
@@ -92,6 +103,17 @@ class NativeSurface {
     return clear_surface_ == kPartialClear;
   }
 
+  // Rects to be cleared before rendering when ClearSurface() or
+  // IsPartialClear() is true, the parts of the clear area which are not
+  // rendered to anyway. Set by Compositor.
+  void SetClearRegion(const HwcRegion& region) {
+    clear_region_ = region;
+  }
+
+  const HwcRegion& GetClearRegion() const {
+    return clear_region_;
+  }
+
   void SetPlaneTarget(const DisplayPlaneState& plane);
 
   // Resets DisplayFrame, SurfaceDamage to display_frame.
@@ -103,17 +125,38 @@ class NativeSurface {
   // Set's Damage rect of this surface.
   void UpdateSurfaceDamage(const HwcRect<int>& currentsurface_damage,
                            bool force);
+  void UpdateSurfaceDamage(const HwcRegion& currentsurface_damage,
+                           bool force);
+
+  // Adds damage of frames which were rendered to other surfaces of the
+  // plane since this one was last rendered.
+  void AddMissedDamage(const HwcRegion& damage);
 
   // Resets damage of this surface to empty.
   void ResetDamage();
 
+  // Frame of the plane's DamageHistory this surface was last rendered
+  // for, 0 if unknown.
+  uint32_t GetRenderedFrame() const {
+    return rendered_frame_;
+  }
+
+  void SetRenderedFrame(uint32_t frame) {
+    rendered_frame_ = frame;
+  }
+
   // Return's damage area of this surface.
   const HwcRect<int>& GetSurfaceDamage() const {
     return layer_.GetSurfaceDamage();
   }
 
+  // Return's damage area of this surface as non-overlapping rects.
+  const HwcRegion& GetSurfaceDamageRegion() const {
+    return layer_.GetSurfaceDamageRegion();
+  }
+
   // Return's damage area of this surface.
-  const HwcRect<int>& GetPreviousSurfaceDamage() const {
+  const HwcRegion& GetPreviousSurfaceDamage() const {
     return previous_damage_;
   }
 
@@ -140,17 +183,22 @@ class NativeSurface {
 
  private:
   void InitializeLayer(HWCNativeHandle native_handle);
+  // Adds damage clipped to the size of this surface to region.
+  void ClipDamage(const HwcRegion& damage, HwcRegion& region) const;
   HWCNativeHandle native_handle_;
   int width_;
   int height_;
   ClearType clear_surface_;
+  HwcRegion clear_region_;
   int surface_age_;
   bool damage_changed_ = true;
   bool reset_damage_ = true;
   uint64_t modifier_ = 0;
   bool on_screen_ = false;
-  HwcRect<int> previous_damage_;
-  HwcRect<int> previous_nc_damage_;
+  bool defer_native_fence_ = false;
+  int32_t render_fence_ = -1;
+  uint32_t rendered_frame_ = 0;
+  HwcRegion previous_damage_;
 };
 
 }  // namespace hwcomposer
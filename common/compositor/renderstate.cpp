@@ -157,7 +157,9 @@ void RenderState::ConstructState(std::vector<OverlayLayer> &layers,
       }
     }
 
-    if (layer.GetBlending() == HWCBlending::kBlendingNone) {
+    // Layers below an opaque one don't contribute to the region, SeparateLayers
+    // normally drops them already.
+    if (layer.IsOpaque()) {
       src.alpha_ = src.premult_ = 1.0f;
       break;
     }
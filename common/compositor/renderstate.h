@@ -74,10 +74,27 @@ struct DrawState {
     }
   }
 
+  // Prepares the state to be filled for another frame. Keeps the storage of
+  // its containers, states_ is expected to be assigned to.
+  void Reset() {
+    for (int32_t fence : acquire_fences_) {
+      close(fence);
+    }
+
+    acquire_fences_.clear();
+    media_state_.layers_.clear();
+    surface_ = NULL;
+    destroy_surface_ = false;
+    deferred_fence_ = false;
+    retire_fence_ = -1;
+  }
+
   std::vector<RenderState> states_;
   MediaState media_state_;
   NativeSurface *surface_;
   bool destroy_surface_ = false;
+  // Set if surface_ has a sw_sync fence signalled by CompositorThread.
+  bool deferred_fence_ = false;
   int32_t retire_fence_ = -1;
   std::vector<int32_t> acquire_fences_;
 };
@@ -0,0 +1,63 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "nativeswresource.h"
+
+#include "hwctrace.h"
+#include "overlaybuffer.h"
+#include "swshim.h"
+
+namespace hwcomposer {
+
+bool NativeSWResource::PrepareResources(
+    const std::vector<OverlayBuffer*>& buffers) {
+  std::vector<struct sw_image>().swap(layer_images_);
+  layer_images_.reserve(buffers.size());
+  for (auto& buffer : buffers) {
+    if (buffer) {
+      const ResourceHandle& import = buffer->GetGpuResource(NULL, true);
+      if (!import.image_.planes_[0]) {
+        ETRACE("Failed to map buffer.");
+        return false;
+      }
+
+      layer_images_.emplace_back(import.image_);
+    } else {
+      layer_images_.emplace_back();
+    }
+  }
+
+  return true;
+}
+
+NativeSWResource::~NativeSWResource() {
+}
+
+void NativeSWResource::ReleaseGPUResources(
+    const std::vector<ResourceHandle>& handles) {
+  for (const ResourceHandle& handle : handles)
+    UnmapSoftwareImage(handle);
+}
+
+GpuResourceHandle NativeSWResource::GetResourceHandle(
+    uint32_t layer_index) const {
+  if (layer_images_.size() <= layer_index)
+    return sw_image();
+
+  return layer_images_.at(layer_index);
+}
+
+}  // namespace hwcomposer
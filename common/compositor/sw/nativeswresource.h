@@ -0,0 +1,43 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_SW_NATIVESWRESOURCE_H_
+#define COMMON_COMPOSITOR_SW_NATIVESWRESOURCE_H_
+
+#include <vector>
+
+#include "nativegpuresource.h"
+
+namespace hwcomposer {
+
+class NativeSWResource : public NativeGpuResource {
+ public:
+  NativeSWResource() = default;
+  ~NativeSWResource() override;
+
+  // Maps buffers not mapped yet. Their mappings are kept until the
+  // buffers are released.
+  bool PrepareResources(const std::vector<OverlayBuffer*>& buffers) override;
+  GpuResourceHandle GetResourceHandle(uint32_t layer_index) const override;
+
+  void ReleaseGPUResources(const std::vector<ResourceHandle>& handles) override;
+
+ private:
+  std::vector<struct sw_image> layer_images_;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_SW_NATIVESWRESOURCE_H_
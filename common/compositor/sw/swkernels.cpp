@@ -0,0 +1,712 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "swkernels.h"
+
+#include <drm_fourcc.h>
+#include <math.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+// SIMD kernels are built for their instruction sets through target
+// attributes and picked at runtime, the rest of the library keeps the
+// baseline. The scalar kernels only match them with SSE floating point
+// math, which 32 bit builds need to ask for with -mfpmath=sse.
+#define SW_KERNELS_X86
+#include <immintrin.h>
+#define SW_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SW_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace hwcomposer {
+
+// Layers below pixels covered more than this don't show, as in the GL
+// shaders.
+static const float kMinCover = 0.5f / 255.0f;
+// Subdivisions of a texel sample positions are rounded to.
+static const float kSubTexels = 256.0f;
+
+// BT.601, limited range.
+static const float kYScale = 1.164383f;
+static const float kVToR = 1.596027f;
+static const float kUToG = 0.391762f;
+static const float kVToG = 0.812968f;
+static const float kUToB = 2.017232f;
+
+// Same as minps and maxps, NaN included.
+static inline float Min(float a, float b) {
+  return a < b ? a : b;
+}
+
+static inline float Max(float a, float b) {
+  return a > b ? a : b;
+}
+
+static inline int32_t Clamp(int32_t value, int32_t limit) {
+  return value < 0 ? 0 : (value > limit ? limit : value);
+}
+
+static inline bool HasRedFirst(uint32_t format) {
+  return format == DRM_FORMAT_ABGR8888 || format == DRM_FORMAT_XBGR8888;
+}
+
+static inline bool IsOpaque(uint32_t format) {
+  return format == DRM_FORMAT_XRGB8888 || format == DRM_FORMAT_XBGR8888;
+}
+
+static inline SWPixels Offset(const SWPixels &pixels, uint32_t offset) {
+  SWPixels result = {pixels.r_ + offset, pixels.g_ + offset,
+                     pixels.b_ + offset, pixels.a_ + offset};
+  return result;
+}
+
+// The two texels on an axis of size texels a sample at coord, in texels
+// minus 0.5, lies between, and its position between them.
+struct SWTexel {
+  int32_t i0_;
+  int32_t i1_;
+  float f_;
+};
+
+static inline SWTexel GetTexel(float coord, int32_t size) {
+  float c = Min(Max(coord, -1.0f), (float)size);
+  float base = floorf(c);
+  int32_t i = (int32_t)base;
+  int32_t q = (int32_t)((c - base) * kSubTexels + 0.5f);
+  if (q == (int32_t)kSubTexels) {
+    i++;
+    q = 0;
+  }
+
+  SWTexel texel;
+  texel.i0_ = Clamp(i, size - 1);
+  texel.i1_ = Clamp(i + 1, size - 1);
+  texel.f_ = q * (1.0f / kSubTexels);
+  return texel;
+}
+
+static inline float Bilinear(float p00, float p01, float p10, float p11,
+                             float fx, float fy) {
+  float top = p00 + (p01 - p00) * fx;
+  float bottom = p10 + (p11 - p10) * fx;
+  return top + (bottom - top) * fy;
+}
+
+static inline float Sample8(const uint8_t *plane, uint32_t pitch,
+                            uint32_t stride, const SWTexel &x,
+                            const SWTexel &y) {
+  const uint8_t *row0 = plane + y.i0_ * pitch;
+  const uint8_t *row1 = plane + y.i1_ * pitch;
+  return Bilinear(row0[x.i0_ * stride], row0[x.i1_ * stride],
+                  row1[x.i0_ * stride], row1[x.i1_ * stride], x.f_, y.f_);
+}
+
+static void FetchRgb(const SWSource &source, const float *vx, float vy,
+                     uint32_t count, const SWPixels &out) {
+  const struct sw_image &image = *source.image_;
+  const float *crop = source.crop_;
+  const float *matrix = source.matrix_;
+  float vy_m1 = vy * matrix[1];
+  float vy_m3 = vy * matrix[3];
+  float width = image.width_;
+  float height = image.height_;
+  bool red_first = HasRedFirst(image.format_);
+  bool opaque = IsOpaque(image.format_);
+  for (uint32_t i = 0; i < count; i++) {
+    float u = (crop[0] + (vx[i] * matrix[0] + vy_m1) * crop[2]) * width - 0.5f;
+    float v =
+        (crop[1] + (vx[i] * matrix[2] + vy_m3) * crop[3]) * height - 0.5f;
+    SWTexel x = GetTexel(u, image.width_);
+    SWTexel y = GetTexel(v, image.height_);
+    const uint32_t *row0 = reinterpret_cast<const uint32_t *>(
+        image.planes_[0] + y.i0_ * image.pitches_[0]);
+    const uint32_t *row1 = reinterpret_cast<const uint32_t *>(
+        image.planes_[0] + y.i1_ * image.pitches_[0]);
+    uint32_t p00 = row0[x.i0_];
+    uint32_t p01 = row0[x.i1_];
+    uint32_t p10 = row1[x.i0_];
+    uint32_t p11 = row1[x.i1_];
+    float c[4];
+    for (uint32_t channel = 0; channel < 4; channel++) {
+      uint32_t shift = channel * 8;
+      c[channel] = Bilinear((p00 >> shift) & 0xff, (p01 >> shift) & 0xff,
+                            (p10 >> shift) & 0xff, (p11 >> shift) & 0xff,
+                            x.f_, y.f_) /
+                   255.0f;
+    }
+
+    out.r_[i] = red_first ? c[0] : c[2];
+    out.g_[i] = c[1];
+    out.b_[i] = red_first ? c[2] : c[0];
+    out.a_[i] = opaque ? 1.0f : c[3];
+  }
+}
+
+// Sampling of chroma follows GL_LINEAR on a texture of half the width,
+// and for NV12 half the height, with sample positions scaled accordingly.
+static void FetchYuv(const SWSource &source, const float *vx, float vy,
+                     uint32_t count, const SWPixels &out) {
+  const struct sw_image &image = *source.image_;
+  const float *crop = source.crop_;
+  const float *matrix = source.matrix_;
+  float vy_m1 = vy * matrix[1];
+  float vy_m3 = vy * matrix[3];
+  float width = image.width_;
+  float height = image.height_;
+  int32_t chroma_width = (image.width_ + 1) / 2;
+  int32_t chroma_height = image.height_;
+  uint32_t luma_stride = 2;
+  const uint8_t *chroma = image.planes_[0] + 1;
+  uint32_t chroma_pitch = image.pitches_[0];
+  uint32_t chroma_stride = 4;
+  uint32_t v_offset = 2;
+  bool subsampled_y = false;
+  if (image.format_ == DRM_FORMAT_NV12) {
+    chroma_height = (image.height_ + 1) / 2;
+    luma_stride = 1;
+    chroma = image.planes_[1];
+    chroma_pitch = image.pitches_[1];
+    chroma_stride = 2;
+    v_offset = 1;
+    subsampled_y = true;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    float u = (crop[0] + (vx[i] * matrix[0] + vy_m1) * crop[2]) * width - 0.5f;
+    float v =
+        (crop[1] + (vx[i] * matrix[2] + vy_m3) * crop[3]) * height - 0.5f;
+    SWTexel x = GetTexel(u, image.width_);
+    SWTexel y = GetTexel(v, image.height_);
+    out.r_[i] =
+        Sample8(image.planes_[0], image.pitches_[0], luma_stride, x, y);
+
+    x = GetTexel((u + 0.5f) * 0.5f - 0.5f, chroma_width);
+    if (subsampled_y)
+      y = GetTexel((v + 0.5f) * 0.5f - 0.5f, chroma_height);
+
+    out.g_[i] = Sample8(chroma, chroma_pitch, chroma_stride, x, y);
+    out.b_[i] = Sample8(chroma + v_offset, chroma_pitch, chroma_stride, x, y);
+    out.a_[i] = 1.0f;
+  }
+}
+
+static void ConvertYuv(const SWPixels &pixels, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    float y = (pixels.r_[i] - 16.0f) * kYScale;
+    float u = pixels.g_[i] - 128.0f;
+    float v = pixels.b_[i] - 128.0f;
+    pixels.r_[i] = Min(Max((y + v * kVToR) / 255.0f, 0.0f), 1.0f);
+    pixels.g_[i] = Min(Max((y - u * kUToG - v * kVToG) / 255.0f, 0.0f), 1.0f);
+    pixels.b_[i] = Min(Max((y + u * kUToB) / 255.0f, 0.0f), 1.0f);
+  }
+}
+
+static bool Blend(const SWPixels &src, const SWBlend &blend,
+                  const SWPixels &acc, uint32_t count) {
+  const float *color = blend.color_;
+  bool visible = false;
+  for (uint32_t i = 0; i < count; i++) {
+    float cover = acc.a_[i];
+    if (cover > kMinCover) {
+      float mult = Max(Min(src.a_[i], color[3]), blend.premult_);
+      acc.r_[i] += ((src.r_[i] + color[0]) * mult * blend.alpha_) * cover;
+      acc.g_[i] += ((src.g_[i] + color[1]) * mult * blend.alpha_) * cover;
+      acc.b_[i] += ((src.b_[i] + color[2]) * mult * blend.alpha_) * cover;
+      acc.a_[i] = cover * (1.0f - src.a_[i] * blend.alpha_);
+    }
+
+    visible |= acc.a_[i] > kMinCover;
+  }
+
+  return visible;
+}
+
+static inline uint32_t ToByte(float value) {
+  return (uint32_t)(Min(Max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void Store(const SWPixels &acc, uint32_t count, bool red_first,
+                  uint32_t *dst) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t r = ToByte(acc.r_[i]);
+    uint32_t g = ToByte(acc.g_[i]);
+    uint32_t b = ToByte(acc.b_[i]);
+    uint32_t a = ToByte(1.0f - acc.a_[i]);
+    if (red_first)
+      dst[i] = r | (g << 8) | (b << 16) | (a << 24);
+    else
+      dst[i] = b | (g << 8) | (r << 16) | (a << 24);
+  }
+}
+
+static const SWKernels kScalarKernels = {"scalar",   FetchRgb, FetchYuv,
+                                         ConvertYuv, Blend,    Store};
+
+#ifdef SW_KERNELS_X86
+SW_TARGET_SSE41 static inline __m128i GetTexelsSse41(__m128 coord,
+                                                      int32_t size,
+                                                      __m128i *i1,
+                                                      __m128 *f) {
+  __m128 c = _mm_min_ps(_mm_max_ps(coord, _mm_set1_ps(-1.0f)),
+                        _mm_set1_ps((float)size));
+  __m128 base = _mm_floor_ps(c);
+  __m128i i = _mm_cvttps_epi32(base);
+  __m128i q = _mm_cvttps_epi32(_mm_add_ps(
+      _mm_mul_ps(_mm_sub_ps(c, base), _mm_set1_ps(kSubTexels)),
+      _mm_set1_ps(0.5f)));
+  __m128i carry = _mm_cmpeq_epi32(q, _mm_set1_epi32((int32_t)kSubTexels));
+  i = _mm_sub_epi32(i, carry);
+  q = _mm_andnot_si128(carry, q);
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i limit = _mm_set1_epi32(size - 1);
+  *i1 = _mm_min_epi32(
+      _mm_max_epi32(_mm_add_epi32(i, _mm_set1_epi32(1)), zero), limit);
+  *f = _mm_mul_ps(_mm_cvtepi32_ps(q), _mm_set1_ps(1.0f / kSubTexels));
+  return _mm_min_epi32(_mm_max_epi32(i, zero), limit);
+}
+
+SW_TARGET_SSE41 static inline __m128i Gather4(const uint8_t *base,
+                                              __m128i offsets) {
+  return _mm_setr_epi32(
+      *reinterpret_cast<const int32_t *>(base + _mm_extract_epi32(offsets, 0)),
+      *reinterpret_cast<const int32_t *>(base + _mm_extract_epi32(offsets, 1)),
+      *reinterpret_cast<const int32_t *>(base + _mm_extract_epi32(offsets, 2)),
+      *reinterpret_cast<const int32_t *>(base + _mm_extract_epi32(offsets, 3)));
+}
+
+SW_TARGET_SSE41 static inline __m128 ChannelSse41(__m128i pixels,
+                                                  uint32_t channel) {
+  return _mm_cvtepi32_ps(
+      _mm_and_si128(_mm_srl_epi32(pixels, _mm_cvtsi32_si128(channel * 8)),
+                    _mm_set1_epi32(0xff)));
+}
+
+SW_TARGET_SSE41 static inline __m128 BilinearSse41(__m128 p00, __m128 p01,
+                                                   __m128 p10, __m128 p11,
+                                                   __m128 fx, __m128 fy) {
+  __m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p01, p00), fx));
+  __m128 bottom = _mm_add_ps(p10, _mm_mul_ps(_mm_sub_ps(p11, p10), fx));
+  return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+}
+
+SW_TARGET_SSE41 static void FetchRgbSse41(const SWSource &source,
+                                          const float *vx, float vy,
+                                          uint32_t count,
+                                          const SWPixels &out) {
+  const struct sw_image &image = *source.image_;
+  const uint8_t *pixels = image.planes_[0];
+  const float *crop = source.crop_;
+  const float *matrix = source.matrix_;
+  bool red_first = HasRedFirst(image.format_);
+  bool opaque = IsOpaque(image.format_);
+  __m128 m0 = _mm_set1_ps(matrix[0]);
+  __m128 m2 = _mm_set1_ps(matrix[2]);
+  __m128 vy_m1 = _mm_set1_ps(vy * matrix[1]);
+  __m128 vy_m3 = _mm_set1_ps(vy * matrix[3]);
+  __m128 width = _mm_set1_ps((float)image.width_);
+  __m128 height = _mm_set1_ps((float)image.height_);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 max_value = _mm_set1_ps(255.0f);
+  __m128 zero = _mm_setzero_ps();
+  __m128i pitch = _mm_set1_epi32(image.pitches_[0]);
+  for (uint32_t i = 0; i < count; i += 4) {
+    __m128 x = _mm_loadu_ps(vx + i);
+    __m128 tx = _mm_add_ps(_mm_mul_ps(x, m0), vy_m1);
+    __m128 ty = _mm_add_ps(_mm_mul_ps(x, m2), vy_m3);
+    __m128 u = _mm_sub_ps(
+        _mm_mul_ps(_mm_add_ps(_mm_set1_ps(crop[0]),
+                              _mm_mul_ps(tx, _mm_set1_ps(crop[2]))),
+                   width),
+        half);
+    __m128 v = _mm_sub_ps(
+        _mm_mul_ps(_mm_add_ps(_mm_set1_ps(crop[1]),
+                              _mm_mul_ps(ty, _mm_set1_ps(crop[3]))),
+                   height),
+        half);
+
+    __m128i x1, y1;
+    __m128 fx, fy;
+    __m128i x0 = GetTexelsSse41(u, image.width_, &x1, &fx);
+    __m128i y0 = GetTexelsSse41(v, image.height_, &y1, &fy);
+    __m128i row0 = _mm_mullo_epi32(y0, pitch);
+    x0 = _mm_slli_epi32(x0, 2);
+    __m128i p00 = Gather4(pixels, _mm_add_epi32(row0, x0));
+
+    __m128 c[4];
+    if (_mm_movemask_ps(_mm_or_ps(_mm_cmpneq_ps(fx, zero),
+                                  _mm_cmpneq_ps(fy, zero)))) {
+      __m128i row1 = _mm_mullo_epi32(y1, pitch);
+      x1 = _mm_slli_epi32(x1, 2);
+      __m128i p01 = Gather4(pixels, _mm_add_epi32(row0, x1));
+      __m128i p10 = Gather4(pixels, _mm_add_epi32(row1, x0));
+      __m128i p11 = Gather4(pixels, _mm_add_epi32(row1, x1));
+      for (uint32_t channel = 0; channel < 4; channel++) {
+        c[channel] = _mm_div_ps(
+            BilinearSse41(
+                ChannelSse41(p00, channel), ChannelSse41(p01, channel),
+                ChannelSse41(p10, channel), ChannelSse41(p11, channel), fx, fy),
+            max_value);
+      }
+    } else {
+      // Unscaled and aligned, as most layers are.
+      for (uint32_t channel = 0; channel < 4; channel++)
+        c[channel] = _mm_div_ps(ChannelSse41(p00, channel), max_value);
+    }
+
+    _mm_storeu_ps(out.r_ + i, red_first ? c[0] : c[2]);
+    _mm_storeu_ps(out.g_ + i, c[1]);
+    _mm_storeu_ps(out.b_ + i, red_first ? c[2] : c[0]);
+    _mm_storeu_ps(out.a_ + i, opaque ? _mm_set1_ps(1.0f) : c[3]);
+  }
+}
+
+SW_TARGET_SSE41 static inline __m128 Saturate(__m128 value) {
+  return _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+SW_TARGET_SSE41 static void ConvertYuvSse41(const SWPixels &pixels,
+                                            uint32_t count) {
+  __m128 max_value = _mm_set1_ps(255.0f);
+  for (uint32_t i = 0; i < count; i += 4) {
+    __m128 y = _mm_mul_ps(
+        _mm_sub_ps(_mm_loadu_ps(pixels.r_ + i), _mm_set1_ps(16.0f)),
+        _mm_set1_ps(kYScale));
+    __m128 u = _mm_sub_ps(_mm_loadu_ps(pixels.g_ + i), _mm_set1_ps(128.0f));
+    __m128 v = _mm_sub_ps(_mm_loadu_ps(pixels.b_ + i), _mm_set1_ps(128.0f));
+    __m128 r = _mm_add_ps(y, _mm_mul_ps(v, _mm_set1_ps(kVToR)));
+    __m128 g = _mm_sub_ps(_mm_sub_ps(y, _mm_mul_ps(u, _mm_set1_ps(kUToG))),
+                          _mm_mul_ps(v, _mm_set1_ps(kVToG)));
+    __m128 b = _mm_add_ps(y, _mm_mul_ps(u, _mm_set1_ps(kUToB)));
+    _mm_storeu_ps(pixels.r_ + i, Saturate(_mm_div_ps(r, max_value)));
+    _mm_storeu_ps(pixels.g_ + i, Saturate(_mm_div_ps(g, max_value)));
+    _mm_storeu_ps(pixels.b_ + i, Saturate(_mm_div_ps(b, max_value)));
+  }
+}
+
+SW_TARGET_SSE41 static bool BlendSse41(const SWPixels &src,
+                                       const SWBlend &blend,
+                                       const SWPixels &acc, uint32_t count) {
+  __m128 min_cover = _mm_set1_ps(kMinCover);
+  __m128 alpha = _mm_set1_ps(blend.alpha_);
+  __m128 premult = _mm_set1_ps(blend.premult_);
+  __m128 color_a = _mm_set1_ps(blend.color_[3]);
+  __m128 visible = _mm_setzero_ps();
+  float *const acc_rgb[] = {acc.r_, acc.g_, acc.b_};
+  const float *const src_rgb[] = {src.r_, src.g_, src.b_};
+  for (uint32_t i = 0; i < count; i += 4) {
+    __m128 cover = _mm_loadu_ps(acc.a_ + i);
+    __m128 active = _mm_cmpgt_ps(cover, min_cover);
+    if (!_mm_movemask_ps(active))
+      continue;
+
+    __m128 a = _mm_loadu_ps(src.a_ + i);
+    __m128 mult = _mm_max_ps(_mm_min_ps(a, color_a), premult);
+    for (uint32_t channel = 0; channel < 3; channel++) {
+      __m128 value = _mm_loadu_ps(acc_rgb[channel] + i);
+      __m128 s = _mm_add_ps(_mm_loadu_ps(src_rgb[channel] + i),
+                            _mm_set1_ps(blend.color_[channel]));
+      __m128 sum = _mm_add_ps(
+          value, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(s, mult), alpha), cover));
+      _mm_storeu_ps(acc_rgb[channel] + i, _mm_blendv_ps(value, sum, active));
+    }
+
+    cover = _mm_blendv_ps(
+        cover,
+        _mm_mul_ps(cover, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(a, alpha))),
+        active);
+    _mm_storeu_ps(acc.a_ + i, cover);
+    visible = _mm_or_ps(visible, _mm_cmpgt_ps(cover, min_cover));
+  }
+
+  return _mm_movemask_ps(visible) != 0;
+}
+
+SW_TARGET_SSE41 static inline __m128i ToBytesSse41(__m128 value) {
+  return _mm_cvttps_epi32(_mm_add_ps(
+      _mm_mul_ps(Saturate(value), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+SW_TARGET_SSE41 static void StoreSse41(const SWPixels &acc, uint32_t count,
+                                       bool red_first, uint32_t *dst) {
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i r = ToBytesSse41(_mm_loadu_ps(acc.r_ + i));
+    __m128i g = ToBytesSse41(_mm_loadu_ps(acc.g_ + i));
+    __m128i b = ToBytesSse41(_mm_loadu_ps(acc.b_ + i));
+    __m128i a = ToBytesSse41(
+        _mm_sub_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(acc.a_ + i)));
+    __m128i low = red_first ? r : b;
+    __m128i high = red_first ? b : r;
+    __m128i packed =
+        _mm_or_si128(_mm_or_si128(low, _mm_slli_epi32(g, 8)),
+                     _mm_or_si128(_mm_slli_epi32(high, 16),
+                                  _mm_slli_epi32(a, 24)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+  }
+
+  Store(Offset(acc, i), count - i, red_first, dst + i);
+}
+
+static const SWKernels kSse41Kernels = {"sse4.1",        FetchRgbSse41,
+                                        FetchYuv,        ConvertYuvSse41,
+                                        BlendSse41,      StoreSse41};
+
+SW_TARGET_AVX2 static inline __m256i GetTexelsAvx2(__m256 coord,
+                                                    int32_t size,
+                                                    __m256i *i1,
+                                                    __m256 *f) {
+  __m256 c = _mm256_min_ps(_mm256_max_ps(coord, _mm256_set1_ps(-1.0f)),
+                           _mm256_set1_ps((float)size));
+  __m256 base = _mm256_floor_ps(c);
+  __m256i i = _mm256_cvttps_epi32(base);
+  __m256i q = _mm256_cvttps_epi32(_mm256_add_ps(
+      _mm256_mul_ps(_mm256_sub_ps(c, base), _mm256_set1_ps(kSubTexels)),
+      _mm256_set1_ps(0.5f)));
+  __m256i carry =
+      _mm256_cmpeq_epi32(q, _mm256_set1_epi32((int32_t)kSubTexels));
+  i = _mm256_sub_epi32(i, carry);
+  q = _mm256_andnot_si256(carry, q);
+
+  __m256i zero = _mm256_setzero_si256();
+  __m256i limit = _mm256_set1_epi32(size - 1);
+  *i1 = _mm256_min_epi32(
+      _mm256_max_epi32(_mm256_add_epi32(i, _mm256_set1_epi32(1)), zero),
+      limit);
+  *f = _mm256_mul_ps(_mm256_cvtepi32_ps(q),
+                     _mm256_set1_ps(1.0f / kSubTexels));
+  return _mm256_min_epi32(_mm256_max_epi32(i, zero), limit);
+}
+
+SW_TARGET_AVX2 static inline __m256i Gather8(const uint8_t *base,
+                                             __m256i offsets) {
+  return _mm256_i32gather_epi32(reinterpret_cast<const int *>(base), offsets,
+                                1);
+}
+
+SW_TARGET_AVX2 static inline __m256 ChannelAvx2(__m256i pixels,
+                                                uint32_t channel) {
+  return _mm256_cvtepi32_ps(_mm256_and_si256(
+      _mm256_srl_epi32(pixels, _mm_cvtsi32_si128(channel * 8)),
+      _mm256_set1_epi32(0xff)));
+}
+
+SW_TARGET_AVX2 static inline __m256 BilinearAvx2(__m256 p00, __m256 p01,
+                                                 __m256 p10, __m256 p11,
+                                                 __m256 fx, __m256 fy) {
+  __m256 top = _mm256_add_ps(p00, _mm256_mul_ps(_mm256_sub_ps(p01, p00), fx));
+  __m256 bottom =
+      _mm256_add_ps(p10, _mm256_mul_ps(_mm256_sub_ps(p11, p10), fx));
+  return _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy));
+}
+
+SW_TARGET_AVX2 static void FetchRgbAvx2(const SWSource &source,
+                                        const float *vx, float vy,
+                                        uint32_t count, const SWPixels &out) {
+  const struct sw_image &image = *source.image_;
+  const uint8_t *pixels = image.planes_[0];
+  const float *crop = source.crop_;
+  const float *matrix = source.matrix_;
+  bool red_first = HasRedFirst(image.format_);
+  bool opaque = IsOpaque(image.format_);
+  __m256 m0 = _mm256_set1_ps(matrix[0]);
+  __m256 m2 = _mm256_set1_ps(matrix[2]);
+  __m256 vy_m1 = _mm256_set1_ps(vy * matrix[1]);
+  __m256 vy_m3 = _mm256_set1_ps(vy * matrix[3]);
+  __m256 width = _mm256_set1_ps((float)image.width_);
+  __m256 height = _mm256_set1_ps((float)image.height_);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 max_value = _mm256_set1_ps(255.0f);
+  __m256 zero = _mm256_setzero_ps();
+  __m256i pitch = _mm256_set1_epi32(image.pitches_[0]);
+  for (uint32_t i = 0; i < count; i += 8) {
+    __m256 x = _mm256_loadu_ps(vx + i);
+    __m256 tx = _mm256_add_ps(_mm256_mul_ps(x, m0), vy_m1);
+    __m256 ty = _mm256_add_ps(_mm256_mul_ps(x, m2), vy_m3);
+    __m256 u = _mm256_sub_ps(
+        _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(crop[0]),
+                                    _mm256_mul_ps(tx, _mm256_set1_ps(crop[2]))),
+                      width),
+        half);
+    __m256 v = _mm256_sub_ps(
+        _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(crop[1]),
+                                    _mm256_mul_ps(ty, _mm256_set1_ps(crop[3]))),
+                      height),
+        half);
+
+    __m256i x1, y1;
+    __m256 fx, fy;
+    __m256i x0 = GetTexelsAvx2(u, image.width_, &x1, &fx);
+    __m256i y0 = GetTexelsAvx2(v, image.height_, &y1, &fy);
+    __m256i row0 = _mm256_mullo_epi32(y0, pitch);
+    x0 = _mm256_slli_epi32(x0, 2);
+    __m256i p00 = Gather8(pixels, _mm256_add_epi32(row0, x0));
+
+    __m256 c[4];
+    if (_mm256_movemask_ps(
+            _mm256_or_ps(_mm256_cmp_ps(fx, zero, _CMP_NEQ_UQ),
+                         _mm256_cmp_ps(fy, zero, _CMP_NEQ_UQ)))) {
+      __m256i row1 = _mm256_mullo_epi32(y1, pitch);
+      x1 = _mm256_slli_epi32(x1, 2);
+      __m256i p01 = Gather8(pixels, _mm256_add_epi32(row0, x1));
+      __m256i p10 = Gather8(pixels, _mm256_add_epi32(row1, x0));
+      __m256i p11 = Gather8(pixels, _mm256_add_epi32(row1, x1));
+      for (uint32_t channel = 0; channel < 4; channel++) {
+        c[channel] = _mm256_div_ps(
+            BilinearAvx2(ChannelAvx2(p00, channel), ChannelAvx2(p01, channel),
+                         ChannelAvx2(p10, channel), ChannelAvx2(p11, channel),
+                         fx, fy),
+            max_value);
+      }
+    } else {
+      for (uint32_t channel = 0; channel < 4; channel++)
+        c[channel] = _mm256_div_ps(ChannelAvx2(p00, channel), max_value);
+    }
+
+    _mm256_storeu_ps(out.r_ + i, red_first ? c[0] : c[2]);
+    _mm256_storeu_ps(out.g_ + i, c[1]);
+    _mm256_storeu_ps(out.b_ + i, red_first ? c[2] : c[0]);
+    _mm256_storeu_ps(out.a_ + i, opaque ? _mm256_set1_ps(1.0f) : c[3]);
+  }
+}
+
+SW_TARGET_AVX2 static inline __m256 SaturateAvx2(__m256 value) {
+  return _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()),
+                       _mm256_set1_ps(1.0f));
+}
+
+SW_TARGET_AVX2 static void ConvertYuvAvx2(const SWPixels &pixels,
+                                          uint32_t count) {
+  __m256 max_value = _mm256_set1_ps(255.0f);
+  for (uint32_t i = 0; i < count; i += 8) {
+    __m256 y = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_loadu_ps(pixels.r_ + i), _mm256_set1_ps(16.0f)),
+        _mm256_set1_ps(kYScale));
+    __m256 u =
+        _mm256_sub_ps(_mm256_loadu_ps(pixels.g_ + i), _mm256_set1_ps(128.0f));
+    __m256 v =
+        _mm256_sub_ps(_mm256_loadu_ps(pixels.b_ + i), _mm256_set1_ps(128.0f));
+    __m256 r = _mm256_add_ps(y, _mm256_mul_ps(v, _mm256_set1_ps(kVToR)));
+    __m256 g = _mm256_sub_ps(
+        _mm256_sub_ps(y, _mm256_mul_ps(u, _mm256_set1_ps(kUToG))),
+        _mm256_mul_ps(v, _mm256_set1_ps(kVToG)));
+    __m256 b = _mm256_add_ps(y, _mm256_mul_ps(u, _mm256_set1_ps(kUToB)));
+    _mm256_storeu_ps(pixels.r_ + i, SaturateAvx2(_mm256_div_ps(r, max_value)));
+    _mm256_storeu_ps(pixels.g_ + i, SaturateAvx2(_mm256_div_ps(g, max_value)));
+    _mm256_storeu_ps(pixels.b_ + i, SaturateAvx2(_mm256_div_ps(b, max_value)));
+  }
+}
+
+SW_TARGET_AVX2 static bool BlendAvx2(const SWPixels &src,
+                                     const SWBlend &blend,
+                                     const SWPixels &acc, uint32_t count) {
+  __m256 min_cover = _mm256_set1_ps(kMinCover);
+  __m256 alpha = _mm256_set1_ps(blend.alpha_);
+  __m256 premult = _mm256_set1_ps(blend.premult_);
+  __m256 color_a = _mm256_set1_ps(blend.color_[3]);
+  __m256 visible = _mm256_setzero_ps();
+  float *const acc_rgb[] = {acc.r_, acc.g_, acc.b_};
+  const float *const src_rgb[] = {src.r_, src.g_, src.b_};
+  for (uint32_t i = 0; i < count; i += 8) {
+    __m256 cover = _mm256_loadu_ps(acc.a_ + i);
+    __m256 active = _mm256_cmp_ps(cover, min_cover, _CMP_GT_OQ);
+    if (!_mm256_movemask_ps(active))
+      continue;
+
+    __m256 a = _mm256_loadu_ps(src.a_ + i);
+    __m256 mult = _mm256_max_ps(_mm256_min_ps(a, color_a), premult);
+    for (uint32_t channel = 0; channel < 3; channel++) {
+      __m256 value = _mm256_loadu_ps(acc_rgb[channel] + i);
+      __m256 s = _mm256_add_ps(_mm256_loadu_ps(src_rgb[channel] + i),
+                               _mm256_set1_ps(blend.color_[channel]));
+      __m256 sum = _mm256_add_ps(
+          value,
+          _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(s, mult), alpha), cover));
+      _mm256_storeu_ps(acc_rgb[channel] + i,
+                       _mm256_blendv_ps(value, sum, active));
+    }
+
+    cover = _mm256_blendv_ps(
+        cover, _mm256_mul_ps(cover, _mm256_sub_ps(_mm256_set1_ps(1.0f),
+                                                  _mm256_mul_ps(a, alpha))),
+        active);
+    _mm256_storeu_ps(acc.a_ + i, cover);
+    visible =
+        _mm256_or_ps(visible, _mm256_cmp_ps(cover, min_cover, _CMP_GT_OQ));
+  }
+
+  return _mm256_movemask_ps(visible) != 0;
+}
+
+SW_TARGET_AVX2 static inline __m256i ToBytesAvx2(__m256 value) {
+  return _mm256_cvttps_epi32(
+      _mm256_add_ps(_mm256_mul_ps(SaturateAvx2(value), _mm256_set1_ps(255.0f)),
+                    _mm256_set1_ps(0.5f)));
+}
+
+SW_TARGET_AVX2 static void StoreAvx2(const SWPixels &acc, uint32_t count,
+                                     bool red_first, uint32_t *dst) {
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i r = ToBytesAvx2(_mm256_loadu_ps(acc.r_ + i));
+    __m256i g = ToBytesAvx2(_mm256_loadu_ps(acc.g_ + i));
+    __m256i b = ToBytesAvx2(_mm256_loadu_ps(acc.b_ + i));
+    __m256i a = ToBytesAvx2(
+        _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(acc.a_ + i)));
+    __m256i low = red_first ? r : b;
+    __m256i high = red_first ? b : r;
+    __m256i packed = _mm256_or_si256(
+        _mm256_or_si256(low, _mm256_slli_epi32(g, 8)),
+        _mm256_or_si256(_mm256_slli_epi32(high, 16),
+                        _mm256_slli_epi32(a, 24)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+
+  Store(Offset(acc, i), count - i, red_first, dst + i);
+}
+
+static const SWKernels kAvx2Kernels = {"avx2",         FetchRgbAvx2,
+                                       FetchYuv,       ConvertYuvAvx2,
+                                       BlendAvx2,      StoreAvx2};
+#endif
+
+SWKernelLevel GetSupportedSWKernelLevel() {
+#ifdef SW_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return kSWAvx2;
+
+  if (__builtin_cpu_supports("sse4.1"))
+    return kSWSse41;
+#endif
+  return kSWScalar;
+}
+
+const SWKernels &GetSWKernels(SWKernelLevel level) {
+  SWKernelLevel supported = GetSupportedSWKernelLevel();
+  if (level > supported)
+    level = supported;
+
+#ifdef SW_KERNELS_X86
+  if (level == kSWAvx2)
+    return kAvx2Kernels;
+
+  if (level == kSWSse41)
+    return kSse41Kernels;
+#endif
+  return kScalarKernels;
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,92 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_SW_SWKERNELS_H_
+#define COMMON_COMPOSITOR_SW_SWKERNELS_H_
+
+#include <stdint.h>
+
+#include "compositordefs.h"
+
+namespace hwcomposer {
+
+// Pixels processed at once by the widest kernels. Arrays passed to
+// kernels hold a multiple of this, entries past count are scratch.
+static const uint32_t kSWKernelWidth = 8;
+
+// A span of pixels, one float per channel and pixel. Accumulated colors
+// keep the coverage left for the layers below in a_, like alphaCover of
+// the GL shaders.
+struct SWPixels {
+  float *r_;
+  float *g_;
+  float *b_;
+  float *a_;
+};
+
+// A layer of a region, as RenderState::LayerState has it.
+struct SWSource {
+  const struct sw_image *image_;
+  // Left, top, width and height of the crop, in 0..1.
+  float crop_[4];
+  float matrix_[4];
+};
+
+struct SWBlend {
+  float color_[4];
+  float alpha_;
+  float premult_;
+};
+
+// The steps of drawing a row of a region. All levels produce the same
+// bits, the operations are done in the same order and without fused
+// multiply-adds.
+struct SWKernels {
+  const char *name_;
+
+  // Samples source like GL_LINEAR with clamping to edges, at the pixels
+  // whose region coordinates are vx in 0..1 and vy. Sample positions are
+  // rounded to 1/256th of a texel, as GPUs do. RGB formats give 0..1
+  // RGBA, YUV ones 0..255 YUV in r_, g_ and b_ for convert_yuv.
+  void (*fetch_rgb)(const SWSource &source, const float *vx, float vy,
+                    uint32_t count, const SWPixels &out);
+  void (*fetch_yuv)(const SWSource &source, const float *vx, float vy,
+                    uint32_t count, const SWPixels &out);
+
+  // Converts limited range BT.601 YUV from fetch_yuv to 0..1 RGB.
+  void (*convert_yuv)(const SWPixels &pixels, uint32_t count);
+
+  // Adds src under the layers accumulated in acc, for the pixels they
+  // leave visible. Returns whether any pixel is still visible.
+  bool (*blend)(const SWPixels &src, const SWBlend &blend,
+                const SWPixels &acc, uint32_t count);
+
+  // Writes acc as 8 bits per channel, R in the lowest byte if red_first.
+  // Unlike the other kernels, exactly count pixels are written.
+  void (*store)(const SWPixels &acc, uint32_t count, bool red_first,
+                uint32_t *dst);
+};
+
+enum SWKernelLevel { kSWScalar, kSWSse41, kSWAvx2 };
+
+// The widest level this CPU runs.
+SWKernelLevel GetSupportedSWKernelLevel();
+
+// Kernels of level, or of the widest supported one below it.
+const SWKernels &GetSWKernels(SWKernelLevel level);
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_SW_SWKERNELS_H_
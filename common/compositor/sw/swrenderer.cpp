@@ -0,0 +1,370 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "swrenderer.h"
+
+#include <drm_fourcc.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "hwcthread.h"
+#include "hwctrace.h"
+#include "hwcutils.h"
+#include "nativesurface.h"
+#include "renderstate.h"
+#include "swshim.h"
+
+#ifndef DMA_BUF_BASE
+// From linux/dma-buf.h, which not all kernel headers have.
+struct dma_buf_sync {
+  uint64_t flags;
+};
+
+#define DMA_BUF_BASE 'b'
+#define DMA_BUF_IOCTL_SYNC _IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
+#define DMA_BUF_SYNC_READ (1 << 0)
+#define DMA_BUF_SYNC_WRITE (2 << 0)
+#define DMA_BUF_SYNC_RW (DMA_BUF_SYNC_READ | DMA_BUF_SYNC_WRITE)
+#define DMA_BUF_SYNC_START (0 << 2)
+#define DMA_BUF_SYNC_END (1 << 2)
+#endif
+
+namespace hwcomposer {
+
+// Bands of fewer rows cost more to hand to a thread than to draw.
+static const uint32_t kMinBandRows = 32;
+static const uint32_t kMaxBands = 8;
+
+static inline uint32_t RoundUpToKernelWidth(uint32_t count) {
+  return (count + kSWKernelWidth - 1) / kSWKernelWidth * kSWKernelWidth;
+}
+
+// Draws bands of SWRenderer::Draw, with scratch space of its own.
+class SWBandWorker : public HWCThread {
+ public:
+  explicit SWBandWorker(SWRenderer *renderer)
+      : HWCThread(-8, "SWBandWorker"), renderer_(renderer) {
+  }
+
+  ~SWBandWorker() override {
+    HWCThread::Exit();
+  }
+
+  bool Start() {
+    if (!done_.Initialize())
+      return false;
+
+    return InitWorker();
+  }
+
+  // Draws band on our thread. Needs to be followed by Wait.
+  void DrawAsync(uint32_t band) {
+    band_ = band;
+    queued_.store(true);
+    Resume();
+  }
+
+  void Wait() {
+    done_.Wait();
+  }
+
+ protected:
+  void HandleRoutine() override {
+    if (!queued_.exchange(false))
+      return;
+
+    renderer_->DrawBand(band_, &scratch_);
+    done_.Signal();
+  }
+
+ private:
+  SWRenderer *renderer_;
+  uint32_t band_ = 0;
+  std::atomic<bool> queued_{false};
+  HWCEvent done_;
+  std::vector<float> scratch_;
+};
+
+SWRenderer::SWRenderer() : kernels_(&GetSWKernels(kSWScalar)) {
+}
+
+SWRenderer::~SWRenderer() {
+}
+
+bool SWRenderer::Init() {
+  kernels_ = &GetSWKernels(GetSupportedSWKernelLevel());
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  SetMaxBands(cpus > 0 ? static_cast<uint32_t>(cpus) : 1);
+  ITRACE("Software composition with %s kernels and up to %u bands.",
+         kernels_->name_, max_bands_);
+  return true;
+}
+
+void SWRenderer::SetKernelLevel(SWKernelLevel level) {
+  kernels_ = &GetSWKernels(level);
+}
+
+void SWRenderer::SetMaxBands(uint32_t bands) {
+  bands = std::max(1u, std::min(bands, kMaxBands));
+  while (workers_.size() + 1 < bands) {
+    std::unique_ptr<SWBandWorker> worker(new SWBandWorker(this));
+    if (!worker->Start()) {
+      ETRACE("Failed to start software composition thread.");
+      break;
+    }
+
+    workers_.emplace_back(std::move(worker));
+  }
+
+  max_bands_ = std::min<uint32_t>(bands, workers_.size() + 1);
+}
+
+bool SWRenderer::Draw(const std::vector<RenderState> &render_states,
+                      NativeSurface *surface) {
+  // We can't read protected buffers either.
+  surface->GetLayer()->SetProtected(false);
+
+  if (!surface->MakeCurrent())
+    return false;
+
+  target_ = sw_target_;
+  int width = target_->width_;
+  int height = target_->height_;
+
+  bool clear_surface = surface->ClearSurface();
+  bool partial_clear = surface->IsPartialClear();
+
+  surface->SetClearSurface(NativeSurface::kNone);
+
+  clears_.clear();
+  if (clear_surface || partial_clear) {
+    for (const HwcRect<int> &rect : surface->GetClearRegion()) {
+      HwcRect<int> clear(std::max(rect.left, 0), std::max(rect.top, 0),
+                         std::min(rect.right, width),
+                         std::min(rect.bottom, height));
+      if (clear.left < clear.right && clear.top < clear.bottom)
+        clears_.emplace_back(clear);
+    }
+  }
+
+  regions_.clear();
+  layers_.clear();
+  columns_.clear();
+  max_columns_ = 0;
+  for (const RenderState &state : render_states) {
+    if (state.layer_state_.empty() || !state.width_ || !state.height_)
+      continue;
+
+    Region region;
+    region.rect_ = HwcRect<int>(
+        std::max(std::min<int>(state.scissor_x_, width), 0),
+        std::max(std::min<int>(state.scissor_y_, height), 0),
+        std::min<int>(state.scissor_x_ + state.scissor_width_, width),
+        std::min<int>(state.scissor_y_ + state.scissor_height_, height));
+    if (region.rect_.left >= region.rect_.right ||
+        region.rect_.top >= region.rect_.bottom)
+      continue;
+
+    region.bounds_[0] = state.x_;
+    region.bounds_[1] = state.y_;
+    region.bounds_[2] = state.width_;
+    region.bounds_[3] = state.height_;
+    region.first_layer_ = layers_.size();
+    region.layer_count_ = state.layer_state_.size();
+    for (const RenderState::LayerState &src : state.layer_state_) {
+      layers_.emplace_back();
+      Layer &layer = layers_.back();
+      const struct sw_image &image = src.handle_;
+      layer.source_.image_ = image.planes_[0] ? &image : NULL;
+      layer.source_.crop_[0] = src.crop_bounds_[0];
+      layer.source_.crop_[1] = src.crop_bounds_[1];
+      layer.source_.crop_[2] = src.crop_bounds_[2] - src.crop_bounds_[0];
+      layer.source_.crop_[3] = src.crop_bounds_[3] - src.crop_bounds_[1];
+      std::copy_n(src.texture_matrix_, 4, layer.source_.matrix_);
+      // Unnormalized, as uLayerColor gets it.
+      const uint8_t *color = src.solid_color_array_;
+      for (int i = 0; i < 4; i++)
+        layer.blend_.color_[i] = color ? color[3 - i] : 0.0f;
+
+      layer.blend_.alpha_ = src.alpha_;
+      layer.blend_.premult_ = src.premult_;
+      layer.yuv_ = image.format_ == DRM_FORMAT_NV12 ||
+                   image.format_ == DRM_FORMAT_YUYV;
+    }
+
+    // Region coordinates of the centers of the pixels, as the GL
+    // rasterizer interpolates them.
+    region.first_column_ = columns_.size();
+    uint32_t count = region.rect_.right - region.rect_.left;
+    for (int x = region.rect_.left; x < region.rect_.right; x++)
+      columns_.emplace_back((x + 0.5f - region.bounds_[0]) /
+                            region.bounds_[2]);
+
+    // Kernels read up to a full vector past the last column.
+    columns_.resize(region.first_column_ + RoundUpToKernelWidth(count),
+                    columns_.back());
+    max_columns_ = std::max(max_columns_, count);
+    regions_.emplace_back(region);
+  }
+
+  if (!regions_.empty() || !clears_.empty()) {
+    uint32_t bands = std::min(max_bands_,
+                              (height + kMinBandRows - 1) / kMinBandRows);
+    bands = std::max(bands, 1u);
+    band_rows_ = (height + bands - 1) / bands;
+    bands = (height + band_rows_ - 1) / band_rows_;
+
+    SyncBuffers(false);
+    for (uint32_t band = 1; band < bands; band++)
+      workers_[band - 1]->DrawAsync(band);
+
+    DrawBand(0, &scratch_);
+
+    for (uint32_t band = 1; band < bands; band++)
+      workers_[band - 1]->Wait();
+
+    SyncBuffers(true);
+  }
+
+  // Drawing is done, there's nothing left to wait for.
+  if (!disable_explicit_sync_)
+    surface->SetNativeFence(-1);
+
+  surface->ResetDamage();
+  return true;
+}
+
+void SWRenderer::DrawBand(uint32_t band, std::vector<float> *scratch) {
+  int top = band * band_rows_;
+  int bottom = std::min<int>(top + band_rows_, target_->height_);
+  uint8_t *pixels = target_->planes_[0];
+  size_t pitch = target_->pitches_[0];
+
+  // Only the parts of the damage which no region renders to, computed by
+  // Compositor.
+  for (const HwcRect<int> &rect : clears_) {
+    int last_row = std::min(rect.bottom, bottom);
+    for (int y = std::max(rect.top, top); y < last_row; y++) {
+      memset(pixels + y * pitch + rect.left * 4, 0,
+             (rect.right - rect.left) * 4);
+    }
+  }
+
+  if (regions_.empty())
+    return;
+
+  // Layer samples followed by the accumulated color. Kept finite past
+  // the pixels of a row, the kernels work on whole vectors.
+  size_t stride = RoundUpToKernelWidth(max_columns_);
+  if (scratch->size() < stride * 8)
+    scratch->assign(stride * 8, 0.0f);
+
+  float *data = scratch->data();
+  SWPixels src = {data, data + stride, data + stride * 2, data + stride * 3};
+  SWPixels acc = {data + stride * 4, data + stride * 5, data + stride * 6,
+                  data + stride * 7};
+  bool red_first = target_->format_ == DRM_FORMAT_ABGR8888 ||
+                   target_->format_ == DRM_FORMAT_XBGR8888;
+
+  for (const Region &region : regions_) {
+    int first_row = std::max(region.rect_.top, top);
+    int last_row = std::min(region.rect_.bottom, bottom);
+    uint32_t count = region.rect_.right - region.rect_.left;
+    uint32_t padded = RoundUpToKernelWidth(count);
+    const float *vx = &columns_[region.first_column_];
+    for (int y = first_row; y < last_row; y++) {
+      float vy = (y + 0.5f - region.bounds_[1]) / region.bounds_[3];
+      std::fill_n(acc.r_, padded, 0.0f);
+      std::fill_n(acc.g_, padded, 0.0f);
+      std::fill_n(acc.b_, padded, 0.0f);
+      // Padding starts covered, so that it never counts as visible.
+      std::fill_n(acc.a_, count, 1.0f);
+      std::fill(acc.a_ + count, acc.a_ + padded, 0.0f);
+
+      for (size_t i = 0; i < region.layer_count_; i++) {
+        const Layer &layer = layers_[region.first_layer_ + i];
+        if (!layer.source_.image_) {
+          // What sampling a texture unit without a texture gives.
+          std::fill_n(src.r_, padded, 0.0f);
+          std::fill_n(src.g_, padded, 0.0f);
+          std::fill_n(src.b_, padded, 0.0f);
+          std::fill_n(src.a_, padded, 1.0f);
+        } else if (layer.yuv_) {
+          kernels_->fetch_yuv(layer.source_, vx, vy, count, src);
+          kernels_->convert_yuv(src, count);
+        } else {
+          kernels_->fetch_rgb(layer.source_, vx, vy, count, src);
+        }
+
+        if (!kernels_->blend(src, layer.blend_, acc, count))
+          break;
+      }
+
+      kernels_->store(
+          acc, count, red_first,
+          reinterpret_cast<uint32_t *>(pixels + y * pitch) + region.rect_.left);
+    }
+  }
+}
+
+void SWRenderer::SyncBuffers(bool end) {
+  int target_fd = target_->fds_[0];
+  if (!end) {
+    source_fds_.clear();
+    for (const Layer &layer : layers_) {
+      if (!layer.source_.image_)
+        continue;
+
+      for (int fd : layer.source_.image_->fds_) {
+        if (fd >= 0 && fd != target_fd &&
+            std::find(source_fds_.begin(), source_fds_.end(), fd) ==
+                source_fds_.end())
+          source_fds_.emplace_back(fd);
+      }
+    }
+  }
+
+  // Lets the kernel flush or invalidate CPU caches where buffers aren't
+  // coherent with the GPU and display.
+  struct dma_buf_sync sync;
+  uint64_t step = end ? DMA_BUF_SYNC_END : DMA_BUF_SYNC_START;
+  sync.flags = step | DMA_BUF_SYNC_READ;
+  for (int fd : source_fds_)
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+  if (target_fd >= 0) {
+    sync.flags = step | DMA_BUF_SYNC_RW;
+    ioctl(target_fd, DMA_BUF_IOCTL_SYNC, &sync);
+  }
+}
+
+void SWRenderer::InsertFence(int32_t kms_fence) {
+  // Buffers are read by this thread, so it waits for them.
+  if (kms_fence > 0) {
+    HWCPoll(kms_fence, -1);
+    close(kms_fence);
+  }
+}
+
+void SWRenderer::SetDisableExplicitSync(bool disable_explicit_sync) {
+  disable_explicit_sync_ = disable_explicit_sync;
+}
+
+}  // namespace hwcomposer
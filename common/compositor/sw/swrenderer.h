@@ -0,0 +1,103 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_SW_SWRENDERER_H_
+#define COMMON_COMPOSITOR_SW_SWRENDERER_H_
+
+#include <memory>
+#include <vector>
+
+#include "hwcdefs.h"
+#include "renderer.h"
+#include "swkernels.h"
+
+namespace hwcomposer {
+
+class SWBandWorker;
+
+// Composites on the CPU, for systems without a usable GPU and as a
+// reference for the pixels of the GPU renderers. Regions are drawn as the
+// GL shaders draw them. The surface is split into bands of rows, which
+// worker threads draw in parallel with the calling one.
+class SWRenderer : public Renderer {
+ public:
+  SWRenderer();
+  ~SWRenderer() override;
+
+  bool Init() override;
+  bool Draw(const std::vector<RenderState> &commands,
+            NativeSurface *surface) override;
+
+  void InsertFence(int32_t kms_fence) override;
+
+  void SetDisableExplicitSync(bool disable_explicit_sync) override;
+
+  // Uses the kernels of level, or of the widest supported one below it.
+  // Init picks the widest supported one.
+  void SetKernelLevel(SWKernelLevel level);
+
+  const char *GetKernelName() const {
+    return kernels_->name_;
+  }
+
+  // Limits the bands a surface is split into, 1 draws on the calling
+  // thread only. Init allows one band per CPU.
+  void SetMaxBands(uint32_t bands);
+
+ private:
+  friend class SWBandWorker;
+
+  struct Layer {
+    // image_ is NULL for layers without a buffer.
+    SWSource source_;
+    SWBlend blend_;
+    bool yuv_;
+  };
+
+  struct Region {
+    // Scissor, clipped to the surface.
+    HwcRect<int> rect_;
+    // Position and size of the region the layers are mapped to.
+    float bounds_[4];
+    size_t first_layer_;
+    size_t layer_count_;
+    // Offset of the region coordinates of rect_'s columns in columns_.
+    size_t first_column_;
+  };
+
+  void DrawBand(uint32_t band, std::vector<float> *scratch);
+  void SyncBuffers(bool end);
+
+  const SWKernels *kernels_;
+  std::vector<std::unique_ptr<SWBandWorker>> workers_;
+  uint32_t max_bands_ = 1;
+  bool disable_explicit_sync_ = false;
+
+  // State of the current Draw, shared by all bands.
+  const struct sw_image *target_ = NULL;
+  uint32_t band_rows_ = 0;
+  uint32_t max_columns_ = 0;
+  HwcRegion clears_;
+  std::vector<Region> regions_;
+  std::vector<Layer> layers_;
+  std::vector<float> columns_;
+  std::vector<int> source_fds_;
+  // Scratch space of the calling thread's band.
+  std::vector<float> scratch_;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_SW_SWRENDERER_H_
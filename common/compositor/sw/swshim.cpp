@@ -0,0 +1,157 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "swshim.h"
+
+#include <drm_fourcc.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+thread_local const struct sw_image *sw_target_;
+
+uint32_t GetSoftwarePlaneCount(uint32_t format) {
+  switch (format) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_YUYV:
+      return 1;
+    case DRM_FORMAT_NV12:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// Bytes of plane of a format_ x width_ x height_ image taken by each of
+// *rows rows.
+static uint64_t GetPlaneRowSize(const struct sw_image &image, uint32_t plane,
+                                uint32_t *rows) {
+  *rows = image.height_;
+  switch (image.format_) {
+    case DRM_FORMAT_YUYV:
+      return ((image.width_ + 1) / 2) * 4ULL;
+    case DRM_FORMAT_NV12:
+      if (plane == 0)
+        return image.width_;
+
+      *rows = (image.height_ + 1) / 2;
+      return ((image.width_ + 1) / 2) * 2ULL;
+    default:
+      return image.width_ * 4ULL;
+  }
+}
+
+bool MapSoftwareImage(const HwcMeta &meta, struct sw_import *import) {
+  struct sw_image &image = import->image_;
+  uint32_t total_planes = GetSoftwarePlaneCount(meta.format_);
+  if (!total_planes || meta.num_planes_ < total_planes || !meta.width_ ||
+      !meta.height_) {
+    ETRACE("Format %4.4s can't be composited in software.",
+           (const char *)&meta.format_);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < meta.num_planes_ * 2; i++) {
+    if (meta.fb_modifiers_[i]) {
+      ETRACE("Only linear buffers can be composited in software.");
+      return false;
+    }
+  }
+
+  image.format_ = meta.format_;
+  image.width_ = meta.width_;
+  image.height_ = meta.height_;
+  image.writable_ = true;
+
+  // Planes usually share one dma-buf, which is mapped once.
+  int map_fds[4];
+  uint32_t maps = 0;
+  bool mapped = true;
+  for (uint32_t i = 0; i < total_planes; i++) {
+    int fd = meta.prime_fds_[i];
+    uint32_t map = 0;
+    while (map < maps && map_fds[map] != fd)
+      map++;
+
+    if (map == maps) {
+      off_t size = lseek(fd, 0, SEEK_END);
+      void *addr = MAP_FAILED;
+      if (size > 0) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        // Buffers of clients may be shared read-only.
+        if (addr == MAP_FAILED && errno == EACCES) {
+          addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+          image.writable_ = false;
+        }
+      }
+
+      if (addr == MAP_FAILED) {
+        ETRACE("Failed to map buffer for software composition %s",
+               PRINTERROR());
+        mapped = false;
+        break;
+      }
+
+      import->maps_[map] = addr;
+      import->map_sizes_[map] = size;
+      map_fds[map] = fd;
+      maps++;
+    }
+
+    uint32_t rows = 0;
+    uint64_t row_size = GetPlaneRowSize(image, i, &rows);
+    if (meta.pitches_[i] < row_size ||
+        meta.offsets_[i] + (uint64_t)meta.pitches_[i] * (rows - 1) +
+                row_size >
+            import->map_sizes_[map]) {
+      ETRACE("Plane %u doesn't fit into its buffer.", i);
+      mapped = false;
+      break;
+    }
+
+    image.planes_[i] =
+        static_cast<uint8_t *>(import->maps_[map]) + meta.offsets_[i];
+    image.pitches_[i] = meta.pitches_[i];
+    image.fds_[i] = fd;
+  }
+
+  if (!mapped) {
+    UnmapSoftwareImage(*import);
+    image = sw_image();
+    for (uint32_t map = 0; map < maps; map++) {
+      import->maps_[map] = NULL;
+      import->map_sizes_[map] = 0;
+    }
+  }
+
+  return mapped;
+}
+
+void UnmapSoftwareImage(const struct sw_import &import) {
+  for (size_t map = 0; map < 4; map++) {
+    if (import.maps_[map])
+      munmap(import.maps_[map], import.map_sizes_[map]);
+  }
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,42 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_SW_SWSHIM_H_
+#define COMMON_COMPOSITOR_SW_SWSHIM_H_
+
+#include <stdint.h>
+
+#include "compositordefs.h"
+
+namespace hwcomposer {
+
+// Image drawn to by SWRenderer on this thread, set by the MakeCurrent of
+// the surface. Compositor threads each have their own, like GL contexts.
+extern thread_local const struct sw_image *sw_target_;
+
+// Number of planes of format if SWRenderer can sample it, 0 otherwise.
+uint32_t GetSoftwarePlaneCount(uint32_t format);
+
+// Maps the planes of the buffer described by meta to import->image_.
+// Fails for formats SWRenderer can't sample and for tiled buffers.
+bool MapSoftwareImage(const HwcMeta &meta, struct sw_import *import);
+
+// Undoes MapSoftwareImage. Only the mappings of import are released,
+// planes_ of copies of it dangle afterwards.
+void UnmapSoftwareImage(const struct sw_import &import);
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_SW_SWSHIM_H_
@@ -0,0 +1,55 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "swsurface.h"
+
+#include <drm_fourcc.h>
+
+#include "hwctrace.h"
+#include "overlaybuffer.h"
+#include "swshim.h"
+
+namespace hwcomposer {
+
+SWSurface::SWSurface(uint32_t width, uint32_t height)
+    : NativeSurface(width, height) {
+}
+
+SWSurface::~SWSurface() {
+}
+
+bool SWSurface::MakeCurrent() {
+  const ResourceHandle& import =
+      layer_.GetBuffer()->GetGpuResource(NULL, false);
+  const struct sw_image& image = import.image_;
+  if (!image.planes_[0]) {
+    ETRACE("Failed to map surface.");
+    return false;
+  }
+
+  // Regions are stored as RGBA, other formats would need a conversion.
+  if (!image.writable_ || image.format_ == DRM_FORMAT_NV12 ||
+      image.format_ == DRM_FORMAT_YUYV) {
+    ETRACE("Surface of format %4.4s can't be drawn to in software.",
+           (const char*)&image.format_);
+    return false;
+  }
+
+  sw_target_ = &image;
+  return true;
+}
+
+}  // namespace hwcomposer
@@ -91,6 +91,8 @@ void NativeVKResource::Reset() {
   for (auto& image_view : src_image_views_) {
     vkDestroyImageView(dev_, image_view, NULL);
   }
+  if (!src_image_views_.empty())
+    image_view_serial_++;
   src_image_views_.clear();
 
   for (auto& image : src_images_) {
@@ -0,0 +1,209 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "vkpipelinecache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+// "HWCV"
+static const uint32_t kCacheMagic = 0x56435748;
+// Bump when the file layout changes.
+static const uint32_t kCacheVersion = 1;
+// Pipelines of all layer counts take a few MB at most, anything bigger is
+// corrupt.
+static const uint32_t kMaxDataSize = 64 * 1024 * 1024;
+
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t length;
+  uint32_t reserved;
+  uint64_t data_hash;
+};
+
+// Leading fields of the data returned by vkGetPipelineCacheData, as
+// defined for VK_PIPELINE_CACHE_HEADER_VERSION_ONE.
+struct PipelineCacheHeader {
+  uint32_t header_size;
+  uint32_t header_version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint8_t uuid[VK_UUID_SIZE];
+};
+
+static uint64_t HashBytes(const void *data, size_t size) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+// Creates directory and its parents if needed.
+static bool CreateDirectory(const std::string &directory) {
+  for (size_t pos = 1; pos <= directory.size(); pos++) {
+    if (pos != directory.size() && directory[pos] != '/')
+      continue;
+
+    std::string parent = directory.substr(0, pos);
+    if (mkdir(parent.c_str(), 0755) && errno != EEXIST)
+      return false;
+  }
+
+  return true;
+}
+
+bool VKPipelineCache::Init(const VkPhysicalDeviceProperties &props) {
+  const char *directory = getenv("HWC_PROGRAM_CACHE_DIR");
+#ifdef PROGRAM_CACHE_DIR
+  if (!directory)
+    directory = PROGRAM_CACHE_DIR;
+#endif
+  if (directory && *directory) {
+    if (CreateDirectory(directory)) {
+      path_ = std::string(directory) + "/vk_pipeline_cache.bin";
+    } else {
+      ETRACE("Failed to create program cache directory %s.", directory);
+    }
+  }
+
+  std::vector<uint8_t> data;
+  if (!path_.empty() && !Load(props, &data)) {
+    // Stale or corrupt, Store replaces it once pipelines are built.
+    unlink(path_.c_str());
+    data.clear();
+  }
+
+  VkPipelineCacheCreateInfo pipeline_cache_create = {};
+  pipeline_cache_create.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipeline_cache_create.initialDataSize = data.size();
+  pipeline_cache_create.pInitialData = data.empty() ? NULL : data.data();
+
+  VkResult res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
+                                       &pipeline_cache_);
+  if (res != VK_SUCCESS && !data.empty()) {
+    ETRACE("Failed to create pipeline cache from stored data (%d)\n", res);
+    pipeline_cache_create.initialDataSize = 0;
+    pipeline_cache_create.pInitialData = NULL;
+    data.clear();
+    res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
+                                &pipeline_cache_);
+  }
+
+  if (res != VK_SUCCESS) {
+    ETRACE("vkCreatePipelineCache failed (%d)\n", res);
+    return false;
+  }
+
+  loaded_size_ = data.size();
+  stored_size_ = data.size();
+  return true;
+}
+
+bool VKPipelineCache::Load(const VkPhysicalDeviceProperties &props,
+                           std::vector<uint8_t> *data) {
+  FILE *file = fopen(path_.c_str(), "rb");
+  if (!file)
+    return true;
+
+  CacheHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == kCacheMagic &&
+               header.version == kCacheVersion &&
+               header.length >= sizeof(PipelineCacheHeader) &&
+               header.length <= kMaxDataSize;
+  if (valid) {
+    data->resize(header.length);
+    valid = fread(data->data(), 1, header.length, file) == header.length &&
+            fgetc(file) == EOF &&
+            HashBytes(data->data(), data->size()) == header.data_hash;
+  }
+
+  fclose(file);
+
+  if (!valid)
+    return false;
+
+  // Drivers are meant to ignore data of another device or driver build,
+  // but don't rely on it.
+  PipelineCacheHeader cache_header;
+  memcpy(&cache_header, data->data(), sizeof(cache_header));
+  return cache_header.header_size >= sizeof(cache_header) &&
+         cache_header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         cache_header.vendor_id == props.vendorID &&
+         cache_header.device_id == props.deviceID &&
+         !memcmp(cache_header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+void VKPipelineCache::Store() {
+  if (path_.empty())
+    return;
+
+  size_t size = 0;
+  VkResult res = vkGetPipelineCacheData(dev_, pipeline_cache_, &size, NULL);
+  if (res != VK_SUCCESS || size <= stored_size_ || size > kMaxDataSize)
+    return;
+
+  std::vector<uint8_t> data(size);
+  res = vkGetPipelineCacheData(dev_, pipeline_cache_, &size, data.data());
+  if (res != VK_SUCCESS)
+    return;
+
+  CacheHeader header;
+  header.magic = kCacheMagic;
+  header.version = kCacheVersion;
+  header.length = size;
+  header.reserved = 0;
+  header.data_hash = HashBytes(data.data(), size);
+
+  // Write to a temporary file and rename it, so that a concurrent Load
+  // never sees a partial cache.
+  std::string temp_path = path_ + ".XXXXXX";
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0)
+    return;
+
+  FILE *file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    unlink(temp_path.c_str());
+    return;
+  }
+
+  bool written_ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                    fwrite(data.data(), 1, size, file) == size;
+  if (fclose(file) || !written_ok || rename(temp_path.c_str(), path_.c_str())) {
+    unlink(temp_path.c_str());
+    return;
+  }
+
+  stored_size_ = size;
+}
+
+}  // namespace hwcomposer
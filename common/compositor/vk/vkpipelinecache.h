@@ -0,0 +1,62 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef VK_PIPELINE_CACHE_H_
+#define VK_PIPELINE_CACHE_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "vkshim.h"
+
+namespace hwcomposer {
+
+// Keeps pipeline_cache_ on disk, so that pipelines built by an earlier run
+// on the same device and driver are not compiled again. The data is
+// checked against the device's pipeline cache header and a checksum
+// before being handed to the driver; anything else starts an empty cache.
+class VKPipelineCache {
+ public:
+  VKPipelineCache() = default;
+  VKPipelineCache(const VKPipelineCache& rhs) = delete;
+  VKPipelineCache& operator=(const VKPipelineCache& rhs) = delete;
+
+  // Creates pipeline_cache_ for the device described by props. The
+  // directory is taken from HWC_PROGRAM_CACHE_DIR, or PROGRAM_CACHE_DIR
+  // set at configure time. Without one, the cache is only kept in memory.
+  bool Init(const VkPhysicalDeviceProperties& props);
+
+  // Writes pipeline_cache_ back if it grew since it was loaded or last
+  // stored.
+  void Store();
+
+  // Size of the data loaded by Init, 0 if there was none.
+  size_t GetLoadedSize() const {
+    return loaded_size_;
+  }
+
+ private:
+  bool Load(const VkPhysicalDeviceProperties& props,
+            std::vector<uint8_t>* data);
+
+  std::string path_;
+  size_t loaded_size_ = 0;
+  size_t stored_size_ = 0;
+};
+
+}  // namespace hwcomposer
+
+#endif  // VK_PIPELINE_CACHE_H_
@@ -43,7 +43,7 @@ VKProgram::~VKProgram() {
   vkDestroyPipeline(dev_, pipeline_, NULL);
 }
 
-bool VKProgram::Init(unsigned layer_index) {
+bool VKProgram::Init(unsigned layer_index, bool update_after_bind) {
   VkResult res;
 
   VkDescriptorSetLayoutBinding bindings[] = {
@@ -60,6 +60,22 @@ bool VKProgram::Init(unsigned layer_index) {
   desc_create.bindingCount = ARRAY_SIZE(bindings);
   desc_create.pBindings = &bindings[0];
 
+  // Only textures change while the geometry of a surface's regions stays
+  // the same, uniforms are rewritten in place.
+  VkDescriptorBindingFlagsEXT binding_flags[] = {
+      0, 0, VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT,
+  };
+  VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_create = {};
+  binding_flags_create.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+  binding_flags_create.bindingCount = ARRAY_SIZE(binding_flags);
+  binding_flags_create.pBindingFlags = &binding_flags[0];
+  if (update_after_bind) {
+    desc_create.pNext = &binding_flags_create;
+    desc_create.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+  }
+
   res = vkCreateDescriptorSetLayout(dev_, &desc_create, NULL,
                                     &descriptor_set_layout_);
   if (res != VK_SUCCESS) {
@@ -212,18 +228,10 @@ bool VKProgram::Init(unsigned layer_index) {
 
 void VKProgram::UseProgram(const RenderState &state,
                            unsigned int viewport_width,
-                           unsigned int viewport_height) {
+                           unsigned int viewport_height, float *vert_ub,
+                           float *frag_ub) {
   unsigned layer_count = state.layer_state_.size();
 
-  size_t vert_ub_size = 4 + 12 * layer_count;
-  RingBuffer::Allocation vert_ub_alloc =
-      ring_buffer_.Allocate(vert_ub_size * sizeof(float), ub_offset_align_);
-  if (!vert_ub_alloc) {
-    ETRACE("Failed to allocate space for vert uniform buffer");
-    return;
-  }
-  float *vert_ub = vert_ub_alloc.get<float>();
-
   vert_ub[0] = state.x_ / (float)viewport_width;
   vert_ub[1] = state.y_ / (float)viewport_height;
   vert_ub[2] = state.width_ / (float)viewport_width;
@@ -245,43 +253,11 @@ void VKProgram::UseProgram(const RenderState &state,
     vert_ub += 4;  // 2 data + 2 padding
   }
 
-  size_t frag_ub_size = 4 * layer_count;
-  RingBuffer::Allocation frag_ub_alloc =
-      ring_buffer_.Allocate(frag_ub_size * sizeof(float), ub_offset_align_);
-  if (!frag_ub_alloc) {
-    ETRACE("failed to allocate space for frag uniform buffer");
-    return;
-  }
-  float *frag_ub = frag_ub_alloc.get<float>();
-
   for (unsigned src_index = 0; src_index < layer_count; src_index++) {
     frag_ub[0] = state.layer_state_[src_index].alpha_;
     frag_ub[1] = state.layer_state_[src_index].premult_;
     frag_ub += 4;  // 2 data + 2 padding
   }
-
-  vert_buf_info_ = {};
-  vert_buf_info_.buffer = uniform_buffer_;
-  vert_buf_info_.offset = vert_ub_alloc.offset();
-  vert_buf_info_.range = vert_ub_size * sizeof(float);
-
-  frag_buf_info_ = {};
-  frag_buf_info_.buffer = uniform_buffer_;
-  frag_buf_info_.offset = frag_ub_alloc.offset();
-  frag_buf_info_.range = frag_ub_size * sizeof(float);
-
-  for (unsigned src_index = 0; src_index < layer_count; src_index++) {
-    const RenderState::LayerState &src = state.layer_state_[src_index];
-
-    VkDescriptorImageInfo image_info = {};
-    image_info.sampler = sampler_;
-    image_info.imageView = src.handle_.image_view;
-    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    src_image_infos_.emplace_back(image_info);
-  }
-
-  ub_allocs_.emplace_back(std::move(vert_ub_alloc));
-  ub_allocs_.emplace_back(std::move(frag_ub_alloc));
 }
 
 }  // namespace hwcomposer
@@ -37,9 +37,22 @@ class VKProgram {
 
   ~VKProgram();
 
-  bool Init(unsigned layer_index);
+  // With update_after_bind, the textures of descriptor sets using our
+  // layout can be rewritten while bound in a recorded command buffer.
+  bool Init(unsigned layer_index, bool update_after_bind);
+
+  // Writes the uniforms of cmd to vert_ub and frag_ub, which need to
+  // hold GetVertUBSize and GetFragUBSize bytes for its layer count.
   void UseProgram(const RenderState& cmd, unsigned int viewport_width,
-                  unsigned int viewport_height);
+                  unsigned int viewport_height, float* vert_ub,
+                  float* frag_ub);
+
+  static size_t GetVertUBSize(unsigned layer_count) {
+    return (4 + 12 * layer_count) * sizeof(float);
+  }
+  static size_t GetFragUBSize(unsigned layer_count) {
+    return 4 * layer_count * sizeof(float);
+  }
 
   VkDescriptorSetLayout getDescLayout() {
     return descriptor_set_layout_;
@@ -50,12 +63,6 @@ class VKProgram {
   VkPipeline getPipeline() {
     return pipeline_;
   }
-  VkDescriptorBufferInfo getVertUBInfo() {
-    return vert_buf_info_;
-  }
-  VkDescriptorBufferInfo getFragUBInfo() {
-    return frag_buf_info_;
-  }
 
  private:
   VkDescriptorSetLayout descriptor_set_layout_;
@@ -63,8 +70,6 @@ class VKProgram {
   VkShaderModule vertex_module_;
   VkShaderModule fragment_module_;
   VkPipeline pipeline_;
-  VkDescriptorBufferInfo vert_buf_info_;
-  VkDescriptorBufferInfo frag_buf_info_;
 };
 
 }  // namespace hwcomposer
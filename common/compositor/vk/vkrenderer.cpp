@@ -15,6 +15,10 @@
 #include "vkrenderer.h"
 #include "vkprogram.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "hwctrace.h"
 #include "nativesurface.h"
 #include "renderstate.h"
@@ -45,6 +49,16 @@ VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugReportCallback(
   return VK_FALSE;
 }
 
+static bool HasExtension(const std::vector<VkExtensionProperties> &extensions,
+                         const char *name) {
+  for (const VkExtensionProperties &extension : extensions) {
+    if (!strcmp(extension.extensionName, name))
+      return true;
+  }
+
+  return false;
+}
+
 uint32_t VKRenderer::GetMemoryTypeIndex(uint32_t mem_type_bits,
                                         uint32_t required_props) {
   for (uint32_t type_index = 0; type_index < 32;
@@ -201,10 +215,32 @@ bool VKRenderer::Init() {
 
   const char *enabled_layers[] = {};
 
-  const char *instance_extensions[] = {
+  std::vector<const char *> instance_extensions = {
       VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
   };
 
+  uint32_t count;
+  res = vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkEnumerateInstanceExtensionProperties failed (%d)\n", res);
+    return false;
+  }
+
+  std::vector<VkExtensionProperties> extensions(count);
+  res = vkEnumerateInstanceExtensionProperties(NULL, &count,
+                                               extensions.data());
+  if (res != VK_SUCCESS) {
+    ETRACE("vkEnumerateInstanceExtensionProperties failed (%d)\n", res);
+    return false;
+  }
+
+  bool has_properties2 = HasExtension(
+      extensions, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+  if (has_properties2) {
+    instance_extensions.emplace_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+  }
+
   VkApplicationInfo app_info = {};
   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   app_info.apiVersion = VK_MAKE_VERSION(1, 0, 0);
@@ -214,8 +250,8 @@ bool VKRenderer::Init() {
   instance_create.pApplicationInfo = &app_info;
   instance_create.enabledLayerCount = ARRAY_SIZE(enabled_layers);
   instance_create.ppEnabledLayerNames = &enabled_layers[0];
-  instance_create.enabledExtensionCount = ARRAY_SIZE(instance_extensions);
-  instance_create.ppEnabledExtensionNames = &instance_extensions[0];
+  instance_create.enabledExtensionCount = instance_extensions.size();
+  instance_create.ppEnabledExtensionNames = instance_extensions.data();
 
   res = vkCreateInstance(&instance_create, NULL, &inst_);
   if (res != VK_SUCCESS) {
@@ -240,7 +276,6 @@ bool VKRenderer::Init() {
     ITRACE("Failed to create vulkan debug callback\n");
   }
 
-  uint32_t count;
   res = vkEnumeratePhysicalDevices(inst_, &count, NULL);
   if (res != VK_SUCCESS) {
     ETRACE("vkEnumeratePhysicalDevices failed (%d)\n", res);
@@ -279,16 +314,63 @@ bool VKRenderer::Init() {
   queue_create.queueCount = 1;
   queue_create.pQueuePriorities = &queue_priority;
 
-  const char *device_extensions[] = {};
+  res = vkEnumerateDeviceExtensionProperties(phys_dev, NULL, &count, NULL);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkEnumerateDeviceExtensionProperties failed (%d)\n", res);
+    return false;
+  }
+
+  extensions.resize(count);
+  res = vkEnumerateDeviceExtensionProperties(phys_dev, NULL, &count,
+                                             extensions.data());
+  if (res != VK_SUCCESS) {
+    ETRACE("vkEnumerateDeviceExtensionProperties failed (%d)\n", res);
+    return false;
+  }
+
+  // Lets the textures of recorded commands change without recording them
+  // again.
+  PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR = NULL;
+  if (has_properties2) {
+    vkGetPhysicalDeviceFeatures2KHR =
+        (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+            inst_, "vkGetPhysicalDeviceFeatures2KHR");
+  }
+
+  if (vkGetPhysicalDeviceFeatures2KHR &&
+      HasExtension(extensions, VK_KHR_MAINTENANCE3_EXTENSION_NAME) &&
+      HasExtension(extensions, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+    indexing_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2KHR features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features.pNext = &indexing_features;
+    vkGetPhysicalDeviceFeatures2KHR(phys_dev, &features);
+    update_after_bind_ =
+        indexing_features.descriptorBindingSampledImageUpdateAfterBind;
+  }
+
+  std::vector<const char *> device_extensions;
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+  indexing_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  if (update_after_bind_) {
+    device_extensions.emplace_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    device_extensions.emplace_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  }
 
   VkDeviceCreateInfo device_create = {};
   device_create.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  if (update_after_bind_)
+    device_create.pNext = &indexing_features;
   device_create.queueCreateInfoCount = 1;
   device_create.pQueueCreateInfos = &queue_create;
   device_create.enabledLayerCount = ARRAY_SIZE(enabled_layers);
   device_create.ppEnabledLayerNames = &enabled_layers[0];
-  device_create.enabledExtensionCount = ARRAY_SIZE(device_extensions);
-  device_create.ppEnabledExtensionNames = &device_extensions[0];
+  device_create.enabledExtensionCount = device_extensions.size();
+  device_create.ppEnabledExtensionNames = device_extensions.data();
 
   res = vkCreateDevice(phys_dev, &device_create, NULL, &dev_);
   if (res != VK_SUCCESS) {
@@ -305,6 +387,9 @@ bool VKRenderer::Init() {
 
   VkCommandPoolCreateInfo pool_create = {};
   pool_create.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  // Command buffers of surfaces are recorded again when their regions
+  // change.
+  pool_create.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
   res = vkCreateCommandPool(dev_, &pool_create, NULL, &cmd_pool_);
   if (res != VK_SUCCESS) {
@@ -325,73 +410,8 @@ bool VKRenderer::Init() {
     return false;
   }
 
-  VkBufferCreateInfo buffer_create = {};
-  buffer_create.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  buffer_create.size = 0x100 * 256;
-  buffer_create.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-
-  res = vkCreateBuffer(dev_, &buffer_create, NULL, &uniform_buffer_);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkCreateBuffer failed (%d)\n", res);
-    return false;
-  }
-
-  VkMemoryRequirements mem_requirements;
-  vkGetBufferMemoryRequirements(dev_, uniform_buffer_, &mem_requirements);
-
-  VkMemoryAllocateInfo mem_allocate = {};
-  mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  mem_allocate.allocationSize = mem_requirements.size;
-  mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
-      mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-  if (mem_allocate.memoryTypeIndex >= 32) {
-    ETRACE("Failed to find suitable uniform buffer device memory\n");
+  if (!CreateDescriptorPool())
     return false;
-  }
-
-  res = vkAllocateMemory(dev_, &mem_allocate, NULL, &uniform_buffer_mem_);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateMemory failed (%d)\n", res);
-    return false;
-  }
-
-  res = vkBindBufferMemory(dev_, uniform_buffer_, uniform_buffer_mem_, 0);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkBindBufferMemory failed (%d)\n", res);
-    return false;
-  }
-
-  uint8_t *uniform_buffer_ptr;
-  res = vkMapMemory(dev_, uniform_buffer_mem_, 0, mem_allocate.allocationSize,
-                    0, (void **)&uniform_buffer_ptr);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkMapMemory failed (%d)\n", res);
-    return false;
-  }
-
-  ring_buffer_ = RingBuffer(uniform_buffer_ptr, buffer_create.size);
-
-  VkDescriptorPoolSize pool_sizes[2];
-  pool_sizes[0] = {};
-  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  pool_sizes[0].descriptorCount = 256;
-  pool_sizes[1] = {};
-  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  pool_sizes[1].descriptorCount = 256;
-
-  VkDescriptorPoolCreateInfo desc_pool_create = {};
-  desc_pool_create.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  desc_pool_create.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-  desc_pool_create.maxSets = 256;
-  desc_pool_create.poolSizeCount = ARRAY_SIZE(pool_sizes);
-  desc_pool_create.pPoolSizes = &pool_sizes[0];
-
-  res = vkCreateDescriptorPool(dev_, &desc_pool_create, NULL, &desc_pool_);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkCreateDescriptorPool failed (%d)\n", res);
-    return false;
-  }
 
   VkSamplerCreateInfo sampler_create = {};
   sampler_create.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -411,7 +431,9 @@ bool VKRenderer::Init() {
   VkAttachmentDescription attach_desc = {};
   attach_desc.format = VK_FORMAT_R8G8B8A8_UNORM;
   attach_desc.samples = VK_SAMPLE_COUNT_1_BIT;
-  attach_desc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  // Only the clear region of the surface is cleared, the rest keeps what
+  // was rendered before.
+  attach_desc.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
   attach_desc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   attach_desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   attach_desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -451,162 +473,275 @@ bool VKRenderer::Init() {
     return false;
   }
 
-  VkPipelineCacheCreateInfo pipeline_cache_create = {};
-  pipeline_cache_create.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  if (!pipeline_cache_file_.Init(device_props_))
+    return false;
 
-  res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
-                              &pipeline_cache_);
+  return true;
+}
+
+bool VKRenderer::CreateDescriptorPool() {
+  VkDescriptorPoolSize pool_sizes[2];
+  pool_sizes[0] = {};
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_sizes[0].descriptorCount = 512;
+  pool_sizes[1] = {};
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_sizes[1].descriptorCount = 1024;
+
+  VkDescriptorPoolCreateInfo desc_pool_create = {};
+  desc_pool_create.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  if (update_after_bind_)
+    desc_pool_create.flags =
+        VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+  desc_pool_create.maxSets = 256;
+  desc_pool_create.poolSizeCount = ARRAY_SIZE(pool_sizes);
+  desc_pool_create.pPoolSizes = &pool_sizes[0];
+
+  VkDescriptorPool desc_pool;
+  VkResult res =
+      vkCreateDescriptorPool(dev_, &desc_pool_create, NULL, &desc_pool);
   if (res != VK_SUCCESS) {
-    ETRACE("vkCreatePipelineCache failed (%d)\n", res);
+    ETRACE("vkCreateDescriptorPool failed (%d)\n", res);
     return false;
   }
 
+  desc_pools_.emplace_back(desc_pool);
   return true;
 }
 
-bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
-                      NativeSurface *surface) {
-  VkResult res;
-  uint32_t frame_width = surface->GetWidth();
-  uint32_t frame_height = surface->GetHeight();
-  // vk renderer should not support protected
-  surface->GetLayer()->SetProtected(false);
-  surface->MakeCurrent();
+VkDescriptorSet VKRenderer::AcquireDescriptorSet(VKProgram *program,
+                                                 unsigned texture_count) {
+  if (free_desc_sets_.size() >= texture_count &&
+      !free_desc_sets_[texture_count - 1].empty()) {
+    VkDescriptorSet desc_set = free_desc_sets_[texture_count - 1].back();
+    free_desc_sets_[texture_count - 1].pop_back();
+    return desc_set;
+  }
 
-  src_image_infos_.clear();
-  ub_allocs_.clear();
-  std::vector<VkDescriptorSetLayout> desc_layouts;
-  std::vector<VkDescriptorSet> desc_sets(render_states.size());
-  std::vector<VkDescriptorBufferInfo> ub_infos;
-  for (const RenderState &state : render_states) {
-    unsigned size = state.layer_state_.size();
-    if (size == 0)
-      break;
+  VkDescriptorSetLayout desc_layout = program->getDescLayout();
+  VkDescriptorSetAllocateInfo alloc_desc_set = {};
+  alloc_desc_set.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_desc_set.descriptorPool = desc_pools_.back();
+  alloc_desc_set.descriptorSetCount = 1;
+  alloc_desc_set.pSetLayouts = &desc_layout;
 
-    VKProgram *program = GetProgram(size);
-    if (!program)
-      continue;
+  VkDescriptorSet desc_set;
+  VkResult res = vkAllocateDescriptorSets(dev_, &alloc_desc_set, &desc_set);
+  if (res != VK_SUCCESS) {
+    // Out of pool memory, or fragmented.
+    if (!CreateDescriptorPool())
+      return VK_NULL_HANDLE;
+
+    alloc_desc_set.descriptorPool = desc_pools_.back();
+    res = vkAllocateDescriptorSets(dev_, &alloc_desc_set, &desc_set);
+    if (res != VK_SUCCESS) {
+      ETRACE("vkAllocateDescriptorSets failed (%d)\n", res);
+      return VK_NULL_HANDLE;
+    }
+  }
 
-    desc_layouts.emplace_back(program->getDescLayout());
+  return desc_set;
+}
 
-    program->UseProgram(state, frame_width, frame_height);
+bool VKRenderer::AllocateUniforms(VKDrawCache *cache, size_t size) {
+  cache->ReleaseUniforms();
 
-    ub_infos.emplace_back(program->getVertUBInfo());
-    ub_infos.emplace_back(program->getFragUBInfo());
+  VkBufferCreateInfo buffer_create = {};
+  buffer_create.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_create.size = size;
+  buffer_create.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+  VkResult res =
+      vkCreateBuffer(dev_, &buffer_create, NULL, &cache->uniform_buffer_);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkCreateBuffer failed (%d)\n", res);
+    return false;
   }
 
-  VkDescriptorSetAllocateInfo alloc_desc_set = {};
-  alloc_desc_set.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  alloc_desc_set.descriptorPool = desc_pool_;
-  alloc_desc_set.descriptorSetCount = (uint32_t)desc_layouts.size();
-  alloc_desc_set.pSetLayouts = desc_layouts.data();
+  VkMemoryRequirements mem_requirements;
+  vkGetBufferMemoryRequirements(dev_, cache->uniform_buffer_,
+                                &mem_requirements);
+
+  VkMemoryAllocateInfo mem_allocate = {};
+  mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mem_allocate.allocationSize = mem_requirements.size;
+  mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
+      mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  if (mem_allocate.memoryTypeIndex >= 32) {
+    ETRACE("Failed to find suitable uniform buffer device memory\n");
+    return false;
+  }
 
-  res = vkAllocateDescriptorSets(dev_, &alloc_desc_set, desc_sets.data());
+  res = vkAllocateMemory(dev_, &mem_allocate, NULL, &cache->uniform_memory_);
   if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateDescriptorSets failed (%d)\n", res);
+    ETRACE("vkAllocateMemory failed (%d)\n", res);
     return false;
   }
 
+  res = vkBindBufferMemory(dev_, cache->uniform_buffer_,
+                           cache->uniform_memory_, 0);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkBindBufferMemory failed (%d)\n", res);
+    return false;
+  }
+
+  res = vkMapMemory(dev_, cache->uniform_memory_, 0, size, 0,
+                    (void **)&cache->uniforms_);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkMapMemory failed (%d)\n", res);
+    return false;
+  }
+
+  cache->uniform_size_ = size;
+  return true;
+}
+
+bool VKRenderer::PrepareLayout(VKDrawCache *cache,
+                               const std::vector<RenderState> &render_states,
+                               const std::vector<VKProgram *> &programs,
+                               uint32_t frame_width, uint32_t frame_height) {
+  size_t regions = programs.size();
+  cache->recorded_ = false;
+  cache->ReleaseDescriptorSets();
+  cache->image_views_.clear();
+  cache->ub_infos_.clear();
+
+  // Sets of the previous layout come straight back from free_desc_sets_.
+  for (size_t i = 0; i < regions; i++) {
+    unsigned layer_count = render_states[i].layer_state_.size();
+    VkDescriptorSet desc_set = AcquireDescriptorSet(programs[i], layer_count);
+    if (desc_set == VK_NULL_HANDLE) {
+      cache->ReleaseDescriptorSets();
+      return false;
+    }
+
+    cache->desc_sets_.emplace_back(desc_set);
+    cache->layer_counts_.emplace_back(layer_count);
+  }
+
+  size_t align = std::max<size_t>(ub_offset_align_, 1);
+  size_t size = 0;
+  for (size_t i = 0; i < regions; i++) {
+    unsigned layer_count = cache->layer_counts_[i];
+    size_t ranges[] = {VKProgram::GetVertUBSize(layer_count),
+                       VKProgram::GetFragUBSize(layer_count)};
+    for (size_t range : ranges) {
+      VkDescriptorBufferInfo ub_info = {};
+      ub_info.offset = size;
+      ub_info.range = range;
+      cache->ub_infos_.emplace_back(ub_info);
+      size = (size + range + align - 1) / align * align;
+    }
+  }
+
+  if (size > cache->uniform_size_) {
+    size_t allocation = 4096;
+    while (allocation < size)
+      allocation *= 2;
+
+    if (!AllocateUniforms(cache, allocation)) {
+      cache->ReleaseDescriptorSets();
+      return false;
+    }
+  }
+
   std::vector<VkWriteDescriptorSet> write_desc_sets;
-  size_t src_image_infos_offset = 0;
-  for (size_t cmd_index = 0; cmd_index < render_states.size(); cmd_index++) {
-    const RenderState &state = render_states[cmd_index];
-    size_t layer_count = state.layer_state_.size();
-    VkDescriptorSet desc_set = desc_sets[cmd_index];
-
-    VkWriteDescriptorSet write_desc_set = {};
-    write_desc_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_desc_set.dstSet = desc_set;
-    write_desc_set.dstBinding = 0;
-    write_desc_set.descriptorCount = 1;
-    write_desc_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    write_desc_set.pBufferInfo = &ub_infos[cmd_index * 2 + 0];
-    write_desc_sets.emplace_back(write_desc_set);
-
-    write_desc_set = {};
-    write_desc_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_desc_set.dstSet = desc_set;
-    write_desc_set.dstBinding = 1;
-    write_desc_set.descriptorCount = 1;
-    write_desc_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    write_desc_set.pBufferInfo = &ub_infos[cmd_index * 2 + 1];
-    write_desc_sets.emplace_back(write_desc_set);
-
-    write_desc_set = {};
-    write_desc_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_desc_set.dstSet = desc_set;
-    write_desc_set.dstBinding = 2;
-    write_desc_set.descriptorCount = (uint32_t)layer_count;
-    write_desc_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    write_desc_set.pImageInfo = &src_image_infos_[src_image_infos_offset];
-    write_desc_sets.emplace_back(write_desc_set);
-
-    src_image_infos_offset += layer_count;
+  for (size_t i = 0; i < regions; i++) {
+    for (uint32_t binding = 0; binding < 2; binding++) {
+      VkDescriptorBufferInfo &ub_info = cache->ub_infos_[i * 2 + binding];
+      ub_info.buffer = cache->uniform_buffer_;
+
+      VkWriteDescriptorSet write_desc_set = {};
+      write_desc_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write_desc_set.dstSet = cache->desc_sets_[i];
+      write_desc_set.dstBinding = binding;
+      write_desc_set.descriptorCount = 1;
+      write_desc_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      write_desc_set.pBufferInfo = &ub_info;
+      write_desc_sets.emplace_back(write_desc_set);
+    }
   }
 
   vkUpdateDescriptorSets(dev_, write_desc_sets.size(), write_desc_sets.data(),
                          0, NULL);
 
-  VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
-  cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmd_buffer_alloc.commandPool = cmd_pool_;
-  cmd_buffer_alloc.commandBufferCount = 1;
+  cache->scissors_.clear();
+  for (size_t i = 0; i < regions; i++) {
+    const RenderState &state = render_states[i];
+    VkRect2D scissor = {};
+    scissor.offset = {
+        .x = (int32_t)state.x_, .y = (int32_t)state.y_,
+    };
+    scissor.extent = {
+        .width = (uint32_t)state.width_, .height = (uint32_t)state.height_,
+    };
+    cache->scissors_.emplace_back(scissor);
+  }
+
+  cache->framebuffer_ = framebuffer_;
+  cache->extent_.width = frame_width;
+  cache->extent_.height = frame_height;
+  return true;
+}
 
-  VkCommandBuffer cmd_buffer;
-  res = vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc, &cmd_buffer);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
-    return false;
+bool VKRenderer::RecordDrawCommands(VKDrawCache *cache,
+                                    const std::vector<VKProgram *> &programs) {
+  VkResult res;
+  cache->recorded_ = false;
+  if (cache->draw_cmd_buffer_ == VK_NULL_HANDLE) {
+    VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
+    cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_buffer_alloc.commandPool = cmd_pool_;
+    cmd_buffer_alloc.commandBufferCount = 1;
+
+    res = vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc,
+                                   &cache->draw_cmd_buffer_);
+    if (res != VK_SUCCESS) {
+      ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
+      cache->draw_cmd_buffer_ = VK_NULL_HANDLE;
+      return false;
+    }
   }
 
+  VkCommandBuffer cmd_buffer = cache->draw_cmd_buffer_;
+  // Submitted again by later Draws, never while still pending.
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   res = vkBeginCommandBuffer(cmd_buffer, &begin_info);
   if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
+    ETRACE("vkBeginCommandBuffer failed (%d)\n", res);
     return false;
   }
 
-  std::vector<VkImageMemoryBarrier> barrier_before_clear;
-  barrier_before_clear.emplace_back(dst_barrier_before_clear_);
-  barrier_before_clear.insert(barrier_before_clear.end(),
-                              src_barrier_before_clear_.begin(),
-                              src_barrier_before_clear_.end());
-
-  vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, NULL, 0, NULL,
-                       barrier_before_clear.size(),
-                       barrier_before_clear.data());
-
-  VkClearValue clear_value[1];
-  clear_value[0] = {};
-  clear_value[0].color.float32[0] = 0.0f;
-  clear_value[0].color.float32[1] = 0.0f;
-  clear_value[0].color.float32[2] = 0.0f;
-  clear_value[0].color.float32[3] = 0.0f;
-
-  VkExtent2D extent = {};
-  extent.width = frame_width;
-  extent.height = frame_height;
-
   VkRect2D rect = {};
-  rect.extent = extent;
+  rect.extent = cache->extent_;
 
   VkRenderPassBeginInfo pass_begin = {};
   pass_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   pass_begin.renderPass = render_pass_;
-  pass_begin.framebuffer = framebuffer_;
+  pass_begin.framebuffer = cache->framebuffer_;
   pass_begin.renderArea = rect;
-  pass_begin.clearValueCount = 1;
-  pass_begin.pClearValues = &clear_value[0];
 
   vkCmdBeginRenderPass(cmd_buffer, &pass_begin, VK_SUBPASS_CONTENTS_INLINE);
 
+  if (!cache->clear_rects_.empty()) {
+    VkClearAttachment clear_attachment = {};
+    clear_attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    clear_attachment.colorAttachment = 0;
+    clear_attachment.clearValue.color.float32[0] = 0.0f;
+    clear_attachment.clearValue.color.float32[1] = 0.0f;
+    clear_attachment.clearValue.color.float32[2] = 0.0f;
+    clear_attachment.clearValue.color.float32[3] = 0.0f;
+    vkCmdClearAttachments(cmd_buffer, 1, &clear_attachment,
+                          cache->clear_rects_.size(),
+                          cache->clear_rects_.data());
+  }
+
   VkViewport viewport = {};
-  viewport.width = (float)frame_width;
-  viewport.height = (float)frame_height;
+  viewport.width = (float)cache->extent_.width;
+  viewport.height = (float)cache->extent_.height;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
 
@@ -616,31 +751,21 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
   vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &vert_buffer_, &zero_offset);
 
   size_t last_layer_count = 0;
-  for (size_t cmd_index = 0; cmd_index < render_states.size(); cmd_index++) {
-    const RenderState &state = render_states[cmd_index];
-    size_t layer_count = state.layer_state_.size();
-    VkDescriptorSet desc_set = desc_sets[cmd_index];
-
-    VkRect2D scissor = {};
-    scissor.offset = {
-        .x = (int32_t)state.x_, .y = (int32_t)state.y_,
-    };
-    scissor.extent = {
-        .width = (uint32_t)state.width_, .height = (uint32_t)state.height_,
-    };
-
-    VKProgram *program = GetProgram(layer_count);
-    VkPipeline pipeline = program->getPipeline();
+  for (size_t cmd_index = 0; cmd_index < programs.size(); cmd_index++) {
+    size_t layer_count = cache->layer_counts_[cmd_index];
+    VKProgram *program = programs[cmd_index];
     VkPipelineLayout pipeline_layout = program->getPipeLayout();
 
     if (last_layer_count != layer_count) {
-      vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        program->getPipeline());
       last_layer_count = layer_count;
     }
 
-    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+    vkCmdSetScissor(cmd_buffer, 0, 1, &cache->scissors_[cmd_index]);
     vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipeline_layout, 0, 1, &desc_set, 0, NULL);
+                            pipeline_layout, 0, 1,
+                            &cache->desc_sets_[cmd_index], 0, NULL);
 
     vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
   }
@@ -653,10 +778,208 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
     return false;
   }
 
+  cache->recorded_ = true;
+  return true;
+}
+
+static bool SameClearRect(const VkClearRect &lhs, const VkClearRect &rhs) {
+  return lhs.rect.offset.x == rhs.rect.offset.x &&
+         lhs.rect.offset.y == rhs.rect.offset.y &&
+         lhs.rect.extent.width == rhs.rect.extent.width &&
+         lhs.rect.extent.height == rhs.rect.extent.height;
+}
+
+bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
+                      NativeSurface *surface) {
+  VkResult res;
+  uint32_t frame_width = surface->GetWidth();
+  uint32_t frame_height = surface->GetHeight();
+  // vk renderer should not support protected
+  surface->GetLayer()->SetProtected(false);
+  if (!surface->MakeCurrent())
+    return false;
+
+  VKDrawCache *cache = draw_cache_;
+  std::vector<VKProgram *> programs;
+  for (const RenderState &state : render_states) {
+    unsigned size = state.layer_state_.size();
+    if (size == 0)
+      break;
+
+    VKProgram *program = GetProgram(size);
+    if (!program)
+      return false;
+
+    programs.emplace_back(program);
+  }
+
+  // Only the parts of the damage which no region renders to, computed
+  // by Compositor. Empty if the regions cover it all.
+  clear_rects_.clear();
+  if (surface->ClearSurface() || surface->IsPartialClear()) {
+    for (const HwcRect<int> &region_rect : surface->GetClearRegion()) {
+      VkClearRect clear_rect = {};
+      clear_rect.rect.offset = {
+          .x = region_rect.left, .y = region_rect.top,
+      };
+      clear_rect.rect.extent = {
+          .width = (uint32_t)(region_rect.right - region_rect.left),
+          .height = (uint32_t)(region_rect.bottom - region_rect.top),
+      };
+      clear_rect.baseArrayLayer = 0;
+      clear_rect.layerCount = 1;
+      clear_rects_.emplace_back(clear_rect);
+    }
+  }
+
+  surface->SetClearSurface(NativeSurface::kNone);
+
+  size_t regions = programs.size();
+  bool layout_changed = !cache->recorded_ ||
+                        cache->framebuffer_ != framebuffer_ ||
+                        cache->extent_.width != frame_width ||
+                        cache->extent_.height != frame_height ||
+                        cache->layer_counts_.size() != regions;
+  for (size_t i = 0; !layout_changed && i < regions; i++) {
+    const RenderState &state = render_states[i];
+    const VkRect2D &scissor = cache->scissors_[i];
+    layout_changed = cache->layer_counts_[i] != state.layer_state_.size() ||
+                     scissor.offset.x != (int32_t)state.x_ ||
+                     scissor.offset.y != (int32_t)state.y_ ||
+                     scissor.extent.width != (uint32_t)state.width_ ||
+                     scissor.extent.height != (uint32_t)state.height_;
+  }
+
+  if (layout_changed &&
+      !PrepareLayout(cache, render_states, programs, frame_width,
+                     frame_height)) {
+    return false;
+  }
+
+  // Nothing uses the uniforms of the previous Draw any more, they are
+  // rewritten in place.
+  for (size_t i = 0; i < regions; i++) {
+    float *vert_ub =
+        (float *)(cache->uniforms_ + cache->ub_infos_[i * 2 + 0].offset);
+    float *frag_ub =
+        (float *)(cache->uniforms_ + cache->ub_infos_[i * 2 + 1].offset);
+    programs[i]->UseProgram(render_states[i], frame_width, frame_height,
+                            vert_ub, frag_ub);
+  }
+
+  src_image_infos_.clear();
+  std::vector<VkImageView> image_views;
+  for (size_t i = 0; i < regions; i++) {
+    for (const RenderState::LayerState &src : render_states[i].layer_state_) {
+      VkDescriptorImageInfo image_info = {};
+      image_info.sampler = sampler_;
+      image_info.imageView = src.handle_.image_view;
+      image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      src_image_infos_.emplace_back(image_info);
+      image_views.emplace_back(src.handle_.image_view);
+    }
+  }
+
+  bool record = layout_changed || !reuse_commands_;
+  // The clears are part of the recorded commands.
+  if (clear_rects_.size() != cache->clear_rects_.size() ||
+      !std::equal(clear_rects_.begin(), clear_rects_.end(),
+                  cache->clear_rects_.begin(), SameClearRect)) {
+    cache->clear_rects_ = clear_rects_;
+    record = true;
+  }
+
+  bool views_valid = cache->image_view_serial_ == image_view_serial_ &&
+                     cache->image_views_.size() == image_views.size();
+  if (!views_valid || image_views != cache->image_views_) {
+    std::vector<VkWriteDescriptorSet> write_desc_sets;
+    size_t src_image_infos_offset = 0;
+    for (size_t i = 0; i < regions; i++) {
+      size_t layer_count = cache->layer_counts_[i];
+      bool changed =
+          !views_valid ||
+          !std::equal(image_views.begin() + src_image_infos_offset,
+                      image_views.begin() + src_image_infos_offset +
+                          layer_count,
+                      cache->image_views_.begin() + src_image_infos_offset);
+      if (changed) {
+        VkWriteDescriptorSet write_desc_set = {};
+        write_desc_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_desc_set.dstSet = cache->desc_sets_[i];
+        write_desc_set.dstBinding = 2;
+        write_desc_set.descriptorCount = (uint32_t)layer_count;
+        write_desc_set.descriptorType =
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write_desc_set.pImageInfo = &src_image_infos_[src_image_infos_offset];
+        write_desc_sets.emplace_back(write_desc_set);
+      }
+
+      src_image_infos_offset += layer_count;
+    }
+
+    vkUpdateDescriptorSets(dev_, write_desc_sets.size(),
+                           write_desc_sets.data(), 0, NULL);
+    cache->image_views_.swap(image_views);
+    cache->image_view_serial_ = image_view_serial_;
+    // Without update after bind, this invalidated the recorded commands.
+    if (!update_after_bind_)
+      record = true;
+  }
+
+  if (record && !RecordDrawCommands(cache, programs))
+    return false;
+
+  if (cache->barrier_cmd_buffer_ == VK_NULL_HANDLE) {
+    VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
+    cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_buffer_alloc.commandPool = cmd_pool_;
+    cmd_buffer_alloc.commandBufferCount = 1;
+
+    res = vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc,
+                                   &cache->barrier_cmd_buffer_);
+    if (res != VK_SUCCESS) {
+      ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
+      cache->barrier_cmd_buffer_ = VK_NULL_HANDLE;
+      return false;
+    }
+  }
+
+  // Source images change from one Draw to the next, their transitions are
+  // recorded separately from the draws.
+  VkCommandBuffer barrier_cmd_buffer = cache->barrier_cmd_buffer_;
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  res = vkBeginCommandBuffer(barrier_cmd_buffer, &begin_info);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkBeginCommandBuffer failed (%d)\n", res);
+    return false;
+  }
+
+  std::vector<VkImageMemoryBarrier> barrier_before_clear;
+  barrier_before_clear.emplace_back(dst_barrier_before_clear_);
+  barrier_before_clear.insert(barrier_before_clear.end(),
+                              src_barrier_before_clear_.begin(),
+                              src_barrier_before_clear_.end());
+
+  vkCmdPipelineBarrier(barrier_cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, NULL, 0, NULL,
+                       barrier_before_clear.size(),
+                       barrier_before_clear.data());
+
+  res = vkEndCommandBuffer(barrier_cmd_buffer);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkEndCommandBuffer failed (%d)\n", res);
+    return false;
+  }
+
+  VkCommandBuffer cmd_buffers[] = {barrier_cmd_buffer,
+                                   cache->draw_cmd_buffer_};
   VkSubmitInfo submit = {};
   submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submit.commandBufferCount = 1;
-  submit.pCommandBuffers = &cmd_buffer;
+  submit.commandBufferCount = ARRAY_SIZE(cmd_buffers);
+  submit.pCommandBuffers = &cmd_buffers[0];
 
   res = vkQueueSubmit(queue_, 1, &submit, VK_NULL_HANDLE);
   if (res != VK_SUCCESS) {
@@ -670,15 +993,6 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
     return false;
   }
 
-  vkFreeCommandBuffers(dev_, cmd_pool_, 1, &cmd_buffer);
-
-  res = vkFreeDescriptorSets(dev_, desc_pool_, desc_sets.size(),
-                             desc_sets.data());
-  if (res != VK_SUCCESS) {
-    ETRACE("vkFreeDescriptorSets failed (%d)\n", res);
-    return false;
-  }
-
   return true;
 }
 
@@ -696,11 +1010,12 @@ VKProgram *VKRenderer::GetProgram(unsigned texture_count) {
   }
 
   std::unique_ptr<VKProgram> program(new VKProgram());
-  if (program->Init(texture_count)) {
+  if (program->Init(texture_count, update_after_bind_)) {
     if (programs_.size() < texture_count)
       programs_.resize(texture_count);
 
     programs_[texture_count - 1] = std::move(program);
+    pipeline_cache_file_.Store();
     return programs_[texture_count - 1].get();
   }
 
@@ -18,6 +18,7 @@
 #include <memory>
 
 #include "renderer.h"
+#include "vkpipelinecache.h"
 #include "vkprogram.h"
 #include "vkshim.h"
 
@@ -34,19 +35,52 @@ class VKRenderer : public Renderer {
   void InsertFence(int32_t kms_fence) override;
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
 
+  // Submits the commands recorded by the last Draw into a surface again
+  // while its regions keep the same geometry. On by default, turning it
+  // off records them for every Draw.
+  void EnableCommandReuse(bool enable) {
+    reuse_commands_ = enable;
+  }
+
+  // Whether textures of recorded commands can be changed without
+  // recording them again.
+  bool UsesUpdateAfterBind() const {
+    return update_after_bind_;
+  }
+
+  // Size of the pipeline cache data loaded from disk by Init.
+  size_t GetLoadedPipelineCacheSize() const {
+    return pipeline_cache_file_.GetLoadedSize();
+  }
+
  private:
   VKProgram *GetProgram(unsigned texture_count);
   uint32_t GetMemoryTypeIndex(uint32_t mem_type_bits, uint32_t required_props);
   VkBuffer UploadBuffer(size_t data_size, const uint8_t *data,
                         VkBufferUsageFlags usage);
+  bool CreateDescriptorPool();
+  VkDescriptorSet AcquireDescriptorSet(VKProgram *program,
+                                       unsigned texture_count);
+  bool AllocateUniforms(VKDrawCache *cache, size_t size);
+  bool PrepareLayout(VKDrawCache *cache,
+                     const std::vector<RenderState> &render_states,
+                     const std::vector<VKProgram *> &programs,
+                     uint32_t frame_width, uint32_t frame_height);
+  bool RecordDrawCommands(VKDrawCache *cache,
+                          const std::vector<VKProgram *> &programs);
 
   VkPhysicalDeviceProperties device_props_;
   VkPhysicalDeviceMemoryProperties device_mem_props_;
-  VkDeviceMemory uniform_buffer_mem_;
-  VkDescriptorPool desc_pool_;
-  VkCommandPool cmd_pool_;
+  // Descriptor sets are never freed but recycled through free_desc_sets_,
+  // a new pool is added once the last one is exhausted.
+  std::vector<VkDescriptorPool> desc_pools_;
   VkQueue queue_;
   VkBuffer vert_buffer_;
+  VKPipelineCache pipeline_cache_file_;
+  bool update_after_bind_ = false;
+  bool reuse_commands_ = true;
+  // Clear rects of the surface being drawn.
+  std::vector<VkClearRect> clear_rects_;
 
   std::vector<std::unique_ptr<VKProgram>> programs_;
 };
@@ -22,100 +22,62 @@ VkDevice dev_;
 VkInstance inst_;
 VkRenderPass render_pass_;
 VkPipelineCache pipeline_cache_;
-VkBuffer uniform_buffer_;
+VkCommandPool cmd_pool_;
 VkSampler sampler_;
 std::vector<VkImage> src_images_;
 std::vector<VkImageView> src_image_views_;
+uint32_t image_view_serial_;
 std::vector<VkDescriptorImageInfo> src_image_infos_;
-RingBuffer ring_buffer_;
-std::vector<RingBuffer::Allocation> ub_allocs_;
 size_t ub_offset_align_;
 std::vector<VkImageMemoryBarrier> src_barrier_before_clear_;
 VkImageMemoryBarrier dst_barrier_before_clear_;
 VkFramebuffer framebuffer_;
+VKDrawCache *draw_cache_;
+std::vector<std::vector<VkDescriptorSet>> free_desc_sets_;
 
-RingBuffer::Allocation RingBuffer::Allocate(size_t size, size_t alignment) {
-  if (size > buffer_size_)
-    return Allocation();
-
-  size_t base = write_offset_;
-  size_t padding = ((alignment - (base & (alignment - 1))) & (alignment - 1));
-  size_t jump = padding + size;
-  if (base + padding + size > buffer_size_) {
-    base = 0;
-    padding = 0;
-    jump = buffer_size_ - write_offset_ + size;
-  }
-
-  if (IsSpanInUse(base, size)) {
-    return Allocation();
-  }
-
-  jump_queue_.emplace_back(base + padding, jump);
-
-  write_offset_ += jump;
-  write_offset_ %= buffer_size_;
-
-  return Allocation(this, buffer_ + base + padding);
+VKDrawCache::~VKDrawCache() {
+  Reset();
 }
 
-void RingBuffer::Free(uint8_t *ptr) {
-  size_t base = ptr - buffer_;
-  bool found = false;
-  for (jump_entry_t &entry : jump_queue_) {
-    if (entry.base == base) {
-      entry.free = true;
-      found = true;
-      break;
-    }
-  }
-
-  auto it = jump_queue_.begin();
-  for (; it != jump_queue_.end(); ++it) {
-    if (!it->free)
-      break;
-    read_offset_ += it->jump;
-    read_offset_ %= buffer_size_;
-  }
-
-  jump_queue_.erase(jump_queue_.begin(), it);
-
-  if (jump_queue_.empty()) {
-    write_offset_ = 0;
-    read_offset_ = 0;
+void VKDrawCache::Reset() {
+  VkCommandBuffer cmd_buffers[] = {barrier_cmd_buffer_, draw_cmd_buffer_};
+  for (VkCommandBuffer cmd_buffer : cmd_buffers) {
+    if (cmd_buffer != VK_NULL_HANDLE)
+      vkFreeCommandBuffers(dev_, cmd_pool_, 1, &cmd_buffer);
   }
+  barrier_cmd_buffer_ = VK_NULL_HANDLE;
+  draw_cmd_buffer_ = VK_NULL_HANDLE;
+  recorded_ = false;
+
+  ReleaseDescriptorSets();
+  scissors_.clear();
+  clear_rects_.clear();
+  image_views_.clear();
+  ub_infos_.clear();
+  framebuffer_ = VK_NULL_HANDLE;
+  ReleaseUniforms();
+}
 
-#ifndef NDEBUG
-  if (!jump_queue_.empty()) {
-    auto next = jump_queue_.front();
+void VKDrawCache::ReleaseDescriptorSets() {
+  for (size_t i = 0; i < desc_sets_.size(); i++) {
+    uint32_t layer_count = layer_counts_.at(i);
+    if (free_desc_sets_.size() < layer_count)
+      free_desc_sets_.resize(layer_count);
+    free_desc_sets_[layer_count - 1].emplace_back(desc_sets_[i]);
   }
-#endif
+  desc_sets_.clear();
+  layer_counts_.clear();
 }
 
-bool RingBuffer::IsSpanInUse(size_t first, size_t size) {
-  if (jump_queue_.empty())
-    return false;
-
-  size_t last = first + size - 1;
-
-  size_t use_first = read_offset_;
-  size_t use_last = (write_offset_ == 0 ? buffer_size_ : write_offset_) - 1;
-  if (use_last < use_first)
-    use_last += buffer_size_;
-
-  if (first <= use_first && last >= use_first)
-    return true;
-
-  if (first <= use_last && last >= use_last)
-    return true;
-
-  if (use_first <= first && use_last >= first)
-    return true;
-
-  if (use_first <= last && use_last >= last)
-    return true;
-
-  return false;
+void VKDrawCache::ReleaseUniforms() {
+  if (uniform_memory_ != VK_NULL_HANDLE)
+    vkUnmapMemory(dev_, uniform_memory_);
+  vkDestroyBuffer(dev_, uniform_buffer_, NULL);
+  vkFreeMemory(dev_, uniform_memory_, NULL);
+  uniform_buffer_ = VK_NULL_HANDLE;
+  uniform_memory_ = VK_NULL_HANDLE;
+  uniforms_ = nullptr;
+  uniform_size_ = 0;
 }
 
 }  // namespace hwcomposer
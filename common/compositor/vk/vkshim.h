@@ -23,123 +23,73 @@
 
 namespace hwcomposer {
 
-// Generic ring buffer that always allocates contiguous regions. Chunks can be
-// freed in any order, but the in flight pointer (read_offset_) only advances
-// when the oldest in flight chunk is free. It's optimized. for the case where
-// the oldest chunks are the first to be freed, but this is not strictly
-// required. Returned Allocation objects automatically free themselves when they
-// go out of scope.
-class RingBuffer {
+// Commands and descriptors of the last Draw into a surface. The commands
+// are submitted again for as long as the regions drawn keep the same
+// geometry; uniforms are rewritten in place at fixed offsets of a buffer
+// of the surface. Descriptor sets go back to free_desc_sets_ on Reset.
+class VKDrawCache {
  public:
-  class Allocation {
-   public:
-    Allocation() = default;
-    Allocation(RingBuffer *parent, uint8_t *ptr) {
-      parent_ = parent;
-      ptr_ = ptr;
-    }
-    Allocation(Allocation &&rhs) noexcept {
-      parent_ = rhs.parent_;
-      ptr_ = rhs.ptr_;
-      rhs.parent_ = nullptr;
-      rhs.ptr_ = nullptr;
-    }
-
-    ~Allocation() {
-      CheckedFree();
-    }
-
-    Allocation &operator=(Allocation &&rhs) noexcept {
-      if (&rhs == this)
-        return *this;
-      CheckedFree();
-
-      parent_ = rhs.parent_;
-      ptr_ = rhs.ptr_;
-      rhs.parent_ = nullptr;
-      rhs.ptr_ = nullptr;
-
-      return *this;
-    }
-
-    explicit operator bool() const {
-      return ptr_ != nullptr && parent_ != nullptr;
-    }
-
-    uint8_t *ptr() {
-      return ptr_;
-    }
-
-    template <typename T>
-    T *get() {
-      return (T *)ptr_;
-    }
-
-    size_t offset() const {
-      return ptr_ - parent_->buffer_;
-    }
-
-   private:
-    RingBuffer *parent_ = nullptr;
-    uint8_t *ptr_ = nullptr;
-
-    void CheckedFree() {
-      if (parent_ && ptr_)
-        parent_->Free(ptr_);
-    }
-  };
-
-  RingBuffer() = default;
-  RingBuffer(uint8_t *buffer, size_t buffer_size)
-      : buffer_(buffer), buffer_size_(buffer_size) {
-  }
-
-  explicit operator bool() const {
-    return buffer_ != nullptr;
-  }
-
-  uint8_t *get() {
-    return buffer_;
-  }
-
-  // If succesful, the returned allocation's offset within the ring buffer will
-  // be aligned, but the allocation's pointer may not be. alignment must be a
-  // power of two.
-  Allocation Allocate(size_t size, size_t alignment);
-
- private:
-  uint8_t *buffer_ = nullptr;
-  size_t buffer_size_ = 0;
-  size_t read_offset_ = 0;
-  size_t write_offset_ = 0;
-  struct jump_entry_t {
-    size_t base;
-    size_t jump;
-    bool free = false;
-    jump_entry_t(size_t b, size_t j) : base(b), jump(j) {
-    }
-  };
-  std::vector<jump_entry_t> jump_queue_;
-
-  bool IsSpanInUse(size_t first, size_t size);
-  void Free(uint8_t *ptr);
+  VKDrawCache() = default;
+  ~VKDrawCache();
+  VKDrawCache(const VKDrawCache &) = delete;
+  VKDrawCache &operator=(const VKDrawCache &) = delete;
+
+  // Releases everything, the next Draw records the commands again.
+  void Reset();
+
+  // Hands desc_sets_ back to free_desc_sets_.
+  void ReleaseDescriptorSets();
+
+  void ReleaseUniforms();
+
+  // Recorded for every Draw, transitions the images used.
+  VkCommandBuffer barrier_cmd_buffer_ = VK_NULL_HANDLE;
+  VkCommandBuffer draw_cmd_buffer_ = VK_NULL_HANDLE;
+  bool recorded_ = false;
+
+  // Geometry draw_cmd_buffer_ was recorded for, one entry per region.
+  VkFramebuffer framebuffer_ = VK_NULL_HANDLE;
+  VkExtent2D extent_ = {};
+  std::vector<VkRect2D> scissors_;
+  std::vector<uint32_t> layer_counts_;
+  // Parts of the framebuffer cleared before the regions are drawn.
+  std::vector<VkClearRect> clear_rects_;
+
+  std::vector<VkDescriptorSet> desc_sets_;
+  // Image views last written to desc_sets_, in region order, and the
+  // image_view_serial_ they were written at.
+  std::vector<VkImageView> image_views_;
+  uint32_t image_view_serial_ = 0;
+  // Vertex and fragment uniforms of every region.
+  std::vector<VkDescriptorBufferInfo> ub_infos_;
+
+  VkBuffer uniform_buffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory uniform_memory_ = VK_NULL_HANDLE;
+  uint8_t *uniforms_ = nullptr;
+  size_t uniform_size_ = 0;
 };
 
 extern VkDevice dev_;
 extern VkInstance inst_;
 extern VkRenderPass render_pass_;
 extern VkPipelineCache pipeline_cache_;
-extern VkBuffer uniform_buffer_;
+extern VkCommandPool cmd_pool_;
 extern VkSampler sampler_;
 extern std::vector<VkImage> src_images_;
 extern std::vector<VkImageView> src_image_views_;
+// Bumped whenever source image views are destroyed, so that a handle
+// reused by the driver isn't mistaken for a view already written to a
+// VKDrawCache.
+extern uint32_t image_view_serial_;
 extern std::vector<VkDescriptorImageInfo> src_image_infos_;
-extern RingBuffer ring_buffer_;
-extern std::vector<RingBuffer::Allocation> ub_allocs_;
 extern size_t ub_offset_align_;
 extern std::vector<VkImageMemoryBarrier> src_barrier_before_clear_;
 extern VkImageMemoryBarrier dst_barrier_before_clear_;
 extern VkFramebuffer framebuffer_;
+extern VKDrawCache *draw_cache_;
+// Descriptor sets of programs with i + 1 textures, not used by any
+// VKDrawCache.
+extern std::vector<std::vector<VkDescriptorSet>> free_desc_sets_;
 
 }  // namespace hwcomposer
 
@@ -50,18 +50,16 @@ bool VKSurface::InitializeGPUResources() {
   clear_range.levelCount = 1;
   clear_range.layerCount = 1;
 
-  dst_barrier_before_clear_ = {};
-  dst_barrier_before_clear_.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  dst_barrier_before_clear_.srcAccessMask = 0;
-  dst_barrier_before_clear_.dstAccessMask =
-      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dst_barrier_before_clear_.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  dst_barrier_before_clear_.newLayout =
-      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  dst_barrier_before_clear_.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  dst_barrier_before_clear_.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  dst_barrier_before_clear_.image = image_;
-  dst_barrier_before_clear_.subresourceRange = clear_range;
+  barrier_before_clear_ = {};
+  barrier_before_clear_.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier_before_clear_.srcAccessMask = 0;
+  barrier_before_clear_.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier_before_clear_.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier_before_clear_.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  barrier_before_clear_.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier_before_clear_.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier_before_clear_.image = image_;
+  barrier_before_clear_.subresourceRange = clear_range;
 
   VkImageViewCreateInfo view_create = {};
   view_create.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -109,6 +107,11 @@ bool VKSurface::MakeCurrent() {
   }
 
   framebuffer_ = surface_fb_;
+  dst_barrier_before_clear_ = barrier_before_clear_;
+  // Render passes load the image, keep its contents from the previous
+  // Draw, which left it ready for scanout.
+  barrier_before_clear_.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  draw_cache_ = &cache_;
 
   return true;
 }
@@ -36,6 +36,8 @@ class VKSurface : public NativeSurface {
   VkImage image_;
   VkImageView image_view_;
   VkFramebuffer surface_fb_;
+  VkImageMemoryBarrier barrier_before_clear_;
+  VKDrawCache cache_;
 };
 
 }  // namespace hwcomposer
@@ -18,6 +18,7 @@
 
 #include <sys/file.h>
 
+#include "compositorpool.h"
 #include "mosaicdisplay.h"
 
 #include "hwctrace.h"
@@ -314,7 +315,9 @@ void GpuDevice::HandleHWCSettings() {
 
   bool use_logical = false;
   bool use_mosaic = false;
+  bool parallel_mosaic = false;
   bool use_cloned = false;
+  bool scaled_clones = false;
   bool rotate_display = false;
   bool use_float = false;
   std::vector<uint32_t> logical_displays;
@@ -340,9 +343,11 @@ void GpuDevice::HandleHWCSettings() {
   std::string key_plane_reserved("PLANE_RESERVED");
   std::string key_logical_display("LOGICAL_DISPLAY");
   std::string key_mosaic_display("MOSAIC_DISPLAY");
+  std::string key_mosaic_parallel("MOSAIC_PARALLEL_PRESENT");
   std::string key_physical_display("PHYSICAL_DISPLAY");
   std::string key_physical_display_rotation("PHYSICAL_DISPLAY_ROTATION");
   std::string key_clone_display("CLONE_DISPLAY");
+  std::string key_clone_scaled("CLONE_SCALED");
   std::string key_float_display("FLOAT_DISPLAY");
 #ifdef ENABLE_PANORAMA
   std::string key_panorama("PANORAMA");
@@ -351,6 +356,7 @@ void GpuDevice::HandleHWCSettings() {
 #endif
 
   std::string key_reserved_drm_plane("DRM_PLANE_RESERVED");
+  std::string key_compositor_threads("COMPOSITOR_THREADS");
 
   std::vector<uint32_t> mosaic_duplicate_check;
   std::vector<uint32_t> clone_duplicate_check;
@@ -380,6 +386,11 @@ void GpuDevice::HandleHWCSettings() {
           if (!value.compare(enable_str)) {
             use_mosaic = true;
           }
+          // Got parallel mosaic present switch
+        } else if (!key.compare(key_mosaic_parallel)) {
+          if (!value.compare(enable_str)) {
+            parallel_mosaic = true;
+          }
 #ifdef ENABLE_PANORAMA
           // Got panorama switch
         } else if (!key.compare(key_panorama)) {
@@ -392,6 +403,11 @@ void GpuDevice::HandleHWCSettings() {
           if (!value.compare(enable_str)) {
             use_cloned = true;
           }
+          // Got scaled clone switch
+        } else if (!key.compare(key_clone_scaled)) {
+          if (!value.compare(enable_str)) {
+            scaled_clones = true;
+          }
           // Got rotation switch.
         } else if (!key.compare(key_rotate)) {
           if (!value.compare(enable_str)) {
@@ -406,6 +422,14 @@ void GpuDevice::HandleHWCSettings() {
           if (!value.compare(enable_str)) {
             reserve_plane_ = true;
           }
+          // Got size of the shared compositor pool
+        } else if (!key.compare(key_compositor_threads)) {
+          if (value.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+
+          uint32_t compositor_threads = atoi(value.c_str());
+          if (compositor_threads > 0 && !compositor_pool_)
+            compositor_pool_.reset(new CompositorPool(compositor_threads));
         } else if (!key.compare(key_logical_display)) {
           std::string physical_index_str;
           std::istringstream i_value(value);
@@ -742,6 +766,7 @@ void GpuDevice::HandleHWCSettings() {
             if (i_available_mosaic_displays.size() > 0) {
               std::unique_ptr<MosaicDisplay> mosaic(
                   new MosaicDisplay(i_available_mosaic_displays));
+              mosaic->SetParallelPresent(parallel_mosaic);
               mosaic_displays_.emplace_back(std::move(mosaic));
               // Save the mosaic to the final displays list
               total_displays_.emplace_back(mosaic_displays_.back().get());
@@ -783,6 +808,8 @@ void GpuDevice::HandleHWCSettings() {
       for (size_t clone = 1; clone < c_size; clone++) {
         total_displays_.at(temp.at(clone))->CloneDisplay(physical_display);
       }
+
+      physical_display->SetScaledClones(scaled_clones);
     }
 
     for (size_t t = 0; t < displays_size; t++) {
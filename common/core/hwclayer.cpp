@@ -108,6 +108,7 @@ void HwcLayer::SetSurfaceDamage(const HwcRegion& surface_damage) {
   state_ |= kLayerContentChanged;
   HwcRect<int> rect;
   ResetRectToRegion(surface_damage, rect);
+  HwcRegion region;
   if (rects == 1) {
     if ((rect.top == 0) && (rect.bottom == 0) && (rect.left == 0) &&
         (rect.right == 0)) {
@@ -115,6 +116,7 @@ void HwcLayer::SetSurfaceDamage(const HwcRegion& surface_damage) {
       state_ &= ~kSurfaceDamageChanged;
       UpdateRenderingDamage(rect, rect, true);
       surface_damage_.reset();
+      surface_damage_region_.clear();
       return;
     } else {
       state_ |= kSurfaceDamageChanged;
@@ -124,15 +126,23 @@ void HwcLayer::SetSurfaceDamage(const HwcRegion& surface_damage) {
     state_ &= ~kSurfaceDamageChanged;
   }
 
+  if (rects == 0) {
+    AddRectToRegion(rect, region);
+  } else {
+    CalculateRegion(surface_damage, region);
+  }
+
   if ((surface_damage_.left == rect.left) &&
       (surface_damage_.top == rect.top) &&
       (surface_damage_.right == rect.right) &&
-      (surface_damage_.bottom == rect.bottom)) {
+      (surface_damage_.bottom == rect.bottom) &&
+      (surface_damage_region_ == region)) {
     return;
   }
 
-  UpdateRenderingDamage(surface_damage_, rect, false);
+  UpdateRenderingDamage(surface_damage_region_, region);
   surface_damage_ = rect;
+  surface_damage_region_.swap(region);
 }
 
 void HwcLayer::SetVisibleRegion(const HwcRegion& visible_region) {
@@ -219,10 +229,6 @@ int32_t HwcLayer::GetAcquireFence() {
 }
 
 void HwcLayer::SufaceDamageTransfrom() {
-  int ox = 0, oy = 0;
-  HwcRect<int> translated_damage =
-      TranslateRect(surface_damage_, -source_crop_.left, -source_crop_.top);
-
   // From observation: In Android, when the source crop is not (0, 0),
   // the surface damage is already translated to global display coordinate.
   // Therefore, no translation is needed.
@@ -250,62 +256,14 @@ void HwcLayer::SufaceDamageTransfrom() {
                      source_crop_.top, (source_crop_.right - source_crop_.left),
                      (source_crop_.bottom - source_crop_.top));
 #endif
-    int display_width = display_frame_.right - display_frame_.left;
-    int display_height = display_frame_.bottom - display_frame_.top;
-    int source_width = source_crop_.right - source_crop_.left;
-    int source_height = source_crop_.bottom - source_crop_.top;
-
-    float ratiow = display_width * 1.0 / source_width;
-    float ratioh = display_height * 1.0 / source_height;
-    translated_damage.left = translated_damage.left * ratiow + 0.5;
-    translated_damage.right = translated_damage.right * ratiow + 0.5;
-    translated_damage.top = translated_damage.top * ratioh + 0.5;
-    translated_damage.bottom = translated_damage.bottom * ratioh + 0.5;
-
-    if (transform_ == hwcomposer::HWCTransform::kTransform270) {
-      ox = display_frame_.left;
-      oy = display_frame_.bottom;
-      current_rendering_damage_.left = ox + translated_damage.top;
-      current_rendering_damage_.top = oy - translated_damage.right;
-      current_rendering_damage_.right = ox + translated_damage.bottom;
-      current_rendering_damage_.bottom = oy - translated_damage.left;
-    } else if (transform_ == hwcomposer::HWCTransform::kTransform180) {
-      ox = display_frame_.right;
-      oy = display_frame_.bottom;
-      current_rendering_damage_.left = ox - translated_damage.right;
-      current_rendering_damage_.top = oy - translated_damage.bottom;
-      current_rendering_damage_.right = ox - translated_damage.left;
-      current_rendering_damage_.bottom = oy - translated_damage.top;
-    } else if (transform_ & hwcomposer::HWCTransform::kTransform90) {
-      if (transform_ & hwcomposer::HWCTransform::kReflectX) {
-        ox = display_frame_.left;
-        oy = display_frame_.top;
-        current_rendering_damage_.left = ox + translated_damage.top;
-        current_rendering_damage_.top = oy + translated_damage.left;
-        current_rendering_damage_.right = ox + translated_damage.bottom;
-        current_rendering_damage_.bottom = oy + translated_damage.right;
-      } else if (transform_ & hwcomposer::HWCTransform::kReflectY) {
-        ox = display_frame_.right;
-        oy = display_frame_.bottom;
-        current_rendering_damage_.left = ox - translated_damage.bottom;
-        current_rendering_damage_.top = oy - translated_damage.right;
-        current_rendering_damage_.right = ox - translated_damage.top;
-        current_rendering_damage_.bottom = oy - translated_damage.left;
-      } else {
-        ox = display_frame_.right;
-        oy = display_frame_.top;
-        current_rendering_damage_.left = ox - translated_damage.bottom;
-        current_rendering_damage_.top = oy + translated_damage.left;
-        current_rendering_damage_.right = ox - translated_damage.top;
-        current_rendering_damage_.bottom = oy + translated_damage.right;
-      }
-    } else if (transform_ == 0) {
-      ox = display_frame_.left;
-      oy = display_frame_.top;
-      current_rendering_damage_.left = ox + translated_damage.left;
-      current_rendering_damage_.top = oy + translated_damage.top;
-      current_rendering_damage_.right = ox + translated_damage.right;
-      current_rendering_damage_.bottom = oy + translated_damage.bottom;
+    if (!TransformDamageRect(surface_damage_, current_rendering_damage_))
+      return;
+
+    current_rendering_damage_region_.clear();
+    for (const HwcRect<int>& damage : surface_damage_region_) {
+      HwcRect<int> rendering_damage;
+      TransformDamageRect(damage, rendering_damage);
+      AddRectToRegion(rendering_damage, current_rendering_damage_region_);
     }
 #ifdef RECT_DAMAGE_TRACING
     IRECTDAMAGETRACE(
@@ -317,6 +275,75 @@ void HwcLayer::SufaceDamageTransfrom() {
   }
 }
 
+bool HwcLayer::TransformDamageRect(const HwcRect<int>& damage,
+                                   HwcRect<int>& rendering_damage) const {
+  int ox = 0, oy = 0;
+  HwcRect<int> translated_damage =
+      TranslateRect(damage, -source_crop_.left, -source_crop_.top);
+
+  int display_width = display_frame_.right - display_frame_.left;
+  int display_height = display_frame_.bottom - display_frame_.top;
+  int source_width = source_crop_.right - source_crop_.left;
+  int source_height = source_crop_.bottom - source_crop_.top;
+
+  float ratiow = display_width * 1.0 / source_width;
+  float ratioh = display_height * 1.0 / source_height;
+  translated_damage.left = translated_damage.left * ratiow + 0.5;
+  translated_damage.right = translated_damage.right * ratiow + 0.5;
+  translated_damage.top = translated_damage.top * ratioh + 0.5;
+  translated_damage.bottom = translated_damage.bottom * ratioh + 0.5;
+
+  if (transform_ == hwcomposer::HWCTransform::kTransform270) {
+    ox = display_frame_.left;
+    oy = display_frame_.bottom;
+    rendering_damage.left = ox + translated_damage.top;
+    rendering_damage.top = oy - translated_damage.right;
+    rendering_damage.right = ox + translated_damage.bottom;
+    rendering_damage.bottom = oy - translated_damage.left;
+  } else if (transform_ == hwcomposer::HWCTransform::kTransform180) {
+    ox = display_frame_.right;
+    oy = display_frame_.bottom;
+    rendering_damage.left = ox - translated_damage.right;
+    rendering_damage.top = oy - translated_damage.bottom;
+    rendering_damage.right = ox - translated_damage.left;
+    rendering_damage.bottom = oy - translated_damage.top;
+  } else if (transform_ & hwcomposer::HWCTransform::kTransform90) {
+    if (transform_ & hwcomposer::HWCTransform::kReflectX) {
+      ox = display_frame_.left;
+      oy = display_frame_.top;
+      rendering_damage.left = ox + translated_damage.top;
+      rendering_damage.top = oy + translated_damage.left;
+      rendering_damage.right = ox + translated_damage.bottom;
+      rendering_damage.bottom = oy + translated_damage.right;
+    } else if (transform_ & hwcomposer::HWCTransform::kReflectY) {
+      ox = display_frame_.right;
+      oy = display_frame_.bottom;
+      rendering_damage.left = ox - translated_damage.bottom;
+      rendering_damage.top = oy - translated_damage.right;
+      rendering_damage.right = ox - translated_damage.top;
+      rendering_damage.bottom = oy - translated_damage.left;
+    } else {
+      ox = display_frame_.right;
+      oy = display_frame_.top;
+      rendering_damage.left = ox - translated_damage.bottom;
+      rendering_damage.top = oy + translated_damage.left;
+      rendering_damage.right = ox - translated_damage.top;
+      rendering_damage.bottom = oy + translated_damage.right;
+    }
+  } else if (transform_ == 0) {
+    ox = display_frame_.left;
+    oy = display_frame_.top;
+    rendering_damage.left = ox + translated_damage.left;
+    rendering_damage.top = oy + translated_damage.top;
+    rendering_damage.right = ox + translated_damage.right;
+    rendering_damage.bottom = oy + translated_damage.bottom;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
 void HwcLayer::Validate() {
   if (total_displays_ == 1) {
     state_ &= ~kVisibleRegionChanged;
@@ -332,6 +359,10 @@ void HwcLayer::Validate() {
     }
   }
 
+  ResetConstraints();
+}
+
+void HwcLayer::ResetConstraints() {
   if (left_constraint_.empty() && left_source_constraint_.empty())
     return;
 
@@ -465,10 +496,23 @@ void HwcLayer::UpdateRenderingDamage(const HwcRect<int>& old_rect,
     CalculateRect(old_rect, current_rendering_damage_);
   }
 
+  AddRectToRegion(old_rect, current_rendering_damage_region_);
   if (same_rect)
     return;
 
   CalculateRect(newrect, current_rendering_damage_);
+  AddRectToRegion(newrect, current_rendering_damage_region_);
+}
+
+void HwcLayer::UpdateRenderingDamage(const HwcRegion& old_region,
+                                     const HwcRegion& new_region) {
+  for (const HwcRect<int>& rect : old_region) {
+    UpdateRenderingDamage(rect, rect, true);
+  }
+
+  for (const HwcRect<int>& rect : new_region) {
+    UpdateRenderingDamage(rect, rect, true);
+  }
 }
 
 const HwcRect<int>& HwcLayer::GetLayerDamage() {
@@ -159,6 +159,26 @@ void LogicalDisplay::SetDisableExplicitSync(bool disable_explicit_sync) {
   physical_display_->SetDisableExplicitSync(disable_explicit_sync);
 }
 
+void LogicalDisplay::SetLateLatching(bool enable) {
+  physical_display_->SetLateLatching(enable);
+}
+
+void LogicalDisplay::WaitForLatch() {
+  physical_display_->WaitForLatch();
+}
+
+uint32_t LogicalDisplay::GetMissedPresentDeadlines() {
+  return physical_display_->GetMissedPresentDeadlines();
+}
+
+bool LogicalDisplay::GetFrameStats(HwcFrameStats *stats) {
+  return physical_display_->GetFrameStats(stats);
+}
+
+void LogicalDisplay::ResetFrameStats() {
+  physical_display_->ResetFrameStats();
+}
+
 void LogicalDisplay::SetVideoScalingMode(uint32_t mode) {
   physical_display_->SetVideoScalingMode(mode);
 }
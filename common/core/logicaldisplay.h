@@ -76,6 +76,11 @@ class LogicalDisplay : public NativeDisplay {
   void SetContrast(uint32_t red, uint32_t green, uint32_t blue) override;
   void SetBrightness(uint32_t red, uint32_t green, uint32_t blue) override;
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
+  void SetLateLatching(bool enable) override;
+  void WaitForLatch() override;
+  uint32_t GetMissedPresentDeadlines() override;
+  bool GetFrameStats(HwcFrameStats *stats) override;
+  void ResetFrameStats() override;
   void SetVideoScalingMode(uint32_t mode) override;
   void SetVideoColor(HWCColorControl color, float value) override;
   void GetVideoColor(HWCColorControl color, float *value, float *start,
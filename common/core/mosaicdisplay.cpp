@@ -17,12 +17,15 @@
 #include "mosaicdisplay.h"
 
 #include <libsync.h>
+#include <atomic>
 #include <sstream>
 #include <string>
 
 #include <hwclayer.h>
 
+#include "hwcthread.h"
 #include "hwctrace.h"
+#include "presentsequencer.h"
 
 namespace hwcomposer {
 
@@ -65,6 +68,124 @@ class MDHotPlugCallback : public hwcomposer::HotPlugCallback {
   MosaicDisplay *display_;
 };
 
+// Presents one of the displays of a mosaic, with the layers and
+// constraints it got for the current frame.
+class MosaicPresentWorker : public HWCThread {
+ public:
+  MosaicPresentWorker() : HWCThread(-8, "MosaicPresentWorker") {
+  }
+
+  ~MosaicPresentWorker() override {
+    HWCThread::Exit();
+  }
+
+  bool Start() {
+    if (initialized_)
+      return true;
+
+    if (!done_.Initialize())
+      return false;
+
+    return InitWorker();
+  }
+
+  std::vector<HwcLayer *> &GetLayers() {
+    return layers_;
+  }
+
+  // Sets up the next frame of display, the index-th presented one.
+  void SetUp(NativeDisplay *display, PixelUploaderCallback *call_back,
+             uint32_t index) {
+    display_ = display;
+    call_back_ = call_back;
+    sequencer_ = NULL;
+    index_ = index;
+  }
+
+  // Lets display be presented concurrently with the others of sequencer.
+  void SetSequencer(PresentSequencer *sequencer) {
+    sequencer_ = sequencer;
+  }
+
+  void SetConstraints(int32_t left, int32_t right, int32_t left_source,
+                      int32_t right_source, uint32_t total_displays) {
+    left_constraint_ = left;
+    right_constraint_ = right;
+    left_source_constraint_ = left_source;
+    right_source_constraint_ = right_source;
+    total_displays_ = total_displays;
+  }
+
+  // Presents on the calling thread.
+  void Present() {
+    // Not while holding up the other displays.
+    display_->WaitForLatch();
+    PresentTurn turn(sequencer_, index_);
+    turn.BeginPrepare();
+    for (HwcLayer *layer : layers_) {
+      // Anything left by a display which didn't validate its layers.
+      layer->ResetConstraints();
+      layer->SetLeftConstraint(left_constraint_);
+      layer->SetRightConstraint(right_constraint_);
+      layer->SetLeftSourceConstraint(left_source_constraint_);
+      layer->SetRightSourceConstraint(right_source_constraint_);
+      layer->SetTotalDisplays(total_displays_);
+    }
+
+    retire_fence_ = -1;
+    if (sequencer_)
+      display_->SetPresentTurn(&turn);
+
+    display_->Present(layers_, &retire_fence_, call_back_, true);
+    IMOSAICDISPLAYTRACE("Present called for Display index %d \n", index_);
+    if (sequencer_)
+      display_->SetPresentTurn(NULL);
+  }
+
+  // Presents on our thread. Needs to be followed by Wait.
+  void PresentAsync() {
+    pending_ = true;
+    queued_.store(true);
+    Resume();
+  }
+
+  // Returns the retire fence of the last Present.
+  int32_t Wait() {
+    if (pending_) {
+      done_.Wait();
+      pending_ = false;
+    }
+
+    return retire_fence_;
+  }
+
+ protected:
+  void HandleRoutine() override {
+    if (!queued_.exchange(false))
+      return;
+
+    Present();
+    done_.Signal();
+  }
+
+ private:
+  NativeDisplay *display_ = NULL;
+  PixelUploaderCallback *call_back_ = NULL;
+  PresentSequencer *sequencer_ = NULL;
+  uint32_t index_ = 0;
+  std::vector<HwcLayer *> layers_;
+  int32_t left_constraint_ = 0;
+  int32_t right_constraint_ = 0;
+  int32_t left_source_constraint_ = 0;
+  int32_t right_source_constraint_ = 0;
+  uint32_t total_displays_ = 1;
+  int32_t retire_fence_ = -1;
+  // Only used by the thread owning us.
+  bool pending_ = false;
+  std::atomic<bool> queued_{false};
+  HWCEvent done_;
+};
+
 MosaicDisplay::MosaicDisplay(const std::vector<NativeDisplay *> &displays)
     : dpix_(0), dpiy_(0) {
   uint32_t size = displays.size();
@@ -176,10 +297,15 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
   lock_.lock();
   if (update_connected_displays_) {
     std::vector<NativeDisplay *>().swap(connected_displays_);
+    can_present_parallel_ = true;
     uint32_t size = physical_displays_.size();
     for (uint32_t i = 0; i < size; i++) {
       if (physical_displays_.at(i)->IsConnected()) {
         connected_displays_.emplace_back(physical_displays_.at(i));
+        // Logical displays share the layers collected by their manager
+        // and can't be presented independently.
+        if (!physical_displays_.at(i)->SetPresentTurn(NULL))
+          can_present_parallel_ = false;
       }
     }
     update_connected_displays_ = false;
@@ -188,12 +314,17 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
   uint32_t size = connected_displays_.size();
   int32_t left_constraint = 0;
   size_t total_layers = source_layers.size();
-  int32_t fence = -1;
+  uint32_t presented = 0;
   *retire_fence = -1;
   for (uint32_t i = 0; i < size; i++) {
     NativeDisplay *display = connected_displays_.at(i);
     int32_t right_constraint = left_constraint + display->Width();
-    std::vector<HwcLayer *> layers;
+    if (present_workers_.size() <= presented)
+      present_workers_.emplace_back(new MosaicPresentWorker());
+
+    MosaicPresentWorker *worker = present_workers_.at(presented).get();
+    std::vector<HwcLayer *> &layers = worker->GetLayers();
+    layers.clear();
     uint32_t dlconstraint = display->GetLogicalIndex() * display->Width();
     uint32_t drconstraint = dlconstraint + display->Width();
     IMOSAICDISPLAYTRACE("Display index %d \n", i);
@@ -209,12 +340,6 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
         continue;
       }
 
-      layer->SetLeftConstraint(dlconstraint);
-      layer->SetRightConstraint(drconstraint);
-      layer->SetLeftSourceConstraint(left_constraint);
-      layer->SetRightSourceConstraint(right_constraint);
-      layer->SetTotalDisplays(size - i);
-
       layers.emplace_back(layer);
     }
 
@@ -222,8 +347,55 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
       continue;
     }
 
-    display->Present(layers, &fence, call_back, true);
-    IMOSAICDISPLAYTRACE("Present called for Display index %d \n", i);
+    // Constraints are set on the layers right before the display is
+    // presented, as they are queued per layer.
+    worker->SetConstraints(dlconstraint, drconstraint, left_constraint,
+                           right_constraint, size - i);
+    worker->SetUp(display, call_back, presented);
+    presented++;
+    left_constraint = right_constraint;
+  }
+
+  bool parallel = parallel_present_ && can_present_parallel_ && presented > 1;
+  if (parallel) {
+    for (uint32_t i = 1; i < presented; i++) {
+      if (!present_workers_.at(i)->Start()) {
+        ETRACE("Failed to start MosaicPresentWorker. %s", PRINTERROR());
+        parallel = false;
+        break;
+      }
+    }
+  }
+
+  if (parallel) {
+    if (!present_sequencer_)
+      present_sequencer_.reset(new PresentSequencer());
+
+    parallel = present_sequencer_->Reset(presented);
+  }
+
+  if (parallel) {
+    for (uint32_t i = 0; i < presented; i++) {
+      present_workers_.at(i)->SetSequencer(present_sequencer_.get());
+    }
+
+    // The first display is presented by us, once all others are on their
+    // way, as it has to be done preparing before they can go on.
+    for (uint32_t i = 1; i < presented; i++) {
+      present_workers_.at(i)->PresentAsync();
+    }
+
+    present_workers_.at(0)->Present();
+  } else {
+    for (uint32_t i = 0; i < presented; i++) {
+      present_workers_.at(i)->Present();
+    }
+  }
+
+  // Retire fences are merged in display order, as when presenting one
+  // display after the other.
+  for (uint32_t i = 0; i < presented; i++) {
+    int32_t fence = present_workers_.at(i)->Wait();
     if (fence > 0) {
       if (*retire_fence < 0) {
         *retire_fence = fence;
@@ -236,13 +408,15 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
         close(fence);
       }
     }
-
-    left_constraint = right_constraint;
   }
 
   return true;
 }
 
+void MosaicDisplay::SetParallelPresent(bool enable) {
+  parallel_present_ = enable;
+}
+
 bool MosaicDisplay::PresentClone(NativeDisplay * /*display*/) {
   return false;
 }
@@ -411,6 +585,68 @@ void MosaicDisplay::SetDisableExplicitSync(bool disable_explicit_sync) {
   }
 }
 
+void MosaicDisplay::SetLateLatching(bool enable) {
+  uint32_t size = physical_displays_.size();
+  for (uint32_t i = 0; i < size; i++) {
+    physical_displays_.at(i)->SetLateLatching(enable);
+  }
+}
+
+uint32_t MosaicDisplay::GetMissedPresentDeadlines() {
+  uint32_t missed = 0;
+  uint32_t size = physical_displays_.size();
+  for (uint32_t i = 0; i < size; i++) {
+    missed += physical_displays_.at(i)->GetMissedPresentDeadlines();
+  }
+
+  return missed;
+}
+
+bool MosaicDisplay::GetFrameStats(HwcFrameStats *stats) {
+  // Stats of all displays are summed up. Each frame presented by us is
+  // counted once per physical display.
+  *stats = HwcFrameStats();
+  uint32_t size = physical_displays_.size();
+  for (uint32_t i = 0; i < size; i++) {
+    HwcFrameStats temp;
+    if (!physical_displays_.at(i)->GetFrameStats(&temp))
+      continue;
+
+    stats->frames_presented += temp.frames_presented;
+    stats->frames_skipped += temp.frames_skipped;
+    stats->full_validations += temp.full_validations;
+    stats->incremental_validations += temp.incremental_validations;
+    stats->plane_revalidations += temp.plane_revalidations;
+    stats->test_commits += temp.test_commits;
+    stats->gpu_composited_pixels += temp.gpu_composited_pixels;
+    stats->gpu_sampled_pixels += temp.gpu_sampled_pixels;
+    stats->clears_avoided += temp.clears_avoided;
+    stats->clear_bytes_saved += temp.clear_bytes_saved;
+    stats->media_compositions += temp.media_compositions;
+    stats->commit_failures += temp.commit_failures;
+    stats->validate_time += temp.validate_time;
+    stats->compose_time += temp.compose_time;
+    stats->commit_time += temp.commit_time;
+    stats->plane_assignment_cache_hits += temp.plane_assignment_cache_hits;
+    stats->plane_assignment_cache_misses += temp.plane_assignment_cache_misses;
+    stats->incremental_strategy_validations +=
+        temp.incremental_strategy_validations;
+    stats->incremental_strategy_test_commits +=
+        temp.incremental_strategy_test_commits;
+    stats->batched_strategy_validations += temp.batched_strategy_validations;
+    stats->batched_strategy_test_commits += temp.batched_strategy_test_commits;
+  }
+
+  return true;
+}
+
+void MosaicDisplay::ResetFrameStats() {
+  uint32_t size = physical_displays_.size();
+  for (uint32_t i = 0; i < size; i++) {
+    physical_displays_.at(i)->ResetFrameStats();
+  }
+}
+
 void MosaicDisplay::SetVideoScalingMode(uint32_t mode) {
   uint32_t size = physical_displays_.size();
   for (uint32_t i = 0; i < size; i++) {
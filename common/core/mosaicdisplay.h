@@ -27,6 +27,9 @@
 
 namespace hwcomposer {
 
+class MosaicPresentWorker;
+class PresentSequencer;
+
 class MosaicDisplay : public NativeDisplay {
  public:
   MosaicDisplay(const std::vector<NativeDisplay *> &displays);
@@ -69,6 +72,10 @@ class MosaicDisplay : public NativeDisplay {
   void SetContrast(uint32_t red, uint32_t green, uint32_t blue) override;
   void SetBrightness(uint32_t red, uint32_t green, uint32_t blue) override;
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
+  void SetLateLatching(bool enable) override;
+  uint32_t GetMissedPresentDeadlines() override;
+  bool GetFrameStats(HwcFrameStats *stats) override;
+  void ResetFrameStats() override;
   void SetVideoScalingMode(uint32_t mode) override;
   void SetVideoColor(HWCColorControl color, float value) override;
   void GetVideoColor(HWCColorControl color, float *value, float *start,
@@ -114,6 +121,10 @@ class MosaicDisplay : public NativeDisplay {
 
   bool ContainConnector(const uint32_t connector_id) override;
 
+  // Presents the displays making up the mosaic in parallel, each on a
+  // thread of its own, rather than one after the other.
+  void SetParallelPresent(bool enable);
+
 #ifdef ENABLE_PANORAMA
   void SetPanoramaMode(bool mode);
   void SetExtraDispInfo(int num_physical_displays, int num_virtual_displays);
@@ -122,6 +133,11 @@ class MosaicDisplay : public NativeDisplay {
  private:
   std::vector<NativeDisplay *> physical_displays_;
   std::vector<NativeDisplay *> connected_displays_;
+  // One per display presented in the last frame. Only the threads of the
+  // ones after the first are used, the first display is presented by the
+  // calling thread.
+  std::vector<std::unique_ptr<MosaicPresentWorker>> present_workers_;
+  std::unique_ptr<PresentSequencer> present_sequencer_;
   std::shared_ptr<RefreshCallback> refresh_callback_ = NULL;
   std::shared_ptr<VsyncCallback> vsync_callback_ = NULL;
   std::shared_ptr<HotPlugCallback> hotplug_callback_ = NULL;
@@ -140,6 +156,9 @@ class MosaicDisplay : public NativeDisplay {
   bool connected_ = false;
   bool pending_vsync_ = false;
   bool update_connected_displays_ = true;
+  bool parallel_present_ = false;
+  // All connected displays can be presented concurrently.
+  bool can_present_parallel_ = false;
 #ifdef ENABLE_PANORAMA
   bool panorama_mode_ = false;
   int32_t num_physical_displays_ = 1;
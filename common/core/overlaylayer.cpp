@@ -81,6 +81,20 @@ OverlayBuffer* OverlayLayer::GetBuffer() const {
   }
 }
 
+bool OverlayLayer::IsOpaque() const {
+  if (blending_ == HWCBlending::kBlendingNone)
+    return true;
+
+  if (alpha_ != 0xff)
+    return false;
+
+  if (type_ == kLayerSolidColor)
+    return (solid_color_ & 0xff) == 0xff;
+
+  OverlayBuffer* buffer = GetBuffer();
+  return buffer && IsOpaqueFormat(buffer->GetFormat());
+}
+
 std::shared_ptr<OverlayBuffer>& OverlayLayer::GetSharedBuffer() const {
   return imported_buffer_->buffer_;
 }
@@ -194,6 +208,7 @@ void OverlayLayer::InitializeState(HwcLayer* layer,
 
   alpha_ = layer->GetAlpha();
   layer_index_ = layer_index;
+  hwc_layer_ = layer;
   z_order_ = z_order;
   source_crop_width_ = layer->GetSourceCropWidth();
   source_crop_height_ = layer->GetSourceCropHeight();
@@ -201,12 +216,16 @@ void OverlayLayer::InitializeState(HwcLayer* layer,
   dataspace_ = layer->GetDataSpace();
   blending_ = layer->GetBlending();
   surface_damage_ = layer->GetLayerDamage();
+  surface_damage_region_ = layer->GetLayerDamageRegion();
+  if (surface_damage_region_.empty())
+    AddRectToRegion(surface_damage_, surface_damage_region_);
 
   solid_color_ = layer->GetSolidColor();
 
   if (previous_layer && layer->HasZorderChanged()) {
     if (previous_layer->actual_composition_ == kGpu) {
       CalculateRect(previous_layer->display_frame_, surface_damage_);
+      AddRectToRegion(previous_layer->display_frame_, surface_damage_region_);
       bool force_partial_clear = true;
       // We can skip Clear in case display frame, transforms are same.
       if (previous_layer->display_frame_ == display_frame_ &&
@@ -245,6 +264,8 @@ void OverlayLayer::InitializeState(HwcLayer* layer,
       const std::shared_ptr<OverlayBuffer>& buffer = imported_buffer_->buffer_;
       surface_damage_.right = surface_damage_.left + buffer->GetWidth();
       surface_damage_.bottom = surface_damage_.top + buffer->GetHeight();
+      surface_damage_region_.clear();
+      AddRectToRegion(surface_damage_, surface_damage_region_);
     }
   }
 
@@ -339,6 +360,10 @@ void OverlayLayer::InitializeState(HwcLayer* layer,
     } else {
       surface_damage_.reset();
     }
+
+    // Individual rects are not tracked across displays.
+    surface_damage_region_.clear();
+    AddRectToRegion(surface_damage_, surface_damage_region_);
     IMOSAICDISPLAYTRACE(
         "surface_damage_ %d %d %d %d  left_source_constraint: %d "
         "left_constraint: %d \n",
@@ -414,6 +439,7 @@ void OverlayLayer::ValidatePreviousFrameState(OverlayLayer* rhs,
       if (!layer->IsValidated()) {
         content_changed = true;
         CalculateRect(rhs->display_frame_, surface_damage_);
+        AddRectToRegion(rhs->display_frame_, surface_damage_region_);
       } else if (!content_changed) {
         if ((buffer && rhs->imported_buffer_.get() &&
              (buffer->GetFormat() !=
@@ -502,6 +528,7 @@ void OverlayLayer::CloneLayer(const OverlayLayer* layer,
             resource_manager, true);
   ValidateForOverlayUsage();
   surface_damage_ = layer->GetSurfaceDamage();
+  surface_damage_region_ = layer->surface_damage_region_;
   transform_ = layer->transform_;
   plane_transform_ = layer->plane_transform_;
   alpha_ = layer->alpha_;
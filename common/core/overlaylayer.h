@@ -69,6 +69,13 @@ struct OverlayLayer {
     return layer_index_;
   }
 
+  // HwcLayer this layer was initialized from. This is only used to
+  // identify layers across frames and must not be dereferenced, as the
+  // HwcLayer might be gone by the time we look at it.
+  const HwcLayer* GetHwcLayer() const {
+    return hwc_layer_;
+  }
+
   uint8_t GetAlpha() const {
     return alpha_;
   }
@@ -79,6 +86,9 @@ struct OverlayLayer {
     return blending_;
   }
 
+  // Returns true if nothing below the layer shows through it.
+  bool IsOpaque() const;
+
   // This represents the transform to
   // be applied to this layer without taking
   // into account any Display transform i.e.
@@ -123,6 +133,16 @@ struct OverlayLayer {
     return surface_damage_;
   }
 
+  // Non-overlapping rects making up the surface damage, all of them are
+  // enclosed by GetSurfaceDamage.
+  const HwcRegion& GetSurfaceDamageRegion() const {
+    return surface_damage_region_;
+  }
+
+  HwcRegion& GetSurfaceDamageRegion() {
+    return surface_damage_region_;
+  }
+
   uint32_t GetSourceCropWidth() const {
     return source_crop_width_;
   }
@@ -286,6 +306,7 @@ struct OverlayLayer {
   uint32_t plane_transform_ = 0;
   uint32_t z_order_ = 0;
   uint32_t layer_index_ = 0;
+  const HwcLayer* hwc_layer_ = NULL;
   uint32_t source_crop_width_ = 0;
   uint32_t source_crop_height_ = 0;
   uint32_t display_frame_width_ = 0;
@@ -298,6 +319,7 @@ struct OverlayLayer {
   HwcRect<float> source_crop_;
   HwcRect<int> display_frame_;
   HwcRect<int> surface_damage_;
+  HwcRegion surface_damage_region_;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   uint32_t state_ = kLayerContentChanged | kDimensionsChanged;
   std::unique_ptr<ImportedBuffer> imported_buffer_;
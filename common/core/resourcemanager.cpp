@@ -46,6 +46,17 @@ void ResourceManager::PurgeBuffer() {
   PreparePurgedResources();
 }
 
+void ResourceManager::ReleaseGpuResources() {
+  // Buffers used in several of the last frames are in several maps, this
+  // is a no-op for all but the first of them.
+  for (auto& map : cached_buffers_) {
+    for (auto& entry : map) {
+      if (entry.second)
+        entry.second->ReleaseGpuResources();
+    }
+  }
+}
+
 void ResourceManager::Dump() {
 }
 
@@ -74,6 +74,10 @@ class ResourceManager {
                           bool* has_gpu_resource);
   void PurgeBuffer();
 
+  // Calls ReleaseGpuResources on all cached buffers, for them to be
+  // imported again by the next context using them.
+  void ReleaseGpuResources();
+
   // This should be called by DisplayQueue at end of every present call
   // to free all purged GL, Native and Media resources. Returns true
   // if any resources are marked to be deleted else returns false.
@@ -0,0 +1,56 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "damagehistory.h"
+
+#include "hwcutils.h"
+
+namespace hwcomposer {
+
+void DamageHistory::AddDamage(const HwcRect<int> &damage) {
+  AddRectToRegion(damage, pending_);
+}
+
+void DamageHistory::AddDamage(const HwcRegion &damage) {
+  CalculateRegion(damage, pending_);
+}
+
+uint32_t DamageHistory::FrameRendered() {
+  last_frame_++;
+  // Skip 0 on wrap around, it means unknown content.
+  if (last_frame_ == 0)
+    last_frame_ = 1;
+
+  HwcRegion &frame = frames_[last_frame_ % kMaxAge];
+  frame.swap(pending_);
+  pending_.clear();
+  return last_frame_;
+}
+
+bool DamageHistory::GetDamageSince(uint32_t frame, HwcRegion &damage) const {
+  damage.clear();
+  if (frame == 0 || frame > last_frame_ || last_frame_ - frame > kMaxAge)
+    return false;
+
+  for (uint32_t i = frame + 1; i <= last_frame_; i++) {
+    CalculateRegion(frames_[i % kMaxAge], damage);
+  }
+
+  CalculateRegion(pending_, damage);
+  return true;
+}
+
+}  // namespace hwcomposer
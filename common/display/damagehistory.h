@@ -0,0 +1,59 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_DAMAGEHISTORY_H_
+#define COMMON_DISPLAY_DAMAGEHISTORY_H_
+
+#include <stdint.h>
+
+#include <hwcdefs.h>
+
+namespace hwcomposer {
+
+// Damage of the last frames rendered to the offscreen surfaces of a
+// plane. Same as with EGL_EXT_buffer_age, a surface which was last
+// rendered age frames ago needs the damage of those frames and of the
+// current one redrawn.
+class DamageHistory {
+ public:
+  // Offscreen planes rotate through 3 surfaces, allow for one more in
+  // case a surface skipped a frame.
+  static const uint32_t kMaxAge = 4;
+
+  DamageHistory() = default;
+
+  // Adds damage to the frame being prepared.
+  void AddDamage(const HwcRect<int> &damage);
+  void AddDamage(const HwcRegion &damage);
+
+  // Marks the frame being prepared as rendered and returns its number.
+  // Frames are numbered from 1, 0 stands for unknown content.
+  uint32_t FrameRendered();
+
+  // Sets damage to all damage since frame, including the frame being
+  // prepared. Returns false if frame is unknown or too old, in which
+  // case the whole surface needs to be redrawn.
+  bool GetDamageSince(uint32_t frame, HwcRegion &damage) const;
+
+ private:
+  // Damage of frame n is at frames_[n % kMaxAge].
+  HwcRegion frames_[kMaxAge];
+  HwcRegion pending_;
+  uint32_t last_frame_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_DAMAGEHISTORY_H_
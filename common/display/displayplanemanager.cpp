@@ -43,6 +43,11 @@ DisplayPlaneManager::DisplayPlaneManager(DisplayPlaneHandler *plane_handler,
 #else
       release_surfaces_(false) {
 #endif
+#ifdef ENABLE_BATCHED_PLANE_VALIDATION
+  validation_strategy_ = ValidationStrategy::kBatched;
+#else
+  validation_strategy_ = ValidationStrategy::kIncremental;
+#endif
 }
 
 DisplayPlaneManager::~DisplayPlaneManager() {
@@ -69,12 +74,13 @@ bool DisplayPlaneManager::Initialize(uint32_t width, uint32_t height) {
   height_ = height;
   bool status = plane_handler_->PopulatePlanes(overlay_planes_);
   ResizeOverlays();
+  assignment_cache_.Clear();
   return status;
 }
 
 bool DisplayPlaneManager::ValidateLayers(
     std::vector<OverlayLayer> &layers, int add_index, bool disable_overlay,
-    bool *commit_checked, bool *re_validation_needed,
+    bool keep_cursor, bool *commit_checked, bool *re_validation_needed,
     DisplayPlaneStateList &composition,
     DisplayPlaneStateList &previous_composition,
     std::vector<NativeSurface *> &mark_later) {
@@ -102,8 +108,8 @@ bool DisplayPlaneManager::ValidateLayers(
 #endif
   }
 
-  std::vector<OverlayPlane> commit_planes;
-
+  std::vector<OverlayPlane> &commit_planes = commit_planes_;
+  commit_planes.clear();
   for (DisplayPlaneState &temp : composition) {
     commit_planes.emplace_back(
         OverlayPlane(temp.GetDisplayPlane(), temp.GetOverlayLayer()));
@@ -116,7 +122,8 @@ bool DisplayPlaneManager::ValidateLayers(
     ISURFACETRACE("Forcing GPU For all layers %d %d %d %d \n", disable_overlay,
                   composition.empty(), add_index <= 0, layers.size());
 #endif
-    ForceGpuForAllLayers(commit_planes, composition, layers, mark_later, false);
+    ForceGpuForAllLayers(commit_planes, composition, layers, mark_later, false,
+                         keep_cursor);
 
     *re_validation_needed = false;
     *commit_checked = true;
@@ -151,7 +158,26 @@ bool DisplayPlaneManager::ValidateLayers(
     return true;
   }
 
-  std::vector<OverlayLayer *> cursor_layers;
+  // In case of full validation, check if we have already validated
+  // this layer stack.
+  bool full_validation = composition.empty();
+  if (full_validation) {
+    const PlaneAssignmentCache::Assignment *assignment =
+        assignment_cache_.Lookup(layers, display_transform_);
+    bool render_layers = false;
+    if (assignment &&
+        RestorePlaneAssignment(*assignment, layers, composition,
+                               &render_layers)) {
+      *re_validation_needed = false;
+      *commit_checked = true;
+      return render_layers;
+    }
+  }
+
+  uint32_t test_commits = test_commits_;
+
+  ArenaVector<OverlayLayer *> cursor_layers(
+      (ArenaAllocator<OverlayLayer *>(frame_arena_)));
   auto layer_begin = layers.begin();
   auto layer_end = layers.end();
   bool validate_final_layers = false;
@@ -162,6 +188,18 @@ bool DisplayPlaneManager::ValidateLayers(
     layer_begin = layers.begin() + add_index;
   }
 
+  // Strategy which produced the composition, batched validation falls back
+  // to incremental when it fails.
+  ValidationStrategy strategy = ValidationStrategy::kIncremental;
+  if (full_validation &&
+      validation_strategy_ == ValidationStrategy::kBatched &&
+      ValidateLayersBatched(layers, composition, commit_planes, cursor_layers,
+                            mark_later)) {
+    strategy = ValidationStrategy::kBatched;
+    test_commit_done = true;
+    layer_begin = layer_end;
+  }
+
   if (layer_begin != layer_end) {
     auto overlay_end = overlay_planes_.end();
 #ifdef DISABLE_CURSOR_PLANE
@@ -413,9 +451,293 @@ bool DisplayPlaneManager::ValidateLayers(
   FinalizeValidation(composition, commit_planes, &render_layers,
                      re_validation_needed);
   *commit_checked = test_commit_done;
+  if (full_validation) {
+    CachePlaneAssignment(composition, layers);
+    ValidationStats &stats = stats_[static_cast<int32_t>(strategy)];
+    stats.validations++;
+    stats.test_commits += test_commits_ - test_commits;
+  }
+
   return render_layers;
 }
 
+bool DisplayPlaneManager::ValidateLayersBatched(
+    std::vector<OverlayLayer> &layers, DisplayPlaneStateList &composition,
+    std::vector<OverlayPlane> &commit_planes,
+    ArenaVector<OverlayLayer *> &cursor_layers,
+    std::vector<NativeSurface *> &mark_later) {
+  // Video planes and display rotation need checks which are specific
+  // to the plane being used, leave them to incremental validation.
+  if (display_transform_ != kIdentity)
+    return false;
+
+  for (const OverlayLayer &layer : layers) {
+    if (layer.IsVideoLayer())
+      return false;
+  }
+
+  size_t total_planes = overlay_planes_.size();
+#ifdef DISABLE_CURSOR_PLANE
+  if (!enable_last_plane_ || cursor_plane_) {
+    total_planes--;
+  }
+#else
+  if (cursor_plane_) {
+    total_planes--;
+  }
+#endif
+
+  std::vector<LayerGroup> groups;
+  ArenaVector<OverlayLayer *> cursors(cursor_layers.get_allocator());
+  for (OverlayLayer &layer : layers) {
+    // Cursor layers are handled separately.
+    if (layer.IsCursorLayer()) {
+      cursors.emplace_back(&layer);
+      continue;
+    }
+
+    layer.SupportedDisplayComposition(OverlayLayer::kGpu);
+    bool scanout = false;
+    if (groups.size() < total_planes && !layer.IsSolidColor()) {
+      DisplayPlane *plane = overlay_planes_.at(groups.size()).get();
+      scanout = plane->ValidateLayer(&layer) &&
+                (layer.GetBuffer()->GetFb() != 0);
+    }
+
+    if (scanout || groups.empty() || !groups.back().gpu) {
+      groups.emplace_back();
+      groups.back().gpu = !scanout;
+    }
+
+    groups.back().layers.emplace_back(&layer);
+  }
+
+  if (groups.size() < 2)
+    return false;
+
+  // Layers which don't fit on the available planes are composited into
+  // the last one.
+  if (groups.size() > total_planes) {
+    LayerGroup &last_group = groups.at(total_planes - 1);
+    last_group.gpu = true;
+    for (size_t i = total_planes; i < groups.size(); i++) {
+      last_group.layers.insert(last_group.layers.end(),
+                               groups.at(i).layers.begin(),
+                               groups.at(i).layers.end());
+    }
+
+    groups.resize(total_planes);
+  }
+
+  size_t kept_groups = groups.size();
+  BuildBatchedComposition(groups, kept_groups, composition, commit_planes,
+                          mark_later);
+  if (!TestCommit(commit_planes)) {
+    // Compositing all layers in one plane is checked last, bisect the
+    // groups which can keep their own plane assuming it works.
+    size_t passed = 0;
+    size_t failed = kept_groups;
+    while (failed - passed > 1) {
+      size_t mid = passed + (failed - passed) / 2;
+      BuildBatchedComposition(groups, mid, composition, commit_planes,
+                              mark_later);
+      if (TestCommit(commit_planes)) {
+        passed = mid;
+      } else {
+        failed = mid;
+      }
+    }
+
+    kept_groups = passed;
+    BuildBatchedComposition(groups, kept_groups, composition, commit_planes,
+                            mark_later);
+    if (kept_groups == 0 && !TestCommit(commit_planes)) {
+      // Leave it to incremental validation to find what works.
+      for (DisplayPlaneState &plane : composition) {
+        plane.GetDisplayPlane()->SetInUse(false);
+        MarkSurfacesForRecycling(&plane, mark_later, false);
+      }
+
+      DisplayPlaneStateList().swap(composition);
+      commit_planes.clear();
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < kept_groups; i++) {
+    const LayerGroup &group = groups.at(i);
+    if (!group.gpu)
+      group.layers.front()->SupportedDisplayComposition(OverlayLayer::kAll);
+  }
+
+  cursor_layers.swap(cursors);
+  return true;
+}
+
+void DisplayPlaneManager::BuildBatchedComposition(
+    const std::vector<LayerGroup> &groups, size_t kept_groups,
+    DisplayPlaneStateList &composition,
+    std::vector<OverlayPlane> &commit_planes,
+    std::vector<NativeSurface *> &mark_later) {
+  for (DisplayPlaneState &plane : composition) {
+    plane.GetDisplayPlane()->SetInUse(false);
+    MarkSurfacesForRecycling(&plane, mark_later, false);
+  }
+
+  DisplayPlaneStateList().swap(composition);
+  commit_planes.clear();
+
+  size_t total_groups = groups.size();
+  for (size_t i = 0; i < total_groups; i++) {
+    const LayerGroup &group = groups.at(i);
+    // Groups after kept_groups are composited into the plane of
+    // kept_groups.
+    if (i > kept_groups) {
+      for (OverlayLayer *layer : group.layers) {
+        composition.back().AddLayer(layer);
+      }
+
+      continue;
+    }
+
+    DisplayPlane *plane = overlay_planes_.at(i).get();
+    OverlayLayer *layer = group.layers.front();
+    composition.emplace_back(plane, layer, this, layer->GetZorder(),
+                             display_transform_);
+    size_t size = group.layers.size();
+    for (size_t j = 1; j < size; j++) {
+      composition.back().AddLayer(group.layers.at(j));
+    }
+  }
+
+  size_t size = composition.size();
+  for (size_t i = 0; i < size; i++) {
+    DisplayPlaneState &plane = composition.at(i);
+    if (i == kept_groups || groups.at(i).gpu)
+      SetOffScreenPlaneTarget(plane);
+
+    commit_planes.emplace_back(
+        OverlayPlane(plane.GetDisplayPlane(), plane.GetOverlayLayer()));
+  }
+}
+
+void DisplayPlaneManager::GetValidationStats(ValidationStrategy strategy,
+                                             uint32_t *validations,
+                                             uint32_t *test_commits) const {
+  const ValidationStats &stats = stats_[static_cast<int32_t>(strategy)];
+  *validations = stats.validations;
+  *test_commits = stats.test_commits;
+}
+
+bool DisplayPlaneManager::TestCommit(
+    const std::vector<OverlayPlane> &commit_planes) const {
+  test_commits_++;
+  return plane_handler_->TestCommit(commit_planes);
+}
+
+bool DisplayPlaneManager::RestorePlaneAssignment(
+    const PlaneAssignmentCache::Assignment &assignment,
+    std::vector<OverlayLayer> &layers, DisplayPlaneStateList &composition,
+    bool *render_layers) {
+  size_t total_planes = overlay_planes_.size();
+  for (const PlaneAssignmentCache::PlaneAssignment &cached :
+       assignment.planes) {
+    if (cached.plane_index >= total_planes || cached.source_layers.empty())
+      return false;
+  }
+
+  size_t size = layers.size();
+  for (size_t i = 0; i < size; i++) {
+    layers.at(i).SupportedDisplayComposition(assignment.scanout_layers.at(i)
+                                                 ? OverlayLayer::kAll
+                                                 : OverlayLayer::kGpu);
+  }
+
+  bool needs_gpu = false;
+  for (const PlaneAssignmentCache::PlaneAssignment &cached :
+       assignment.planes) {
+    DisplayPlane *plane = overlay_planes_.at(cached.plane_index).get();
+    OverlayLayer *layer = &(layers.at(cached.source_layers.front()));
+    composition.emplace_back(plane, layer, this, layer->GetZorder(),
+                             display_transform_);
+    DisplayPlaneState &last_plane = composition.back();
+    size_t total_layers = cached.source_layers.size();
+    for (size_t i = 1; i < total_layers; i++) {
+      last_plane.AddLayer(&(layers.at(cached.source_layers.at(i))));
+    }
+
+    if (cached.video_plane)
+      last_plane.SetVideoPlane(true);
+
+    for (const size_t &index : cached.source_layers) {
+      OverlayLayer &source_layer = layers.at(index);
+      if (source_layer.IsCursorLayer()) {
+        source_layer.SetLayerComposition(cached.offscreen
+                                             ? OverlayLayer::kGpu
+                                             : OverlayLayer::kDisplay);
+      }
+    }
+
+    if (!cached.offscreen)
+      continue;
+
+    SetOffScreenPlaneTarget(last_plane);
+    last_plane.SetRotationType(cached.rotation_type, false);
+    last_plane.UsePlaneScalar(cached.use_plane_scalar, false);
+    last_plane.SetDisplayDownScalingFactor(cached.down_scaling_factor, false);
+    last_plane.RefreshSurfaces(NativeSurface::kFullClear);
+    // Results of all checks are part of the cached assignment.
+    last_plane.ValidateReValidation();
+    last_plane.RevalidationDone(
+        DisplayPlaneState::ReValidationType::kScanout |
+        DisplayPlaneState::ReValidationType::kUpScalar |
+        DisplayPlaneState::ReValidationType::kRotation |
+        DisplayPlaneState::ReValidationType::kDownScaling);
+    if (!needs_gpu)
+      needs_gpu = !last_plane.IsSurfaceRecycled();
+  }
+
+  *render_layers = needs_gpu;
+  return true;
+}
+
+void DisplayPlaneManager::CachePlaneAssignment(
+    const DisplayPlaneStateList &composition,
+    const std::vector<OverlayLayer> &layers) {
+  PlaneAssignmentCache::Assignment assignment;
+  for (const DisplayPlaneState &plane : composition) {
+    size_t total_planes = overlay_planes_.size();
+    uint32_t plane_index = 0;
+    while (plane_index < total_planes &&
+           overlay_planes_.at(plane_index).get() != plane.GetDisplayPlane()) {
+      plane_index++;
+    }
+
+    if (plane_index == total_planes)
+      return;
+
+    assignment.planes.emplace_back();
+    PlaneAssignmentCache::PlaneAssignment &cached = assignment.planes.back();
+    cached.plane_index = plane_index;
+    cached.source_layers = plane.GetSourceLayers();
+    cached.video_plane = plane.IsVideoPlane();
+    cached.offscreen = plane.NeedsOffScreenComposition();
+    cached.use_plane_scalar = plane.IsUsingPlaneScalar();
+    cached.down_scaling_factor = plane.GetDownScalingFactor();
+    cached.rotation_type = plane.GetRotationType();
+  }
+
+  for (const OverlayLayer &layer : layers) {
+    assignment.scanout_layers.emplace_back(layer.CanScanOut());
+  }
+
+  assignment_cache_.Insert(assignment);
+}
+
+void DisplayPlaneManager::InvalidatePlaneAssignment() {
+  assignment_cache_.InvalidateLast();
+}
+
 DisplayPlaneState *DisplayPlaneManager::GetLastUsedOverlay(
     DisplayPlaneStateList &composition) {
   CTRACE();
@@ -454,7 +776,7 @@ void DisplayPlaneManager::PreparePlaneForCursor(
 void DisplayPlaneManager::ValidateCursorLayer(
     std::vector<OverlayLayer> &all_layers,
     std::vector<OverlayPlane> &commit_planes,
-    std::vector<OverlayLayer *> &cursor_layers,
+    ArenaVector<OverlayLayer *> &cursor_layers,
     std::vector<NativeSurface *> &mark_later,
     DisplayPlaneStateList &composition, bool *validate_final_layers,
     bool *test_commit_done, bool recycle_resources) {
@@ -525,7 +847,7 @@ void DisplayPlaneManager::ValidateCursorLayer(
 
       if (reset_overlay) {
         // Layer for the plane should have changed, reset commit planes.
-        std::vector<OverlayPlane>().swap(commit_planes);
+        commit_planes.clear();
         for (DisplayPlaneState &temp : composition) {
           commit_planes.emplace_back(
               OverlayPlane(temp.GetDisplayPlane(), temp.GetOverlayLayer()));
@@ -629,7 +951,7 @@ void DisplayPlaneManager::ValidateForDownScaling(
     last_plane.SetDisplayDownScalingFactor(1, false);
     if (!last_plane.IsUsingPlaneScalar() && last_plane.CanUseGPUDownScaling()) {
       last_plane.SetDisplayDownScalingFactor(4, false);
-      if (!plane_handler_->TestCommit(commit_planes)) {
+      if (!TestCommit(commit_planes)) {
         last_plane.SetDisplayDownScalingFactor(1, false);
       }
     }
@@ -718,6 +1040,7 @@ void DisplayPlaneManager::ReleaseUnreservedPlanes(
     plane_index++;
   }
   ResizeOverlays();
+  assignment_cache_.Clear();
 }
 
 void DisplayPlaneManager::SetOffScreenPlaneTarget(DisplayPlaneState &plane) {
@@ -735,6 +1058,11 @@ void DisplayPlaneManager::ReleaseAllOffScreenTargets() {
   std::vector<std::unique_ptr<NativeSurface>>().swap(surfaces_);
 }
 
+void DisplayPlaneManager::ReleaseSurfaceGpuResources() {
+  for (auto &fb : surfaces_)
+    fb->ReleaseGpuResources();
+}
+
 void DisplayPlaneManager::ReleaseFreeOffScreenTargets(bool forced) {
   if (!release_surfaces_ && !forced)
     return;
@@ -762,6 +1090,7 @@ void DisplayPlaneManager::SetLastPlaneUsage(bool enable) {
 
   if (enable_last_plane_ != enable) {
     enable_last_plane_ = enable;
+    assignment_cache_.Clear();
     // If we have cursor plane, we can use all overlays and just
     // ignore cursor plane in case  W/A need's to be enabled.
     if (cursor_plane_) {
@@ -848,7 +1177,7 @@ void DisplayPlaneManager::ValidateFinalLayers(
   }
 
   // If this combination fails just fall back to 3D for all layers.
-  if (!plane_handler_->TestCommit(commit_planes)) {
+  if (!TestCommit(commit_planes)) {
     ForceGpuForAllLayers(commit_planes, composition, layers, mark_later,
                          recycle_resources);
   }
@@ -857,7 +1186,8 @@ void DisplayPlaneManager::ValidateFinalLayers(
 bool DisplayPlaneManager::FallbacktoGPU(
     DisplayPlane *target_plane, OverlayLayer *layer,
     const std::vector<OverlayPlane> &commit_planes) const {
-  // SolidColor can't be scanout directly
+  // SolidColor can't be scanout directly, except as the pipe background
+  // which DisplayQueue takes out of the layer list beforehand.
   if (layer->IsSolidColor())
     return true;
   // For Video, we always want to support Display Composition.
@@ -876,7 +1206,7 @@ bool DisplayPlaneManager::FallbacktoGPU(
 
   // TODO(kalyank): Take relevant factors into consideration to determine if
   // Plane Composition makes sense. i.e. layer size etc
-  if (!plane_handler_->TestCommit(commit_planes)) {
+  if (!TestCommit(commit_planes)) {
     return true;
   }
 
@@ -901,7 +1231,7 @@ void DisplayPlaneManager::ForceVppForAllLayers(
       MarkSurfacesForRecycling(&plane, mark_later, recycle_resources);
     }
     DisplayPlaneStateList().swap(composition);
-    std::vector<OverlayPlane>().swap(commit_planes);
+    commit_planes.clear();
     auto overlay_begin = overlay_planes_.begin();
     // Let's mark all planes as free to be used.
     for (auto j = overlay_begin; j < overlay_planes_.end(); ++j) {
@@ -949,7 +1279,8 @@ void DisplayPlaneManager::ForceVppForAllLayers(
 void DisplayPlaneManager::ForceGpuForAllLayers(
     std::vector<OverlayPlane> &commit_planes,
     DisplayPlaneStateList &composition, std::vector<OverlayLayer> &layers,
-    std::vector<NativeSurface *> &mark_later, bool recycle_resources) {
+    std::vector<NativeSurface *> &mark_later, bool recycle_resources,
+    bool keep_cursor) {
   // Let's mark all planes as free to be used.
   for (auto j = overlay_planes_.begin(); j != overlay_planes_.end(); ++j) {
     j->get()->SetInUse(false);
@@ -964,8 +1295,24 @@ void DisplayPlaneManager::ForceGpuForAllLayers(
   auto layer_begin = layers.begin();
   auto layer_end = layers.end();
   DisplayPlaneStateList().swap(composition);
-  std::vector<OverlayPlane>().swap(commit_planes);
-  OverlayLayer *primary_layer = &(*(layers.begin()));
+  commit_planes.clear();
+  ArenaVector<OverlayLayer *> cursor_layers(
+      (ArenaAllocator<OverlayLayer *>(frame_arena_)));
+  if (keep_cursor) {
+    while (layer_begin != layer_end && layer_begin->IsCursorLayer()) {
+      cursor_layers.emplace_back(&(*(layer_begin)));
+      layer_begin++;
+    }
+
+    // Nothing but cursors, compose them like any other layer.
+    if (layer_begin == layer_end) {
+      cursor_layers.clear();
+      layer_begin = layers.begin();
+      keep_cursor = false;
+    }
+  }
+
+  OverlayLayer *primary_layer = &(*(layer_begin));
   DisplayPlane *current_plane = overlay_planes_.at(0).get();
 
   composition.emplace_back(current_plane, primary_layer, this,
@@ -979,6 +1326,11 @@ void DisplayPlaneManager::ForceGpuForAllLayers(
 #endif
 
   for (auto i = layer_begin; i != layer_end; ++i) {
+    if (keep_cursor && i->IsCursorLayer()) {
+      cursor_layers.emplace_back(&(*(i)));
+      continue;
+    }
+
 #ifdef SURFACE_TRACING
     ISURFACETRACE("Added layer in ForceGpuForAllLayers: %d \n", i->GetZorder());
 #endif
@@ -999,6 +1351,14 @@ void DisplayPlaneManager::ForceGpuForAllLayers(
   // Reset andy Scanout validation state.
   uint32_t validation_done = DisplayPlaneState::ReValidationType::kScanout;
   last_plane.RevalidationDone(validation_done);
+
+  if (!cursor_layers.empty()) {
+    bool validate_final_layers = false;
+    bool test_commit_done = false;
+    ValidateCursorLayer(layers, commit_planes, cursor_layers, mark_later,
+                        composition, &validate_final_layers, &test_commit_done,
+                        recycle_resources);
+  }
 }
 
 void DisplayPlaneManager::ReleasedSurfaces() {
@@ -1050,7 +1410,8 @@ bool DisplayPlaneManager::ReValidatePlanes(
   *request_full_validation = false;
   bool render = false;
   bool reset_composition_region = false;
-  std::vector<OverlayPlane> commit_planes;
+  std::vector<OverlayPlane> &commit_planes = commit_planes_;
+  commit_planes.clear();
   for (DisplayPlaneState &temp : composition) {
     commit_planes.emplace_back(
         OverlayPlane(temp.GetDisplayPlane(), temp.GetOverlayLayer()));
@@ -1064,7 +1425,7 @@ bool DisplayPlaneManager::ReValidatePlanes(
 
   if (re_validate_commit) {
     // If this combination fails just fall back to full validation.
-    if (!plane_handler_->TestCommit(commit_planes)) {
+    if (!TestCommit(commit_planes)) {
 #ifdef SURFACE_TRACING
       ISURFACETRACE(
           "ReValidatePlanes Test commit failed. Forcing full validation. \n");
@@ -1271,7 +1632,7 @@ size_t DisplayPlaneManager::SquashNonVideoPlanes(
 
   if (!commit_planes.empty() && squashed_count) {
     // Layer for the plane should have changed, reset commit planes.
-    std::vector<OverlayPlane>().swap(commit_planes);
+    commit_planes.clear();
     for (DisplayPlaneState &temp : composition) {
       commit_planes.emplace_back(
           OverlayPlane(temp.GetDisplayPlane(), temp.GetOverlayLayer()));
@@ -1346,7 +1707,7 @@ bool DisplayPlaneManager::SquashPlanesAsNeeded(
 
         if (!commit_planes.empty()) {
           // Layer for the plane should have changed, reset commit planes.
-          std::vector<OverlayPlane>().swap(commit_planes);
+          commit_planes.clear();
           for (DisplayPlaneState &temp : composition) {
             commit_planes.emplace_back(
                 OverlayPlane(temp.GetDisplayPlane(), temp.GetOverlayLayer()));
@@ -24,6 +24,8 @@
 
 #include "displayplanehandler.h"
 #include "displayplanestate.h"
+#include "framearena.h"
+#include "planeassignmentcache.h"
 
 namespace hwcomposer {
 
@@ -36,6 +38,12 @@ struct OverlayLayer;
 
 class DisplayPlaneManager {
  public:
+  enum class ValidationStrategy : int32_t {
+    kIncremental,  // Test one layer/plane combination at a time.
+    kBatched,      // Test the whole assignment, bisect on failure.
+    kTotal
+  };
+
   DisplayPlaneManager(DisplayPlaneHandler *plane_handler,
                       ResourceManager *resource_manager);
 
@@ -43,9 +51,25 @@ class DisplayPlaneManager {
 
   bool Initialize(uint32_t width, uint32_t height);
 
+  // Arena used for temporaries during validation. It's expected to be
+  // reset by the caller once per frame.
+  void SetFrameArena(FrameArena *arena) {
+    frame_arena_ = arena;
+  }
+
+  // Pool from which DisplayPlaneStates of this manager get their state.
+  // All DisplayPlaneStates created with this manager need to be destroyed
+  // before it.
+  DisplayPlaneState::StatePool &GetPlaneStatePool() {
+    return state_pool_;
+  }
+
+  // With disable_overlay all layers are composed into a single plane,
+  // except cursor layers with keep_cursor, which are validated for a plane
+  // of their own as usual.
   bool ValidateLayers(std::vector<OverlayLayer> &layers, int add_index,
-                      bool disable_overlay, bool *commit_checked,
-                      bool *re_validation_needed,
+                      bool disable_overlay, bool keep_cursor,
+                      bool *commit_checked, bool *re_validation_needed,
                       DisplayPlaneStateList &composition,
                       DisplayPlaneStateList &previous_composition,
                       std::vector<NativeSurface *> &mark_later);
@@ -76,6 +100,10 @@ class DisplayPlaneManager {
 
   void ReleaseAllOffScreenTargets();
 
+  // Keeps all surfaces, but drops what they have imported into the
+  // context rendering to them.
+  void ReleaseSurfaceGpuResources();
+
   bool HasSurfaces() const {
     return !surfaces_.empty();
   }
@@ -124,11 +152,65 @@ class DisplayPlaneManager {
 
   void ReleaseUnreservedPlanes(std::vector<uint32_t> &reserved_planes);
 
+  // Drops the plane assignment used by the last full validation from
+  // cache. This should be called in case committing it failed.
+  void InvalidatePlaneAssignment();
+
+  uint32_t GetPlaneAssignmentCacheHits() const {
+    return assignment_cache_.GetHits();
+  }
+
+  uint32_t GetPlaneAssignmentCacheMisses() const {
+    return assignment_cache_.GetMisses();
+  }
+
+  // Total number of test commits done so far.
+  uint32_t GetTestCommits() const {
+    return test_commits_;
+  }
+
+  // Returns number of full validations done with strategy and the
+  // number of test commits they needed.
+  void GetValidationStats(ValidationStrategy strategy, uint32_t *validations,
+                          uint32_t *test_commits) const;
+
  private:
+  // Consecutive layers to be shown by one plane.
+  struct LayerGroup {
+    std::vector<OverlayLayer *> layers;
+    bool gpu = false;
+  };
+
+  struct ValidationStats {
+    uint32_t validations = 0;
+    uint32_t test_commits = 0;
+  };
+
   DisplayPlaneState *GetLastUsedOverlay(DisplayPlaneStateList &composition);
   bool FallbacktoGPU(DisplayPlane *target_plane, OverlayLayer *layer,
                      const std::vector<OverlayPlane> &commit_planes) const;
 
+  bool TestCommit(const std::vector<OverlayPlane> &commit_planes) const;
+
+  // Puts every layer which can be scanned out on its own plane and tests
+  // the whole assignment at once. In case that fails, we bisect on the
+  // number of planes kept, moving layers of the remaining ones to the GPU
+  // composited plane. Returns false if layers need to be validated
+  // incrementally.
+  bool ValidateLayersBatched(std::vector<OverlayLayer> &layers,
+                             DisplayPlaneStateList &composition,
+                             std::vector<OverlayPlane> &commit_planes,
+                             ArenaVector<OverlayLayer *> &cursor_layers,
+                             std::vector<NativeSurface *> &mark_later);
+
+  // Builds composition using first kept_groups of groups as is, with
+  // layers of the remaining groups composited into one plane.
+  void BuildBatchedComposition(const std::vector<LayerGroup> &groups,
+                               size_t kept_groups,
+                               DisplayPlaneStateList &composition,
+                               std::vector<OverlayPlane> &commit_planes,
+                               std::vector<NativeSurface *> &mark_later);
+
   void ValidateFinalLayers(std::vector<OverlayPlane> &commit_planes,
                            DisplayPlaneStateList &list,
                            std::vector<OverlayLayer> &layers,
@@ -160,7 +242,7 @@ class DisplayPlaneManager {
                             DisplayPlaneStateList &composition,
                             std::vector<OverlayLayer> &layers,
                             std::vector<NativeSurface *> &mark_later,
-                            bool recycle_resources);
+                            bool recycle_resources, bool keep_cursor = false);
 
   void ForceVppForAllLayers(std::vector<OverlayPlane> &commit_planes,
                             DisplayPlaneStateList &composition,
@@ -173,7 +255,7 @@ class DisplayPlaneManager {
   // frame.
   void ValidateCursorLayer(std::vector<OverlayLayer> &all_layers,
                            std::vector<OverlayPlane> &commit_planes,
-                           std::vector<OverlayLayer *> &cursor_layers,
+                           ArenaVector<OverlayLayer *> &cursor_layers,
                            std::vector<NativeSurface *> &mark_later,
                            DisplayPlaneStateList &composition,
                            bool *validate_final_layers, bool *test_commit_done,
@@ -188,6 +270,17 @@ class DisplayPlaneManager {
 
   void ResizeOverlays();
 
+  // Re-creates a plane assignment which has already been validated for
+  // layers, without doing any test commits. Returns false if assignment
+  // cannot be used with current planes.
+  bool RestorePlaneAssignment(
+      const PlaneAssignmentCache::Assignment &assignment,
+      std::vector<OverlayLayer> &layers, DisplayPlaneStateList &composition,
+      bool *render_layers);
+
+  void CachePlaneAssignment(const DisplayPlaneStateList &composition,
+                            const std::vector<OverlayLayer> &layers);
+
   DisplayPlaneHandler *plane_handler_;
   ResourceManager *resource_manager_;
   DisplayPlane *cursor_plane_;
@@ -199,6 +292,14 @@ class DisplayPlaneManager {
   uint32_t total_overlays_;
   uint32_t display_transform_;
   bool release_surfaces_;
+  PlaneAssignmentCache assignment_cache_;
+  FrameArena *frame_arena_ = NULL;
+  // Planes to be test committed, kept to reuse the storage across frames.
+  std::vector<OverlayPlane> commit_planes_;
+  DisplayPlaneState::StatePool state_pool_;
+  ValidationStrategy validation_strategy_;
+  mutable uint32_t test_commits_ = 0;
+  ValidationStats stats_[static_cast<int32_t>(ValidationStrategy::kTotal)];
 #ifdef DISABLE_CURSOR_PLANE
   bool enable_last_plane_;
 #endif
@@ -21,9 +21,11 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 namespace hwcomposer {
 
-DisplayPlaneState::DisplayPlanePrivateState::~DisplayPlanePrivateState() {
+void DisplayPlaneState::DisplayPlanePrivateState::Reset() {
   bool surfaces_deleted = false;
   for (NativeSurface *surface : surfaces_) {
     if (!surface->IsOnScreen()) {
@@ -34,12 +36,55 @@ DisplayPlaneState::DisplayPlanePrivateState::~DisplayPlanePrivateState() {
 
   if (surfaces_deleted)
     plane_manager_->ReleasedSurfaces();
+
+  // Keep storage of the containers around, to avoid allocating them
+  // again when this state is re-used.
+  std::vector<size_t> source_layers;
+  std::vector<CompositionRegion> composition_region;
+  std::vector<RenderState> render_states;
+  std::vector<NativeSurface *> surfaces;
+  source_layers.swap(source_layers_);
+  composition_region.swap(composition_region_);
+  render_states.swap(render_states_);
+  surfaces.swap(surfaces_);
+  StatePool *pool = pool_;
+
+  *this = DisplayPlanePrivateState();
+
+  source_layers.clear();
+  composition_region.clear();
+  render_states.clear();
+  surfaces.clear();
+  source_layers_.swap(source_layers);
+  composition_region_.swap(composition_region);
+  render_states_.swap(render_states);
+  surfaces_.swap(surfaces);
+  pool_ = pool;
+}
+
+DisplayPlaneState::DisplayPlanePrivateState *
+DisplayPlaneState::StatePool::Acquire() {
+  if (free_states_.empty()) {
+    states_.emplace_back();
+    states_.back().pool_ = this;
+    return &states_.back();
+  }
+
+  DisplayPlanePrivateState *state = free_states_.back();
+  free_states_.pop_back();
+  return state;
+}
+
+void DisplayPlaneState::StatePool::Recycle(DisplayPlanePrivateState *state) {
+  state->Reset();
+  free_states_.emplace_back(state);
 }
 
 DisplayPlaneState::DisplayPlaneState(DisplayPlane *plane, OverlayLayer *layer,
                                      DisplayPlaneManager *plane_manager,
                                      uint32_t index, uint32_t plane_transform) {
-  private_data_ = std::make_shared<DisplayPlanePrivateState>();
+  private_data_ = plane_manager->GetPlaneStatePool().Acquire();
+  private_data_->ref_count_ = 1;
   private_data_->source_layers_.emplace_back(index);
   private_data_->display_frame_ = layer->GetDisplayFrame();
   private_data_->rect_updated_ = true;
@@ -66,8 +111,50 @@ DisplayPlaneState::DisplayPlaneState(DisplayPlane *plane, OverlayLayer *layer,
   recycled_surface_ = false;
 }
 
+DisplayPlaneState::DisplayPlaneState(DisplayPlaneState &&rhs)
+    : recycled_surface_(rhs.recycled_surface_),
+      surface_swapped_(rhs.surface_swapped_),
+      needs_surface_allocation_(rhs.needs_surface_allocation_),
+      re_validate_layer_(rhs.re_validate_layer_),
+      private_data_(rhs.private_data_) {
+  rhs.private_data_ = NULL;
+}
+
+DisplayPlaneState &DisplayPlaneState::operator=(DisplayPlaneState &&other) {
+  if (this == &other)
+    return *this;
+
+  ReleaseState();
+  recycled_surface_ = other.recycled_surface_;
+  surface_swapped_ = other.surface_swapped_;
+  needs_surface_allocation_ = other.needs_surface_allocation_;
+  re_validate_layer_ = other.re_validate_layer_;
+  private_data_ = other.private_data_;
+  other.private_data_ = NULL;
+  return *this;
+}
+
+DisplayPlaneState::~DisplayPlaneState() {
+  ReleaseState();
+}
+
+void DisplayPlaneState::ReleaseState() {
+  if (!private_data_)
+    return;
+
+  if (--private_data_->ref_count_ == 0)
+    private_data_->pool_->Recycle(private_data_);
+
+  private_data_ = NULL;
+}
+
 void DisplayPlaneState::CopyState(DisplayPlaneState &state) {
-  private_data_ = state.private_data_;
+  if (private_data_ != state.private_data_) {
+    ReleaseState();
+    private_data_ = state.private_data_;
+    private_data_->ref_count_++;
+  }
+
   if (private_data_->surfaces_.size() == 3)
     needs_surface_allocation_ = false;
 
@@ -97,6 +184,7 @@ void DisplayPlaneState::AddLayer(const OverlayLayer *layer) {
   // we shouldn't have done them yet (i.e. Previous state could have
   // been direct scanout.)
   bool rect_updated = true;
+  private_data_->damage_history_.AddDamage(private_data_->display_frame_);
   for (NativeSurface *surface : private_data_->surfaces_) {
     // Damage whole old rect.
     surface->UpdateSurfaceDamage(private_data_->display_frame_, true);
@@ -109,6 +197,7 @@ void DisplayPlaneState::AddLayer(const OverlayLayer *layer) {
   } else {
     private_data_->display_frame_ = target_display_frame;
     private_data_->source_crop_ = target_source_crop;
+    private_data_->damage_history_.AddDamage(private_data_->display_frame_);
     for (NativeSurface *surface : private_data_->surfaces_) {
       surface->UpdateSurfaceDamage(private_data_->display_frame_, true);
     }
@@ -188,6 +277,7 @@ void DisplayPlaneState::ResetLayers(const std::vector<OverlayLayer> &layers,
     return;
   }
 
+  private_data_->damage_history_.AddDamage(private_data_->display_frame_);
   for (NativeSurface *surface : private_data_->surfaces_) {
     // Damage whole old rect.
     surface->UpdateSurfaceDamage(private_data_->display_frame_, true);
@@ -200,6 +290,7 @@ void DisplayPlaneState::ResetLayers(const std::vector<OverlayLayer> &layers,
   } else {
     private_data_->display_frame_ = target_display_frame;
     private_data_->source_crop_ = target_source_crop;
+    private_data_->damage_history_.AddDamage(private_data_->display_frame_);
     for (NativeSurface *surface : private_data_->surfaces_) {
       surface->UpdateSurfaceDamage(private_data_->display_frame_, true);
     }
@@ -237,12 +328,32 @@ void DisplayPlaneState::ResetLayers(const std::vector<OverlayLayer> &layers,
   RefreshSurfaces(NativeSurface::kPartialClear);
 }
 
+bool DisplayPlaneState::RemapLayers(const std::vector<OverlayLayer> &layers,
+                                    const std::vector<int> &z_order_map) {
+  std::vector<size_t> &source_layers = private_data_->source_layers_;
+  size_t kept = 0;
+  for (size_t i = 0; i < source_layers.size(); i++) {
+    int z_order = z_order_map.at(source_layers.at(i));
+    if (z_order != -1)
+      source_layers.at(kept++) = z_order;
+  }
+
+  if (kept == source_layers.size())
+    return false;
+
+  source_layers.resize(kept);
+  bool rects_updated = false;
+  ResetLayers(layers, layers.size(), &rects_updated);
+  return true;
+}
+
 void DisplayPlaneState::RefreshLayerRects(
     const std::vector<OverlayLayer> &layers) {
   const std::vector<size_t> &current_layers = private_data_->source_layers_;
   HwcRect<int> target_display_frame;
   HwcRect<float> target_source_crop;
   HwcRect<int> surface_damage = HwcRect<int>(0, 0, 0, 0);
+  HwcRegion damage_region;
   bool only_cursor_layer = true;
   for (const size_t &index : current_layers) {
     const OverlayLayer &layer = layers.at(index);
@@ -256,11 +367,13 @@ void DisplayPlaneState::RefreshLayerRects(
 
     if (layer.HasLayerContentChanged()) {
       CalculateRect(layer.GetSurfaceDamage(), surface_damage);
+      CalculateRegion(layer.GetSurfaceDamageRegion(), damage_region);
     }
   }
 
   if (!only_cursor_layer) {
     CalculateRect(private_data_->display_frame_, surface_damage);
+    AddRectToRegion(private_data_->display_frame_, damage_region);
   }
 
   bool rect_updated = true;
@@ -272,6 +385,7 @@ void DisplayPlaneState::RefreshLayerRects(
     private_data_->source_crop_ = target_source_crop;
     if (!only_cursor_layer) {
       CalculateRect(private_data_->display_frame_, surface_damage);
+      AddRectToRegion(private_data_->display_frame_, damage_region);
     }
   }
 
@@ -281,8 +395,9 @@ void DisplayPlaneState::RefreshLayerRects(
   private_data_->refresh_surface_ = true;
   recycled_surface_ = false;
   if (!surface_damage.empty()) {
+    private_data_->damage_history_.AddDamage(damage_region);
     for (NativeSurface *surface : private_data_->surfaces_) {
-      surface->UpdateSurfaceDamage(surface_damage, true);
+      surface->UpdateSurfaceDamage(damage_region, true);
     }
 
     RefreshSurfaces(NativeSurface::kPartialClear);
@@ -353,19 +468,25 @@ void DisplayPlaneState::SwapSurfaceIfNeeded() {
     return;
 
   if (size == 3) {
-    std::vector<NativeSurface *> temp;
-    temp.reserve(size);
     // Lets make sure front buffer is now back in the list.
-    temp.emplace_back(private_data_->surfaces_.at(2));
-    temp.emplace_back(private_data_->surfaces_.at(0));
-    temp.emplace_back(private_data_->surfaces_.at(1));
-    private_data_->surfaces_.swap(temp);
+    std::vector<NativeSurface *> &surfaces = private_data_->surfaces_;
+    std::rotate(surfaces.begin(), surfaces.begin() + 2, surfaces.end());
   }
 
   surface_swapped_ = true;
   recycled_surface_ = false;
   NativeSurface *surface = private_data_->surfaces_.at(0);
   private_data_->layer_ = surface->GetLayer();
+
+  // Surface needs everything redrawn which changed since it was last
+  // rendered, not just damage of this frame.
+  DamageHistory &history = private_data_->damage_history_;
+  HwcRegion &damage = private_data_->missed_damage_;
+  if (!history.GetDamageSince(surface->GetRenderedFrame(), damage))
+    AddRectToRegion(private_data_->display_frame_, damage);
+
+  surface->AddMissedDamage(damage);
+  surface->SetRenderedFrame(history.FrameRendered());
 }
 
 void DisplayPlaneState::HandleCommitFailure() {
@@ -375,13 +496,9 @@ void DisplayPlaneState::HandleCommitFailure() {
 
   if (surface_swapped_) {
     if (size == 3) {
-      std::vector<NativeSurface *> temp;
-      temp.reserve(size);
       // Lets make sure we restore the buffer queue.
-      temp.emplace_back(private_data_->surfaces_.at(1));
-      temp.emplace_back(private_data_->surfaces_.at(2));
-      temp.emplace_back(private_data_->surfaces_.at(0));
-      private_data_->surfaces_.swap(temp);
+      std::vector<NativeSurface *> &surfaces = private_data_->surfaces_;
+      std::rotate(surfaces.begin(), surfaces.begin() + 1, surfaces.end());
     }
 
     NativeSurface *surface = private_data_->surfaces_.at(0);
@@ -442,12 +559,19 @@ void DisplayPlaneState::RefreshSurfaces(NativeSurface::ClearType clear_surface,
 }
 
 void DisplayPlaneState::UpdateDamage(const HwcRect<int> &surface_damage) {
+  HwcRegion damage_region;
+  AddRectToRegion(surface_damage, damage_region);
+  UpdateDamage(damage_region);
+}
+
+void DisplayPlaneState::UpdateDamage(const HwcRegion &surface_damage) {
   if (surface_damage.empty()) {
     for (NativeSurface *surface : private_data_->surfaces_) {
       surface->ResetDamage();
     }
   } else {
     recycled_surface_ = false;
+    private_data_->damage_history_.AddDamage(surface_damage);
     for (NativeSurface *surface : private_data_->surfaces_) {
       surface->UpdateSurfaceDamage(surface_damage, false);
     }
@@ -472,12 +596,25 @@ std::vector<CompositionRegion> &DisplayPlaneState::GetCompositionRegion() {
 }
 
 void DisplayPlaneState::ResetCompositionRegion() {
-  if (!private_data_->composition_region_.empty())
-    std::vector<CompositionRegion>().swap(private_data_->composition_region_);
+  // Entries are kept for Compositor to overwrite, so that the storage of
+  // their containers is reused.
+  private_data_->geometry_hash_ = 0;
 
   recycled_surface_ = false;
 }
 
+std::vector<RenderState> &DisplayPlaneState::GetRenderStates() {
+  return private_data_->render_states_;
+}
+
+uint64_t DisplayPlaneState::GetGeometryHash() const {
+  return private_data_->geometry_hash_;
+}
+
+void DisplayPlaneState::SetGeometryHash(uint64_t hash) {
+  private_data_->geometry_hash_ = hash;
+}
+
 bool DisplayPlaneState::IsCursorPlane() const {
   return private_data_->type_ == DisplayPlanePrivateState::PlaneType::kCursor;
 }
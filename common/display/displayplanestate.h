@@ -18,12 +18,15 @@
 #define COMMON_DISPLAY_DISPLAYPLANESTATE_H_
 
 #include <stdint.h>
+#include <deque>
 #include <vector>
 
 #include "compositionregion.h"
+#include "damagehistory.h"
 #include "displayplane.h"
 #include "nativesurface.h"
 #include "overlaylayer.h"
+#include "renderstate.h"
 
 namespace hwcomposer {
 
@@ -50,12 +53,15 @@ class DisplayPlaneState {
     kGPURotation       // Plane will be rotated during 3D composition.
   };
 
+  class StatePool;
+
   DisplayPlaneState() = default;
-  DisplayPlaneState(DisplayPlaneState &&rhs) = default;
-  DisplayPlaneState &operator=(DisplayPlaneState &&other) = default;
+  DisplayPlaneState(DisplayPlaneState &&rhs);
+  DisplayPlaneState &operator=(DisplayPlaneState &&other);
   DisplayPlaneState(DisplayPlane *plane, OverlayLayer *layer,
                     DisplayPlaneManager *plane_manager, uint32_t index,
                     uint32_t plane_transform);
+  ~DisplayPlaneState();
 
   // Copies plane state from state.
   void CopyState(DisplayPlaneState &state);
@@ -67,6 +73,13 @@ class DisplayPlaneState {
   void ResetLayers(const std::vector<OverlayLayer> &layers, size_t remove_index,
                    bool *rects_updated);
 
+  // Moves source layers of this plane to their z order in layers, given
+  // by z_order_map for each z order of the last frame, -1 for layers
+  // removed since. Returns true if some of them were removed, in which
+  // case the plane is reset like with ResetLayers.
+  bool RemapLayers(const std::vector<OverlayLayer> &layers,
+                   const std::vector<int> &z_order_map);
+
   // Updates display frame and source rects combined region for
   // this plane.
   void RefreshLayerRects(const std::vector<OverlayLayer> &layers);
@@ -112,6 +125,7 @@ class DisplayPlaneState {
                        bool force = false);
 
   void UpdateDamage(const HwcRect<int> &surface_damage);
+  void UpdateDamage(const HwcRegion &surface_damage);
 
   DisplayPlane *GetDisplayPlane() const;
 
@@ -123,9 +137,18 @@ class DisplayPlaneState {
   // Returns composition region used by this plane.
   std::vector<CompositionRegion> &GetCompositionRegion();
 
-  // Resets composition region to null.
+  // Marks composition region and render states to be recalculated on the
+  // next composition.
   void ResetCompositionRegion();
 
+  // Render states of the composition region. Together with the region,
+  // they stay valid as long as the geometry hash doesn't change.
+  std::vector<RenderState> &GetRenderStates();
+
+  uint64_t GetGeometryHash() const;
+
+  void SetGeometryHash(uint64_t hash);
+
   bool IsCursorPlane() const;
 
   bool HasCursorLayer() const;
@@ -237,6 +260,9 @@ class DisplayPlaneState {
  private:
   void CalculateSourceCrop(HwcRect<float> &source_crop) const;
 
+  // Drops our reference to private_data_.
+  void ReleaseState();
+
   class DisplayPlanePrivateState {
    public:
     enum class PlaneType : int32_t {
@@ -251,7 +277,9 @@ class DisplayPlaneState {
                  // layer before scanning out.
     };
 
-    ~DisplayPlanePrivateState();
+    // Releases any surfaces which are not on screen and resets state
+    // to defaults, keeping storage of the containers.
+    void Reset();
 
     State state_ = State::kScanout;
     DisplayPlane *plane_ = NULL;
@@ -260,6 +288,10 @@ class DisplayPlaneState {
     HwcRect<float> source_crop_;
     std::vector<size_t> source_layers_;
     std::vector<CompositionRegion> composition_region_;
+    std::vector<RenderState> render_states_;
+    // Hash of the geometry composition_region_ and render_states_ were
+    // calculated for.
+    uint64_t geometry_hash_ = 0;
 
     bool use_plane_scalar_ = false;
     // Even if layer can be scanned out
@@ -289,17 +321,43 @@ class DisplayPlaneState {
     // Any offscreen surfaces used by this
     // plane.
     std::vector<NativeSurface *> surfaces_;
+    // Damage of the frames rendered to surfaces_.
+    DamageHistory damage_history_;
+    // Damage a surface missed while it wasn't rendered to, kept to reuse
+    // its storage.
+    HwcRegion missed_damage_;
     PlaneType type_ = PlaneType::kNormal;
     uint32_t plane_transform_ = kIdentity;
     RotationType rotation_type_ = RotationType::kDisplayRotation;
     DisplayPlaneManager *plane_manager_ = NULL;
+    StatePool *pool_ = NULL;
+    // Number of DisplayPlaneStates referring to this state. These are
+    // only used from the thread presenting the display.
+    uint32_t ref_count_ = 0;
   };
 
   bool recycled_surface_ = true;
   bool surface_swapped_ = false;
   bool needs_surface_allocation_ = true;
   uint32_t re_validate_layer_ = ReValidationType::kNone;
-  std::shared_ptr<DisplayPlanePrivateState> private_data_;
+  DisplayPlanePrivateState *private_data_ = NULL;
+};
+
+// Storage for states of all planes of a DisplayPlaneManager. States are
+// recycled once no DisplayPlaneState refers to them, so building
+// composition lists doesn't need to allocate after the first few frames.
+class DisplayPlaneState::StatePool {
+ public:
+  StatePool() = default;
+  StatePool(const StatePool &) = delete;
+  StatePool &operator=(const StatePool &) = delete;
+
+  DisplayPlanePrivateState *Acquire();
+  void Recycle(DisplayPlanePrivateState *state);
+
+ private:
+  std::deque<DisplayPlanePrivateState> states_;
+  std::vector<DisplayPlanePrivateState *> free_states_;
 };
 
 }  // namespace hwcomposer
@@ -45,6 +45,7 @@ DisplayQueue::DisplayQueue(uint32_t gpu_fd, bool disable_explictsync,
   }
 
   vblank_handler_.reset(new VblankEventHandler(this));
+  vblank_handler_->SetPresentScheduler(&present_scheduler_);
   resource_manager_.reset(new ResourceManager(buffer_handler));
 
   /* use 0x80 as default brightness for all colors */
@@ -77,6 +78,9 @@ bool DisplayQueue::Initialize(uint32_t pipe, uint32_t width, uint32_t height,
     return false;
   }
 
+  // Plane states need to be released before the manager owning them.
+  previous_plane_state_.clear();
+  spare_plane_state_.clear();
   display_plane_manager_.reset(
       new DisplayPlaneManager(plane_handler, resource_manager_.get()));
   if (!display_plane_manager_->Initialize(width, height)) {
@@ -86,6 +90,8 @@ bool DisplayQueue::Initialize(uint32_t pipe, uint32_t width, uint32_t height,
 
   display_plane_manager_->SetDisplayTransform(plane_transform_);
   display_plane_manager_->SetLastPlaneUsage(!enable_wa_);
+  display_plane_manager_->SetFrameArena(&frame_arena_);
+  compositor_.SetFrameArena(&frame_arena_);
   ResetQueue();
   vblank_handler_->SetPowerMode(kOff);
   vblank_handler_->Init(gpu_fd_, pipe);
@@ -169,7 +175,7 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
                                    bool* render_layers, bool* can_ignore_commit,
                                    bool* needs_plane_validation,
                                    bool* force_full_validation,
-                                   int* add_index) {
+                                   int* add_index, bool remap_layers) {
   CTRACE();
   bool needs_gpu_composition = false;
   bool ignore_commit = true;
@@ -201,6 +207,15 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
     composition->emplace_back();
     DisplayPlaneState& last_plane = composition->back();
     last_plane.CopyState(previous_plane);
+    // Layers of the plane removed in this frame, only with remap_layers.
+    bool plane_layers_removed = false;
+    if (remap_layers) {
+      plane_layers_removed =
+          last_plane.RemapLayers(layers, previous_z_order_map_);
+      // The planes now refer to this frame's layers.
+      ignore_commit = false;
+    }
+
     if (reset_plane) {
       const std::vector<size_t>& source_layers = last_plane.GetSourceLayers();
       size_t source_layers_size = source_layers.size();
@@ -309,8 +324,10 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
     DisplayPlaneState& target_plane = composition->back();
     if (target_plane.NeedsOffScreenComposition()) {
       HwcRect<int> surface_damage = HwcRect<int>(0, 0, 0, 0);
-      bool update_rect = reset_plane;
-      bool refresh_surfaces = reset_composition_regions;
+      damage_region_.clear();
+      bool update_rect = reset_plane || plane_layers_removed;
+      bool refresh_surfaces =
+          reset_composition_regions || plane_layers_removed;
       bool force_partial_clear = false;
 
       const std::vector<size_t>& source_layers = target_plane.GetSourceLayers();
@@ -334,6 +351,7 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
 
           if (layer.HasLayerContentChanged()) {
             CalculateRect(layer.GetSurfaceDamage(), surface_damage);
+            CalculateRegion(layer.GetSurfaceDamageRegion(), damage_region_);
           }
         }
       }
@@ -365,6 +383,7 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
       if (!removed_layers && update_rect) {
         target_plane.RefreshLayerRects(layers);
         surface_damage.reset();
+        damage_region_.clear();
       }
 
       // Let's check if we need to check this plane-layer combination.
@@ -388,7 +407,7 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
             target_plane.RefreshSurfaces(NativeSurface::kPartialClear, true);
           }
 
-          target_plane.UpdateDamage(surface_damage);
+          target_plane.UpdateDamage(damage_region_);
         }
 
         if (refresh_surfaces || reset_plane || update_rect) {
@@ -414,7 +433,7 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
           }
         }
       } else {
-        target_plane.UpdateDamage(surface_damage);
+        target_plane.UpdateDamage(damage_region_);
       }
 
       DisplayPlaneState& squashed_plane = composition->back();
@@ -532,6 +551,164 @@ void DisplayQueue::GetCachedLayers(const std::vector<OverlayLayer>& layers,
   }
 }
 
+HwcLayer* DisplayQueue::FindBackgroundLayer(
+    const std::vector<HwcLayer*>& source_layers) {
+  if (!display_->SupportsPipeCanvasColor() ||
+      scaling_tracker_.scaling_state_ == ScalingTracker::kNeedsScaling)
+    return NULL;
+
+  uint32_t width = display_plane_manager_->GetWidth();
+  uint32_t height = display_plane_manager_->GetHeight();
+  if (plane_transform_ & (kTransform90 | kTransform270))
+    std::swap(width, height);
+
+  HwcLayer* background = NULL;
+  for (HwcLayer* layer : source_layers) {
+    if (!layer->IsVisible())
+      continue;
+
+    // Only used if some layer is left for the planes.
+    if (background)
+      return background;
+
+    if (layer->GetLayerCompositionType() != Composition_SolidColor ||
+        layer->GetNativeHandle() || layer->GetAlpha() != 0xff ||
+        (layer->GetSolidColor() & 0xff) != 0xff)
+      return NULL;
+
+    const HwcRect<int>& frame = layer->GetDisplayFrame();
+    if (frame.left > 0 || frame.top > 0 ||
+        frame.right < static_cast<int>(width) ||
+        frame.bottom < static_cast<int>(height))
+      return NULL;
+
+    background = layer;
+  }
+
+  return NULL;
+}
+
+void DisplayQueue::SetBackgroundColor(bool enabled, uint32_t color) {
+  if (!enabled)
+    color = 0;
+
+  if (enabled == has_background_ && color == background_color_)
+    return;
+
+  has_background_ = enabled;
+  background_color_ = color;
+  state_ |= kCanvasColorChanged;
+}
+
+void DisplayQueue::UpdateCanvasColor() {
+  if (!(state_ & kCanvasColorChanged))
+    return;
+
+  if (has_background_) {
+    display_->SetPipeCanvasColor(8, (background_color_ >> 24) & 0xff,
+                                 (background_color_ >> 16) & 0xff,
+                                 (background_color_ >> 8) & 0xff, 0xff);
+  } else {
+    display_->SetPipeCanvasColor(canvas_.bpc, canvas_.red, canvas_.green,
+                                 canvas_.blue, canvas_.alpha);
+  }
+
+  state_ &= ~kCanvasColorChanged;
+}
+
+void DisplayQueue::MatchPreviousLayers(
+    const std::vector<HwcLayer*>& source_layers) {
+  size_t size = source_layers.size();
+  size_t previous_size = in_flight_layers_.size();
+  previous_layer_match_.assign(size, -1);
+
+  // Layers which are not visible are never in in_flight_layers_.
+  std::vector<size_t>& candidates = match_candidates_;
+  candidates.clear();
+  for (size_t i = 0; i < size; i++) {
+    const HwcLayer* layer = source_layers.at(i);
+    if (layer->IsVisible() && layer != background_layer_)
+      candidates.emplace_back(i);
+  }
+
+  // Usually the whole stack is the same as last frame, so first take
+  // out the common prefix and suffix.
+  size_t total = candidates.size();
+  size_t prefix = 0;
+  while (prefix < total && prefix < previous_size &&
+         source_layers.at(candidates.at(prefix)) ==
+             in_flight_layers_.at(prefix).GetHwcLayer()) {
+    previous_layer_match_.at(candidates.at(prefix)) = prefix;
+    prefix++;
+  }
+
+  size_t suffix = 0;
+  while (prefix + suffix < total && prefix + suffix < previous_size &&
+         source_layers.at(candidates.at(total - suffix - 1)) ==
+             in_flight_layers_.at(previous_size - suffix - 1).GetHwcLayer()) {
+    previous_layer_match_.at(candidates.at(total - suffix - 1)) =
+        previous_size - suffix - 1;
+    suffix++;
+  }
+
+  size_t rows = total - prefix - suffix;
+  size_t columns = previous_size - prefix - suffix;
+  if (rows == 0 || columns == 0)
+    return;
+
+  // Longest common subsequence of the remaining layers. table at (i, j)
+  // holds the length of the LCS of layers starting at i and previous
+  // layers starting at j.
+  size_t stride = columns + 1;
+  match_table_.assign((rows + 1) * stride, 0);
+  for (size_t i = rows; i-- > 0;) {
+    const HwcLayer* layer = source_layers.at(candidates.at(prefix + i));
+    for (size_t j = columns; j-- > 0;) {
+      uint16_t& entry = match_table_.at(i * stride + j);
+      if (layer == in_flight_layers_.at(prefix + j).GetHwcLayer()) {
+        entry = match_table_.at((i + 1) * stride + j + 1) + 1;
+      } else {
+        entry = std::max(match_table_.at((i + 1) * stride + j),
+                         match_table_.at(i * stride + j + 1));
+      }
+    }
+  }
+
+  size_t i = 0;
+  size_t j = 0;
+  while (i < rows && j < columns) {
+    if (source_layers.at(candidates.at(prefix + i)) ==
+        in_flight_layers_.at(prefix + j).GetHwcLayer()) {
+      previous_layer_match_.at(candidates.at(prefix + i)) = prefix + j;
+      i++;
+      j++;
+    } else if (match_table_.at((i + 1) * stride + j) >=
+               match_table_.at(i * stride + j + 1)) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+}
+
+bool DisplayQueue::CanKeepPreviousPlanes() const {
+  for (const DisplayPlaneState& plane : previous_plane_state_) {
+    bool has_layers = false;
+    for (size_t index : plane.GetSourceLayers()) {
+      if (previous_z_order_map_.at(index) != -1) {
+        has_layers = true;
+        break;
+      }
+    }
+
+    // Planes can't be left empty in the middle of the composition.
+    if (!has_layers)
+      return false;
+  }
+
+  return true;
+}
+
 void DisplayQueue::InitializeOverlayLayers(
     std::vector<HwcLayer*>& source_layers, bool handle_constraints,
     bool validate_layers, std::vector<OverlayLayer>& layers, int& remove_index,
@@ -540,11 +717,15 @@ void DisplayQueue::InitializeOverlayLayers(
   size_t size = source_layers.size();
   size_t previous_size = in_flight_layers_.size();
   uint32_t z_order = 0;
+  size_t matched = 0;
+  bool keep_planes = true;
+  MatchPreviousLayers(source_layers);
+  previous_z_order_map_.assign(previous_size, -1);
 
   for (size_t layer_index = 0; layer_index < size; layer_index++) {
     HwcLayer* layer = source_layers.at(layer_index);
     layer->SetReleaseFence(-1);
-    if (!layer->IsVisible())
+    if (!layer->IsVisible() || layer == background_layer_)
       continue;
 
     // Discard protected video for tear down
@@ -557,8 +738,22 @@ void DisplayQueue::InitializeOverlayLayers(
     layers.emplace_back();
     OverlayLayer* overlay_layer = &(layers.back());
     OverlayLayer* previous_layer = NULL;
+    int match = previous_layer_match_.at(layer_index);
+    if (match != -1)
+      previous_layer = &(in_flight_layers_.at(match));
+
     if (previous_size > z_order) {
-      previous_layer = &(in_flight_layers_.at(z_order));
+      // Layers have been added, removed or re-ordered below this one. Planes
+      // showing layers below z_order can be kept, the rest need to be
+      // validated again unless layers were only removed.
+      if (match != static_cast<int>(z_order) && add_index == -1) {
+        add_index = z_order;
+        if (remove_index == -1)
+          remove_index = z_order;
+#ifdef SURFACE_TRACING
+        ISURFACETRACE("Layer stack changed at z order: %d \n", z_order);
+#endif
+      }
     } else if (add_index == -1) {
       add_index = z_order;
     }
@@ -607,6 +802,15 @@ void DisplayQueue::InitializeOverlayLayers(
       has_cursor_layer = true;
     }
 
+    if (previous_layer) {
+      previous_z_order_map_.at(match) = z_order;
+      matched++;
+      // Cursor and video layers have planes of their own.
+      if (previous_layer->IsCursorLayer() != overlay_layer->IsCursorLayer() ||
+          previous_layer->IsVideoLayer() != overlay_layer->IsVideoLayer())
+        keep_planes = false;
+    }
+
     z_order++;
 
     // Handle case where Media layer has been destroyed/created or has changed
@@ -652,13 +856,28 @@ void DisplayQueue::InitializeOverlayLayers(
 #endif
     }
   }
+
+  // Layers of this frame are a subsequence of the last one's.
+  layers_removed_only_ = keep_planes && matched == z_order &&
+                         matched < previous_size;
 }
 
 bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
                                int32_t* retire_fence, bool* ignore_clone_update,
                                PixelUploaderCallback* call_back,
-                               bool handle_constraints) {
+                               bool handle_constraints,
+                               PresentTurn* turn) {
   CTRACE();
+  // Surfaces of the last frame might still be in use by the compositor.
+  compositor_.WaitForPendingDraw();
+  MigrateCompositor();
+  frame_arena_.Reset();
+  present_scheduler_.LatchFrame();
+  int64_t stage_start = FrameStats::Now();
+  uint32_t test_commits = display_plane_manager_->GetTestCommits();
+  uint32_t cache_hits = display_plane_manager_->GetPlaneAssignmentCacheHits();
+  uint32_t cache_misses =
+      display_plane_manager_->GetPlaneAssignmentCacheMisses();
   ScopedIdleStateTracker tracker(idle_tracker_, compositor_,
                                  resource_manager_.get(), this);
   if (tracker.IgnoreUpdate()) {
@@ -668,13 +887,16 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
 
   size_t previous_size = in_flight_layers_.size();
   std::vector<OverlayLayer> layers;
+  layers.swap(spare_layers_);
   int remove_index = -1;
   int add_index = -1;
   // If last commit failed, lets force full validation as
   // state might be all wrong in our side.
   bool idle_frame = tracker.RenderIdleMode();
-  bool validate_layers =
-      last_commit_failed_update_ || previous_plane_state_.empty();
+  bool validate_layers = last_commit_failed_update_ ||
+                         previous_plane_state_.empty() ||
+                         (state_ & kScaledClonesChanged);
+  state_ &= ~kScaledClonesChanged;
   *retire_fence = -1;
 
   bool has_video_layer = false;
@@ -682,18 +904,49 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
   bool re_validate_commit = false;
   needs_clone_validation_ = false;
 
+  background_layer_ = FindBackgroundLayer(source_layers);
   InitializeOverlayLayers(source_layers, handle_constraints, validate_layers,
                           layers, remove_index, add_index, has_video_layer,
                           has_cursor_layer, re_validate_commit, idle_frame);
+  if (layers.empty() && background_layer_) {
+    // Everything above the background was dropped, let a plane show it.
+    background_layer_ = NULL;
+    remove_index = -1;
+    add_index = -1;
+    InitializeOverlayLayers(source_layers, handle_constraints, validate_layers,
+                            layers, remove_index, add_index, has_video_layer,
+                            has_cursor_layer, re_validate_commit, idle_frame);
+  }
+
+  SetBackgroundColor(
+      background_layer_ != NULL,
+      background_layer_ ? background_layer_->GetSolidColor() : 0);
+  // Nothing below reads source_layers till release fences are set.
+  if (turn)
+    turn->EndPrepare();
+
   if (has_cursor_layer)
     tracker.FrameHasCursor();
 
+  // Layers removed from the middle of the stack only change the z order of
+  // the layers above. Their planes are kept as long as none is left empty.
+  bool remap_layers = false;
+  if (!validate_layers && layers_removed_only_ && add_index != -1 &&
+      CanKeepPreviousPlanes()) {
+#ifdef SURFACE_TRACING
+    ISURFACETRACE("Keeping planes of layers above z order: %d \n", add_index);
+#endif
+    remap_layers = true;
+    add_index = -1;
+    remove_index = -1;
+  }
+
   // We may have skipped layers which are not visible.
   size_t size = layers.size();
   if ((add_index == 0) || validate_layers) {
     // If index is zero, no point trying for incremental validation.
     validate_layers = true;
-  } else if (previous_size > size) {
+  } else if (previous_size > size && !remap_layers) {
     if (remove_index == -1) {
       remove_index = size;
     } else if (add_index != -1) {
@@ -702,7 +955,8 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
   }
 
   if (idle_frame) {
-    if ((add_index != -1) || (remove_index != -1) || re_validate_commit) {
+    if ((add_index != -1) || (remove_index != -1) || re_validate_commit ||
+        remap_layers) {
       idle_frame = false;
     }
   }
@@ -729,6 +983,7 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
 #endif
 
   DisplayPlaneStateList current_composition_planes;
+  current_composition_planes.swap(spare_plane_state_);
   bool render_layers;
   bool force_media_composition = false;
   bool requested_video_effect = false;
@@ -751,6 +1006,17 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
   bool composition_passed = true;
 
   bool disable_overlays = state_ & kDisableOverlay;
+  // Clones scale our frame as a single plane, along with the cursor plane.
+  bool single_plane = false;
+  if ((state_ & kScaledClones) && !disable_overlays) {
+    size_t cursor_layers = 0;
+    for (const OverlayLayer& layer : layers) {
+      if (layer.IsCursorLayer())
+        cursor_layers++;
+    }
+
+    single_plane = layers.size() - cursor_layers > 1;
+  }
   bool disable_explictsync = state_ & kDisableExplictSync;
 
   if (!validate_layers && tracker.RevalidateLayers()) {
@@ -766,15 +1032,15 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     bool needs_plane_validation = false;
     GetCachedLayers(layers, remove_index, &current_composition_planes,
                     &render_layers, &can_ignore_commit, &needs_plane_validation,
-                    &validate_layers, &add_index);
+                    &validate_layers, &add_index, remap_layers);
     if (add_index == 0) {
       validate_layers = true;
     }
 
     if (!validate_layers && add_index > 0) {
       bool render_cursor = display_plane_manager_->ValidateLayers(
-          layers, add_index, disable_overlays, &commit_checked,
-          &needs_plane_validation, current_composition_planes,
+          layers, add_index, disable_overlays || single_plane, single_plane,
+          &commit_checked, &needs_plane_validation, current_composition_planes,
           previous_plane_state_, surfaces_not_inuse_);
 
       if (!render_layers)
@@ -787,6 +1053,7 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     }
 
     if (!validate_layers && (re_validate_commit || needs_plane_validation)) {
+      frame_stats_.Add(FrameStats::kPlaneRevalidations);
       bool render = display_plane_manager_->ReValidatePlanes(
           current_composition_planes, layers, surfaces_not_inuse_,
           &validate_layers, needs_plane_validation, re_validate_commit);
@@ -804,7 +1071,12 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
         can_ignore_commit = false;
       }
 
+      // A new canvas color needs a commit to carry it.
+      if (state_ & kCanvasColorChanged)
+        can_ignore_commit = false;
+
       if (can_ignore_commit) {
+        frame_stats_.Add(FrameStats::kFramesSkipped);
         *ignore_clone_update = true;
         // Free any surfaces.
         if (!mark_not_inuse_.empty()) {
@@ -819,6 +1091,10 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
 
         return true;
       }
+
+      // Only counted once neither a full validation nor a skipped frame
+      // took over.
+      frame_stats_.Add(FrameStats::kIncrementalValidations);
     }
   }
 
@@ -830,15 +1106,18 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
       tracker.ResetTrackerState();
 
     needs_clone_validation_ = true;
+    frame_stats_.Add(FrameStats::kFullValidations);
 
     // We are doing a full re-validation.
     add_index = 0;
     bool force_gpu = disable_overlays || idle_frame ||
                      ((state_ & kConfigurationChanged) && (layers.size() > 1));
     bool test_commit = false;
+    bool keep_cursor = !force_gpu && single_plane;
     render_layers = display_plane_manager_->ValidateLayers(
-        layers, add_index, force_gpu, &test_commit, &test_commit,
-        current_composition_planes, previous_plane_state_, surfaces_not_inuse_);
+        layers, add_index, force_gpu || single_plane, keep_cursor, &test_commit,
+        &test_commit, current_composition_planes, previous_plane_state_,
+        surfaces_not_inuse_);
     // If Video effects need to be applied, let's make sure
     // we go through the composition pass for Video Layers.
     if (force_media_composition && requested_video_effect) {
@@ -852,6 +1131,19 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
   DUMP_CURRENT_COMPOSITION_PLANES();
   DUMP_CURRENT_LAYER_PLANE_COMBINATIONS();
   DUMP_CURRENT_DUPLICATE_LAYER_COMBINATIONS();
+  present_scheduler_.StageDone(PresentScheduler::kValidate);
+  frame_stats_.Add(FrameStats::kTestCommits,
+                   display_plane_manager_->GetTestCommits() - test_commits);
+  frame_stats_.Add(
+      FrameStats::kPlaneAssignmentCacheHits,
+      display_plane_manager_->GetPlaneAssignmentCacheHits() - cache_hits);
+  frame_stats_.Add(
+      FrameStats::kPlaneAssignmentCacheMisses,
+      display_plane_manager_->GetPlaneAssignmentCacheMisses() - cache_misses);
+  AddValidationStats();
+  int64_t stage_end = FrameStats::Now();
+  frame_stats_.Add(FrameStats::kValidateTime, stage_end - stage_start);
+  stage_start = stage_end;
 
   // Ensure all pixel buffer uploads are done.
   if (call_back) {
@@ -882,17 +1174,45 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
       }
     }
 
-    std::vector<HwcRect<int>> layers_rects;
+    std::vector<HwcRect<int>>& layers_rects = layers_rects_;
+    layers_rects.clear();
     for (size_t layer_index = 0; layer_index < size; layer_index++) {
       const OverlayLayer& layer = layers.at(layer_index);
       layers_rects.emplace_back(layer.GetDisplayFrame());
     }
 
+    for (DisplayPlaneState& plane : current_composition_planes) {
+      if (plane.NeedsOffScreenComposition() && plane.IsVideoPlane())
+        frame_stats_.Add(FrameStats::kMediaCompositions);
+    }
+
     // Prepare for final composition.
-    if (!compositor_.Draw(current_composition_planes, layers, layers_rects)) {
+    if (!compositor_.Draw(current_composition_planes, layers, layers_rects,
+                          true, present_scheduler_.GetComposeDeadline())) {
       ETRACE("Failed to prepare for the frame composition. ");
       composition_passed = false;
     }
+
+    frame_stats_.Add(FrameStats::kGpuCompositedPixels,
+                     compositor_.GetDrawnPixels());
+    frame_stats_.Add(FrameStats::kGpuSampledPixels,
+                     compositor_.GetSampledPixels());
+    frame_stats_.Add(FrameStats::kClearsAvoided,
+                     compositor_.GetClearsAvoided());
+    frame_stats_.Add(FrameStats::kClearBytesSaved,
+                     compositor_.GetClearBytesSaved());
+
+    // A queued draw is timed till the GPU is done with it.
+    int32_t compose_fence = compositor_.TakeDeferredDrawFence();
+    if (compose_fence >= 0) {
+      present_scheduler_.ComposeQueued(compose_fence);
+    } else {
+      present_scheduler_.StageDone(PresentScheduler::kCompose);
+    }
+
+    stage_end = FrameStats::Now();
+    frame_stats_.Add(FrameStats::kComposeTime, stage_end - stage_start);
+    stage_start = stage_end;
   }
 
   if (!composition_passed) {
@@ -908,11 +1228,9 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     state_ &= ~kNeedsColorCorrection;
   }
 
-  if (state_ & kCanvasColorChanged) {
-    display_->SetPipeCanvasColor(canvas_.bpc, canvas_.red, canvas_.green,
-                                 canvas_.blue, canvas_.alpha);
-    state_ &= ~kCanvasColorChanged;
-  }
+  // Sent with the planes, so that the background changes in the same
+  // frame as the planes covering it.
+  UpdateCanvasColor();
 
   int32_t fence = 0;
   bool fence_released = false;
@@ -925,12 +1243,17 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     kms_fence_ = 0;
   }
 
+  frame_stats_.Add(FrameStats::kCommitTime, FrameStats::Now() - stage_start);
   if (!composition_passed) {
+    frame_stats_.Add(FrameStats::kCommitFailures);
     last_commit_failed_update_ = true;
     HandleCommitFailure(current_composition_planes);
     return false;
   }
 
+  present_scheduler_.FrameCommitted(fence);
+  frame_stats_.Add(FrameStats::kFramesPresented);
+
   // Mark any surfaces as not in use. These surfaces
   // where not marked earlier as they where onscreen.
   // Doing it here also ensures that if this surface
@@ -942,7 +1265,7 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
       mark_not_inuse_.at(i)->SetSurfaceAge(-1);
     }
 
-    std::vector<NativeSurface*>().swap(mark_not_inuse_);
+    mark_not_inuse_.clear();
     tracker.ForceSurfaceRelease();
   }
 
@@ -977,6 +1300,9 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     *retire_fence = dup(fence);
     kms_fence_ = fence;
 
+    if (turn)
+      turn->BeginRelease();
+
     SetReleaseFenceToLayers(fence, source_layers);
   }
 
@@ -986,10 +1312,31 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     display_->HandleLazyInitialization();
   }
 
+  // Layers and planes of the previous frame are released here as before,
+  // but we keep their storage for the next one.
+  layers.clear();
+  spare_layers_.swap(layers);
+  current_composition_planes.clear();
+  spare_plane_state_.swap(current_composition_planes);
   return true;
 }
 
+void DisplayQueue::MigrateCompositor() {
+  if (!compositor_.ShouldMigrate())
+    return;
+
+  // Textures and frame buffers of the worker we leave are released in its
+  // context, the next one imports buffers again as it draws them.
+  display_plane_manager_->ReleaseSurfaceGpuResources();
+  resource_manager_->ReleaseGpuResources();
+  resource_manager_->PreparePurgedResources();
+  compositor_.Migrate();
+}
+
 void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
+  compositor_.WaitForPendingDraw();
+  MigrateCompositor();
+  frame_arena_.Reset();
   ScopedCloneStateTracker tracker(compositor_, resource_manager_.get(), this);
   const DisplayPlaneStateList& source_planes =
       queue->GetCurrentCompositionPlanes();
@@ -1012,11 +1359,53 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
     return;
   }
 
+  // With scaled clones the source frame is a single plane, its final
+  // composition or only scanout buffer. We show it with the same aspect
+  // ratio through the scaler of one of our planes, the source background
+  // filling the bars, and fall back to a single downscaling blit without
+  // one.
+  bool scaled = queue->state_ & kScaledClones;
+  // The source has dropped its background from its planes. Without a pipe
+  // canvas of our own, it goes below them as a solid color layer.
+  bool background_layer =
+      queue->has_background_ && !display_->SupportsPipeCanvasColor();
+  SetBackgroundColor(queue->has_background_ && !background_layer,
+                     queue->background_color_);
   std::vector<OverlayLayer> layers;
   int add_index = -1;
   int remove_index = -1;
   size_t z_order = 0;
   size_t previous_size = in_flight_layers_.size();
+  if (background_layer) {
+    uint32_t width = display_plane_manager_->GetWidth();
+    uint32_t height = display_plane_manager_->GetHeight();
+    HwcRect<int> frame(0, 0, width, height);
+    HwcRegion damage;
+    // Content only changes with the color.
+    if (clone_background_.GetSolidColor() != queue->background_color_ ||
+        !(clone_background_.GetDisplayFrame() == frame)) {
+      damage.emplace_back(frame);
+    } else {
+      damage.emplace_back(0, 0, 0, 0);
+    }
+
+    clone_background_.SetLayerCompositionType(Composition_SolidColor);
+    clone_background_.SetSolidColor(queue->background_color_);
+    clone_background_.SetDisplayFrame(frame, 0, 0);
+    clone_background_.SetSourceCrop(HwcRect<float>(0, 0, width, height));
+    clone_background_.SetSurfaceDamage(damage);
+
+    layers.emplace_back();
+    OverlayLayer* previous_layer =
+        previous_size > 0 ? &(in_flight_layers_.at(0)) : NULL;
+    if (!previous_layer || !previous_layer->IsSolidColor())
+      add_index = 0;
+
+    layers.back().InitializeFromHwcLayer(
+        &clone_background_, resource_manager_.get(), previous_layer, 0, 0,
+        height, kRotateNone, false);
+    z_order++;
+  }
   for (const DisplayPlaneState& previous_plane : source_planes) {
     layers.emplace_back();
 
@@ -1032,7 +1421,18 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
 
     HwcRect<int> display_frame =
         previous_plane.GetOverlayLayer()->GetDisplayFrame();
-    if (scaling_tracker_.scaling_state_ == ScalingTracker::kNeedsScaling) {
+    if (scaled) {
+      float scale = scaling_tracker_.letterbox_scale;
+      display_frame.left = scaling_tracker_.letterbox_left +
+                           static_cast<int>(display_frame.left * scale);
+      display_frame.top = scaling_tracker_.letterbox_top +
+                          static_cast<int>(display_frame.top * scale);
+      display_frame.right = scaling_tracker_.letterbox_left +
+                            static_cast<int>(display_frame.right * scale);
+      display_frame.bottom = scaling_tracker_.letterbox_top +
+                             static_cast<int>(display_frame.bottom * scale);
+    } else if (scaling_tracker_.scaling_state_ ==
+               ScalingTracker::kNeedsScaling) {
       display_frame.left =
           display_frame.left +
           (display_frame.left * scaling_tracker_.scaling_width);
@@ -1070,8 +1470,18 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
   bool validate_layers = last_commit_failed_update_ ||
                          queue->needs_clone_validation_ ||
                          previous_plane_state_.empty() || (add_index == 0);
-  if (previous_plane_state_.size() != source_planes.size())
+  if (previous_plane_state_.size() != layers.size())
+    validate_layers = true;
+
+  if (scaled != clone_scaled_) {
+    clone_scaled_ = scaled;
+    validate_layers = true;
+  }
+
+  if (background_layer != clone_background_shown_) {
+    clone_background_shown_ = background_layer;
     validate_layers = true;
+  }
 
   DisplayPlaneStateList current_composition_planes;
   // Validate Overlays and Layers usage.
@@ -1091,16 +1501,16 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
 
     GetCachedLayers(layers, remove_index, &current_composition_planes,
                     &render_layers, &can_ignore_commit, &needs_plane_validation,
-                    &validate_layers, &add_index);
+                    &validate_layers, &add_index, false);
     if (add_index == 0) {
       validate_layers = true;
     }
 
     if (!validate_layers && add_index > 0) {
       bool render_cursor = display_plane_manager_->ValidateLayers(
-          layers, add_index, false, &commit_checked, &needs_plane_validation,
-          current_composition_planes, previous_plane_state_,
-          surfaces_not_inuse_);
+          layers, add_index, false, false, &commit_checked,
+          &needs_plane_validation, current_composition_planes,
+          previous_plane_state_, surfaces_not_inuse_);
 
       if (!render_layers)
         render_layers = render_cursor;
@@ -1117,6 +1527,9 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
     }
 
     if (!validate_layers) {
+      if (state_ & kCanvasColorChanged)
+        can_ignore_commit = false;
+
       if (can_ignore_commit) {
         // Free any surfaces.
         if (!mark_not_inuse_.empty()) {
@@ -1139,7 +1552,7 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
 
   if (validate_layers) {
     render_layers = display_plane_manager_->ValidateLayers(
-        layers, 0, false, &test_commit, &test_commit,
+        layers, 0, false, false, &test_commit, &test_commit,
         current_composition_planes, previous_plane_state_, surfaces_not_inuse_);
   }
 
@@ -1154,7 +1567,8 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
     clone_rendered_ = true;
     compositor_.BeginFrame(false);
 
-    std::vector<HwcRect<int>> layers_rects;
+    std::vector<HwcRect<int>>& layers_rects = layers_rects_;
+    layers_rects.clear();
     size_t size = layers.size();
     for (size_t layer_index = 0; layer_index < size; layer_index++) {
       const OverlayLayer& layer = layers.at(layer_index);
@@ -1174,6 +1588,8 @@ void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
     return;
   }
 
+  UpdateCanvasColor();
+
   int32_t fence = 0;
   bool fence_released = false;
   composition_passed =
@@ -1275,9 +1691,9 @@ void DisplayQueue::SetCloneMode(bool cloned) {
 }
 
 void DisplayQueue::IgnoreUpdates() {
-  idle_tracker_.idle_frames_ = 0;
   idle_tracker_.state_ = FrameStateTracker::kIgnoreUpdates;
   idle_tracker_.revalidate_frames_counter_ = 0;
+  vblank_handler_->RestartIdleTimer();
 }
 
 bool DisplayQueue::IsIgnoreUpdates() {
@@ -1286,6 +1702,10 @@ bool DisplayQueue::IsIgnoreUpdates() {
 
 void DisplayQueue::HandleCommitFailure(
     DisplayPlaneStateList& current_composition_planes) {
+  // Surfaces cannot be recycled while they are being rendered to.
+  compositor_.WaitForPendingDraw();
+  // Make sure we don't end up with the same plane assignment again.
+  display_plane_manager_->InvalidatePlaneAssignment();
   for (DisplayPlaneState& plane : current_composition_planes) {
     if (plane.GetSurfaces().empty()) {
       continue;
@@ -1477,6 +1897,46 @@ void DisplayQueue::SetDisableExplicitSync(bool disable_explicit_sync) {
   }
 }
 
+void DisplayQueue::GetFrameStats(HwcFrameStats* stats) const {
+  frame_stats_.Get(stats);
+}
+
+void DisplayQueue::AddValidationStats() {
+  typedef DisplayPlaneManager::ValidationStrategy Strategy;
+  static const struct {
+    Strategy strategy;
+    FrameStats::Counter validations;
+    FrameStats::Counter test_commits;
+  } kCounters[] = {{Strategy::kIncremental,
+                    FrameStats::kIncrementalStrategyValidations,
+                    FrameStats::kIncrementalStrategyTestCommits},
+                   {Strategy::kBatched, FrameStats::kBatchedStrategyValidations,
+                    FrameStats::kBatchedStrategyTestCommits}};
+
+  for (const auto& counters : kCounters) {
+    int32_t index = static_cast<int32_t>(counters.strategy);
+    uint32_t validations = 0;
+    uint32_t test_commits = 0;
+    display_plane_manager_->GetValidationStats(counters.strategy, &validations,
+                                               &test_commits);
+    frame_stats_.Add(counters.validations,
+                     validations - strategy_validations_[index]);
+    frame_stats_.Add(counters.test_commits,
+                     test_commits - strategy_test_commits_[index]);
+    strategy_validations_[index] = validations;
+    strategy_test_commits_[index] = test_commits;
+  }
+}
+
+void DisplayQueue::ResetFrameStats() {
+  frame_stats_.Reset();
+}
+
+void DisplayQueue::SetLateLatching(bool enable) {
+  present_scheduler_.SetEnabled(enable);
+  vblank_handler_->UpdateVblankRequests();
+}
+
 void DisplayQueue::SetVideoScalingMode(uint32_t mode) {
   video_lock_.lock();
   requested_video_effect_ = true;
@@ -1565,18 +2025,6 @@ void DisplayQueue::HandleIdleCase() {
     return;
   }
 
-  if (idle_tracker_.idle_frames_ > kidleframes) {
-    idle_tracker_.idle_lock_.unlock();
-    return;
-  }
-
-  if (idle_tracker_.idle_frames_ < kidleframes) {
-    idle_tracker_.idle_frames_++;
-    idle_tracker_.idle_lock_.unlock();
-    return;
-  }
-
-  idle_tracker_.idle_frames_++;
   power_mode_lock_.lock();
   if (!(state_ & kIgnoreIdleRefresh) && refresh_callback_ &&
       (state_ & kPoweredOn)) {
@@ -1627,15 +2075,38 @@ void DisplayQueue::UpdateScalingRatio(uint32_t primary_width,
   if (primary_area != display_area) {
     scaling_tracker_.scaling_state_ = ScalingTracker::kNeedsScaling;
     scaling_tracker_.scaling_width =
-        float(display_width - primary_width) / float(primary_width);
+        (float(display_width) - float(primary_width)) / float(primary_width);
     scaling_tracker_.scaling_height =
-        float(display_height - primary_height) / float(primary_height);
+        (float(display_height) - float(primary_height)) /
+        float(primary_height);
   }
 
+  float scale = std::min(float(display_width) / float(primary_width),
+                         float(display_height) / float(primary_height));
+  scaling_tracker_.letterbox_scale = scale;
+  scaling_tracker_.letterbox_left =
+      (int32_t(display_width) - int32_t(primary_width * scale)) / 2;
+  scaling_tracker_.letterbox_top =
+      (int32_t(display_height) - int32_t(primary_height * scale)) / 2;
+
   state_ |= kConfigurationChanged;
 }
 
+void DisplayQueue::SetScaledClones(bool enable) {
+  if (enable == static_cast<bool>(state_ & kScaledClones))
+    return;
+
+  if (enable) {
+    state_ |= kScaledClones;
+  } else {
+    state_ &= ~kScaledClones;
+  }
+
+  state_ |= kScaledClonesChanged;
+}
+
 void DisplayQueue::ResetQueue() {
+  compositor_.WaitForPendingDraw();
   last_commit_failed_update_ = false;
   std::vector<OverlayLayer>().swap(in_flight_layers_);
   DisplayPlaneStateList().swap(previous_plane_state_);
@@ -1651,10 +2122,11 @@ void DisplayQueue::ResetQueue() {
   }
 
   idle_tracker_.state_ = 0;
-  idle_tracker_.idle_frames_ = 0;
   if (ignore_updates) {
     idle_tracker_.state_ |= FrameStateTracker::kIgnoreUpdates;
   }
+
+  vblank_handler_->RestartIdleTimer();
   compositor_.Reset();
   clone_rendered_ = false;
 }
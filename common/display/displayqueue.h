@@ -28,8 +28,12 @@
 
 #include "compositor.h"
 #include "displayplanemanager.h"
+#include "framestats.h"
+#include "hwclayer.h"
 #include "hwcthread.h"
 #include "platformdefines.h"
+#include "presentscheduler.h"
+#include "presentsequencer.h"
 #include "resourcemanager.h"
 #include "vblankeventhandler.h"
 
@@ -54,7 +58,6 @@ class DisplayPlaneHandler;
 struct HwcLayer;
 class NativeBufferHandler;
 
-static uint32_t kidleframes = 250;
 class DisplayQueue {
  public:
   DisplayQueue(uint32_t gpu_fd, bool disable_explictsync,
@@ -66,7 +69,8 @@ class DisplayQueue {
 
   bool QueueUpdate(std::vector<HwcLayer*>& source_layers, int32_t* retire_fence,
                    bool* ignore_clone_update, PixelUploaderCallback* call_back,
-                   bool handle_constraints);
+                   bool handle_constraints,
+                   PresentTurn* turn = NULL);
   bool SetPowerMode(uint32_t power_mode);
   bool CheckPlaneFormat(uint32_t format);
   void SetGamma(float red, float green, float blue);
@@ -75,6 +79,21 @@ class DisplayQueue {
   void SetBrightness(uint32_t red, uint32_t green, uint32_t blue);
   void SetDisableExplicitSync(bool disable_explicit_sync);
   void SetVideoScalingMode(uint32_t mode);
+  // When enabled, frames are latched as late as possible while still
+  // making it for the next vblank.
+  void SetLateLatching(bool enable);
+  // With late latching, waits till work on the next frame needs to
+  // start. Called before the layers of the frame are read.
+  void WaitForLatch() {
+    present_scheduler_.WaitForLatch();
+  }
+
+  uint32_t GetMissedPresentDeadlines() const {
+    return present_scheduler_.GetMissedDeadlines();
+  }
+
+  void GetFrameStats(HwcFrameStats* stats) const;
+  void ResetFrameStats();
   void SetVideoColor(HWCColorControl color, float value);
   void GetVideoColor(HWCColorControl color, float* value, float* start,
                      float* end);
@@ -91,6 +110,7 @@ class DisplayQueue {
 
   void VSyncControl(bool enabled);
 
+  // Called by VblankEventHandler once there were no updates for a while.
   void HandleIdleCase();
 
   void DisplayConfigurationChanged();
@@ -106,6 +126,12 @@ class DisplayQueue {
 
   void SetCloneMode(bool cloned);
 
+  // While enabled, frames are composed into a single plane whenever they
+  // have more than one layer besides cursors, so that clones can scan out
+  // our final composition as is, scaled by their planes. Cursors keep their
+  // own plane.
+  void SetScaledClones(bool enable);
+
   void RotateDisplay(HWCRotation rotation);
 
   void IgnoreUpdates();
@@ -157,6 +183,8 @@ class DisplayQueue {
     kVideoDiscardProtected =
         1 << 6,  // Need to discard protected video due to tearing down
     kDisableOverlay = 1 << 7,  // Disable HW overlay
+    kScaledClones = 1 << 8,    // Clones scan out our final composition.
+    kScaledClonesChanged = 1 << 9,  // Layers need full validation.
   };
 
   struct ScalingTracker {
@@ -167,6 +195,11 @@ class DisplayQueue {
     float scaling_height = 1.0;
     float scaling_width = 1.0;
     uint32_t scaling_state_ = ScalingTracker::kNeeedsNoSclaing;
+    // Aspect preserving mapping of the source display, centered with
+    // letterbox or pillarbox bars.
+    float letterbox_scale = 1.0;
+    int32_t letterbox_left = 0;
+    int32_t letterbox_top = 0;
   };
 
   struct FrameStateTracker {
@@ -187,7 +220,6 @@ class DisplayQueue {
       kForceIgnoreUpdates = 1 << 6  // Ignore all commits/updates.
     };
 
-    uint32_t idle_frames_ = 0;
     bool has_cursor_layer_ = false;
     SpinLock idle_lock_;
     int state_ = kPrepareComposition;
@@ -256,10 +288,6 @@ class DisplayQueue {
 
     ~ScopedIdleStateTracker() {
       tracker_.idle_lock_.lock();
-      // Reset idle frame count. We want that idle frames
-      // are continuous to detect idle mode scenario.
-      tracker_.idle_frames_ = 0;
-
       tracker_.state_ &= ~FrameStateTracker::kPrepareComposition;
       if (tracker_.state_ & FrameStateTracker::kRenderIdleDisplay) {
         tracker_.state_ &= ~FrameStateTracker::kRenderIdleDisplay;
@@ -281,6 +309,10 @@ class DisplayQueue {
       tracker_.total_planes_ = queue_->previous_plane_state_.size();
       tracker_.idle_lock_.unlock();
 
+      // We want that idle time is continuous to detect idle mode
+      // scenario.
+      queue_->vblank_handler_->RestartIdleTimer();
+
       // Free any surfaces.
       queue_->display_plane_manager_->ReleaseFreeOffScreenTargets(forced_);
 
@@ -333,7 +365,8 @@ class DisplayQueue {
                        int remove_index, DisplayPlaneStateList* composition,
                        bool* render_layers, bool* can_ignore_commit,
                        bool* needs_plane_validation,
-                       bool* force_full_validation, int* add_index);
+                       bool* force_full_validation, int* add_index,
+                       bool remap_layers);
   void SetReleaseFenceToLayers(int32_t fence,
                                std::vector<HwcLayer*>& source_layers);
 
@@ -347,7 +380,29 @@ class DisplayQueue {
   // queue is teraing down or re-started for some reason.
   void ResetQueue();
 
+  // Moves our compositor to another worker of the pool, if it asks for
+  // it. Needs to be called between frames.
+  void MigrateCompositor();
+
   void HandleCommitFailure(DisplayPlaneStateList& current_composition_planes);
+  // Matches source_layers with in_flight_layers_ by identity, keeping
+  // their relative order. Results are stored in previous_layer_match_.
+  void MatchPreviousLayers(const std::vector<HwcLayer*>& source_layers);
+  // Returns true if every plane of previous_plane_state_ keeps at least
+  // one of its layers in this frame, going by previous_z_order_map_.
+  bool CanKeepPreviousPlanes() const;
+
+  // Adds validations per strategy done by DisplayPlaneManager since the
+  // last call to frame stats.
+  void AddValidationStats();
+  // Returns the bottom-most layer of source_layers if it's an opaque solid
+  // color covering the whole display, which can be shown through the pipe
+  // canvas instead of a plane. NULL otherwise.
+  HwcLayer* FindBackgroundLayer(const std::vector<HwcLayer*>& source_layers);
+  void SetBackgroundColor(bool enabled, uint32_t color);
+  // Hands the display the background color if one is set, canvas_
+  // otherwise, to go out with the next Commit.
+  void UpdateCanvasColor();
   void InitializeOverlayLayers(std::vector<HwcLayer*>& source_layers,
                                bool handle_constraints, bool validate_layers,
                                std::vector<OverlayLayer>& layers,
@@ -364,11 +419,33 @@ class DisplayQueue {
   int32_t kms_fence_ = 0;
   struct gamma_colors gamma_;
   struct canvas_color_comps canvas_;
+  // Layer of the current frame shown through the pipe canvas, skipped when
+  // initializing overlay layers.
+  HwcLayer* background_layer_ = NULL;
+  // Color of the layer last shown through the pipe canvas, in RGBA8888.
+  uint32_t background_color_ = 0;
+  bool has_background_ = false;
+  FrameStats frame_stats_;
+  // Totals of DisplayPlaneManager::GetValidationStats when last added to
+  // frame_stats_, indexed by strategy.
+  uint32_t strategy_validations_[static_cast<int32_t>(
+      DisplayPlaneManager::ValidationStrategy::kTotal)] = {};
+  uint32_t strategy_test_commits_[static_cast<int32_t>(
+      DisplayPlaneManager::ValidationStrategy::kTotal)] = {};
+  // Needs to outlive vblank_handler_.
+  PresentScheduler present_scheduler_;
   std::unique_ptr<VblankEventHandler> vblank_handler_;
   std::unique_ptr<DisplayPlaneManager> display_plane_manager_;
   std::unique_ptr<ResourceManager> resource_manager_;
   std::vector<OverlayLayer> in_flight_layers_;
   DisplayPlaneStateList previous_plane_state_;
+  // Containers of the last frame, kept around to reuse their storage.
+  std::vector<OverlayLayer> spare_layers_;
+  DisplayPlaneStateList spare_plane_state_;
+  // Display frames of the layers passed to Compositor::Draw.
+  std::vector<HwcRect<int>> layers_rects_;
+  // Temporaries of a frame, reset at the start of every update.
+  FrameArena frame_arena_;
   FrameStateTracker idle_tracker_;
   ScalingTracker scaling_tracker_;
   // shared_ptr since we need to use this outside of the thread lock (to
@@ -393,6 +470,12 @@ class DisplayQueue {
   bool clone_mode_ = false;
   // Set to true if this queue needs to render the offscreen surfaces.
   bool clone_rendered_ = false;
+  // Source of the last cloned frame had scaled clones enabled.
+  bool clone_scaled_ = false;
+  // Background of the source shown as a layer, when we can't show it
+  // through the pipe canvas.
+  HwcLayer clone_background_;
+  bool clone_background_shown_ = false;
   // Surfaces to be marked as not in use. These
   // are surfaces which are added to surfaces_not_inuse_
   // below.
@@ -402,6 +485,20 @@ class DisplayQueue {
   // frame.
   std::vector<NativeSurface*> surfaces_not_inuse_;
   std::vector<HwcLayer*>* source_layers_ = NULL;
+  // Index of layer in in_flight_layers_ matching each source layer, -1
+  // if there is none.
+  std::vector<int> previous_layer_match_;
+  // Storage used by MatchPreviousLayers.
+  std::vector<size_t> match_candidates_;
+  std::vector<uint16_t> match_table_;
+  // Z order in this frame of each layer of in_flight_layers_, -1 if it
+  // has been removed.
+  std::vector<int> previous_z_order_map_;
+  // Set by InitializeOverlayLayers when the only change to the layer stack
+  // is that some layers have been removed.
+  bool layers_removed_only_ = false;
+  // Damage of the offscreen plane being checked in GetCachedLayers.
+  HwcRegion damage_region_;
 };
 
 }  // namespace hwcomposer
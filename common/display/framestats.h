@@ -0,0 +1,119 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_FRAMESTATS_H_
+#define COMMON_DISPLAY_FRAMESTATS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+#include <hwcdefs.h>
+
+namespace hwcomposer {
+
+// Counters updated by DisplayQueue for every frame. These can be read and
+// reset from any thread. Relaxed atomics are used, so that collecting
+// stats is cheap enough to always be done; a snapshot taken while a frame
+// is in progress might contain only part of its updates.
+class FrameStats {
+ public:
+  enum Counter {
+    kFramesPresented = 0,
+    kFramesSkipped,
+    kFullValidations,
+    kIncrementalValidations,
+    kPlaneRevalidations,
+    kTestCommits,
+    kGpuCompositedPixels,
+    kGpuSampledPixels,
+    kClearsAvoided,
+    kClearBytesSaved,
+    kMediaCompositions,
+    kCommitFailures,
+    kValidateTime,
+    kComposeTime,
+    kCommitTime,
+    kPlaneAssignmentCacheHits,
+    kPlaneAssignmentCacheMisses,
+    kIncrementalStrategyValidations,
+    kIncrementalStrategyTestCommits,
+    kBatchedStrategyValidations,
+    kBatchedStrategyTestCommits,
+    kTotalCounters
+  };
+
+  FrameStats() {
+    Reset();
+  }
+
+  FrameStats(const FrameStats &) = delete;
+  FrameStats &operator=(const FrameStats &) = delete;
+
+  void Add(Counter counter, uint64_t value = 1) {
+    counters_[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void Reset() {
+    for (uint32_t i = 0; i < kTotalCounters; i++) {
+      counters_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Get(HwcFrameStats *stats) const {
+    stats->frames_presented = Load(kFramesPresented);
+    stats->frames_skipped = Load(kFramesSkipped);
+    stats->full_validations = Load(kFullValidations);
+    stats->incremental_validations = Load(kIncrementalValidations);
+    stats->plane_revalidations = Load(kPlaneRevalidations);
+    stats->test_commits = Load(kTestCommits);
+    stats->gpu_composited_pixels = Load(kGpuCompositedPixels);
+    stats->gpu_sampled_pixels = Load(kGpuSampledPixels);
+    stats->clears_avoided = Load(kClearsAvoided);
+    stats->clear_bytes_saved = Load(kClearBytesSaved);
+    stats->media_compositions = Load(kMediaCompositions);
+    stats->commit_failures = Load(kCommitFailures);
+    stats->validate_time = Load(kValidateTime);
+    stats->compose_time = Load(kComposeTime);
+    stats->commit_time = Load(kCommitTime);
+    stats->plane_assignment_cache_hits = Load(kPlaneAssignmentCacheHits);
+    stats->plane_assignment_cache_misses = Load(kPlaneAssignmentCacheMisses);
+    stats->incremental_strategy_validations =
+        Load(kIncrementalStrategyValidations);
+    stats->incremental_strategy_test_commits =
+        Load(kIncrementalStrategyTestCommits);
+    stats->batched_strategy_validations = Load(kBatchedStrategyValidations);
+    stats->batched_strategy_test_commits = Load(kBatchedStrategyTestCommits);
+  }
+
+  // Current CLOCK_MONOTONIC time in ns, to be used for stage timings.
+  static int64_t Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+ private:
+  uint64_t Load(Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counters_[kTotalCounters];
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_FRAMESTATS_H_
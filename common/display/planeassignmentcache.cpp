@@ -0,0 +1,167 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "planeassignmentcache.h"
+
+#include "hwctrace.h"
+#include "overlaybuffer.h"
+#include "overlaylayer.h"
+
+namespace hwcomposer {
+
+static void HashValue(uint64_t &hash, uint32_t value) {
+  // FNV-1a
+  for (uint32_t i = 0; i < 4; i++) {
+    hash ^= (value >> (i * 8)) & 0xff;
+    hash *= 1099511628211ULL;
+  }
+}
+
+bool PlaneAssignmentCache::LayerSignature::operator==(
+    const LayerSignature &rhs) const {
+  return format == rhs.format && tiling_mode == rhs.tiling_mode &&
+         transform == rhs.transform && display_left == rhs.display_left &&
+         display_top == rhs.display_top && display_width == rhs.display_width &&
+         display_height == rhs.display_height &&
+         source_width == rhs.source_width &&
+         source_height == rhs.source_height && blending == rhs.blending &&
+         alpha == rhs.alpha && type == rhs.type;
+}
+
+bool PlaneAssignmentCache::Signature::operator==(
+    const Signature &rhs) const {
+  return hash == rhs.hash && display_transform == rhs.display_transform &&
+         layers == rhs.layers;
+}
+
+const PlaneAssignmentCache::Assignment *PlaneAssignmentCache::Lookup(
+    const std::vector<OverlayLayer> &layers, uint32_t display_transform) {
+  Signature &signature = last_signature_;
+  signature.hash = 14695981039346656037ULL;
+  signature.display_transform = display_transform;
+  signature.layers.clear();
+  signature.layers.reserve(layers.size());
+  HashValue(signature.hash, display_transform);
+  for (const OverlayLayer &layer : layers) {
+    signature.layers.emplace_back();
+    LayerSignature &temp = signature.layers.back();
+    if (layer.IsCursorLayer()) {
+      temp.type = kLayerCursor;
+    } else if (layer.IsProtected()) {
+      temp.type = kLayerProtected;
+    } else if (layer.IsVideoLayer()) {
+      temp.type = kLayerVideo;
+    } else if (layer.IsSolidColor()) {
+      temp.type = kLayerSolidColor;
+    }
+
+    OverlayBuffer *buffer = layer.GetBuffer();
+    if (buffer && !layer.IsSolidColor()) {
+      temp.format = buffer->GetFormat();
+      temp.tiling_mode = buffer->GetTilingMode();
+    }
+
+    temp.transform = layer.GetPlaneTransform();
+    temp.display_left = layer.GetDisplayFrame().left;
+    temp.display_top = layer.GetDisplayFrame().top;
+    temp.display_width = layer.GetDisplayFrameWidth();
+    temp.display_height = layer.GetDisplayFrameHeight();
+    temp.source_width = layer.GetSourceCropWidth();
+    temp.source_height = layer.GetSourceCropHeight();
+    temp.blending = layer.GetBlending();
+    temp.alpha = layer.GetAlpha();
+
+    HashValue(signature.hash, temp.format);
+    HashValue(signature.hash, temp.tiling_mode);
+    HashValue(signature.hash, temp.transform);
+    HashValue(signature.hash, static_cast<uint32_t>(temp.display_left));
+    HashValue(signature.hash, static_cast<uint32_t>(temp.display_top));
+    HashValue(signature.hash, temp.display_width);
+    HashValue(signature.hash, temp.display_height);
+    HashValue(signature.hash, temp.source_width);
+    HashValue(signature.hash, temp.source_height);
+    HashValue(signature.hash, static_cast<uint32_t>(temp.blending));
+    HashValue(signature.hash, (temp.alpha << 8) | temp.type);
+  }
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (!(it->signature == signature))
+      continue;
+
+    // Move to front, so that least recently used entry is at the back.
+    entries_.splice(entries_.begin(), entries_, it);
+    hits_++;
+#ifdef RESOURCE_CACHE_TRACING
+    ICACHETRACE("Plane assignment cache hit. hits: %d misses: %d \n", hits_,
+                misses_);
+#endif
+    return &entries_.front().assignment;
+  }
+
+  misses_++;
+#ifdef RESOURCE_CACHE_TRACING
+  ICACHETRACE("Plane assignment cache miss. hits: %d misses: %d \n", hits_,
+              misses_);
+#endif
+  return NULL;
+}
+
+void PlaneAssignmentCache::Insert(Assignment &assignment) {
+  // Invalidated since the last Lookup.
+  if (!last_signature_.hash)
+    return;
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->signature == last_signature_) {
+      entries_.erase(it);
+      break;
+    }
+  }
+
+  if (entries_.size() == kMaxEntries)
+    entries_.pop_back();
+
+  entries_.emplace_front();
+  Entry &entry = entries_.front();
+  entry.signature = last_signature_;
+  entry.assignment.planes.swap(assignment.planes);
+  entry.assignment.scanout_layers.swap(assignment.scanout_layers);
+}
+
+void PlaneAssignmentCache::InvalidateLast() {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->signature == last_signature_) {
+      entries_.erase(it);
+      break;
+    }
+  }
+
+  ResetLastSignature();
+}
+
+void PlaneAssignmentCache::ResetLastSignature() {
+  // Keeps storage of layers for the next Lookup.
+  last_signature_.hash = 0;
+  last_signature_.display_transform = 0;
+  last_signature_.layers.clear();
+}
+
+void PlaneAssignmentCache::Clear() {
+  std::list<Entry>().swap(entries_);
+  ResetLastSignature();
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,129 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_PLANEASSIGNMENTCACHE_H_
+#define COMMON_DISPLAY_PLANEASSIGNMENTCACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+
+#include <hwcdefs.h>
+
+#include "displayplanestate.h"
+
+namespace hwcomposer {
+
+struct OverlayLayer;
+
+// LRU cache of plane assignments which passed validation, keyed by the
+// attributes of the layer stack which matter for the test commits done
+// by DisplayPlaneManager. Looking up an assignment here lets us skip
+// those test commits when we cycle between a few known layer stacks.
+class PlaneAssignmentCache {
+ public:
+  struct PlaneAssignment {
+    // Index of the plane in DisplayPlaneManager overlay planes.
+    uint32_t plane_index = 0;
+    std::vector<size_t> source_layers;
+    bool video_plane = false;
+    bool offscreen = false;
+    bool use_plane_scalar = false;
+    uint32_t down_scaling_factor = 1;
+    DisplayPlaneState::RotationType rotation_type =
+        DisplayPlaneState::RotationType::kDisplayRotation;
+  };
+
+  struct Assignment {
+    std::vector<PlaneAssignment> planes;
+    // True for layers which can be scanned out directly.
+    std::vector<bool> scanout_layers;
+  };
+
+  PlaneAssignmentCache() = default;
+  PlaneAssignmentCache(const PlaneAssignmentCache &) = delete;
+  PlaneAssignmentCache &operator=(const PlaneAssignmentCache &) = delete;
+
+  // Returns assignment for layers in case we have one, NULL otherwise.
+  // Signature of layers is remembered to be used by Insert and
+  // InvalidateLast.
+  const Assignment *Lookup(const std::vector<OverlayLayer> &layers,
+                           uint32_t display_transform);
+
+  // Adds assignment for layers passed to the last Lookup call.
+  void Insert(Assignment &assignment);
+
+  // Drops assignment of layers passed to the last Lookup call. This
+  // should be called when the assignment fails to be committed. Insert
+  // does nothing until the next Lookup.
+  void InvalidateLast();
+
+  void Clear();
+
+  uint32_t GetHits() const {
+    return hits_;
+  }
+
+  uint32_t GetMisses() const {
+    return misses_;
+  }
+
+ private:
+  struct LayerSignature {
+    uint32_t format = 0;
+    uint32_t tiling_mode = 0;
+    uint32_t transform = 0;
+    int32_t display_left = 0;
+    int32_t display_top = 0;
+    uint32_t display_width = 0;
+    uint32_t display_height = 0;
+    uint32_t source_width = 0;
+    uint32_t source_height = 0;
+    HWCBlending blending = HWCBlending::kBlendingNone;
+    uint8_t alpha = 0xff;
+    uint8_t type = kLayerNormal;
+
+    bool operator==(const LayerSignature &rhs) const;
+  };
+
+  struct Signature {
+    uint64_t hash = 0;
+    uint32_t display_transform = 0;
+    std::vector<LayerSignature> layers;
+
+    bool operator==(const Signature &rhs) const;
+  };
+
+  struct Entry {
+    Signature signature;
+    Assignment assignment;
+  };
+
+  // Makes Insert and InvalidateLast no-ops till the next Lookup.
+  void ResetLastSignature();
+
+  // Number of layer stacks we remember.
+  static const size_t kMaxEntries = 8;
+
+  std::list<Entry> entries_;
+  Signature last_signature_;
+  uint32_t hits_ = 0;
+  uint32_t misses_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_PLANEASSIGNMENTCACHE_H_
@@ -0,0 +1,309 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "presentscheduler.h"
+
+#include <errno.h>
+#include <linux/sync_file.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+static const int64_t kOneSecondNs = 1 * 1000 * 1000 * 1000;
+// Slack left between expected end of the frame and vblank, to absorb
+// jitter in our estimates.
+static const int64_t kDeadlineMarginNs = 2 * 1000 * 1000;
+// Ignore vblank intervals longer than this (i.e. below 10Hz) when
+// there is no period known yet, they are likely due to the vblank
+// thread having been suspended.
+static const int64_t kMaxVblankPeriodNs = 100 * 1000 * 1000;
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * kOneSecondNs + ts.tv_nsec;
+}
+
+static int64_t GetThreadTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * kOneSecondNs + ts.tv_nsec;
+}
+
+// Returns the CLOCK_MONOTONIC time at which fence signalled, 0 if it
+// hasn't yet and -1 on errors.
+static int64_t GetFenceSignalTime(int32_t fence) {
+  struct sync_fence_info info[4];
+  struct sync_file_info file_info;
+  memset(&file_info, 0, sizeof(file_info));
+  file_info.num_fences = 4;
+  file_info.sync_fence_info = (uintptr_t)info;
+  if (ioctl(fence, SYNC_IOC_FILE_INFO, &file_info) < 0 ||
+      file_info.num_fences > 4) {
+    return -1;
+  }
+
+  if (file_info.status < 0)
+    return -1;
+
+  if (file_info.status == 0)
+    return 0;
+
+  // Signalled once the last of its fences did.
+  int64_t timestamp = 0;
+  for (uint32_t i = 0; i < file_info.num_fences; i++) {
+    if ((int64_t)info[i].timestamp_ns > timestamp)
+      timestamp = info[i].timestamp_ns;
+  }
+
+  return timestamp;
+}
+
+PresentScheduler::~PresentScheduler() {
+  for (const PendingCompose &compose : pending_composes_)
+    close(compose.fence);
+
+  for (const PendingRetire &retire : pending_retires_)
+    close(retire.fence);
+}
+
+void PresentScheduler::SetEnabled(bool enabled) {
+  enabled_ = enabled;
+  last_mark_ = -1;
+  target_vblank_ = -1;
+  latch_waited_ = false;
+  if (!enabled) {
+    for (const PendingCompose &compose : pending_composes_)
+      close(compose.fence);
+
+    for (const PendingRetire &retire : pending_retires_)
+      close(retire.fence);
+
+    pending_composes_.clear();
+    pending_retires_.clear();
+  }
+}
+
+void PresentScheduler::UpdateVblank(int64_t timestamp) {
+  vblank_lock_.lock();
+  if (last_vblank_ > 0 && timestamp > last_vblank_) {
+    int64_t delta = timestamp - last_vblank_;
+    if (vblank_period_ == 0) {
+      if (delta < kMaxVblankPeriodNs)
+        vblank_period_ = delta;
+    } else if (delta < vblank_period_ + vblank_period_ / 2) {
+      // Skip intervals spanning more than one vblank, we might not be
+      // woken up for every vblank.
+      vblank_period_ += (delta - vblank_period_) / 8;
+    }
+  }
+
+  last_vblank_ = timestamp;
+  vblank_lock_.unlock();
+}
+
+int64_t PresentScheduler::GetEstimate() const {
+  int64_t estimate = kDeadlineMarginNs;
+  for (uint32_t i = 0; i < kTotalStages; i++) {
+    estimate += stage_estimate_[i];
+  }
+
+  return estimate;
+}
+
+void PresentScheduler::WaitForLatch() {
+  if (!enabled_ || latch_waited_)
+    return;
+
+  CheckComposed();
+  CheckRetired();
+  vblank_lock_.lock();
+  int64_t last_vblank = last_vblank_;
+  int64_t period = vblank_period_;
+  vblank_lock_.unlock();
+
+  latch_waited_ = true;
+  target_vblank_ = -1;
+  if (last_vblank < 0 || period == 0)
+    return;
+
+  // Find first vblank we can still make and start as late as possible
+  // for it.
+  int64_t now = GetTimeNs();
+  int64_t estimate = GetEstimate();
+  int64_t earliest_end = now + estimate;
+  int64_t target = last_vblank + period;
+  if (earliest_end > target)
+    target += ((earliest_end - target) / period + 1) * period;
+
+  target_vblank_ = target;
+  scheduled_frames_++;
+  int64_t latch_time = target - estimate;
+  if (latch_time <= now)
+    return;
+
+  struct timespec ts;
+  ts.tv_sec = latch_time / kOneSecondNs;
+  ts.tv_nsec = latch_time % kOneSecondNs;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+void PresentScheduler::LatchFrame() {
+  if (!enabled_)
+    return;
+
+  WaitForLatch();
+  latch_waited_ = false;
+  last_mark_ = GetTimeNs();
+  last_cpu_mark_ = GetThreadTimeNs();
+}
+
+void PresentScheduler::StageDone(Stage stage) {
+  if (last_mark_ < 0)
+    return;
+
+  int64_t now = GetTimeNs();
+  int64_t cpu_now = GetThreadTimeNs();
+  int64_t duration = now - last_mark_;
+  // Commits wait for earlier frames to be flipped to or submitted, which
+  // is time the frame itself doesn't need. Everything else the commit
+  // does is work on our thread.
+  if (stage == kCommit)
+    duration = cpu_now - last_cpu_mark_;
+
+  last_mark_ = now;
+  last_cpu_mark_ = cpu_now;
+  UpdateEstimate(stage, duration);
+}
+
+void PresentScheduler::ComposeQueued(int32_t fence) {
+  if (last_mark_ < 0) {
+    close(fence);
+    return;
+  }
+
+  PendingCompose compose;
+  compose.fence = fence;
+  compose.start = last_mark_;
+  pending_composes_.emplace_back(compose);
+  last_mark_ = GetTimeNs();
+  last_cpu_mark_ = GetThreadTimeNs();
+}
+
+void PresentScheduler::UpdateEstimate(Stage stage, int64_t duration) {
+  // React immediately to frames getting more expensive, but only slowly
+  // to cheaper ones so that a single fast frame doesn't make us miss the
+  // next vblank.
+  int64_t &estimate = stage_estimate_[stage];
+  if (duration > estimate) {
+    estimate = duration;
+  } else {
+    estimate -= (estimate - duration) / 16;
+  }
+}
+
+void PresentScheduler::FrameCommitted(int32_t retire_fence) {
+  if (last_mark_ < 0)
+    return;
+
+  StageDone(kCommit);
+  if (target_vblank_ > 0) {
+    int32_t fence = retire_fence > 0 ? dup(retire_fence) : -1;
+    if (fence >= 0) {
+      PendingRetire retire;
+      retire.fence = fence;
+      retire.target_vblank = target_vblank_;
+      pending_retires_.emplace_back(retire);
+    } else {
+      CheckDeadline(target_vblank_, last_mark_);
+    }
+  }
+
+  CheckComposed();
+  CheckRetired();
+  last_mark_ = -1;
+  target_vblank_ = -1;
+}
+
+void PresentScheduler::CheckComposed() {
+  size_t composed = 0;
+  for (const PendingCompose &compose : pending_composes_) {
+    int64_t end = GetFenceSignalTime(compose.fence);
+    // Draws of our compositor finish in order.
+    if (end == 0)
+      break;
+
+    if (end > compose.start)
+      UpdateEstimate(kCompose, end - compose.start);
+
+    close(compose.fence);
+    composed++;
+  }
+
+  pending_composes_.erase(pending_composes_.begin(),
+                          pending_composes_.begin() + composed);
+}
+
+void PresentScheduler::CheckRetired() {
+  size_t retired = 0;
+  for (const PendingRetire &retire : pending_retires_) {
+    int64_t flip_time = GetFenceSignalTime(retire.fence);
+    // Retire fences signal in order.
+    if (flip_time == 0)
+      break;
+
+    if (flip_time > 0)
+      CheckDeadline(retire.target_vblank, flip_time);
+
+    close(retire.fence);
+    retired++;
+  }
+
+  pending_retires_.erase(pending_retires_.begin(),
+                         pending_retires_.begin() + retired);
+}
+
+void PresentScheduler::CheckDeadline(int64_t target_vblank,
+                                     int64_t flip_time) {
+  vblank_lock_.lock();
+  int64_t period = vblank_period_;
+  vblank_lock_.unlock();
+
+  // Flips are signalled a little after the vblank timestamp, anything
+  // before the next vblank made it.
+  if (flip_time <= target_vblank + period / 2)
+    return;
+
+  missed_deadlines_++;
+  IPAGEFLIPEVENTTRACE("Missed present deadline by %lld us. Total missed: %d \n",
+                      (long long)(flip_time - target_vblank) / 1000,
+                      missed_deadlines_);
+}
+
+int64_t PresentScheduler::GetComposeDeadline() const {
+  if (target_vblank_ < 0)
+    return -1;
+
+  return target_vblank_ - stage_estimate_[kCommit] - kDeadlineMarginNs;
+}
+
+}  // namespace hwcomposer
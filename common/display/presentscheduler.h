@@ -0,0 +1,140 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_PRESENTSCHEDULER_H_
+#define COMMON_DISPLAY_PRESENTSCHEDULER_H_
+
+#include <stdint.h>
+
+#include <spinlock.h>
+
+#include <atomic>
+#include <vector>
+
+namespace hwcomposer {
+
+// Delays latching of a frame until just before it needs to be ready for
+// the next vblank. Time needed by the different stages of a frame is
+// estimated from previous frames, vblank timing comes from
+// VblankEventHandler. All calls except UpdateVblank and IsEnabled are
+// expected to be made from the thread presenting the display.
+class PresentScheduler {
+ public:
+  enum Stage {
+    kValidate = 0,  // Layer and plane validation.
+    kCompose = 1,   // Offscreen composition.
+    kCommit = 2,    // Atomic commit.
+    kTotalStages = 3
+  };
+
+  PresentScheduler() = default;
+  ~PresentScheduler();
+  PresentScheduler(const PresentScheduler &) = delete;
+  PresentScheduler &operator=(const PresentScheduler &) = delete;
+
+  void SetEnabled(bool enabled);
+
+  bool IsEnabled() const {
+    return enabled_;
+  }
+
+  // Called for every vblank with its timestamp in CLOCK_MONOTONIC ns.
+  void UpdateVblank(int64_t timestamp);
+
+  // Waits till the latest time at which work on the next frame can
+  // start, so that it can still be shown at the next vblank. Needs to be
+  // called before the layers of the frame are read, so that they are
+  // latched after the wait.
+  void WaitForLatch();
+
+  // Marks the start of work on the frame. Waits first if WaitForLatch
+  // wasn't called for it.
+  void LatchFrame();
+
+  // Marks end of stage. Time since end of the previous stage (or
+  // LatchFrame) is accounted to stage.
+  void StageDone(Stage stage);
+
+  // Marks end of the compose stage for a draw which was only queued.
+  // Time till fence signals is accounted to it instead, once it has.
+  // Takes ownership of fence.
+  void ComposeQueued(int32_t fence);
+
+  // Marks the frame as committed. Whether it made its vblank is checked
+  // once retire_fence signals, i.e. the frame has been flipped to. With
+  // no retire_fence, the commit is expected to have returned only after
+  // the flip.
+  void FrameCommitted(int32_t retire_fence);
+
+  // CLOCK_MONOTONIC time in ns by which composition of the current frame
+  // needs to be done to make its vblank, -1 if it isn't scheduled.
+  int64_t GetComposeDeadline() const;
+
+  // Frames which were committed after the vblank they were scheduled
+  // for.
+  uint32_t GetMissedDeadlines() const {
+    return missed_deadlines_;
+  }
+
+  uint32_t GetScheduledFrames() const {
+    return scheduled_frames_;
+  }
+
+ private:
+  struct PendingRetire {
+    int32_t fence;
+    int64_t target_vblank;
+  };
+
+  struct PendingCompose {
+    int32_t fence;
+    int64_t start;
+  };
+
+  int64_t GetEstimate() const;
+  void UpdateEstimate(Stage stage, int64_t duration);
+  void CheckComposed();
+  void CheckRetired();
+  void CheckDeadline(int64_t target_vblank, int64_t flip_time);
+
+  SpinLock vblank_lock_;
+  // Protected by vblank_lock_.
+  int64_t last_vblank_ = -1;
+  int64_t vblank_period_ = 0;
+
+  // Read by the vblank thread through IsEnabled.
+  std::atomic<bool> enabled_{false};
+  // Estimated duration of each stage in ns.
+  int64_t stage_estimate_[kTotalStages] = {0, 0, 0};
+  // End of last stage of the current frame, -1 if no frame is in
+  // progress.
+  int64_t last_mark_ = -1;
+  // CPU time of our thread at last_mark_.
+  int64_t last_cpu_mark_ = -1;
+  // Vblank the current frame is meant for.
+  int64_t target_vblank_ = -1;
+  // WaitForLatch was called for the current frame.
+  bool latch_waited_ = false;
+  // Queued draws which the GPU hasn't finished yet, oldest first.
+  std::vector<PendingCompose> pending_composes_;
+  // Committed frames which haven't been flipped to yet, oldest first.
+  std::vector<PendingRetire> pending_retires_;
+  uint32_t missed_deadlines_ = 0;
+  uint32_t scheduled_frames_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_PRESENTSCHEDULER_H_
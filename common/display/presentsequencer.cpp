@@ -0,0 +1,97 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "presentsequencer.h"
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+PresentTurn::PresentTurn(PresentSequencer *sequencer, uint32_t index)
+    : sequencer_(sequencer), index_(index) {
+}
+
+PresentTurn::~PresentTurn() {
+  if (!sequencer_)
+    return;
+
+  BeginRelease();
+  sequencer_->Pass(sequencer_->displays_ + index_);
+}
+
+void PresentTurn::BeginPrepare() {
+  if (!sequencer_ || state_ != kIdle)
+    return;
+
+  sequencer_->WaitFor(index_);
+  state_ = kPreparing;
+}
+
+void PresentTurn::EndPrepare() {
+  if (!sequencer_)
+    return;
+
+  BeginPrepare();
+  if (state_ != kPreparing)
+    return;
+
+  sequencer_->Pass(index_);
+  state_ = kPrepared;
+}
+
+void PresentTurn::BeginRelease() {
+  if (!sequencer_)
+    return;
+
+  EndPrepare();
+  if (state_ != kPrepared)
+    return;
+
+  sequencer_->WaitFor(sequencer_->displays_ + index_);
+  state_ = kReleasing;
+}
+
+bool PresentSequencer::Reset(uint32_t displays) {
+  size_t total = displays * 2;
+  while (turns_.size() < total) {
+    std::unique_ptr<HWCEvent> event(new HWCEvent());
+    if (!event->Initialize()) {
+      ETRACE("Failed to initialize present sequencer event. %s",
+             PRINTERROR());
+      return false;
+    }
+
+    turns_.emplace_back(std::move(event));
+  }
+
+  displays_ = displays;
+  return true;
+}
+
+void PresentSequencer::WaitFor(uint32_t turn) {
+  // Nothing comes before the first turn.
+  if (turn == 0)
+    return;
+
+  turns_.at(turn)->Wait();
+}
+
+void PresentSequencer::Pass(uint32_t turn) {
+  if (turn + 1 < displays_ * 2)
+    turns_.at(turn + 1)->Signal();
+}
+
+}  // namespace hwcomposer
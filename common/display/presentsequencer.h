@@ -0,0 +1,88 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_PRESENTSEQUENCER_H_
+#define COMMON_DISPLAY_PRESENTSEQUENCER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "hwcevent.h"
+
+namespace hwcomposer {
+
+// Lets displays showing the same HwcLayers be presented concurrently.
+// Every display takes two turns per frame: one to read the layers while
+// preparing its frame, and one to hand out release fences and validate
+// them once committed. Turns are taken in display order, and all prepare
+// turns come before the first release turn, so that layers are seen in
+// the same state as when the displays were presented one after the other.
+// Everything in between, validation, composition and commit, runs in
+// parallel.
+class PresentSequencer {
+ public:
+  PresentSequencer() = default;
+  PresentSequencer(const PresentSequencer &) = delete;
+  PresentSequencer &operator=(const PresentSequencer &) = delete;
+
+  // Starts a new frame of displays displays. All turns of the previous
+  // frame need to have been passed.
+  bool Reset(uint32_t displays);
+
+ private:
+  friend class PresentTurn;
+
+  void WaitFor(uint32_t turn);
+  void Pass(uint32_t turn);
+
+  uint32_t displays_ = 0;
+  // One event per turn, signalled once the turn before it is passed.
+  std::vector<std::unique_ptr<HWCEvent>> turns_;
+};
+
+// Turns of one display for the current frame of a PresentSequencer.
+// Turns not explicitly taken are passed on destruction, so that every
+// exit path keeps the displays after ours going.
+class PresentTurn {
+ public:
+  PresentTurn(PresentSequencer *sequencer, uint32_t index);
+  ~PresentTurn();
+
+  PresentTurn(const PresentTurn &) = delete;
+  PresentTurn &operator=(const PresentTurn &) = delete;
+
+  // Waits for the displays before ours to be done preparing.
+  void BeginPrepare();
+
+  // Lets the next display prepare.
+  void EndPrepare();
+
+  // Waits for all displays to be done preparing and the displays before
+  // ours to be done releasing.
+  void BeginRelease();
+
+ private:
+  enum State { kIdle, kPreparing, kPrepared, kReleasing };
+
+  PresentSequencer *sequencer_;
+  uint32_t index_;
+  State state_ = kIdle;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_PRESENTSEQUENCER_H_
@@ -16,15 +16,28 @@
 
 #include "vblankeventhandler.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "displayqueue.h"
 #include "hwctrace.h"
+#include "presentscheduler.h"
 
 namespace hwcomposer {
 
 static const int64_t kOneSecondNs = 1 * 1000 * 1000 * 1000;
+// Time without updates after which display is considered idle. This is
+// about the 250 frames at 60Hz which we used to count vblanks for.
+static const int64_t kIdleTimeoutNs = 4 * kOneSecondNs;
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * kOneSecondNs + ts.tv_nsec;
+}
 
 VblankEventHandler::VblankEventHandler(DisplayQueue* queue)
     : HWCThread(-8, "VblankEventHandler"),
@@ -34,9 +47,23 @@ VblankEventHandler::VblankEventHandler(DisplayQueue* queue)
       last_timestamp_(-1),
       queue_(queue) {
   memset(&type_, 0, sizeof(type_));
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd_ < 0) {
+    ETRACE("Failed to create idle timer. %s", PRINTERROR());
+  } else {
+    fd_handler_.AddFd(timer_fd_);
+  }
 }
 
 VblankEventHandler::~VblankEventHandler() {
+  // Make sure our thread is gone before closing fds it uses.
+  Exit();
+
+  if (vblank_fd_ >= 0)
+    close(vblank_fd_);
+
+  if (timer_fd_ >= 0)
+    close(timer_fd_);
 }
 
 void VblankEventHandler::Init(int fd, int pipe) {
@@ -44,6 +71,23 @@ void VblankEventHandler::Init(int fd, int pipe) {
   uint32_t high_crtc = (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
   type_ = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
                              (high_crtc & DRM_VBLANK_HIGH_CRTC_MASK));
+  if (vblank_fd_ >= 0)
+    return;
+
+  // Vblank events are delivered to the file which requested them. As fd
+  // is shared by all displays, open the device again for our events.
+  char* name = drmGetDeviceNameFromFd(fd);
+  if (name) {
+    vblank_fd_ = open(name, O_RDWR | O_CLOEXEC);
+    free(name);
+  }
+
+  if (vblank_fd_ < 0) {
+    ETRACE("Failed to open DRM device for vblank events. %s", PRINTERROR());
+    return;
+  }
+
+  fd_handler_.AddFd(vblank_fd_);
 }
 
 bool VblankEventHandler::SetPowerMode(uint32_t power_mode) {
@@ -66,6 +110,7 @@ int VblankEventHandler::RegisterCallback(
   display_ = display;
   last_timestamp_ = -1;
   spin_lock_.unlock();
+  Resume();
   return 0;
 }
 
@@ -79,15 +124,68 @@ int VblankEventHandler::VSyncControl(bool enabled) {
   last_timestamp_ = -1;
   spin_lock_.unlock();
 
+  // Let our thread arm vblank requests if needed.
+  Resume();
   return 0;
 }
 
+void VblankEventHandler::UpdateVblankRequests() {
+  Resume();
+}
+
+void VblankEventHandler::RestartIdleTimer() {
+  int64_t now = GetTimeNs();
+  spin_lock_.lock();
+  last_update_ = now;
+  bool arm = !idle_timer_armed_;
+  idle_timer_armed_ = true;
+  spin_lock_.unlock();
+
+  // If the timer is already running, HandleIdleTimer re-arms it based on
+  // last_update_. This avoids touching the timer for every frame.
+  if (arm)
+    ArmIdleTimer(kIdleTimeoutNs);
+}
+
+void VblankEventHandler::ArmIdleTimer(int64_t timeout) {
+  if (timer_fd_ < 0)
+    return;
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = timeout / kOneSecondNs;
+  spec.it_value.tv_nsec = timeout % kOneSecondNs;
+  if (timerfd_settime(timer_fd_, 0, &spec, NULL) < 0)
+    ETRACE("Failed to arm idle timer. %s", PRINTERROR());
+}
+
+void VblankEventHandler::HandleIdleTimer() {
+  uint64_t expirations;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) < 0)
+    return;
+
+  int64_t now = GetTimeNs();
+  spin_lock_.lock();
+  int64_t elapsed = now - last_update_;
+  if (elapsed < kIdleTimeoutNs) {
+    spin_lock_.unlock();
+    ArmIdleTimer(kIdleTimeoutNs - elapsed);
+    return;
+  }
+
+  idle_timer_armed_ = false;
+  spin_lock_.unlock();
+  queue_->HandleIdleCase();
+}
+
 void VblankEventHandler::HandlePageFlipEvent(unsigned int sec,
                                              unsigned int usec) {
   int64_t timestamp = ((int64_t)sec * kOneSecondNs) + ((int64_t)usec * 1000);
   IPAGEFLIPEVENTTRACE("HandleVblankCallBack Frame Time %f",
                       static_cast<float>(timestamp - last_timestamp_) / (1000));
   last_timestamp_ = timestamp;
+  if (scheduler_)
+    scheduler_->UpdateVblank(timestamp);
 
   IPAGEFLIPEVENTTRACE("Callback called from HandlePageFlipEvent. %lu",
                       timestamp);
@@ -98,22 +196,82 @@ void VblankEventHandler::HandlePageFlipEvent(unsigned int sec,
   spin_lock_.unlock();
 }
 
-void VblankEventHandler::HandleWait() {
+void VblankEventHandler::VblankEventCallback(int /*fd*/,
+                                             unsigned int /*sequence*/,
+                                             unsigned int sec,
+                                             unsigned int usec, void* data) {
+  VblankEventHandler* handler = static_cast<VblankEventHandler*>(data);
+  handler->vblank_pending_ = false;
+  handler->HandlePageFlipEvent(sec, usec);
 }
 
-void VblankEventHandler::HandleRoutine() {
-  queue_->HandleIdleCase();
+bool VblankEventHandler::NeedsVblank() {
+  spin_lock_.lock();
+  bool needed = enabled_ && callback_;
+  spin_lock_.unlock();
+  if (!needed && scheduler_)
+    needed = scheduler_->IsEnabled();
+
+  return needed;
+}
 
+void VblankEventHandler::RequestVblank() {
   drmVBlank vblank;
   memset(&vblank, 0, sizeof(vblank));
+  vblank.request.type = (drmVBlankSeqType)(type_ | DRM_VBLANK_EVENT);
   vblank.request.sequence = 1;
+  vblank.request.signal = (unsigned long)this;
+
+  if (drmWaitVBlank(vblank_fd_, &vblank)) {
+    ETRACE("Failed to request vblank event. %s", PRINTERROR());
+    return;
+  }
+
+  vblank_pending_ = true;
+}
+
+void VblankEventHandler::HandleWait() {
+  if (vblank_fd_ < 0 && NeedsVblank()) {
+    // We block in drmWaitVBlank, only check if idle timer expired.
+    fd_handler_.Poll(0);
+    return;
+  }
 
-  int fd = fd_;
-  vblank.request.type = type_;
+  HWCThread::HandleWait();
+}
+
+void VblankEventHandler::HandleRoutine() {
+  if (timer_fd_ >= 0 && fd_handler_.IsReady(timer_fd_) > 0)
+    HandleIdleTimer();
+
+  if (vblank_fd_ < 0) {
+    if (!NeedsVblank())
+      return;
+
+    drmVBlank vblank;
+    memset(&vblank, 0, sizeof(vblank));
+    vblank.request.sequence = 1;
+    vblank.request.type = type_;
+
+    int ret = drmWaitVBlank(fd_, &vblank);
+    if (!ret)
+      HandlePageFlipEvent(vblank.reply.tval_sec,
+                          (int64_t)vblank.reply.tval_usec);
+    return;
+  }
+
+  if (fd_handler_.IsReady(vblank_fd_) > 0) {
+    drmEventContext context;
+    memset(&context, 0, sizeof(context));
+    context.version = DRM_EVENT_CONTEXT_VERSION;
+    context.vblank_handler = VblankEventCallback;
+    drmHandleEvent(vblank_fd_, &context);
+  }
 
-  int ret = drmWaitVBlank(fd, &vblank);
-  if (!ret)
-    HandlePageFlipEvent(vblank.reply.tval_sec, (int64_t)vblank.reply.tval_usec);
+  // Only one request is kept pending at a time, the next one is made once
+  // we receive its event.
+  if (!vblank_pending_ && NeedsVblank())
+    RequestVblank();
 }
 
 }  // namespace hwcomposer
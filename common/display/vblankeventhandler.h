@@ -30,6 +30,7 @@
 namespace hwcomposer {
 
 class DisplayQueue;
+class PresentScheduler;
 
 class VblankEventHandler : public HWCThread {
  public:
@@ -47,11 +48,32 @@ class VblankEventHandler : public HWCThread {
 
   int VSyncControl(bool enabled);
 
+  // scheduler is informed of every vblank. It needs to outlive us.
+  void SetPresentScheduler(PresentScheduler* scheduler) {
+    scheduler_ = scheduler;
+  }
+
+  // Should be called whenever scheduler_ gets enabled or disabled.
+  void UpdateVblankRequests();
+
+  // Should be called after every frame. DisplayQueue::HandleIdleCase is
+  // called once there hasn't been any update for a while.
+  void RestartIdleTimer();
+
  protected:
   void HandleRoutine() override;
   void HandleWait() override;
 
  private:
+  static void VblankEventCallback(int fd, unsigned int sequence,
+                                  unsigned int sec, unsigned int usec,
+                                  void* data);
+
+  bool NeedsVblank();
+  void RequestVblank();
+  void ArmIdleTimer(int64_t timeout);
+  void HandleIdleTimer();
+
   // shared_ptr since we need to use this outside of the thread lock (to
   // actually call the hook) and we don't want the memory freed until we're
   // done
@@ -61,9 +83,20 @@ class VblankEventHandler : public HWCThread {
   bool enabled_ = false;
 
   int fd_;
+  // Our own file of the DRM device, so that we only receive our vblank
+  // events when reading them. -1 in case we couldn't open one, vblanks are
+  // waited for synchronously on fd_ in that case.
+  int vblank_fd_ = -1;
+  int timer_fd_ = -1;
+  // Accessed only from our thread.
+  bool vblank_pending_ = false;
+  // Protected by spin_lock_.
+  bool idle_timer_armed_ = false;
+  int64_t last_update_ = 0;
   int64_t last_timestamp_;
   drmVBlankSeqType type_;
   DisplayQueue* queue_;
+  PresentScheduler* scheduler_ = NULL;
 };
 
 }  // namespace hwcomposer
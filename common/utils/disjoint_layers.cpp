@@ -15,343 +15,235 @@
 */
 
 #include "disjoint_layers.h"
-#include <assert.h>
+
 #include <stdint.h>
+
 #include <algorithm>
-#include <iostream>
-#include <list>
-#include <map>
-#include <set>
 #include <utility>
 #include <vector>
-#include "hwctrace.h"
-#include "hwcutils.h"
 
 namespace hwcomposer {
 
-enum EventType { START, END };
+void RectIDs::getIds(std::vector<TId> *ids) const {
+  for (size_t word = 0; word <= rest_.size(); word++) {
+    uint64_t bits = word == 0 ? first_ : rest_[word - 1];
+    TId base = word * kWordBits;
+    while (bits) {
+      TId bit = __builtin_ctzll(bits);
+      ids->emplace_back(base + bit);
+      bits &= bits - 1;
+    }
+  }
+}
 
-struct YPOI {
-  EventType type;
-  uint64_t y;
-  uint64_t rect_id;
+bool RectIDs::operator==(const RectIDs &rhs) const {
+  if (first_ != rhs.first_)
+    return false;
 
-  bool operator<(const YPOI &rhs) const {
-    if (y == rhs.y)
-      return rect_id < rhs.rect_id;
-    else
-      return (y < rhs.y);
+  // Trailing words might be zero in one set and missing in the other.
+  size_t common = std::min(rest_.size(), rhs.rest_.size());
+  for (size_t i = 0; i < common; i++) {
+    if (rest_[i] != rhs.rest_[i])
+      return false;
   }
+
+  const ArenaVector<uint64_t> &longer =
+      rest_.size() > rhs.rest_.size() ? rest_ : rhs.rest_;
+  for (size_t i = common; i < longer.size(); i++) {
+    if (longer[i])
+      return false;
+  }
+
+  return true;
+}
+
+namespace {
+
+// Left or right edge of a rect.
+struct XEvent {
+  int x;
+  RectIDs::TId rect_id;
+  bool start;
 };
 
-// Any region will have start X and set of Y coordinates.
-struct Region {
-  uint64_t sx;
-  std::set<YPOI> y_points;
-  RectIDs rect_ids;
+// Top or bottom edge of a rect.
+struct YEvent {
+  int y;
+  RectIDs::TId rect_id;
+  bool start;
 };
 
-// POI is the point of interest while traversing through x coordinates
-struct POI {
-  EventType type;
-  uint64_t rect_id;
-  uint64_t x;
-  uint64_t top_y;
-  uint64_t bot_y;
 
-  bool operator<(const POI &rhs) const {
-    return (x <= rhs.x);
+// Regions of the previous slab are extended into the current slab if they
+// continue unchanged, all others are left as they are. open holds indices
+// into out of the regions touching the previous slab, sorted by top.
+class SlabMerger {
+ public:
+  SlabMerger(int left, int right, ArenaVector<size_t> *open,
+             ArenaVector<size_t> *next_open, ArenaVector<RectSet<int>> *out)
+      : left_(left),
+        right_(right),
+        open_(open),
+        next_open_(next_open),
+        out_(out) {
+    next_open_->clear();
   }
-};
 
-// This function will take active region and right x
-// For an active region there will be set of YPOI
-// It will traverse through each y_poi and given out
-// rectangle with rect_ids active at that time.
-void GenerateOutLayers(Region *reg, uint64_t x,
-                       const HwcRect<int> &damage_region,
-                       std::vector<RectSet<int>> *out) {
-  Rect<int> out_rect;
-  out_rect.left = std::max(damage_region.left, static_cast<int>(reg->sx));
-  out_rect.right = std::min(damage_region.right, static_cast<int>(x));
-  RectIDs rect_ids;
-
-  for (std::set<YPOI>::iterator y_poi_it = reg->y_points.begin();
-       y_poi_it != reg->y_points.end(); y_poi_it++) {
-    const YPOI &y_poi = *y_poi_it;
-    // No need to check for start or end event
-    // as rect_ids is empty
-    if (rect_ids.isEmpty()) {
-      out_rect.top = std::max(damage_region.top, static_cast<int>(y_poi.y));
-      rect_ids.add(y_poi.rect_id);
-    } else {
-      if (out_rect.top == static_cast<int>(y_poi.y)) {
-        if (y_poi.type == START) {
-          rect_ids.add(y_poi.rect_id);
-        } else {
-          rect_ids.subtract(y_poi.rect_id);
-        }
-        continue;
-      }
-      out_rect.bottom = y_poi.y;
-      if (AnalyseOverlap(damage_region, out_rect) == kOutside)
-        continue;
+  ~SlabMerger() {
+    open_->swap(*next_open_);
+  }
 
-      out->emplace_back(RectSet<int>(rect_ids, out_rect));
-      out_rect.top = std::max(damage_region.top, static_cast<int>(y_poi.y));
-      if (y_poi.type == START) {
-        rect_ids.add(y_poi.rect_id);
-      } else {
-        rect_ids.subtract(y_poi.rect_id);
+  // Adds [top, bottom) of the slab, covered by rect_ids.
+  void AddInterval(int top, int bottom, const RectIDs &rect_ids) {
+    while (index_ < open_->size() &&
+           (*out_)[(*open_)[index_]].rect.top < top) {
+      index_++;
+    }
+
+    if (index_ < open_->size()) {
+      RectSet<int> &region = (*out_)[(*open_)[index_]];
+      if (region.rect.right == left_ && region.rect.top == top &&
+          region.rect.bottom == bottom && region.id_set == rect_ids) {
+        region.rect.right = right_;
+        next_open_->emplace_back((*open_)[index_]);
+        index_++;
+        return;
       }
     }
+
+    next_open_->emplace_back(out_->size());
+    out_->emplace_back(rect_ids, Rect<int>(left_, top, right_, bottom));
   }
-}
 
-// This function will remove y coordinates corresponding to given rect_id
-void RemoveYpois(Region *reg, uint64_t rect_id) {
-  std::set<YPOI>::iterator top_it = reg->y_points.begin();
-  while (top_it != reg->y_points.end()) {
-    if ((*top_it).rect_id == rect_id) {
-      reg->y_points.erase(top_it++);
-    } else {
-      top_it++;
+ private:
+  int left_;
+  int right_;
+  ArenaVector<size_t> *open_;
+  ArenaVector<size_t> *next_open_;
+  ArenaVector<RectSet<int>> *out_;
+  size_t index_ = 0;
+};
+
+}  // namespace
+
+// Splits the slab [left, right) into vertical intervals covered by the
+// same set of rects. y_edges holds top and bottom edges of all rects
+// crossing the slab, sorted by y.
+static void SplitSlab(int left, int right, const ArenaVector<YEvent> &y_edges,
+                      ArenaVector<size_t> *open, ArenaVector<size_t> *next_open,
+                      ArenaVector<RectSet<int>> *out) {
+  SlabMerger merger(left, right, open, next_open, out);
+  RectIDs rect_ids((ArenaAllocator<uint64_t>(out->get_allocator())));
+  size_t depth = 0;
+  int previous_y = 0;
+  size_t i = 0;
+  while (i < y_edges.size()) {
+    int y = y_edges[i].y;
+    if (depth > 0 && y > previous_y)
+      merger.AddInterval(previous_y, y, rect_ids);
+
+    for (; i < y_edges.size() && y_edges[i].y == y; i++) {
+      const YEvent &edge = y_edges[i];
+      if (edge.start) {
+        rect_ids.add(edge.rect_id);
+        depth++;
+      } else {
+        rect_ids.subtract(edge.rect_id);
+        depth--;
+      }
     }
-  }
-}
 
-bool compare_region(const Region *first, const Region *second) {
-  uint64_t first_min_y = (*(first->y_points.begin())).y;
-  uint64_t second_min_y = (*(second->y_points.begin())).y;
-  return (first_min_y < second_min_y);
+    previous_y = y;
+  }
 }
 
-void get_draw_regions(const std::vector<Rect<int>> &in,
+// Sweeps a vertical line from left to right over the rects. Between two
+// consecutive x edges the set of rects crossing the line doesn't change,
+// so each such slab is split vertically and the resulting intervals are
+// merged with identical ones of the previous slab. All state lives in
+// flat arrays, which are sorted once per slab.
+void get_draw_regions(const Rect<int> *in, size_t count,
                       const HwcRect<int> &damage_region,
-                      std::vector<RectSet<int>> *out) {
-  if (in.size() > RectIDs::max_elements) {
-    return;
-  }
-
-  // Set of all point of interests from input rectangles.
-  std::set<POI> pois;
-  std::list<Region *> imp_reg;
-  std::list<Region> active_regions;
-
-  // This loop will add all point of interests into pois.
-  for (uint64_t i = 0; i < in.size(); i++) {
-    const Rect<int> &rect = in[i];
-
-    // Filter out empty or invalid rects.
+                      ArenaVector<RectSet<int>> *out) {
+  ArenaAllocator<RectSet<int>> allocator = out->get_allocator();
+  ArenaVector<Rect<int>> rects(count, Rect<int>(),
+                               ArenaAllocator<Rect<int>>(allocator));
+  ArenaVector<XEvent> x_events((ArenaAllocator<XEvent>(allocator)));
+  x_events.reserve(count * 2);
+
+  for (size_t i = 0; i < count; i++) {
+    Rect<int> &rect = rects[i];
+    rect.left = std::max(damage_region.left, in[i].left);
+    rect.top = std::max(damage_region.top, in[i].top);
+    rect.right = std::min(damage_region.right, in[i].right);
+    rect.bottom = std::min(damage_region.bottom, in[i].bottom);
+
+    // Filter out empty or invalid rects and those outside of damage.
     if (rect.left >= rect.right || rect.top >= rect.bottom)
       continue;
 
-    if (AnalyseOverlap(damage_region, rect) == kOutside)
-      continue;
-
-    POI poi;
-    poi.rect_id = i;
-    poi.x = std::max(damage_region.left, rect.left);
-    poi.top_y = std::max(damage_region.top, rect.top);
-    poi.bot_y = std::min(damage_region.bottom, rect.bottom);
-    poi.type = START;
-    pois.insert(poi);
-
-    poi.type = END;
-    poi.x = std::min(damage_region.right, rect.right);
-    pois.insert(poi);
+    RectIDs::TId id = static_cast<RectIDs::TId>(i);
+    x_events.emplace_back(XEvent{rect.left, id, true});
+    x_events.emplace_back(XEvent{rect.right, id, false});
   }
 
-  for (std::set<POI>::iterator it = pois.begin(); it != pois.end(); ++it) {
-    const POI &poi = *it;
-    // First rectangle has to be inserted into active region
-    // This condition will be true if existing all active
-    // regions are already copied to out.
-    // If current poi is of type END there are no active regions,
-    // then this poi might already covered in previous pass
-    if (active_regions.size() == 0 && poi.type == START) {
-      Region reg;
-      reg.sx = poi.x;
-      YPOI y_poi;
-
-      y_poi.rect_id = poi.rect_id;
-      y_poi.type = START;
-      y_poi.y = poi.top_y;
-      reg.y_points.insert(y_poi);
-
-      y_poi.type = END;
-      y_poi.y = poi.bot_y;
-      reg.y_points.insert(y_poi);
-
-      RectIDs rectIds;
-      rectIds.add(poi.rect_id);
-      reg.rect_ids = rectIds;
-      active_regions.push_back(reg);
-      continue;
+  if (x_events.empty())
+    return;
+
+  std::sort(x_events.begin(), x_events.end(),
+            [](const XEvent &lhs, const XEvent &rhs) { return lhs.x < rhs.x; });
+
+  // Horizontal edges of the rects crossing the sweep line, sorted by y.
+  ArenaVector<YEvent> y_edges((ArenaAllocator<YEvent>(allocator)));
+  ArenaVector<uint8_t> ended(count, 0, ArenaAllocator<uint8_t>(allocator));
+  ArenaVector<size_t> open((ArenaAllocator<size_t>(allocator)));
+  ArenaVector<size_t> next_open((ArenaAllocator<size_t>(allocator)));
+  // A slab has at most one interval less than edges crossing it.
+  y_edges.reserve(count * 2);
+  open.reserve(count * 2);
+  next_open.reserve(count * 2);
+  out->reserve(out->size() + count * 4);
+
+  auto compare_y = [](const YEvent &lhs, const YEvent &rhs) {
+    return lhs.y < rhs.y;
+  };
+  int slab_left = x_events.front().x;
+  size_t i = 0;
+  while (i < x_events.size()) {
+    int x = x_events[i].x;
+    if (!y_edges.empty()) {
+      SplitSlab(slab_left, x, y_edges, &open, &next_open, out);
     }
 
-    // If active_regions in not empty, Check if current
-    // poi y points fall in range of any existing
-    // active_regions.
-    // If yes, get that active region and do further processing
-    // If No, create a new region and insert into active regions
-    // If it is start event then there is possibility that multiple
-    // active_regions get impacted.
-    // If it is end event then one or none active_regions will get
-    // impacted.
-    bool found = false;
-    imp_reg.clear();
-    std::list<Region>::iterator it_reg = active_regions.begin();
-    while (it_reg != active_regions.end()) {
-      Region &cur_reg = *it_reg;
-      uint64_t min_y = (*(cur_reg.y_points.begin())).y;
-      uint64_t max_y = (*(cur_reg.y_points.rbegin())).y;
-      // If bottom y is less than minimum y in region or top y is greater than
-      // max y in region, then this region is not impacted by this rect
-      if (poi.bot_y <= min_y || poi.top_y >= max_y) {
-        it_reg++;
+    bool has_ended = false;
+    for (; i < x_events.size() && x_events[i].x == x; i++) {
+      const XEvent &event = x_events[i];
+      if (!event.start) {
+        ended[event.rect_id] = 1;
+        has_ended = true;
         continue;
-      } else {
-        found = true;
-        // Found atleast one affected active region. If it is start event,
-        // add rect_id to cur_reg.rect_ids, also top_y and bot_y to
-        // cur_reg.y_points. if it is end event, remove rect_id from
-        // cur_reg.rect_ids and also top_y and bot_y from cur_reg.y_points.
-        // Also, if it is end event, check cur_reg.rect_ids is non empty,
-        // if it is empty remove region from active_regions.
-        // If it is start or end event, check next poi.x and see if it is same
-        // and
-        // those y coordinates fall in this region and it is END event, if yes
-        // 1) remove that rect_id and y coordinates as well
-        // 2)contine to check next poi.x until you find mismatch x.
-        if (poi.x == cur_reg.sx) {
-          if (poi.type == START) {
-            cur_reg.rect_ids.add(poi.rect_id);
-            imp_reg.push_back(&cur_reg);
-          }
-
-          it_reg++;
-          continue;
-        }
-        if (poi.type == START) {
-          GenerateOutLayers(&cur_reg, poi.x, damage_region, out);
-          cur_reg.sx = poi.x;
-          cur_reg.rect_ids.add(poi.rect_id);
-          imp_reg.push_back(&cur_reg);
-          std::set<POI>::iterator next_poi_it = it;
-          next_poi_it++;
-          for (; next_poi_it != pois.end(); next_poi_it++) {
-            const POI &next_poi = *next_poi_it;
-            if (next_poi.x != poi.x) {
-              break;
-            } else {
-              if (next_poi.bot_y <= min_y || next_poi.top_y >= max_y ||
-                  next_poi.type == START) {
-                continue;
-              }
-              cur_reg.rect_ids.subtract(next_poi.rect_id);
-              RemoveYpois(&cur_reg, next_poi.rect_id);
-            }
-          }
-          it_reg++;
-        } else {
-          GenerateOutLayers(&cur_reg, poi.x, damage_region, out);
-          RemoveYpois(&cur_reg, poi.rect_id);
-          cur_reg.sx = poi.x;
-          cur_reg.rect_ids.subtract(poi.rect_id);
-
-          std::set<POI>::iterator next_poi_it = it;
-          next_poi_it++;
-          for (; next_poi_it != pois.end(); next_poi_it++) {
-            const POI &next_poi = *next_poi_it;
-            if (next_poi.x != poi.x) {
-              break;
-            } else {
-              if (next_poi.bot_y <= min_y || next_poi.top_y >= max_y ||
-                  next_poi.type == START) {
-                continue;
-              }
-              cur_reg.rect_ids.subtract(next_poi.rect_id);
-              RemoveYpois(&cur_reg, next_poi.rect_id);
-            }
-          }
-          if (cur_reg.rect_ids.isEmpty()) {
-            active_regions.erase(it_reg++);
-          } else {
-            it_reg++;
-          }
-        }
       }
+
+      const Rect<int> &rect = rects[event.rect_id];
+      YEvent top{rect.top, event.rect_id, true};
+      YEvent bottom{rect.bottom, event.rect_id, false};
+      y_edges.insert(std::upper_bound(y_edges.begin(), y_edges.end(), top,
+                                      compare_y),
+                     top);
+      y_edges.insert(std::upper_bound(y_edges.begin(), y_edges.end(), bottom,
+                                      compare_y),
+                     bottom);
     }
-    // If no affected active region found, add new active region
-    if (!found && poi.type == START) {
-      Region reg;
-      reg.sx = poi.x;
-      YPOI y_poi;
-
-      y_poi.rect_id = poi.rect_id;
-      y_poi.type = START;
-      y_poi.y = poi.top_y;
-      reg.y_points.insert(y_poi);
-
-      y_poi.type = END;
-      y_poi.y = poi.bot_y;
-      reg.y_points.insert(y_poi);
-
-      RectIDs rectIds;
-      rectIds.add(poi.rect_id);
-      reg.rect_ids = rectIds;
-      active_regions.push_back(reg);
-    } else {
-      if (imp_reg.size() > 1 && poi.type == START) {
-        imp_reg.sort(compare_region);
-        uint64_t cur_y = 0;
-        for (std::list<Region *>::iterator cur_imp_reg_it = imp_reg.begin();
-             cur_imp_reg_it != imp_reg.end(); cur_imp_reg_it++) {
-          Region &cur_imp_reg = *(*cur_imp_reg_it);
-          YPOI y_poi;
-          y_poi.rect_id = poi.rect_id;
-          y_poi.type = START;
-
-          if (cur_y == 0) {
-            y_poi.y = poi.top_y;
-          } else {
-            y_poi.y = cur_y;
-          }
-          // This is to split vertical
-          // line into all impacted
-          // regions.
-          cur_imp_reg.y_points.insert(y_poi);
-          // Take bottom of current region as start of next impacted region
-          cur_y = (*(cur_imp_reg.y_points.rbegin())).y;
-          std::list<Region *>::iterator next_imp_reg_it = cur_imp_reg_it;
-          next_imp_reg_it++;
-          if (next_imp_reg_it == imp_reg.end()) {
-            // If there is an another
-            // region which is impacted, no
-            // need to add anything.
-            // if there is no other active region left,
-            // take bottom y and push into this active region
-            y_poi.y = poi.bot_y;
-          } else {
-            y_poi.y = cur_y;
-          }
-          y_poi.type = END;
-          cur_imp_reg.y_points.insert(y_poi);
-        }
-      } else if (imp_reg.size() == 1 && poi.type == START) {
-        // Only one region got impacted add y coordinated to that region
-        std::list<Region *>::iterator cur_imp_reg_it = imp_reg.begin();
-        YPOI y_poi;
-        y_poi.rect_id = poi.rect_id;
-        y_poi.type = START;
-        y_poi.y = poi.top_y;
-        (*cur_imp_reg_it)->y_points.insert(y_poi);
-        y_poi.type = END;
-        y_poi.y = poi.bot_y;
-        (*cur_imp_reg_it)->y_points.insert(y_poi);
-      }
+
+    if (has_ended) {
+      y_edges.erase(std::remove_if(y_edges.begin(), y_edges.end(),
+                                   [&ended](const YEvent &edge) {
+                                     return ended[edge.rect_id] != 0;
+                                   }),
+                    y_edges.end());
     }
+
+    slab_left = x;
   }
 }
 
@@ -25,61 +25,105 @@
 
 #include <hwcdefs.h>
 
+#include "framearena.h"
+
 namespace hwcomposer {
 
 // Some of the structs are adopted from drm_hwcomposer
+// Set of rect ids. Ids below 64 are kept inline, so that sets of the
+// usual handful of layers don't need any allocation. There is no upper
+// limit on ids, memory for the others comes from the allocator passed on
+// construction and is shared with all copies.
 struct RectIDs {
  public:
-  typedef uint64_t TId;
+  typedef uint32_t TId;
+
+  RectIDs() = default;
 
-  RectIDs() : bitset(0) {
+  explicit RectIDs(const ArenaAllocator<uint64_t> &allocator)
+      : rest_(allocator) {
   }
 
-  explicit RectIDs(TId id) : bitset(0) {
+  explicit RectIDs(TId id) {
     add(id);
   }
 
   void add(TId id) {
-    bitset |= ((uint64_t)1) << id;
+    if (id < kWordBits) {
+      first_ |= ((uint64_t)1) << id;
+      return;
+    }
+
+    size_t word = id / kWordBits - 1;
+    if (word >= rest_.size())
+      rest_.resize(word + 1, 0);
+
+    rest_[word] |= ((uint64_t)1) << (id % kWordBits);
   }
 
   void subtract(TId id) {
-    bitset &= ~(((uint64_t)1) << id);
+    if (id < kWordBits) {
+      first_ &= ~(((uint64_t)1) << id);
+      return;
+    }
+
+    size_t word = id / kWordBits - 1;
+    if (word < rest_.size())
+      rest_[word] &= ~(((uint64_t)1) << (id % kWordBits));
   }
 
-  bool isEmpty() const {
-    return bitset == 0;
-  }
+  bool has(TId id) const {
+    if (id < kWordBits)
+      return first_ & (((uint64_t)1) << id);
 
-  uint64_t getBits() const {
-    return bitset;
-  }
+    size_t word = id / kWordBits - 1;
+    if (word >= rest_.size())
+      return false;
 
-  bool operator==(const RectIDs &rhs) const {
-    return bitset == rhs.bitset;
+    return rest_[word] & (((uint64_t)1) << (id % kWordBits));
   }
 
-  bool operator<(const RectIDs &rhs) const {
-    return bitset < rhs.bitset;
+  bool isEmpty() const {
+    if (first_)
+      return false;
+
+    for (uint64_t word : rest_) {
+      if (word)
+        return false;
+    }
+
+    return true;
   }
 
+  // Appends all ids in the set to ids, in ascending order.
+  void getIds(std::vector<TId> *ids) const;
+
+  bool operator==(const RectIDs &rhs) const;
+
   RectIDs operator|(const RectIDs &rhs) const {
-    RectIDs ret;
-    ret.bitset = bitset | rhs.bitset;
+    RectIDs ret(*this);
+    if (ret.rest_.size() < rhs.rest_.size())
+      ret.rest_.resize(rhs.rest_.size(), 0);
+
+    ret.first_ |= rhs.first_;
+    for (size_t i = 0; i < rhs.rest_.size(); i++)
+      ret.rest_[i] |= rhs.rest_[i];
+
     return ret;
   }
 
   RectIDs operator|(TId id) const {
-    RectIDs ret;
-    ret.bitset = bitset;
+    RectIDs ret(*this);
     ret.add(id);
     return ret;
   }
 
-  static const int max_elements = sizeof(TId) * 8;
-
  private:
-  uint64_t bitset;
+  static const TId kWordBits = 64;
+
+  uint64_t first_ = 0;
+  // Ids from 64 onwards, 64 per word.
+  ArenaVector<uint64_t> rest_;
 };
 
 template <typename TNum>
@@ -95,9 +139,13 @@ struct RectSet {
   }
 };
 
-void get_draw_regions(const std::vector<Rect<int>> &in,
+// Splits the part of the count rects in "in" which lies within
+// damage_region into disjoint rects. Each of them is tagged with the ids
+// (indices into "in") of all rects covering it. Scratch memory is taken
+// from the allocator of out.
+void get_draw_regions(const Rect<int> *in, size_t count,
                       const HwcRect<int> &damage_region,
-                      std::vector<RectSet<int>> *out);
+                      ArenaVector<RectSet<int>> *out);
 }  // namespace hwcomposer
 
 #endif  // COMMON_UTILS_DISJOINT_LAYERS_H_
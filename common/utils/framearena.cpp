@@ -0,0 +1,79 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "framearena.h"
+
+namespace hwcomposer {
+
+// Enough for temporaries of a frame with a handful of layers.
+static const size_t kMinBlockSize = 16 * 1024;
+
+FrameArena::~FrameArena() {
+  for (Block &block : blocks_) {
+    delete[] block.data;
+  }
+}
+
+void FrameArena::AddBlock(size_t size) {
+  if (size < kMinBlockSize)
+    size = kMinBlockSize;
+
+  Block block;
+  block.data = new uint8_t[size];
+  block.size = size;
+  blocks_.emplace_back(block);
+  offset_ = 0;
+}
+
+void *FrameArena::Allocate(size_t size, size_t alignment) {
+  if (!blocks_.empty()) {
+    Block &block = blocks_.back();
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+    size_t offset = ((base + offset_ + alignment - 1) & ~(alignment - 1)) - base;
+    if (offset + size <= block.size) {
+      offset_ = offset + size;
+      return block.data + offset;
+    }
+  }
+
+  // new[] returns memory suitably aligned for any fundamental type.
+  size_t block_size = size;
+  if (!blocks_.empty())
+    block_size += blocks_.back().size;
+
+  AddBlock(block_size);
+  offset_ = size;
+  return blocks_.back().data;
+}
+
+void FrameArena::Reset() {
+  offset_ = 0;
+  if (blocks_.size() < 2)
+    return;
+
+  // Replace all blocks with one which can hold everything allocated this
+  // frame, so that we don't need to grow again next frame.
+  size_t total_size = 0;
+  for (Block &block : blocks_) {
+    total_size += block.size;
+    delete[] block.data;
+  }
+
+  blocks_.clear();
+  AddBlock(total_size);
+}
+
+}  // namespace hwcomposer
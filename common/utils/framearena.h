@@ -0,0 +1,102 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_UTILS_FRAMEARENA_H_
+#define COMMON_UTILS_FRAMEARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <vector>
+
+namespace hwcomposer {
+
+// Monotonic allocator for temporaries which don't outlive a frame.
+// Memory is only given back in Reset, which is expected to be called once
+// per frame. After the first few frames, all allocations are served from
+// one block and no calls to malloc are needed.
+class FrameArena {
+ public:
+  FrameArena() = default;
+  ~FrameArena();
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  void *Allocate(size_t size, size_t alignment);
+
+  // Invalidates all memory returned by Allocate so far.
+  void Reset();
+
+ private:
+  struct Block {
+    uint8_t *data;
+    size_t size;
+  };
+
+  void AddBlock(size_t size);
+
+  std::vector<Block> blocks_;
+  size_t offset_ = 0;
+};
+
+// Allocator to be used with standard containers. Memory comes from arena
+// if one is set, from the heap otherwise.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  ArenaAllocator() = default;
+
+  explicit ArenaAllocator(FrameArena *arena) : arena_(arena) {
+  }
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {
+  }
+
+  T *allocate(size_t n) {
+    if (!arena_)
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+
+    return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t /*n*/) {
+    if (!arena_)
+      ::operator delete(p);
+  }
+
+  FrameArena *arena_ = NULL;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs) {
+  return lhs.arena_ == rhs.arena_;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs) {
+  return lhs.arena_ != rhs.arena_;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace hwcomposer
+#endif  // COMMON_UTILS_FRAMEARENA_H_
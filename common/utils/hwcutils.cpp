@@ -17,6 +17,7 @@
 #include "hwcutils.h"
 
 #include <poll.h>
+#include <stdint.h>
 
 #include "hwctrace.h"
 
@@ -78,6 +79,97 @@ void CalculateRect(const HwcRect<int>& target_rect, HwcRect<int>& new_rect) {
   new_rect.bottom = std::max(target_rect.bottom, new_rect.bottom);
 }
 
+static uint64_t RectArea(const HwcRect<int>& rect) {
+  return (uint64_t)(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+void AddRectToRegion(const HwcRect<int>& rect, HwcRegion& region) {
+  if (rect.left >= rect.right || rect.top >= rect.bottom)
+    return;
+
+  // Rects of the region don't overlap, so if one of them encloses rect no
+  // other one can overlap it.
+  HwcRect<int> merged = rect;
+  size_t i = 0;
+  while (i < region.size()) {
+    if (!IsOverlapping(region[i], merged)) {
+      i++;
+      continue;
+    }
+
+    if (IsEnclosedBy(merged, region[i]))
+      return;
+
+    // The merged rect grew, check all remaining rects again.
+    CalculateRect(region[i], merged);
+    region[i] = region.back();
+    region.pop_back();
+    i = 0;
+  }
+
+  region.emplace_back(merged);
+  if (region.size() <= kMaxDamageRects)
+    return;
+
+  size_t first = 0;
+  size_t second = 1;
+  uint64_t least_waste = UINT64_MAX;
+  for (size_t j = 0; j < region.size(); j++) {
+    for (size_t k = j + 1; k < region.size(); k++) {
+      HwcRect<int> bounds = region[j];
+      CalculateRect(region[k], bounds);
+      uint64_t waste =
+          RectArea(bounds) - RectArea(region[j]) - RectArea(region[k]);
+      if (waste < least_waste) {
+        least_waste = waste;
+        first = j;
+        second = k;
+      }
+    }
+  }
+
+  HwcRect<int> bounds = region[first];
+  CalculateRect(region[second], bounds);
+  region[second] = region.back();
+  region.pop_back();
+  region[first] = region.back();
+  region.pop_back();
+  AddRectToRegion(bounds, region);
+}
+
+void CalculateRegion(const HwcRegion& target_region, HwcRegion& new_region) {
+  for (const HwcRect<int>& rect : target_region) {
+    AddRectToRegion(rect, new_region);
+  }
+}
+
+void SubtractRectFromRegion(const HwcRect<int>& rect, HwcRegion& region) {
+  HwcRegion remaining;
+  remaining.reserve(region.size());
+  for (const HwcRect<int>& current : region) {
+    if (!IsOverlapping(current, rect)) {
+      remaining.emplace_back(current);
+      continue;
+    }
+
+    // Bands above and below rect span the whole width, the ones left and
+    // right of it only its height.
+    int top = std::max(current.top, rect.top);
+    int bottom = std::min(current.bottom, rect.bottom);
+    if (current.top < top)
+      remaining.emplace_back(current.left, current.top, current.right, top);
+    if (bottom < current.bottom)
+      remaining.emplace_back(current.left, bottom, current.right,
+                             current.bottom);
+    if (current.left < rect.left)
+      remaining.emplace_back(current.left, top, rect.left, bottom);
+    if (rect.right < current.right)
+      remaining.emplace_back(rect.right, top, current.right, bottom);
+  }
+
+  region.swap(remaining);
+}
+
 void CalculateSourceRect(const HwcRect<float>& target_rect,
                          HwcRect<float>& new_rect) {
   if (new_rect.empty()) {
@@ -120,6 +212,30 @@ bool IsSupportedMediaFormat(uint32_t format) {
   return false;
 }
 
+bool IsOpaqueFormat(uint32_t format) {
+  switch (format) {
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_RGBX8888:
+    case DRM_FORMAT_BGRX8888:
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_XBGR2101010:
+    case DRM_FORMAT_RGBX1010102:
+    case DRM_FORMAT_BGRX1010102:
+    case DRM_FORMAT_RGB888:
+    case DRM_FORMAT_BGR888:
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+      return true;
+    case DRM_FORMAT_AYUV:
+      return false;
+    default:
+      break;
+  }
+
+  return IsSupportedMediaFormat(format);
+}
+
 uint32_t GetTotalPlanesForFormat(uint32_t format) {
   switch (format) {
     case DRM_FORMAT_NV12:
@@ -0,0 +1,112 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "synctimeline.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "hwctrace.h"
+
+#ifndef SW_SYNC_IOC_INC
+struct sw_sync_create_fence_data {
+  uint32_t value;
+  char name[32];
+  int32_t fence;
+};
+
+#define SW_SYNC_IOC_MAGIC 'W'
+#define SW_SYNC_IOC_CREATE_FENCE \
+  _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, uint32_t)
+#endif
+
+namespace hwcomposer {
+
+SyncTimeline::SyncTimeline() {
+}
+
+SyncTimeline::~SyncTimeline() {
+  if (timeline_fd_ < 0)
+    return;
+
+  SignalAll();
+  close(timeline_fd_);
+}
+
+bool SyncTimeline::Initialize() {
+  if (timeline_fd_ >= 0)
+    return true;
+
+  timeline_fd_ = open("/dev/sw_sync", O_RDWR | O_CLOEXEC);
+  if (timeline_fd_ < 0)
+    timeline_fd_ = open("/sys/kernel/debug/sync/sw_sync", O_RDWR | O_CLOEXEC);
+
+  if (timeline_fd_ < 0) {
+    ITRACE("sw_sync is not available. %s", PRINTERROR());
+    return false;
+  }
+
+  return true;
+}
+
+int32_t SyncTimeline::CreateFence(const char *name) {
+  if (timeline_fd_ < 0)
+    return -1;
+
+  ScopedSpinLock lock(lock_);
+  struct sw_sync_create_fence_data data;
+  memset(&data, 0, sizeof(data));
+  data.value = fence_pt_ + 1;
+  strncpy(data.name, name, sizeof(data.name) - 1);
+  if (ioctl(timeline_fd_, SW_SYNC_IOC_CREATE_FENCE, &data) < 0) {
+    ETRACE("Failed to create sw_sync fence. %s", PRINTERROR());
+    return -1;
+  }
+
+  fence_pt_++;
+  return data.fence;
+}
+
+void SyncTimeline::Signal() {
+  ScopedSpinLock lock(lock_);
+  if (signalled_pt_ == fence_pt_)
+    return;
+
+  Advance(1);
+}
+
+void SyncTimeline::SignalAll() {
+  ScopedSpinLock lock(lock_);
+  if (signalled_pt_ == fence_pt_)
+    return;
+
+  Advance(fence_pt_ - signalled_pt_);
+}
+
+void SyncTimeline::Advance(uint32_t increment) {
+  if (ioctl(timeline_fd_, SW_SYNC_IOC_INC, &increment) < 0) {
+    ETRACE("Failed to signal sw_sync timeline. %s", PRINTERROR());
+    return;
+  }
+
+  signalled_pt_ += increment;
+}
+
+}  // namespace hwcomposer
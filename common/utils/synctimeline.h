@@ -0,0 +1,61 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_UTILS_SYNCTIMELINE_H_
+#define COMMON_UTILS_SYNCTIMELINE_H_
+
+#include <stdint.h>
+
+#include <spinlock.h>
+
+namespace hwcomposer {
+
+// This class wraps a sw_sync timeline. It lets us hand out sync_file fences
+// for work which has not been submitted yet and signal them later, in the
+// order they were created.
+class SyncTimeline {
+ public:
+  SyncTimeline();
+  ~SyncTimeline();
+
+  // Returns false in case sw_sync is not available on this system.
+  bool Initialize();
+
+  bool IsValid() const {
+    return timeline_fd_ >= 0;
+  }
+
+  // Creates a fence for the next point on the timeline. Returns -1 on
+  // failure.
+  int32_t CreateFence(const char *name);
+
+  // Signals the oldest fence which has not been signalled yet.
+  void Signal();
+
+  // Signals all fences created so far.
+  void SignalAll();
+
+ private:
+  void Advance(uint32_t increment);
+
+  SpinLock lock_;
+  int timeline_fd_ = -1;
+  uint32_t fence_pt_ = 0;
+  uint32_t signalled_pt_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_UTILS_SYNCTIMELINE_H_
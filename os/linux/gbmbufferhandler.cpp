@@ -96,9 +96,15 @@ bool GbmBufferHandler::CreateBuffer(uint32_t w, uint32_t h, int format,
     flags |= (GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
   }
 
+#ifdef USE_SW
+  // The software compositor addresses pixels through mappings, which only
+  // works for linear layouts.
+  flags |= GBM_BO_USE_LINEAR;
+#else
   if (raw_pixel_buffer) {
     flags |= GBM_BO_USE_LINEAR;
   }
+#endif
 
   if (layer_type == kLayerCursor) {
     if (w < preferred_cursor_width_)
@@ -112,7 +118,7 @@ bool GbmBufferHandler::CreateBuffer(uint32_t w, uint32_t h, int format,
 
   bool rbc_enabled = false;
   uint64_t modifier = DRM_FORMAT_MOD_NONE;
-#ifdef ENABLE_RBC
+#if defined(ENABLE_RBC) && !defined(USE_SW)
   if (preferred_modifier != -1) {
     modifier = preferred_modifier;
   }
@@ -105,6 +105,9 @@ enum iahwc_function_descriptors {
   IAHWC_FUNC_LAYER_SET_SURFACE_DAMAGE,
   IAHWC_FUNC_LAYER_SET_PLANE_ALPHA,
   IAHWC_FUNC_LAYER_SET_INDEX,
+  IAHWC_FUNC_DISPLAY_GET_FRAME_STATS,
+  IAHWC_FUNC_DISPLAY_RESET_FRAME_STATS,
+  IAHWC_FUNC_LAYER_SET_SOLID_COLOR,
 };
 
 enum iahwc_callback_descriptor {
@@ -141,6 +144,32 @@ typedef struct iahwc_region {
   iahwc_rect_t const* rects;
 } iahwc_region_t;
 
+// Totals since the display was created or its stats were last reset.
+// Times are in nanoseconds.
+typedef struct iahwc_frame_stats {
+  uint64_t frames_presented;
+  uint64_t frames_skipped;
+  uint64_t full_validations;
+  uint64_t incremental_validations;
+  uint64_t plane_revalidations;
+  uint64_t test_commits;
+  uint64_t gpu_composited_pixels;
+  uint64_t media_compositions;
+  uint64_t commit_failures;
+  uint64_t validate_time;
+  uint64_t compose_time;
+  uint64_t commit_time;
+  uint64_t gpu_sampled_pixels;
+  uint64_t clears_avoided;
+  uint64_t clear_bytes_saved;
+  uint64_t plane_assignment_cache_hits;
+  uint64_t plane_assignment_cache_misses;
+  uint64_t incremental_strategy_validations;
+  uint64_t incremental_strategy_test_commits;
+  uint64_t batched_strategy_validations;
+  uint64_t batched_strategy_test_commits;
+} iahwc_frame_stats_t;
+
 typedef int (*IAHWC_PFN_GET_NUM_DISPLAYS)(iahwc_device_t*, int* num_displays);
 typedef int (*IAHWC_PFN_REGISTER_CALLBACK)(iahwc_device_t*, int descriptor,
                                            iahwc_display_t display_handle,
@@ -224,6 +253,17 @@ typedef int (*IAHWC_PFN_LAYER_SET_INDEX)(iahwc_device_t*,
                                          iahwc_display_t display_handle,
                                          iahwc_layer_t layer_handle,
                                          uint32_t layer_index);
+typedef int (*IAHWC_PFN_DISPLAY_GET_FRAME_STATS)(
+    iahwc_device_t*, iahwc_display_t display_handle,
+    iahwc_frame_stats_t* stats);
+typedef int (*IAHWC_PFN_DISPLAY_RESET_FRAME_STATS)(
+    iahwc_device_t*, iahwc_display_t display_handle);
+// color is RGBA8888, red in the most significant byte. The layer has no
+// buffer until the next SetBo or SetRawPixelData.
+typedef int (*IAHWC_PFN_LAYER_SET_SOLID_COLOR)(iahwc_device_t*,
+                                               iahwc_display_t display_handle,
+                                               iahwc_layer_t layer_handle,
+                                               uint32_t color);
 typedef int (*IAHWC_PFN_VSYNC)(iahwc_callback_data_t data,
                                iahwc_display_t display, int64_t timestamp);
 typedef int (*IAHWC_PFN_PIXEL_UPLOADER)(iahwc_callback_data_t data,
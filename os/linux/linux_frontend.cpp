@@ -231,6 +231,18 @@ iahwc_function_ptr_t IAHWC::HookGetFunctionPtr(iahwc_device_t* /* device */,
       return ToHook<IAHWC_PFN_LAYER_SET_INDEX>(
           LayerHook<decltype(&IAHWCLayer::SetLayerIndex),
                     &IAHWCLayer::SetLayerIndex, uint32_t>);
+    case IAHWC_FUNC_DISPLAY_GET_FRAME_STATS:
+      return ToHook<IAHWC_PFN_DISPLAY_GET_FRAME_STATS>(
+          DisplayHook<decltype(&IAHWCDisplay::GetFrameStats),
+                      &IAHWCDisplay::GetFrameStats, iahwc_frame_stats_t*>);
+    case IAHWC_FUNC_DISPLAY_RESET_FRAME_STATS:
+      return ToHook<IAHWC_PFN_DISPLAY_RESET_FRAME_STATS>(
+          DisplayHook<decltype(&IAHWCDisplay::ResetFrameStats),
+                      &IAHWCDisplay::ResetFrameStats>);
+    case IAHWC_FUNC_LAYER_SET_SOLID_COLOR:
+      return ToHook<IAHWC_PFN_LAYER_SET_SOLID_COLOR>(
+          LayerHook<decltype(&IAHWCLayer::SetLayerSolidColor),
+                    &IAHWCLayer::SetLayerSolidColor, uint32_t>);
     case IAHWC_FUNC_INVALID:
     default:
       return NULL;
@@ -406,6 +418,45 @@ int IAHWC::IAHWCDisplay::EnableOverlayUsage() {
   return 0;
 }
 
+int IAHWC::IAHWCDisplay::GetFrameStats(iahwc_frame_stats_t* stats) {
+  hwcomposer::HwcFrameStats frame_stats;
+  if (!native_display_->GetFrameStats(&frame_stats))
+    return IAHWC_ERROR_UNSUPPORTED;
+
+  stats->frames_presented = frame_stats.frames_presented;
+  stats->frames_skipped = frame_stats.frames_skipped;
+  stats->full_validations = frame_stats.full_validations;
+  stats->incremental_validations = frame_stats.incremental_validations;
+  stats->plane_revalidations = frame_stats.plane_revalidations;
+  stats->test_commits = frame_stats.test_commits;
+  stats->gpu_composited_pixels = frame_stats.gpu_composited_pixels;
+  stats->media_compositions = frame_stats.media_compositions;
+  stats->commit_failures = frame_stats.commit_failures;
+  stats->validate_time = frame_stats.validate_time;
+  stats->compose_time = frame_stats.compose_time;
+  stats->commit_time = frame_stats.commit_time;
+  stats->gpu_sampled_pixels = frame_stats.gpu_sampled_pixels;
+  stats->clears_avoided = frame_stats.clears_avoided;
+  stats->clear_bytes_saved = frame_stats.clear_bytes_saved;
+  stats->plane_assignment_cache_hits = frame_stats.plane_assignment_cache_hits;
+  stats->plane_assignment_cache_misses =
+      frame_stats.plane_assignment_cache_misses;
+  stats->incremental_strategy_validations =
+      frame_stats.incremental_strategy_validations;
+  stats->incremental_strategy_test_commits =
+      frame_stats.incremental_strategy_test_commits;
+  stats->batched_strategy_validations =
+      frame_stats.batched_strategy_validations;
+  stats->batched_strategy_test_commits =
+      frame_stats.batched_strategy_test_commits;
+  return IAHWC_ERROR_NONE;
+}
+
+int IAHWC::IAHWCDisplay::ResetFrameStats() {
+  native_display_->ResetFrameStats();
+  return IAHWC_ERROR_NONE;
+}
+
 void IAHWC::IAHWCDisplay::Synchronize() {
   raw_data_uploader_->Synchronize();
 }
@@ -522,6 +573,7 @@ int IAHWC::IAHWCLayer::SetBo(gbm_bo* bo) {
   hwc_handle_.gbm_flags = 0;
 
   iahwc_layer_.SetNativeHandle(&hwc_handle_);
+  iahwc_layer_.SetLayerCompositionType(hwcomposer::Composition_Device);
 
   return IAHWC_ERROR_NONE;
 }
@@ -566,6 +618,7 @@ int IAHWC::IAHWCLayer::SetRawPixelData(iahwc_raw_pixel_data bo) {
     orig_height_ = bo.height;
     orig_stride_ = bo.stride;
     iahwc_layer_.SetNativeHandle(pixel_buffer_);
+    iahwc_layer_.SetLayerCompositionType(hwcomposer::Composition_Device);
   }
 
   upload_in_progress_ = true;
@@ -673,6 +726,27 @@ int IAHWC::IAHWCLayer::SetLayerIndex(uint32_t layer_index) {
   return IAHWC_ERROR_NONE;
 }
 
+int IAHWC::IAHWCLayer::SetLayerSolidColor(uint32_t color) {
+  if (pixel_buffer_) {
+    const NativeBufferHandler* buffer_handler =
+        raw_data_uploader_->GetNativeBufferHandler();
+    if (upload_in_progress_) {
+      raw_data_uploader_->Synchronize();
+    }
+    buffer_handler->ReleaseBuffer(pixel_buffer_);
+    buffer_handler->DestroyHandle(pixel_buffer_);
+    pixel_buffer_ = NULL;
+  } else {
+    ClosePrimeHandles();
+  }
+
+  iahwc_layer_.SetNativeHandle(NULL);
+  iahwc_layer_.SetLayerCompositionType(hwcomposer::Composition_SolidColor);
+  iahwc_layer_.SetSolidColor(color);
+
+  return IAHWC_ERROR_NONE;
+}
+
 hwcomposer::HwcLayer* IAHWC::IAHWCLayer::GetLayer() {
   return &iahwc_layer_;
 }
@@ -54,6 +54,7 @@ class IAHWC : public iahwc_device {
     int SetLayerSurfaceDamage(iahwc_region_t region);
     int SetLayerPlaneAlpha(float alpha);
     int SetLayerIndex(uint32_t layer_index);
+    int SetLayerSolidColor(uint32_t color);
     uint32_t GetLayerIndex() {
       return layer_index_;
     }
@@ -105,6 +106,10 @@ class IAHWC : public iahwc_device {
 
     int EnableOverlayUsage();
 
+    int GetFrameStats(iahwc_frame_stats_t* stats);
+
+    int ResetFrameStats();
+
     void Synchronize() override;
 
     int RegisterHotPlugCallback(iahwc_callback_data_t data,
@@ -31,6 +31,7 @@
 namespace hwcomposer {
 
 class NativeDisplay;
+class CompositorPool;
 
 class GpuDevice : public HWCThread {
  public:
@@ -99,6 +100,12 @@ class GpuDevice : public HWCThread {
 
   std::vector<uint32_t> GetDisplayReservedPlanes(uint32_t display_id);
 
+  // Workers shared by the compositors of all displays, NULL if every
+  // display composites on a thread of its own.
+  CompositorPool* GetCompositorPool() {
+    return compositor_pool_.get();
+  }
+
  private:
   GpuDevice();
 
@@ -112,6 +119,8 @@ class GpuDevice : public HWCThread {
   void HandleRoutine() override;
   void HandleWait() override;
   void ParsePlaneReserveSettings(std::string& value);
+  // Declared first, so that it outlives the compositors of all displays.
+  std::unique_ptr<CompositorPool> compositor_pool_;
   std::unique_ptr<DisplayManager> display_manager_;
   std::vector<std::unique_ptr<LogicalDisplayManager>> logical_display_manager_;
   std::vector<std::unique_ptr<NativeDisplay>> mosaic_displays_;
@@ -141,6 +141,46 @@ enum class HWCScalingRunTimeSetting : int32_t {
   kScalingModeHighQuality = 2  // use high quality scaling mode.
 };
 
+// Statistics of frames handled by a display. Times are in nanoseconds
+// and accumulated over all frames.
+struct HwcFrameStats {
+  uint64_t frames_presented = 0;
+  // Frames which didn't need a commit as nothing changed.
+  uint64_t frames_skipped = 0;
+  uint64_t full_validations = 0;
+  // Frames which could re-use planes of the previous frame.
+  uint64_t incremental_validations = 0;
+  uint64_t plane_revalidations = 0;
+  uint64_t test_commits = 0;
+  // Area redrawn by GPU composition, only damaged parts of planes are
+  // redrawn.
+  uint64_t gpu_composited_pixels = 0;
+  // Layer pixels read by GPU composition, a redrawn pixel counts once for
+  // every layer visible at it.
+  uint64_t gpu_sampled_pixels = 0;
+  // Composition target clears skipped since the composited layers cover
+  // the area, and bytes not cleared by skipped or reduced clears.
+  uint64_t clears_avoided = 0;
+  uint64_t clear_bytes_saved = 0;
+  // Planes composited by the media pipeline.
+  uint64_t media_compositions = 0;
+  uint64_t commit_failures = 0;
+  uint64_t validate_time = 0;
+  uint64_t compose_time = 0;
+  uint64_t commit_time = 0;
+  // Full validations which found, or didn't find, the plane assignment of
+  // their layer stack in cache.
+  uint64_t plane_assignment_cache_hits = 0;
+  uint64_t plane_assignment_cache_misses = 0;
+  // Full validations done by each plane validation strategy and the test
+  // commits they needed. Batched validation falls back to incremental when
+  // it fails.
+  uint64_t incremental_strategy_validations = 0;
+  uint64_t incremental_strategy_test_commits = 0;
+  uint64_t batched_strategy_validations = 0;
+  uint64_t batched_strategy_test_commits = 0;
+};
+
 struct EnumClassHash {
   template <typename T>
   std::size_t operator()(T t) const {
@@ -112,6 +112,15 @@ struct HwcLayer {
     return surface_damage_;
   }
 
+  /**
+   * API for getting surface damage of this layer as a list of
+   * non-overlapping rects. GetSurfaceDamage returns the rect
+   * enclosing all of them.
+   */
+  const HwcRegion& GetSurfaceDamageRegion() const {
+    return surface_damage_region_;
+  }
+
   /**
    * API for querying damage region of this layer
    * has changed from last Present call to
@@ -285,10 +294,22 @@ struct HwcLayer {
    */
   const HwcRect<int>& GetLayerDamage();
 
+  /**
+   * API for getting damage caused by this layer for current frame
+   * update as a list of non-overlapping rects, enclosed by
+   * GetLayerDamage.
+   */
+  const HwcRegion& GetLayerDamageRegion() const {
+    return current_rendering_damage_region_;
+  }
+
  private:
   void Validate();
+  void ResetConstraints();
   void UpdateRenderingDamage(const HwcRect<int>& old_rect,
                              const HwcRect<int>& newrect, bool same_rect);
+  void UpdateRenderingDamage(const HwcRegion& old_region,
+                             const HwcRegion& new_region);
 
   /*
    Get Rendering Damage from source surface damage
@@ -296,11 +317,14 @@ struct HwcLayer {
   */
 
   void SufaceDamageTransfrom();
+  bool TransformDamageRect(const HwcRect<int>& damage,
+                           HwcRect<int>& rendering_damage) const;
 
   void SetTotalDisplays(uint32_t total_displays);
   friend class VirtualDisplay;
   friend class PhysicalDisplay;
   friend class MosaicDisplay;
+  friend class MosaicPresentWorker;
 
 #ifdef ENABLE_PANORAMA
   friend class VirtualPanoramaDisplay;
@@ -334,6 +358,8 @@ struct HwcLayer {
   HwcRect<int> surface_damage_;
   HwcRect<int> visible_rect_;
   HwcRect<int> current_rendering_damage_;
+  HwcRegion surface_damage_region_;
+  HwcRegion current_rendering_damage_region_;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   HWCNativeHandle sf_handle_ = 0;
   int32_t release_fd_ = -1;
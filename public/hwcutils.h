@@ -54,6 +54,41 @@ void ResetRectToRegion(const HwcRegion& hwc_region, HwcRect<int>& rect);
  */
 void CalculateRect(const HwcRect<int>& target_rect, HwcRect<int>& new_rect);
 
+// Maximum number of rectangles kept in a damage region.
+const size_t kMaxDamageRects = 16;
+
+/**
+ * Add a rectangle to a damage region
+ *
+ * Rectangles of the region overlapping the new one are merged with it, so
+ * that rectangles of the region never overlap each other. Once the region
+ * holds more than kMaxDamageRects rectangles, the two whose enclosing
+ * rectangle adds the least area are merged.
+ * Has no effect if the rectangle has no area.
+ * @param rect The rectangle to add
+ * @param region The damage region to be expanded
+ */
+void AddRectToRegion(const HwcRect<int>& rect, HwcRegion& region);
+
+/**
+ * Add all rectangles of a damage region to another one
+ *
+ * @param target_region The region to add
+ * @param new_region The damage region to be expanded
+ */
+void CalculateRegion(const HwcRegion& target_region, HwcRegion& new_region);
+
+/**
+ * Remove a rectangle from a region
+ *
+ * Rectangles of the region overlapping the removed one are split into the
+ * parts outside of it, so rectangles of the region still don't overlap.
+ * The region may end up with more than kMaxDamageRects rectangles.
+ * @param rect The rectangle to remove
+ * @param region The region to be reduced
+ */
+void SubtractRectFromRegion(const HwcRect<int>& rect, HwcRegion& region);
+
 /**
  * Expand the bounds of a rectangle to enclose the bounds of a target rectangle
  *
@@ -73,6 +108,14 @@ void CalculateSourceRect(const HwcRect<float>& target_rect,
  */
 bool IsSupportedMediaFormat(uint32_t format);
 
+/**
+ * Check if a format has no alpha channel
+ *
+ * @param format fourcc based pixel format (see drm_fourcc.h)
+ * @return True if every pixel of the format is opaque
+ */
+bool IsOpaqueFormat(uint32_t format);
+
 /**
  * Check how many planes are used for a given pixel format
  *
@@ -33,6 +33,7 @@ struct HwcLayer;
 class GpuDevice;
 class NativeBufferHandler;
 class FrameBufferManager;
+class PresentTurn;
 
 class VsyncCallback {
  public:
@@ -295,6 +296,44 @@ class NativeDisplay {
   virtual void SetDisableExplicitSync(bool /*explicit_sync_enabled*/) {
   }
 
+  /**
+   * API to delay composition of a frame till just before the next
+   * vblank, based on how long previous frames took. This reduces latency
+   * at the cost of Present blocking the caller. Disabled by default.
+   */
+  virtual void SetLateLatching(bool /*enable*/) {
+  }
+
+  /**
+   * With late latching enabled, blocks till the latest time at which the
+   * next frame can be started and still make its vblank. Present does
+   * this itself, calling it before setting up the layers lets the frame
+   * pick up content which became ready in the meantime.
+   */
+  virtual void WaitForLatch() {
+  }
+
+  /**
+   * API to query number of frames which missed the vblank they were
+   * scheduled for, while late latching was enabled.
+   */
+  virtual uint32_t GetMissedPresentDeadlines() {
+    return 0;
+  }
+
+  /**
+   * API to query statistics of frames handled by this display.
+   * @param stats is filled with totals since the display was created or
+   *        ResetFrameStats was last called.
+   * @return false if stats are not supported by this display.
+   */
+  virtual bool GetFrameStats(HwcFrameStats * /*stats*/) {
+    return false;
+  }
+
+  virtual void ResetFrameStats() {
+  }
+
   /**
    * API to connect the display. Note that this doesn't necessarily
    * mean display is turned on. Implementation is free to reset any display
@@ -331,6 +370,26 @@ class NativeDisplay {
   virtual void CloneDisplay(NativeDisplay * /*source_display*/) {
   }
 
+  /**
+   * Displays cloning this one scan out its final composition through a
+   * plane scaler, letterboxed to keep its aspect ratio, instead of
+   * showing and composing its planes themselves. While it has clones of
+   * another size, this display then composes every frame with more than
+   * one layer besides cursors into a single plane.
+   */
+  virtual void SetScaledClones(bool /*enable*/) {
+  }
+
+  /**
+   * Lets Present of this display run concurrently with other displays
+   * presenting the same layers, reading and releasing the layers only at
+   * turn. turn needs to outlive the next Present call. Pass NULL to
+   * present on its own again. Returns false if not supported.
+   */
+  virtual bool SetPresentTurn(PresentTurn * /*turn*/) {
+    return false;
+  }
+
   virtual uint32_t GetXTranslation() {
     return 0;
   }
@@ -100,7 +100,7 @@ json_list := jsonconfigs/colorcorrection.json jsonconfigs/kmscube1layer.json \
 	     jsonconfigs/multiplelayersnovideo.json jsonconfigs/powermode.json \
 	     jsonconfigs/video1layer_nv12.json jsonconfigs/example.json \
 	     jsonconfigs/multiplelayers.json jsonconfigs/multiplelayersnovideo_powermode.json \
-	     jsonconfigs/video1layer_bgra.json
+	     jsonconfigs/video1layer_bgra.json jsonconfigs/multiplelayers_damage.json
 
 
 
@@ -0,0 +1,275 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures CPU time spent in GLRenderer::Draw with and without batching of
+// regions, and checks that both produce the same pixels. Runs on Mesa's
+// llvmpipe without a GPU; EGL_PLATFORM=surfaceless and
+// LIBGL_ALWAYS_SOFTWARE=1 are set unless already present in the
+// environment.
+//
+// Usage: gl-renderer-bench [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "glrenderer.h"
+#include "nativesurface.h"
+#include "renderstate.h"
+#include "shim.h"
+
+using namespace hwcomposer;
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+static const uint32_t kTextureSize = 64;
+
+// Renders into a texture owned by the benchmark instead of a buffer
+// imported through the resource manager.
+class BenchSurface : public NativeSurface {
+ public:
+  BenchSurface() : NativeSurface(kWidth, kHeight) {
+  }
+
+  ~BenchSurface() override {
+    if (fb_)
+      glDeleteFramebuffers(1, &fb_);
+    if (texture_)
+      glDeleteTextures(1, &texture_);
+  }
+
+  bool MakeCurrent() override {
+    if (!fb_) {
+      glGenTextures(1, &texture_);
+      glBindTexture(GL_TEXTURE_2D, texture_);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kWidth, kHeight, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, NULL);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glGenFramebuffers(1, &fb_);
+      glBindFramebuffer(GL_FRAMEBUFFER, fb_);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, texture_, 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+          GL_FRAMEBUFFER_COMPLETE) {
+        return false;
+      }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fb_);
+    return true;
+  }
+
+ private:
+  GLuint fb_ = 0;
+  GLuint texture_ = 0;
+};
+
+// Gradient images sampled by the layers. The renderer samples external
+// textures, so each image is uploaded to a 2D texture and bound to the
+// external texture used as layer handle through an EGLImage.
+class BenchTextures {
+ public:
+  ~BenchTextures() {
+    for (EGLImageKHR image : images_)
+      hwcomposer::eglDestroyImageKHR(eglGetCurrentDisplay(), image);
+    glDeleteTextures(handles_.size(), handles_.data());
+    glDeleteTextures(sources_.size(), sources_.data());
+  }
+
+  bool Init(size_t count) {
+    std::vector<uint8_t> data(kTextureSize * kTextureSize * 4);
+    sources_.resize(count);
+    handles_.resize(count);
+    glGenTextures(count, sources_.data());
+    glGenTextures(count, handles_.data());
+    for (size_t i = 0; i < count; i++) {
+      for (size_t byte = 0; byte < data.size(); byte++)
+        data[byte] = (byte * (i + 3) + byte / kTextureSize * 7) & 0xff;
+
+      glBindTexture(GL_TEXTURE_2D, sources_[i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kTextureSize, kTextureSize, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+      EGLImageKHR image = hwcomposer::eglCreateImageKHR(
+          eglGetCurrentDisplay(), eglGetCurrentContext(),
+          EGL_GL_TEXTURE_2D_KHR, (EGLClientBuffer)(uintptr_t)sources_[i],
+          NULL);
+      if (image == EGL_NO_IMAGE_KHR)
+        return false;
+
+      images_.emplace_back(image);
+      glBindTexture(GL_TEXTURE_EXTERNAL_OES, handles_[i]);
+      hwcomposer::glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                                               (GLeglImageOES)image);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    return glGetError() == GL_NO_ERROR;
+  }
+
+  size_t size() const {
+    return handles_.size();
+  }
+
+  GLuint GetHandle(size_t index) const {
+    return handles_.at(index);
+  }
+
+ private:
+  std::vector<GLuint> sources_;
+  std::vector<GLuint> handles_;
+  std::vector<EGLImageKHR> images_;
+};
+
+static int64_t GetThreadTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Splits the surface into a grid of regions. Neighbouring regions cycle
+// through layer_sets different stacks of 1 to max_layers layers, like the
+// regions of a few overlapping windows.
+static void GenerateStates(int columns, int rows, int layer_sets,
+                           unsigned max_layers, const BenchTextures &textures,
+                           std::vector<RenderState> *states) {
+  // Solid colors are in the byte order the program reads them, alpha first.
+  // Textured layers add nothing to the sampled color.
+  static uint8_t color[4] = {0xff, 0xc0, 0x80, 0x40};
+  static uint8_t no_color[4] = {0xff, 0x00, 0x00, 0x00};
+  states->clear();
+  int width = kWidth / columns;
+  int height = kHeight / rows;
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      int set = (row * columns + column) % layer_sets;
+      states->emplace_back();
+      RenderState &state = states->back();
+      state.x_ = state.scissor_x_ = column * width;
+      state.y_ = state.scissor_y_ = row * height;
+      state.width_ = state.scissor_width_ = width;
+      state.height_ = state.scissor_height_ = height;
+      unsigned layers = 1 + set % max_layers;
+      for (unsigned i = 0; i < layers; i++) {
+        state.layer_state_.emplace_back();
+        RenderState::LayerState &layer = state.layer_state_.back();
+        size_t index = (set + i) % textures.size();
+        layer.crop_bounds_[0] = (float)column / columns;
+        layer.crop_bounds_[1] = (float)row / rows;
+        layer.crop_bounds_[2] = (float)(column + 1) / columns;
+        layer.crop_bounds_[3] = (float)(row + 1) / rows;
+        layer.alpha_ = 0.5f;
+        layer.premult_ = 1.0f;
+        layer.texture_matrix_[0] = 1.0f;
+        layer.texture_matrix_[1] = 0.0f;
+        layer.texture_matrix_[2] = 0.0f;
+        layer.texture_matrix_[3] = 1.0f;
+        layer.layer_index_ = index;
+        layer.solid_color_array_ = (set + i) % 5 == 4 ? color : no_color;
+        layer.handle_ = textures.GetHandle(index);
+      }
+    }
+  }
+}
+
+// Returns average CPU time of the calling thread per Draw in us. Time
+// spent by llvmpipe's rasterizer threads isn't included.
+static double RunDraws(GLRenderer &renderer, BenchSurface &surface,
+                       const std::vector<RenderState> &states, int iterations,
+                       std::vector<uint8_t> *pixels) {
+  // Untimed, compiles the programs needed by states.
+  renderer.Draw(states, &surface);
+  glFinish();
+
+  int64_t total = 0;
+  for (int i = 0; i < iterations; i++) {
+    surface.SetClearSurface(NativeSurface::kFullClear);
+    int64_t start = GetThreadTimeNs();
+    renderer.Draw(states, &surface);
+    total += GetThreadTimeNs() - start;
+    glFinish();
+  }
+
+  pixels->resize(kWidth * kHeight * 4);
+  surface.MakeCurrent();
+  glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels->data());
+  return total / 1000.0 / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 200;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  setenv("EGL_PLATFORM", "surfaceless", 0);
+  setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+
+  GLRenderer renderer;
+  if (!renderer.Init()) {
+    fprintf(stderr, "Failed to initialize GLRenderer.\n");
+    return 1;
+  }
+
+  // Fences need EGL_ANDROID_native_fence_sync, which llvmpipe lacks.
+  renderer.SetDisableExplicitSync(true);
+  printf("GL_RENDERER: %s\n", (const char *)glGetString(GL_RENDERER));
+
+  const unsigned kMaxLayers = 4;
+  BenchTextures textures;
+  if (!textures.Init(8)) {
+    fprintf(stderr, "Failed to upload textures.\n");
+    return 1;
+  }
+
+  BenchSurface surface;
+  const int grids[][2] = {{4, 4}, {8, 8}, {16, 16}, {32, 24}};
+  bool failed = false;
+  std::vector<RenderState> states;
+  std::vector<uint8_t> unbatched_pixels;
+  std::vector<uint8_t> batched_pixels;
+
+  printf("%8s %17s %15s %8s\n", "regions", "unbatched us/draw",
+         "batched us/draw", "speedup");
+  for (const auto &grid : grids) {
+    GenerateStates(grid[0], grid[1], 6, kMaxLayers, textures, &states);
+    renderer.EnableBatching(false);
+    double unbatched_us =
+        RunDraws(renderer, surface, states, iterations, &unbatched_pixels);
+    renderer.EnableBatching(true);
+    double batched_us =
+        RunDraws(renderer, surface, states, iterations, &batched_pixels);
+    if (unbatched_pixels != batched_pixels) {
+      printf("FAIL: batched output differs for %zu regions\n", states.size());
+      failed = true;
+    }
+
+    printf("%8zu %17.1f %15.1f %7.1fx\n", states.size(), unbatched_us,
+           batched_us, unbatched_us / batched_us);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -31,6 +31,8 @@
 #include <linux/major.h>
 #include <signal.h>
 
+#include <new>
+
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
@@ -148,12 +150,31 @@ static uint64_t arg_frames = 0;
 static int display_mode;
 int force_mode = 0, config_index = 0, print_display_config = 0;
 
+/* flag set to print heap allocations done by every Present call */
+static int print_malloc_count;
+/* heap allocations done by this thread so far */
+static thread_local size_t malloc_count = 0;
+
+void *operator new(size_t size) {
+  malloc_count++;
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
 glContext gl;
 
 struct frame {
   std::vector<std::unique_ptr<hwcomposer::HwcLayer>> layers;
   std::vector<std::unique_ptr<LayerRenderer>> layer_renderers;
   std::vector<std::vector<uint32_t>> layers_fences;
+  std::vector<std::vector<hwcomposer::HwcRect<int>>> layers_damage;
   std::vector<int32_t> fences;
 };
 
@@ -264,7 +285,10 @@ class HotPlugEventCallback : public hwcomposer::DisplayHotPlugEventCallback {
     // We only support cloned mode for now.
     hwcomposer::NativeDisplay *primary = connected_displays_.at(0);
     int32_t retire_fence = -1;
+    size_t allocations = malloc_count;
     primary->Present(layers, &retire_fence);
+    if (print_malloc_count)
+      printf("Present: %zu heap allocations\n", malloc_count - allocations);
     fences.emplace_back(retire_fence);
     // store fences for each display for each layer
     unsigned int fence_index = 0;
@@ -621,6 +645,18 @@ static void fill_hwclayer(hwcomposer::HwcLayer *pHwcLayer,
       pParameter->frame_x, pParameter->frame_y, pParameter->frame_width,
       pParameter->frame_height), 0, 0);
   pHwcLayer->SetNativeHandle(pRenderer->GetNativeBoHandle());
+  pHwcLayer->SetAlpha(pParameter->alpha);
+  switch (pParameter->blending) {
+    case LAYER_BLENDING_PREMULT:
+      pHwcLayer->SetBlending(hwcomposer::HWCBlending::kBlendingPremult);
+      break;
+    case LAYER_BLENDING_COVERAGE:
+      pHwcLayer->SetBlending(hwcomposer::HWCBlending::kBlendingCoverage);
+      break;
+    default:
+      pHwcLayer->SetBlending(hwcomposer::HWCBlending::kBlendingNone);
+      break;
+  }
 }
 
 static void init_frames(int32_t width, int32_t height) {
@@ -714,6 +750,12 @@ static void init_frames(int32_t width, int32_t height) {
       hwc_layer = new hwcomposer::HwcLayer();
       fill_hwclayer(hwc_layer, &layer_parameter, renderer);
       frame->layers.push_back(std::unique_ptr<hwcomposer::HwcLayer>(hwc_layer));
+      frame->layers_damage.emplace_back();
+      for (const LAYER_DAMAGE_RECT &rect : layer_parameter.damage) {
+        frame->layers_damage.back().emplace_back(
+            rect.x, rect.y, rect.x + rect.width, rect.y + rect.height);
+      }
+
       frame->layer_renderers.push_back(
           std::unique_ptr<LayerRenderer>(renderer));
     }
@@ -724,7 +766,7 @@ static void print_help(void) {
   printf(
       "usage: testjsonlayers [-h|--help] [-f|--frames <frames>] [-j|--json "
       "<jsonfile>] [-p|--powermode <on/off/doze/dozesuspend>][--displaymode "
-      "<print/forcemode displayconfigindex]\n");
+      "<print/forcemode displayconfigindex] [--malloccount]\n");
 }
 
 static void parse_args(int argc, char *argv[]) {
@@ -733,6 +775,7 @@ static void parse_args(int argc, char *argv[]) {
       {"frames", required_argument, NULL, 'f'},
       {"json", required_argument, NULL, 'j'},
       {"displaymode", required_argument, &display_mode, 1},
+      {"malloccount", no_argument, &print_malloc_count, 1},
       {0},
   };
 
@@ -747,6 +790,8 @@ static void parse_args(int argc, char *argv[]) {
                             /*longindex*/ &longindex)) != -1) {
     switch (opt) {
       case 0:
+        if (!optarg)
+          break;
         if (!strcmp(optarg, "forcemode")) {
           force_mode = 1;
           config_index = atoi(argv[optind++]);
@@ -914,8 +959,11 @@ int main(int argc, char *argv[]) {
       frame->layers_fences[j].clear();
       frame->layer_renderers[j]->Draw(&gpu_fence_fd);
       frame->layers[j]->SetAcquireFence(gpu_fence_fd);
-      std::vector<hwcomposer::HwcRect<int>> damage_region;
-      damage_region.emplace_back(frame->layers[j]->GetDisplayFrame());
+      std::vector<hwcomposer::HwcRect<int>> damage_region =
+          frame->layers_damage[j];
+      if (damage_region.empty())
+        damage_region.emplace_back(frame->layers[j]->GetDisplayFrame());
+
       frame->layers[j]->SetSurfaceDamage(damage_region);
       layers.emplace_back(frame->layers[j].get());
     }
@@ -958,6 +1006,32 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  hwcomposer::HwcFrameStats stats;
+  if (displays.at(0)->GetFrameStats(&stats) &&
+      stats.frames_presented) {
+    printf(
+        "Frames presented: %llu, GPU composited pixels per frame: %llu, GPU "
+        "sampled pixels per frame: %llu\n",
+        (unsigned long long)stats.frames_presented,
+        (unsigned long long)(stats.gpu_composited_pixels /
+                             stats.frames_presented),
+        (unsigned long long)(stats.gpu_sampled_pixels /
+                             stats.frames_presented));
+    printf("Surface clears avoided: %llu, clear bytes saved: %llu\n",
+           (unsigned long long)stats.clears_avoided,
+           (unsigned long long)stats.clear_bytes_saved);
+    printf("Plane assignment cache hits: %llu, misses: %llu\n",
+           (unsigned long long)stats.plane_assignment_cache_hits,
+           (unsigned long long)stats.plane_assignment_cache_misses);
+    printf(
+        "Full validations, test commits: incremental %llu, %llu, batched "
+        "%llu, %llu\n",
+        (unsigned long long)stats.incremental_strategy_validations,
+        (unsigned long long)stats.incremental_strategy_test_commits,
+        (unsigned long long)stats.batched_strategy_validations,
+        (unsigned long long)stats.batched_strategy_test_commits);
+  }
+
   callback->SetBroadcastRGB("Automatic");
   callback->SetGamma(1, 1, 1);
   callback->SetBrightness(0x80, 0x80, 0x80);
@@ -0,0 +1,158 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures CPU time of merging layer damage into a plane's damage region
+// with CalculateRegion, the way DisplayQueue does every frame, against the
+// bounding rect CalculateRect produces. Also reports the area each of them
+// recomposites and checks that the region covers all damage with rects
+// which don't overlap.
+//
+// Usage: region-merge-bench [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include <hwcdefs.h>
+#include <hwcrect.h>
+#include <hwcutils.h>
+
+using namespace hwcomposer;
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t Area(const HwcRect<int> &rect) {
+  return (uint64_t)(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+// Damage of layers, each a region of rects_per_layer small rects of random
+// size and position within the screen, like cursors, clocks and progress
+// bars updating at the same time. Uses its own generator, so that runs are
+// reproducible.
+static void GenerateDamage(size_t layers, size_t rects_per_layer,
+                           std::vector<HwcRegion> *damage) {
+  uint32_t seed = 0x12345678 + layers * 31 + rects_per_layer;
+  damage->assign(layers, HwcRegion());
+  for (HwcRegion &region : *damage) {
+    for (size_t i = 0; i < rects_per_layer; i++) {
+      int values[4];
+      for (int &value : values) {
+        seed = seed * 1103515245 + 12345;
+        value = (seed >> 8) & 0xffff;
+      }
+
+      int width = 16 + values[0] % (kWidth / 8);
+      int height = 16 + values[1] % (kHeight / 8);
+      int left = values[2] % (kWidth - width);
+      int top = values[3] % (kHeight - height);
+      region.emplace_back(left, top, left + width, top + height);
+    }
+  }
+}
+
+// Checks that rects of region don't overlap and that every damage rect is
+// covered by them.
+static bool CheckRegion(const HwcRegion &region,
+                        const std::vector<HwcRegion> &damage) {
+  for (size_t i = 0; i < region.size(); i++) {
+    for (size_t j = i + 1; j < region.size(); j++) {
+      if (AnalyseOverlap(region[i], region[j]) != kOutside)
+        return false;
+    }
+  }
+
+  for (const HwcRegion &layer_damage : damage) {
+    for (const HwcRect<int> &rect : layer_damage) {
+      HwcRegion uncovered(1, rect);
+      for (const HwcRect<int> &covered : region)
+        SubtractRectFromRegion(covered, uncovered);
+
+      if (!uncovered.empty())
+        return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 10000;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  // Layers times damage rects per layer.
+  const size_t scenes[][2] = {{1, 1}, {2, 1}, {4, 2}, {4, 4}, {8, 4}, {16, 4}};
+  std::vector<HwcRegion> damage;
+  HwcRegion region;
+  bool failed = false;
+
+  printf("%6s %6s %12s %12s %6s %14s %14s\n", "layers", "rects",
+         "rect us", "region us", "out", "rect kpixels", "region kpixels");
+  for (const auto &scene : scenes) {
+    GenerateDamage(scene[0], scene[1], &damage);
+
+    HwcRect<int> bounds;
+    int64_t start = GetTimeNs();
+    for (int i = 0; i < iterations; i++) {
+      bounds.reset();
+      for (const HwcRegion &layer_damage : damage) {
+        for (const HwcRect<int> &rect : layer_damage)
+          CalculateRect(rect, bounds);
+      }
+    }
+    double rect_us = (GetTimeNs() - start) / 1000.0 / iterations;
+
+    start = GetTimeNs();
+    for (int i = 0; i < iterations; i++) {
+      // Same pattern as DisplayQueue, which keeps its storage.
+      region.clear();
+      for (const HwcRegion &layer_damage : damage)
+        CalculateRegion(layer_damage, region);
+    }
+    double region_us = (GetTimeNs() - start) / 1000.0 / iterations;
+
+    if (region.size() > kMaxDamageRects || !CheckRegion(region, damage)) {
+      printf("FAIL: region of %zu layers doesn't cover their damage\n",
+             scene[0]);
+      failed = true;
+    }
+
+    uint64_t region_area = 0;
+    for (const HwcRect<int> &rect : region)
+      region_area += Area(rect);
+
+    printf("%6zu %6zu %12.3f %12.3f %6zu %14.1f %14.1f\n", scene[0],
+           scene[0] * scene[1], rect_us, region_us, region.size(),
+           Area(bounds) / 1000.0, region_area / 1000.0);
+  }
+
+  return failed ? 1 : 0;
+}
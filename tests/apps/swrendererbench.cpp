@@ -0,0 +1,262 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures the time SWRenderer::Draw takes with the scalar kernels on one
+// thread, the widest kernels this CPU runs on one thread and the widest
+// kernels on all bands, and checks that all of them produce the same
+// pixels. Sources are small ARGB, NV12 and YUYV images scaled up to the
+// regions, some of them rotated. Needs neither a GPU nor DRM.
+//
+// Usage: sw-renderer-bench [iterations]
+
+#include <drm_fourcc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "nativesurface.h"
+#include "renderstate.h"
+#include "swrenderer.h"
+#include "swshim.h"
+
+using namespace hwcomposer;
+
+static const uint32_t kWidth = 1920;
+static const uint32_t kHeight = 1080;
+static const uint32_t kTextureSize = 64;
+
+// Renders into memory owned by the benchmark instead of a buffer imported
+// through the resource manager.
+class BenchSurface : public NativeSurface {
+ public:
+  BenchSurface() : NativeSurface(kWidth, kHeight), pixels_(kWidth * kHeight) {
+    image_.planes_[0] = reinterpret_cast<uint8_t *>(pixels_.data());
+    image_.pitches_[0] = kWidth * 4;
+    image_.format_ = DRM_FORMAT_ARGB8888;
+    image_.width_ = kWidth;
+    image_.height_ = kHeight;
+    image_.writable_ = true;
+
+    HwcRegion clear;
+    clear.emplace_back(0, 0, kWidth, kHeight);
+    SetClearRegion(clear);
+  }
+
+  bool MakeCurrent() override {
+    sw_target_ = &image_;
+    return true;
+  }
+
+  const std::vector<uint32_t> &GetPixels() const {
+    return pixels_;
+  }
+
+ private:
+  std::vector<uint32_t> pixels_;
+  struct sw_image image_;
+};
+
+// Source images with gradients in every channel, so that filtering shows.
+class BenchTextures {
+ public:
+  void Init(size_t count) {
+    static const uint32_t kFormats[] = {DRM_FORMAT_ARGB8888,
+                                        DRM_FORMAT_XRGB8888, DRM_FORMAT_NV12,
+                                        DRM_FORMAT_YUYV};
+    data_.resize(count);
+    images_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      struct sw_image &image = images_[i];
+      std::vector<uint8_t> &data = data_[i];
+      image.format_ = kFormats[i % 4];
+      image.width_ = kTextureSize;
+      image.height_ = kTextureSize;
+      if (image.format_ == DRM_FORMAT_NV12) {
+        data.resize(kTextureSize * kTextureSize * 3 / 2);
+        image.pitches_[0] = image.pitches_[1] = kTextureSize;
+        image.planes_[1] = data.data() + kTextureSize * kTextureSize;
+      } else if (image.format_ == DRM_FORMAT_YUYV) {
+        data.resize(kTextureSize * kTextureSize * 2);
+        image.pitches_[0] = kTextureSize * 2;
+      } else {
+        data.resize(kTextureSize * kTextureSize * 4);
+        image.pitches_[0] = kTextureSize * 4;
+      }
+
+      image.planes_[0] = data.data();
+      for (size_t byte = 0; byte < data.size(); byte++)
+        data[byte] = (byte * (i + 3) + byte / kTextureSize * 7) & 0xff;
+    }
+  }
+
+  size_t size() const {
+    return images_.size();
+  }
+
+  GpuResourceHandle GetHandle(size_t index) const {
+    return images_.at(index);
+  }
+
+ private:
+  std::vector<std::vector<uint8_t>> data_;
+  std::vector<struct sw_image> images_;
+};
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Splits the surface into a grid of regions. Neighbouring regions cycle
+// through layer_sets different stacks of 1 to max_layers layers, like the
+// regions of a few overlapping windows. Every third layer is rotated by
+// 90 degrees and every fifth one is a solid color.
+static void GenerateStates(int columns, int rows, int layer_sets,
+                           unsigned max_layers, const BenchTextures &textures,
+                           std::vector<RenderState> *states) {
+  static uint8_t color[4] = {0x40, 0x80, 0xc0, 0xff};
+  states->clear();
+  int width = kWidth / columns;
+  int height = kHeight / rows;
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      int set = (row * columns + column) % layer_sets;
+      states->emplace_back();
+      RenderState &state = states->back();
+      state.x_ = state.scissor_x_ = column * width;
+      state.y_ = state.scissor_y_ = row * height;
+      state.width_ = state.scissor_width_ = width;
+      state.height_ = state.scissor_height_ = height;
+      unsigned layers = 1 + set % max_layers;
+      for (unsigned i = 0; i < layers; i++) {
+        state.layer_state_.emplace_back();
+        RenderState::LayerState &layer = state.layer_state_.back();
+        size_t index = (set + i) % textures.size();
+        bool rotated = (set + i) % 3 == 2;
+        layer.crop_bounds_[0] = (float)column / columns;
+        layer.crop_bounds_[1] = (float)row / rows;
+        layer.crop_bounds_[2] = (float)(column + 1) / columns;
+        layer.crop_bounds_[3] = (float)(row + 1) / rows;
+        layer.alpha_ = 0.75f;
+        layer.premult_ = i % 2 ? 1.0f : 0.0f;
+        layer.texture_matrix_[0] = rotated ? 0.0f : 1.0f;
+        layer.texture_matrix_[1] = rotated ? 1.0f : 0.0f;
+        layer.texture_matrix_[2] = rotated ? 1.0f : 0.0f;
+        layer.texture_matrix_[3] = rotated ? 0.0f : 1.0f;
+        layer.layer_index_ = index;
+        if ((set + i) % 5 == 4) {
+          layer.solid_color_array_ = color;
+        } else {
+          layer.solid_color_array_ = NULL;
+          layer.handle_ = textures.GetHandle(index);
+        }
+      }
+    }
+  }
+}
+
+// Returns the average time per Draw in us. Bands are drawn on other
+// threads too, so this is wall time rather than CPU time.
+static double RunDraws(SWRenderer &renderer, BenchSurface &surface,
+                       const std::vector<RenderState> &states, int iterations,
+                       std::vector<uint32_t> *pixels, bool *failed) {
+  int64_t total = 0;
+  for (int i = 0; i < iterations; i++) {
+    surface.SetClearSurface(NativeSurface::kFullClear);
+    int64_t start = GetTimeNs();
+    bool drawn = renderer.Draw(states, &surface);
+    total += GetTimeNs() - start;
+    if (!drawn) {
+      printf("FAIL: Draw failed\n");
+      *failed = true;
+      break;
+    }
+  }
+
+  *pixels = surface.GetPixels();
+  return total / 1000.0 / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 20;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  SWRenderer renderer;
+  if (!renderer.Init()) {
+    fprintf(stderr, "Failed to initialize SWRenderer.\n");
+    return 1;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t bands = cpus > 0 ? cpus : 1;
+  const char *kernels = renderer.GetKernelName();
+  printf("Kernels: %s, CPUs: %u\n", kernels, bands);
+
+  const unsigned kMaxLayers = 4;
+  BenchSurface surface;
+  BenchTextures textures;
+  textures.Init(8);
+
+  const int grids[][2] = {{1, 1}, {4, 4}, {16, 16}, {32, 24}};
+  std::vector<RenderState> states;
+  std::vector<uint32_t> scalar_pixels;
+  std::vector<uint32_t> simd_pixels;
+  std::vector<uint32_t> banded_pixels;
+  bool failed = false;
+
+  printf("%8s %16s %14s %16s\n", "regions", "scalar us/draw",
+         "simd us/draw", "banded us/draw");
+  for (const auto &grid : grids) {
+    GenerateStates(grid[0], grid[1], 6, kMaxLayers, textures, &states);
+
+    renderer.SetKernelLevel(kSWScalar);
+    renderer.SetMaxBands(1);
+    double scalar_us = RunDraws(renderer, surface, states, iterations,
+                                &scalar_pixels, &failed);
+    renderer.SetKernelLevel(GetSupportedSWKernelLevel());
+    double simd_us = RunDraws(renderer, surface, states, iterations,
+                              &simd_pixels, &failed);
+    renderer.SetMaxBands(bands);
+    double banded_us = RunDraws(renderer, surface, states, iterations,
+                                &banded_pixels, &failed);
+    if (simd_pixels != scalar_pixels) {
+      printf("FAIL: %s kernels differ for %zu regions\n", kernels,
+             states.size());
+      failed = true;
+    }
+
+    if (banded_pixels != scalar_pixels) {
+      printf("FAIL: bands differ for %zu regions\n", states.size());
+      failed = true;
+    }
+
+    printf("%8zu %16.1f %14.1f %16.1f\n", states.size(), scalar_us, simd_us,
+           banded_us);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,551 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures CPU time spent in VKRenderer::Draw with command buffers recorded
+// for every Draw and reused across Draws, and checks that both produce the
+// same pixels. Textures alternate between two sets every frame, like the
+// layers of a running application. Runs without a GPU on Mesa's lavapipe,
+// e.g. with VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json,
+// or on SwiftShader by pointing VK_ICD_FILENAMES at vk_swiftshader_icd.json.
+// Set HWC_PROGRAM_CACHE_DIR to see the pipeline cache being loaded on the
+// second run.
+//
+// Usage: vk-renderer-bench [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "nativesurface.h"
+#include "renderstate.h"
+#include "vkrenderer.h"
+#include "vkshim.h"
+
+using namespace hwcomposer;
+
+static const uint32_t kWidth = 1920;
+static const uint32_t kHeight = 1080;
+static const uint32_t kTextureSize = 64;
+
+static VkPhysicalDeviceMemoryProperties mem_props;
+static VkQueue queue;
+static VkCommandBuffer cmd_buffer;
+
+static uint32_t GetMemoryTypeIndex(uint32_t mem_type_bits,
+                                   uint32_t required_props) {
+  for (uint32_t type = 0; type < mem_props.memoryTypeCount; type++) {
+    if ((mem_type_bits & (1 << type)) &&
+        (mem_props.memoryTypes[type].propertyFlags & required_props) ==
+            required_props) {
+      return type;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+static VkDeviceMemory AllocateImageMemory(VkImage image) {
+  VkMemoryRequirements mem_requirements;
+  vkGetImageMemoryRequirements(dev_, image, &mem_requirements);
+
+  VkMemoryAllocateInfo mem_allocate = {};
+  mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mem_allocate.allocationSize = mem_requirements.size;
+  mem_allocate.memoryTypeIndex =
+      GetMemoryTypeIndex(mem_requirements.memoryTypeBits, 0);
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  if (mem_allocate.memoryTypeIndex == UINT32_MAX ||
+      vkAllocateMemory(dev_, &mem_allocate, NULL, &memory) != VK_SUCCESS ||
+      vkBindImageMemory(dev_, image, memory, 0) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+
+  return memory;
+}
+
+static VkImageView CreateView(VkImage image) {
+  VkImageViewCreateInfo view_create = {};
+  view_create.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_create.image = image;
+  view_create.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_create.format = VK_FORMAT_R8G8B8A8_UNORM;
+  view_create.components.r = VK_COMPONENT_SWIZZLE_R;
+  view_create.components.g = VK_COMPONENT_SWIZZLE_G;
+  view_create.components.b = VK_COMPONENT_SWIZZLE_B;
+  view_create.components.a = VK_COMPONENT_SWIZZLE_A;
+  view_create.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_create.subresourceRange.levelCount = 1;
+  view_create.subresourceRange.layerCount = 1;
+
+  VkImageView view = VK_NULL_HANDLE;
+  vkCreateImageView(dev_, &view_create, NULL, &view);
+  return view;
+}
+
+static VkImageMemoryBarrier MakeBarrier(VkImage image, VkImageLayout from,
+                                        VkImageLayout to) {
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                          VK_ACCESS_TRANSFER_READ_BIT |
+                          VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = from;
+  barrier.newLayout = to;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+static bool BeginCommands() {
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  return vkBeginCommandBuffer(cmd_buffer, &begin_info) == VK_SUCCESS;
+}
+
+static bool SubmitCommands() {
+  if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS)
+    return false;
+
+  VkSubmitInfo submit = {};
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers = &cmd_buffer;
+  return vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE) == VK_SUCCESS &&
+         vkQueueWaitIdle(queue) == VK_SUCCESS;
+}
+
+// Renders into an image owned by the benchmark instead of a buffer
+// imported through the resource manager.
+class BenchSurface : public NativeSurface {
+ public:
+  BenchSurface() : NativeSurface(kWidth, kHeight) {
+  }
+
+  ~BenchSurface() override {
+    vkDestroyFramebuffer(dev_, fb_, NULL);
+    vkDestroyImageView(dev_, view_, NULL);
+    vkDestroyImage(dev_, image_, NULL);
+    vkFreeMemory(dev_, memory_, NULL);
+  }
+
+  bool MakeCurrent() override {
+    if (fb_ == VK_NULL_HANDLE && !Initialize())
+      return false;
+
+    framebuffer_ = fb_;
+    dst_barrier_before_clear_ =
+        MakeBarrier(image_, VK_IMAGE_LAYOUT_UNDEFINED,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    dst_barrier_before_clear_.srcAccessMask = 0;
+    dst_barrier_before_clear_.dstAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    draw_cache_ = &cache_;
+    return true;
+  }
+
+  // Copies the image, left in the render pass's final layout by the last
+  // Draw, to pixels.
+  bool ReadPixels(std::vector<uint8_t> *pixels) {
+    VkDeviceSize size = kWidth * kHeight * 4;
+    VkBufferCreateInfo buffer_create = {};
+    buffer_create.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create.size = size;
+    buffer_create.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(dev_, &buffer_create, NULL, &buffer) != VK_SUCCESS)
+      return false;
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(dev_, buffer, &mem_requirements);
+
+    VkMemoryAllocateInfo mem_allocate = {};
+    mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mem_allocate.allocationSize = mem_requirements.size;
+    mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
+        mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    bool ok =
+        mem_allocate.memoryTypeIndex != UINT32_MAX &&
+        vkAllocateMemory(dev_, &mem_allocate, NULL, &memory) == VK_SUCCESS &&
+        vkBindBufferMemory(dev_, buffer, memory, 0) == VK_SUCCESS &&
+        BeginCommands();
+    if (ok) {
+      VkImageMemoryBarrier barrier =
+          MakeBarrier(image_, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+      barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      vkCmdPipelineBarrier(cmd_buffer,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                           1, &barrier);
+
+      VkBufferImageCopy region = {};
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.layerCount = 1;
+      region.imageExtent.width = kWidth;
+      region.imageExtent.height = kHeight;
+      region.imageExtent.depth = 1;
+      vkCmdCopyImageToBuffer(cmd_buffer, image_,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1,
+                             &region);
+      ok = SubmitCommands();
+    }
+
+    void *data = NULL;
+    if (ok && vkMapMemory(dev_, memory, 0, size, 0, &data) == VK_SUCCESS) {
+      pixels->assign((uint8_t *)data, (uint8_t *)data + size);
+      vkUnmapMemory(dev_, memory);
+    } else {
+      ok = false;
+    }
+
+    vkDestroyBuffer(dev_, buffer, NULL);
+    vkFreeMemory(dev_, memory, NULL);
+    return ok;
+  }
+
+ private:
+  bool Initialize() {
+    VkImageCreateInfo image_create = {};
+    image_create.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create.imageType = VK_IMAGE_TYPE_2D;
+    image_create.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_create.extent.width = kWidth;
+    image_create.extent.height = kHeight;
+    image_create.extent.depth = 1;
+    image_create.mipLevels = 1;
+    image_create.arrayLayers = 1;
+    image_create.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_create.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(dev_, &image_create, NULL, &image_) != VK_SUCCESS)
+      return false;
+
+    memory_ = AllocateImageMemory(image_);
+    if (memory_ == VK_NULL_HANDLE)
+      return false;
+
+    view_ = CreateView(image_);
+    if (view_ == VK_NULL_HANDLE)
+      return false;
+
+    VkFramebufferCreateInfo framebuffer_create = {};
+    framebuffer_create.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create.renderPass = render_pass_;
+    framebuffer_create.attachmentCount = 1;
+    framebuffer_create.pAttachments = &view_;
+    framebuffer_create.width = kWidth;
+    framebuffer_create.height = kHeight;
+    framebuffer_create.layers = 1;
+    return vkCreateFramebuffer(dev_, &framebuffer_create, NULL, &fb_) ==
+           VK_SUCCESS;
+  }
+
+  VkImage image_ = VK_NULL_HANDLE;
+  VkDeviceMemory memory_ = VK_NULL_HANDLE;
+  VkImageView view_ = VK_NULL_HANDLE;
+  VkFramebuffer fb_ = VK_NULL_HANDLE;
+  VKDrawCache cache_;
+};
+
+// Source textures cleared to distinct colors, kept in the layout the
+// renderer samples them in.
+class BenchTextures {
+ public:
+  ~BenchTextures() {
+    for (size_t i = 0; i < images_.size(); i++) {
+      vkDestroyImageView(dev_, views_[i], NULL);
+      vkDestroyImage(dev_, images_[i], NULL);
+      vkFreeMemory(dev_, memory_[i], NULL);
+    }
+  }
+
+  bool Init(size_t count) {
+    VkImageCreateInfo image_create = {};
+    image_create.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create.imageType = VK_IMAGE_TYPE_2D;
+    image_create.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_create.extent.width = kTextureSize;
+    image_create.extent.height = kTextureSize;
+    image_create.extent.depth = 1;
+    image_create.mipLevels = 1;
+    image_create.arrayLayers = 1;
+    image_create.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_create.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (!BeginCommands())
+      return false;
+
+    for (size_t i = 0; i < count; i++) {
+      VkImage image;
+      if (vkCreateImage(dev_, &image_create, NULL, &image) != VK_SUCCESS)
+        return false;
+      images_.emplace_back(image);
+      memory_.emplace_back(AllocateImageMemory(image));
+      views_.emplace_back(CreateView(image));
+      if (memory_.back() == VK_NULL_HANDLE || views_.back() == VK_NULL_HANDLE)
+        return false;
+
+      VkImageMemoryBarrier barrier =
+          MakeBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+      barrier.srcAccessMask = 0;
+      vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                           1, &barrier);
+
+      VkClearColorValue color = {};
+      color.float32[0] = (i % 3) / 2.0f;
+      color.float32[1] = (i % 5) / 4.0f;
+      color.float32[2] = (i % 7) / 6.0f;
+      color.float32[3] = 0.5f + (i % 2) * 0.5f;
+      vkCmdClearColorImage(cmd_buffer, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1,
+                           &barrier.subresourceRange);
+
+      barrier = MakeBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL,
+                           0, NULL, 1, &barrier);
+
+      // What the renderer submits ahead of its draws. The layout is kept,
+      // unlike the imported buffers, which are written outside of Vulkan.
+      barrier = MakeBarrier(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      src_barrier_before_clear_.emplace_back(barrier);
+    }
+
+    return SubmitCommands();
+  }
+
+  size_t size() const {
+    return images_.size();
+  }
+
+  GpuResourceHandle GetHandle(size_t index) const {
+    GpuResourceHandle handle;
+    handle.image = images_.at(index);
+    handle.image_view = views_.at(index);
+    return handle;
+  }
+
+ private:
+  std::vector<VkImage> images_;
+  std::vector<VkDeviceMemory> memory_;
+  std::vector<VkImageView> views_;
+};
+
+static int64_t GetThreadTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t GetTimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Splits the surface into a grid of regions. Neighbouring regions cycle
+// through layer_sets different stacks of 1 to max_layers layers, like the
+// regions of a few overlapping windows. texture_offset picks other
+// textures without changing the geometry.
+static void GenerateStates(int columns, int rows, int layer_sets,
+                           unsigned max_layers, size_t texture_offset,
+                           const BenchTextures &textures,
+                           std::vector<RenderState> *states) {
+  states->clear();
+  int width = kWidth / columns;
+  int height = kHeight / rows;
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      int set = (row * columns + column) % layer_sets;
+      states->emplace_back();
+      RenderState &state = states->back();
+      state.x_ = state.scissor_x_ = column * width;
+      state.y_ = state.scissor_y_ = row * height;
+      state.width_ = state.scissor_width_ = width;
+      state.height_ = state.scissor_height_ = height;
+      unsigned layers = 1 + set % max_layers;
+      for (unsigned i = 0; i < layers; i++) {
+        state.layer_state_.emplace_back();
+        RenderState::LayerState &layer = state.layer_state_.back();
+        size_t index = (set + i + texture_offset) % textures.size();
+        layer.crop_bounds_[0] = (float)column / columns;
+        layer.crop_bounds_[1] = (float)row / rows;
+        layer.crop_bounds_[2] = (float)(column + 1) / columns;
+        layer.crop_bounds_[3] = (float)(row + 1) / rows;
+        layer.alpha_ = 0.5f;
+        layer.premult_ = 1.0f;
+        layer.texture_matrix_[0] = 1.0f;
+        layer.texture_matrix_[1] = 0.0f;
+        layer.texture_matrix_[2] = 0.0f;
+        layer.texture_matrix_[3] = 1.0f;
+        layer.layer_index_ = index;
+        layer.solid_color_array_ = NULL;
+        layer.handle_ = textures.GetHandle(index);
+      }
+    }
+  }
+}
+
+// Returns average CPU time of the calling thread per Draw in us, drawing
+// frames[i % frames.size()] in iteration i. Draw waits for the queue to be
+// idle, so time spent by lavapipe's rasterizer threads isn't included but
+// its submission work on our thread is.
+static double RunDraws(VKRenderer &renderer, BenchSurface &surface,
+                       const std::vector<RenderState> (&frames)[2],
+                       int iterations, std::vector<uint8_t> *pixels,
+                       bool *failed) {
+  // Untimed, builds the pipelines needed by frames.
+  renderer.Draw(frames[1], &surface);
+
+  int64_t total = 0;
+  for (int i = 0; i < iterations; i++) {
+    surface.SetClearSurface(NativeSurface::kFullClear);
+    int64_t start = GetThreadTimeNs();
+    bool drawn = renderer.Draw(frames[i % 2], &surface);
+    total += GetThreadTimeNs() - start;
+    if (!drawn) {
+      printf("FAIL: Draw failed\n");
+      *failed = true;
+      break;
+    }
+  }
+
+  if (!surface.ReadPixels(pixels)) {
+    printf("FAIL: reading back the surface failed\n");
+    *failed = true;
+  }
+
+  return total / 1000.0 / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 200;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  VKRenderer renderer;
+  int64_t init_start = GetTimeNs();
+  if (!renderer.Init()) {
+    fprintf(stderr, "Failed to initialize VKRenderer.\n");
+    return 1;
+  }
+  int64_t init_ns = GetTimeNs() - init_start;
+
+  // VKRenderer uses the first device and its first queue family.
+  uint32_t count = 1;
+  VkPhysicalDevice phys_dev;
+  VkResult res = vkEnumeratePhysicalDevices(inst_, &count, &phys_dev);
+  if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+    fprintf(stderr, "vkEnumeratePhysicalDevices failed (%d)\n", res);
+    return 1;
+  }
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(phys_dev, &props);
+  vkGetPhysicalDeviceMemoryProperties(phys_dev, &mem_props);
+  vkGetDeviceQueue(dev_, 0, 0, &queue);
+
+  VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
+  cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_buffer_alloc.commandPool = cmd_pool_;
+  cmd_buffer_alloc.commandBufferCount = 1;
+  if (vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc, &cmd_buffer) !=
+      VK_SUCCESS) {
+    fprintf(stderr, "vkAllocateCommandBuffers failed\n");
+    return 1;
+  }
+
+  printf("Device: %s\n", props.deviceName);
+  printf("Init: %.1f ms, %zu bytes of pipeline cache loaded\n",
+         init_ns / 1000000.0, renderer.GetLoadedPipelineCacheSize());
+  printf("Textures changed %s recording\n",
+         renderer.UsesUpdateAfterBind() ? "without" : "by");
+
+  const unsigned kMaxLayers = 4;
+  BenchSurface surface;
+  bool failed = false;
+  {
+    BenchTextures textures;
+    if (!textures.Init(8)) {
+      fprintf(stderr, "Failed to create textures.\n");
+      return 1;
+    }
+
+    const int grids[][2] = {{4, 4}, {8, 8}, {16, 16}, {32, 24}};
+    std::vector<RenderState> frames[2];
+    std::vector<uint8_t> recorded_pixels;
+    std::vector<uint8_t> reused_pixels;
+
+    printf("%8s %16s %14s %8s\n", "regions", "record us/draw",
+           "reuse us/draw", "speedup");
+    for (const auto &grid : grids) {
+      for (size_t frame = 0; frame < 2; frame++) {
+        GenerateStates(grid[0], grid[1], 6, kMaxLayers, frame, textures,
+                       &frames[frame]);
+      }
+
+      renderer.EnableCommandReuse(false);
+      double record_us = RunDraws(renderer, surface, frames, iterations,
+                                  &recorded_pixels, &failed);
+      renderer.EnableCommandReuse(true);
+      double reuse_us = RunDraws(renderer, surface, frames, iterations,
+                                 &reused_pixels, &failed);
+      if (recorded_pixels != reused_pixels) {
+        printf("FAIL: reused commands differ for %zu regions\n",
+               frames[0].size());
+        failed = true;
+      }
+
+      printf("%8zu %16.1f %14.1f %7.1fx\n", frames[0].size(), record_us,
+             reuse_us, record_us / reuse_us);
+    }
+  }
+
+  src_barrier_before_clear_.clear();
+  vkFreeCommandBuffers(dev_, cmd_pool_, 1, &cmd_buffer);
+  return failed ? 1 : 0;
+}
@@ -53,6 +53,11 @@ bool parseParametersJson(const char* json_path, TEST_PARAMETERS* parameters) {
           } else if (strcmp(layer_key, "transform") == 0) {
             layer_parameter.transform =
                 (LAYER_TRANSFORM)json_object_get_int(layer_value);
+          } else if (strcmp(layer_key, "blending") == 0) {
+            layer_parameter.blending =
+                (LAYER_BLENDING)json_object_get_int(layer_value);
+          } else if (strcmp(layer_key, "alpha") == 0) {
+            layer_parameter.alpha = json_object_get_int(layer_value);
           } else if (strcmp(layer_key, "resource_path") == 0) {
             layer_parameter.resource_path =
                 std::string(json_object_get_string(layer_value));
@@ -94,6 +99,25 @@ bool parseParametersJson(const char* json_path, TEST_PARAMETERS* parameters) {
                 layer_parameter.frame_height = json_object_get_int(frame_value);
               }
             }
+          } else if (strcmp(layer_key, "damage") == 0) {
+            int damage_len = json_object_array_length(layer_value);
+            for (int k = 0; k < damage_len; k++) {
+              LAYER_DAMAGE_RECT rect = {0, 0, 0, 0};
+              struct json_object* rect_object =
+                  json_object_array_get_idx(layer_value, k);
+              json_object_object_foreach(rect_object, rect_key, rect_value) {
+                if (strcmp(rect_key, "x") == 0) {
+                  rect.x = json_object_get_int(rect_value);
+                } else if (strcmp(rect_key, "y") == 0) {
+                  rect.y = json_object_get_int(rect_value);
+                } else if (strcmp(rect_key, "width") == 0) {
+                  rect.width = json_object_get_int(rect_value);
+                } else if (strcmp(rect_key, "height") == 0) {
+                  rect.height = json_object_get_int(rect_value);
+                }
+              }
+              layer_parameter.damage.push_back(rect);
+            }
           }
         }
         parameters->layers_parameters.push_back(layer_parameter);
@@ -203,6 +203,12 @@ typedef enum {
   LAYER_TRANSFORM_UNDEFINED
 } LAYER_TRANSFORM;
 
+typedef enum {
+  LAYER_BLENDING_NONE = 0,
+  LAYER_BLENDING_PREMULT = 1,
+  LAYER_BLENDING_COVERAGE = 2,
+} LAYER_BLENDING;
+
 typedef enum {
   RED = 0,
   GREEN = 1,
@@ -210,6 +216,13 @@ typedef enum {
   ALPHA = 3
 } RGBA;
 
+typedef struct {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+} LAYER_DAMAGE_RECT;
+
 typedef struct {
   LAYER_TYPE type;
   LAYER_FORMAT format;
@@ -225,6 +238,11 @@ typedef struct {
   uint32_t frame_y;
   uint32_t frame_width;
   uint32_t frame_height;
+  // Damage of every frame in buffer coordinates. Whole layer is damaged
+  // if empty.
+  std::vector<LAYER_DAMAGE_RECT> damage;
+  LAYER_BLENDING blending = LAYER_BLENDING_NONE;
+  uint32_t alpha = 0xff;
 } LAYER_PARAMETER;
 
 typedef std::vector<LAYER_PARAMETER> LAYER_PARAMETERS;
@@ -55,6 +55,7 @@ endif
 LOCAL_SRC_FILES := \
         physicaldisplay.cpp \
         drm/drmdisplay.cpp \
+        drm/drmcommitthread.cpp \
         drm/drmbuffer.cpp \
         drm/drmplane.cpp \
         drm/drmdisplaymanager.cpp \
@@ -98,7 +99,13 @@ LOCAL_CPPFLAGS += \
 
 LOCAL_CPPFLAGS += -DVA_SUPPORT_COLOR_RANGE
 
-ifeq ($(strip $(BOARD_USES_VULKAN)), true)
+ifeq ($(strip $(BOARD_USES_SOFTWARE_COMPOSITOR)), true)
+LOCAL_CPPFLAGS += \
+        -DUSE_SW
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../common/compositor/sw
+else ifeq ($(strip $(BOARD_USES_VULKAN)), true)
 LOCAL_SHARED_LIBRARIES += \
         libvulkan
 
@@ -122,6 +129,11 @@ LOCAL_CPPFLAGS += \
 	-DDISABLE_HOTPLUG_NOTIFICATION
 endif
 
+ifeq ($(strip $(ENABLE_PIPELINED_COMMIT)), true)
+LOCAL_CPPFLAGS += \
+	-DENABLE_PIPELINED_COMMIT
+endif
+
 LOCAL_CPPFLAGS += -DENABLE_ANDROID_WA
 
 LOCAL_MODULE := libhwcomposer_wsi
@@ -29,6 +29,10 @@
 #include "hwcutils.h"
 #include "resourcemanager.h"
 
+#ifdef USE_SW
+#include "swshim.h"
+#endif
+
 #ifndef DISABLE_VA
 #include <va/va_drmcommon.h>
 #include "vautils.h"
@@ -58,6 +62,8 @@ DrmBuffer::~DrmBuffer() {
   texture_initialized = image_.texture_ > 0;
 #elif USE_VK
   texture_initialized = image_.texture_ != VK_NULL_HANDLE;
+#elif USE_SW
+  texture_initialized = image_.image_.planes_[0] != NULL;
 #endif
 
 #ifndef DISABLE_VA
@@ -302,6 +308,9 @@ const ResourceHandle& DrmBuffer::GetGpuResource(GpuDisplay egl_display,
       ETRACE("vkCreateDmaBufImageINTEL failed\n");
     }
   }
+#elif USE_SW
+  if (image_.image_.planes_[0] == NULL)
+    MapSoftwareImage(image_.handle_->meta_data_, &image_);
 #endif
   return image_;
 }
@@ -385,6 +394,32 @@ const ResourceHandle& DrmBuffer::GetGpuResource() {
   return image_;
 }
 
+void DrmBuffer::ReleaseGpuResources() {
+#if USE_GL
+  // Images, textures and frame buffer objects belong to the context they
+  // were created in. Vulkan and software imports are not tied to one.
+  if (image_.image_ != 0 || image_.texture_ > 0 || image_.fb_ > 0) {
+    ResourceHandle gpu_resource;
+    gpu_resource.image_ = image_.image_;
+    gpu_resource.texture_ = image_.texture_;
+    gpu_resource.fb_ = image_.fb_;
+    resource_manager_->MarkResourceForDeletion(gpu_resource, true);
+    image_.image_ = 0;
+    image_.texture_ = 0;
+    image_.fb_ = 0;
+  }
+#endif
+
+#ifndef DISABLE_VA
+  if (media_image_.surface_ != VA_INVALID_ID) {
+    MediaResourceHandle media_resource;
+    media_resource.surface_ = media_image_.surface_;
+    media_image_.surface_ = VA_INVALID_ID;
+    resource_manager_->MarkMediaResourceForDeletion(media_resource);
+  }
+#endif
+}
+
 bool DrmBuffer::CreateFrameBuffer() {
   if (image_.drm_fd_) {
     return true;
@@ -106,6 +106,8 @@ class DrmBuffer : public OverlayBuffer {
                                               uint32_t width,
                                               uint32_t height) override;
 
+  void ReleaseGpuResources() override;
+
   bool CreateFrameBufferWithModifier(uint64_t modifier) override;
 
   HWCNativeHandle GetOriginalHandle() const override {
@@ -0,0 +1,184 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "drmcommitthread.h"
+
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <hwcutils.h>
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+DrmCommitThread::DrmCommitThread() : HWCThread(-8, "DrmCommitThread") {
+  if (!cevent_.Initialize())
+    return;
+
+  fd_chandler_.AddFd(cevent_.get_fd());
+}
+
+DrmCommitThread::~DrmCommitThread() {
+  ExitThread();
+
+  if (last_retire_fence_ > 0)
+    close(last_retire_fence_);
+}
+
+bool DrmCommitThread::Initialize(uint32_t gpu_fd, uint32_t crtc_id,
+                                 uint32_t out_fence_ptr_prop) {
+  if (out_fence_ptr_prop == 0)
+    return false;
+
+  if (!timeline_.Initialize())
+    return false;
+
+  gpu_fd_ = gpu_fd;
+  crtc_id_ = crtc_id;
+  out_fence_ptr_prop_ = out_fence_ptr_prop;
+  if (!InitWorker()) {
+    ETRACE("Failed to initalize DrmCommitThread. %s", PRINTERROR());
+    return false;
+  }
+
+  return true;
+}
+
+bool DrmCommitThread::QueueCommit(ScopedDrmAtomicReqPtr &pset, uint32_t flags,
+                                  int32_t *retire_fence) {
+  CommitRequest *request = new CommitRequest();
+  if (drmModeAtomicAddProperty(pset.get(), crtc_id_, out_fence_ptr_prop_,
+                               (uintptr_t)&request->out_fence) < 0) {
+    ETRACE("Failed to add OUT_FENCE_PTR property to pset.");
+    delete request;
+    return false;
+  }
+
+  // pset is dropped by the caller on failure, so it is fine for it to
+  // point to request here.
+  int32_t fence = timeline_.CreateFence("hwc retire");
+  if (fence < 0) {
+    delete request;
+    return false;
+  }
+
+  request->pset = pset.release();
+  request->flags = flags;
+
+  if (last_retire_fence_ > 0)
+    close(last_retire_fence_);
+
+  last_retire_fence_ = dup(fence);
+  *retire_fence = fence;
+
+  queue_lock_.lock();
+  requests_.push(request);
+  queue_lock_.unlock();
+  pending_submission_ = true;
+  Resume();
+  return true;
+}
+
+bool DrmCommitThread::WaitForSubmission() {
+  if (!pending_submission_)
+    return true;
+
+  pending_submission_ = false;
+  if (fd_chandler_.Poll(-1) <= 0) {
+    ETRACE("Poll Failed in DrmCommitThread %s", PRINTERROR());
+    return false;
+  }
+
+  if (fd_chandler_.IsReady(cevent_.get_fd())) {
+    // If eventfd_ is ready, we need to wait on it (using read()) to clean
+    // the flag that says it is ready.
+    cevent_.Wait();
+  }
+
+  queue_lock_.lock();
+  bool failed = commit_failed_;
+  commit_failed_ = false;
+  queue_lock_.unlock();
+  return !failed;
+}
+
+void DrmCommitThread::Flush() {
+  WaitForSubmission();
+  if (last_retire_fence_ > 0) {
+    HWCPoll(last_retire_fence_, -1);
+    close(last_retire_fence_);
+    last_retire_fence_ = -1;
+  }
+}
+
+void DrmCommitThread::ExitThread() {
+  HWCThread::Exit();
+}
+
+void DrmCommitThread::ReleaseRequest(CommitRequest *request) {
+  if (request->out_fence > 0)
+    close(request->out_fence);
+
+  drmModeAtomicFree(request->pset);
+  delete request;
+  // Never leave a retire fence handed out to clients unsignalled.
+  timeline_.Signal();
+}
+
+void DrmCommitThread::HandleRoutine() {
+  queue_lock_.lock();
+  if (requests_.empty()) {
+    queue_lock_.unlock();
+    return;
+  }
+
+  CommitRequest *request = requests_.front();
+  requests_.pop();
+  queue_lock_.unlock();
+
+  // Previous frame has already been shown on screen by the time we get
+  // here, as we wait for its out fence below. NONBLOCK commits will not
+  // run into EBUSY.
+  int ret = drmModeAtomicCommit(gpu_fd_, request->pset, request->flags, NULL);
+  if (ret) {
+    ETRACE("Failed to commit pset ret=%s\n", PRINTERROR());
+    queue_lock_.lock();
+    commit_failed_ = true;
+    queue_lock_.unlock();
+  }
+
+  // Let the queueing thread prepare next frame.
+  cevent_.Signal();
+
+  if (!ret && request->out_fence > 0)
+    HWCPoll(request->out_fence, -1);
+
+  ReleaseRequest(request);
+}
+
+void DrmCommitThread::HandleExit() {
+  queue_lock_.lock();
+  while (!requests_.empty()) {
+    ReleaseRequest(requests_.front());
+    requests_.pop();
+    cevent_.Signal();
+  }
+  queue_lock_.unlock();
+}
+
+}  // namespace hwcomposer
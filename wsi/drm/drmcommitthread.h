@@ -0,0 +1,94 @@
+/*
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef WSI_DRM_DRMCOMMITTHREAD_H_
+#define WSI_DRM_DRMCOMMITTHREAD_H_
+
+#include <stdint.h>
+
+#include <spinlock.h>
+
+#include <memory>
+#include <queue>
+
+#include "drmscopedtypes.h"
+#include "fdhandler.h"
+#include "hwcevent.h"
+#include "hwcthread.h"
+#include "synctimeline.h"
+
+namespace hwcomposer {
+
+// Commit stage of a DrmDisplay. Property sets are built on the thread
+// calling Present and handed over here, where we wait for the previous
+// frame to reach the screen and do the actual atomic commit. Present gets
+// back a sw_sync fence, which is signalled once KMS signals the out fence
+// of the commit it represents.
+class DrmCommitThread : public HWCThread {
+ public:
+  DrmCommitThread();
+  ~DrmCommitThread() override;
+
+  // Returns false in case sw_sync timeline is not available, in which case
+  // caller should continue to commit synchronously.
+  bool Initialize(uint32_t gpu_fd, uint32_t crtc_id,
+                  uint32_t out_fence_ptr_prop);
+
+  // Takes ownership of pset on success. retire_fence will be populated with
+  // a fence which is signalled once this frame is shown on screen.
+  bool QueueCommit(ScopedDrmAtomicReqPtr &pset, uint32_t flags,
+                   int32_t *retire_fence);
+
+  // Blocks till the last queued commit has been submitted to KMS. Returns
+  // false if that commit failed. Planes and fences referenced by the
+  // queued property set should not be touched before this returns.
+  bool WaitForSubmission();
+
+  // Blocks till all queued commits are shown on screen.
+  void Flush();
+
+  void ExitThread();
+
+ protected:
+  void HandleRoutine() override;
+  void HandleExit() override;
+
+ private:
+  struct CommitRequest {
+    drmModeAtomicReq *pset = NULL;
+    uint32_t flags = 0;
+    int32_t out_fence = -1;
+  };
+
+  void ReleaseRequest(CommitRequest *request);
+
+  SpinLock queue_lock_;
+  std::queue<CommitRequest *> requests_;
+  FDHandler fd_chandler_;
+  HWCEvent cevent_;
+  uint32_t gpu_fd_ = 0;
+  uint32_t crtc_id_ = 0;
+  uint32_t out_fence_ptr_prop_ = 0;
+  SyncTimeline timeline_;
+  // Accessed only from the thread queueing commits.
+  bool pending_submission_ = false;
+  int32_t last_retire_fence_ = -1;
+  // Set by commit stage when the last submission failed.
+  bool commit_failed_ = false;
+};
+
+}  // namespace hwcomposer
+#endif  // WSI_DRM_DRMCOMMITTHREAD_H_
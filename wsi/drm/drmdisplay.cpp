@@ -74,6 +74,14 @@ bool DrmDisplay::InitializeDisplay() {
   GetDrmObjectProperty("OUT_FENCE_PTR", crtc_props, &out_fence_ptr_prop_);
   GetDrmObjectProperty("background_color", crtc_props, &canvas_color_prop_);
 
+#ifdef ENABLE_PIPELINED_COMMIT
+  if (!commit_thread_) {
+    std::unique_ptr<DrmCommitThread> commit_thread(new DrmCommitThread());
+    if (commit_thread->Initialize(gpu_fd_, crtc_id_, out_fence_ptr_prop_))
+      commit_thread_ = std::move(commit_thread);
+  }
+#endif
+
   return true;
 }
 
@@ -493,15 +501,49 @@ bool DrmDisplay::Commit(
     const DisplayPlaneStateList &previous_composition_planes,
     bool disable_explicit_fence, int32_t previous_fence, int32_t *commit_fence,
     bool *previous_fence_released) {
+  *previous_fence_released = false;
+  bool pipelined = false;
+  if (commit_thread_) {
+    // Planes and fences referenced by the last queued commit cannot be
+    // touched till it has reached KMS.
+    if (!commit_thread_->WaitForSubmission()) {
+      ETRACE("Previous queued commit failed.");
+      // It might have been carrying the canvas color.
+      canvas_color_changed_ = canvas_color_prop_ != 0;
+      return false;
+    }
+
+    pipelined = !disable_explicit_fence && !(display_state_ & kNeedsModeset);
+    if (!pipelined)
+      commit_thread_->Flush();
+  }
+
   // Do the actual commit.
   ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
-  *previous_fence_released = false;
 
   if (!pset) {
     ETRACE("Failed to allocate property set %d", -ENOMEM);
     return false;
   }
 
+  if (pipelined) {
+    if (!UpdatePlanes(composition_planes, previous_composition_planes,
+                      pset.get()) ||
+        !commit_thread_->QueueCommit(pset, flags_, commit_fence)) {
+      ETRACE("Failed to queue commit.");
+      return false;
+    }
+
+    canvas_color_changed_ = false;
+    // Commit stage takes care of waiting for the previous frame.
+    if (previous_fence > 0) {
+      close(previous_fence);
+      *previous_fence_released = true;
+    }
+
+    return true;
+  }
+
   if (display_state_ & kNeedsModeset) {
     if (!ApplyPendingModeset(pset.get())) {
       ETRACE("Failed to Modeset.");
@@ -517,6 +559,8 @@ bool DrmDisplay::Commit(
     return false;
   }
 
+  canvas_color_changed_ = false;
+
   if (display_state_ & kNeedsModeset) {
     display_state_ &= ~kNeedsModeset;
     if (!disable_explicit_fence) {
@@ -537,17 +581,10 @@ bool DrmDisplay::Commit(
   return true;
 }
 
-bool DrmDisplay::CommitFrame(
+bool DrmDisplay::UpdatePlanes(
     const DisplayPlaneStateList &comp_planes,
     const DisplayPlaneStateList &previous_composition_planes,
-    drmModeAtomicReqPtr pset, uint32_t flags, int32_t previous_fence,
-    bool *previous_fence_released) {
-  CTRACE();
-  if (!pset) {
-    ETRACE("Failed to allocate property set %d", -ENOMEM);
-    return false;
-  }
-
+    drmModeAtomicReqPtr pset) {
   for (const DisplayPlaneState &comp_plane : comp_planes) {
     DrmPlane *plane = static_cast<DrmPlane *>(comp_plane.GetDisplayPlane());
 
@@ -588,6 +625,30 @@ bool DrmDisplay::CommitFrame(
     plane->Disable(pset);
   }
 
+  if (canvas_color_changed_ &&
+      drmModeAtomicAddProperty(pset, crtc_id_, canvas_color_prop_,
+                               canvas_color_) < 0) {
+    ETRACE("Failed to add canvas color to pset.");
+    return false;
+  }
+
+  return true;
+}
+
+bool DrmDisplay::CommitFrame(
+    const DisplayPlaneStateList &comp_planes,
+    const DisplayPlaneStateList &previous_composition_planes,
+    drmModeAtomicReqPtr pset, uint32_t flags, int32_t previous_fence,
+    bool *previous_fence_released) {
+  CTRACE();
+  if (!pset) {
+    ETRACE("Failed to allocate property set %d", -ENOMEM);
+    return false;
+  }
+
+  if (!UpdatePlanes(comp_planes, previous_composition_planes, pset))
+    return false;
+
 #ifndef ENABLE_DOUBLE_BUFFERING
   if (previous_fence > 0) {
     HWCPoll(previous_fence, -1);
@@ -804,8 +865,14 @@ void DrmDisplay::SetPipeCanvasColor(uint16_t bpc, uint16_t red, uint16_t green,
   else if (bpc == 16)
     canvas_color = DRM_RGBA16161616(red, green, blue, alpha);
 
-  drmModeObjectSetProperty(gpu_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC,
-                           canvas_color_prop_, canvas_color);
+  // Goes out with the planes of the next commit, so that it changes in the
+  // same frame as the planes it shows through.
+  canvas_color_ = canvas_color;
+  canvas_color_changed_ = true;
+}
+
+bool DrmDisplay::SupportsPipeCanvasColor() const {
+  return canvas_color_prop_ != 0;
 }
 
 bool DrmDisplay::SetPipeMaxBpc(uint16_t max_bpc) const {
@@ -1007,6 +1074,8 @@ bool DrmDisplay::GetFence(drmModeAtomicReqPtr property_set,
 
 void DrmDisplay::Disable(const DisplayPlaneStateList &composition_planes) {
   IHOTPLUGEVENTTRACE("Disable: Disabling Display: %p", this);
+  if (commit_thread_)
+    commit_thread_->Flush();
 
   for (const DisplayPlaneState &comp_plane : composition_planes) {
     DrmPlane *plane = static_cast<DrmPlane *>(comp_plane.GetDisplayPlane());
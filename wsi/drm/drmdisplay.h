@@ -23,6 +23,7 @@
 
 #include <drmscopedtypes.h>
 
+#include "drmcommitthread.h"
 #include "drmplane.h"
 #include "physicaldisplay.h"
 
@@ -76,6 +77,7 @@ class DrmDisplay : public PhysicalDisplay {
                           uint32_t brightness) const override;
   void SetPipeCanvasColor(uint16_t bpc, uint16_t red, uint16_t green,
                           uint16_t blue, uint16_t alpha) const override;
+  bool SupportsPipeCanvasColor() const override;
   bool SetPipeMaxBpc(uint16_t max_bpc) const override;
   void SetColorTransformMatrix(
       const float *color_transform_matrix,
@@ -150,6 +152,9 @@ class DrmDisplay : public PhysicalDisplay {
   void ApplyPendingLUT(struct drm_color_lut *lut) const;
   bool ApplyPendingModeset(drmModeAtomicReqPtr property_set);
   bool GetFence(drmModeAtomicReqPtr property_set, int32_t *out_fence);
+  bool UpdatePlanes(const DisplayPlaneStateList &comp_planes,
+                    const DisplayPlaneStateList &previous_composition_planes,
+                    drmModeAtomicReqPtr pset);
   bool CommitFrame(const DisplayPlaneStateList &comp_planes,
                    const DisplayPlaneStateList &previous_composition_planes,
                    drmModeAtomicReqPtr pset, uint32_t flags,
@@ -180,6 +185,10 @@ class DrmDisplay : public PhysicalDisplay {
   uint32_t hdcp_srm_id_prop_ = 0;
   uint32_t edid_prop_ = 0;
   uint32_t canvas_color_prop_ = 0;
+  // Canvas color set through SetPipeCanvasColor, added to the next commit
+  // while canvas_color_changed_.
+  mutable uint64_t canvas_color_ = 0;
+  mutable bool canvas_color_changed_ = false;
   uint32_t connector_ = 0;
   bool dcip3_ = false;
   uint32_t max_bpc_prop_ = 0;
@@ -197,6 +206,9 @@ class DrmDisplay : public PhysicalDisplay {
   std::vector<drmModeModeInfo> modes_;
   SpinLock display_lock_;
   DrmDisplayManager *manager_;
+  // Only created when ENABLE_PIPELINED_COMMIT is set and sw_sync is
+  // available.
+  std::unique_ptr<DrmCommitThread> commit_thread_;
 };
 
 }  // namespace hwcomposer
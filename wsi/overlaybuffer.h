@@ -85,6 +85,12 @@ class OverlayBuffer {
                                                       uint32_t width,
                                                       uint32_t height) = 0;
 
+  // Queues what GetGpuResource and GetMediaResource imported for deletion
+  // with the next purged resources, keeping the buffer and its frame
+  // buffer. They are imported again on next use, by whichever context
+  // that happens in.
+  virtual void ReleaseGpuResources() = 0;
+
   // Creates Framebuffer taking into account any Modifiers.
   virtual bool CreateFrameBufferWithModifier(uint64_t modifier) = 0;
 
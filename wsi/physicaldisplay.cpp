@@ -29,6 +29,7 @@
 #include "displayplanemanager.h"
 #include "displayqueue.h"
 #include "hwcutils.h"
+#include "presentsequencer.h"
 #include "wsi_utils.h"
 
 namespace hwcomposer {
@@ -329,10 +330,17 @@ bool PhysicalDisplay::Present(std::vector<HwcLayer *> &source_layers,
     IHOTPLUGEVENTTRACE("Handle_hoplug_notifications done. %p \n", this);
   }
 
+  // Nothing of the frame has been read yet.
+  display_queue_->WaitForLatch();
   bool ignore_clone_update = false;
   bool success = display_queue_->QueueUpdate(source_layers, retire_fence,
                                              &ignore_clone_update, call_back,
-                                             handle_constraints);
+                                             handle_constraints, present_turn_);
+  // Clones set release fences of the layers and validation below resets
+  // their state.
+  if (present_turn_)
+    present_turn_->BeginRelease();
+
   if (success && !clones_.empty() && !ignore_clone_update) {
     HandleClonedDisplays(this);
   }
@@ -349,6 +357,11 @@ bool PhysicalDisplay::Present(std::vector<HwcLayer *> &source_layers,
   return success;
 }
 
+bool PhysicalDisplay::SetPresentTurn(PresentTurn *turn) {
+  present_turn_ = turn;
+  return true;
+}
+
 bool PhysicalDisplay::PresentClone(NativeDisplay *display) {
   CTRACE();
   SPIN_LOCK(modeset_lock_);
@@ -441,6 +454,27 @@ void PhysicalDisplay::SetDisableExplicitSync(bool disable_explicit_sync) {
   display_queue_->SetDisableExplicitSync(disable_explicit_sync);
 }
 
+void PhysicalDisplay::SetLateLatching(bool enable) {
+  display_queue_->SetLateLatching(enable);
+}
+
+void PhysicalDisplay::WaitForLatch() {
+  display_queue_->WaitForLatch();
+}
+
+uint32_t PhysicalDisplay::GetMissedPresentDeadlines() {
+  return display_queue_->GetMissedPresentDeadlines();
+}
+
+bool PhysicalDisplay::GetFrameStats(HwcFrameStats *stats) {
+  display_queue_->GetFrameStats(stats);
+  return true;
+}
+
+void PhysicalDisplay::ResetFrameStats() {
+  display_queue_->ResetFrameStats();
+}
+
 void PhysicalDisplay::SetVideoScalingMode(uint32_t mode) {
   display_queue_->SetVideoScalingMode(mode);
 }
@@ -513,6 +547,13 @@ void PhysicalDisplay::CloneDisplay(NativeDisplay *source_display) {
   }
 }
 
+void PhysicalDisplay::SetScaledClones(bool enable) {
+  SPIN_LOCK(modeset_lock_);
+  scaled_clones_ = enable;
+  display_state_ |= kRefreshClonedDisplays;
+  SPIN_UNLOCK(modeset_lock_);
+}
+
 void PhysicalDisplay::OwnPresentation(NativeDisplay *clone) {
   cloned_displays_.emplace_back(clone);
   display_state_ |= kRefreshClonedDisplays;
@@ -547,8 +588,10 @@ void PhysicalDisplay::RotateDisplay(HWCRotation rotation) {
 void PhysicalDisplay::RefreshClones() {
   display_state_ &= ~kRefreshClonedDisplays;
   std::vector<NativeDisplay *>().swap(clones_);
-  if (cloned_displays_.empty())
+  if (cloned_displays_.empty()) {
+    display_queue_->SetScaledClones(false);
     return;
+  }
 
   size_t size = cloned_displays_.size();
   for (size_t i = 0; i < size; i++) {
@@ -561,15 +604,20 @@ void PhysicalDisplay::RefreshClones() {
 
   uint32_t primary_width = Width();
   uint32_t primary_height = Height();
+  bool needs_scaling = false;
   for (auto display : clones_) {
     uint32_t display_width = display->Width();
     uint32_t display_height = display->Height();
     if ((primary_width == display_width) && (primary_height == display_height))
-      return;
+      continue;
 
+    needs_scaling = true;
     display->UpdateScalingRatio(primary_width, primary_height, display_width,
                                 display_height);
   }
+
+  // Clones of our size show our planes as they are.
+  display_queue_->SetScaledClones(scaled_clones_ && needs_scaling);
 }
 
 bool PhysicalDisplay::GetDisplayAttribute(uint32_t /*config*/,
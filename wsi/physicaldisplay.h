@@ -75,6 +75,8 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
                PixelUploaderCallback *call_back = NULL,
                bool handle_constraints = false) override;
 
+  bool SetPresentTurn(PresentTurn *turn) override;
+
   int RegisterVsyncCallback(std::shared_ptr<VsyncCallback> callback,
                             uint32_t display_id) override;
 
@@ -91,6 +93,11 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
   void SetColorTransform(const float *matrix, HWCColorTransform hint) override;
   void SetBrightness(uint32_t red, uint32_t green, uint32_t blue) override;
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
+  void SetLateLatching(bool enable) override;
+  void WaitForLatch() override;
+  uint32_t GetMissedPresentDeadlines() override;
+  bool GetFrameStats(HwcFrameStats *stats) override;
+  void ResetFrameStats() override;
   void SetVideoScalingMode(uint32_t mode) override;
   void SetVideoColor(HWCColorControl color, float value) override;
   void GetVideoColor(HWCColorControl color, float *value, float *start,
@@ -118,6 +125,8 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
 
   void CloneDisplay(NativeDisplay *source_display) override;
 
+  void SetScaledClones(bool enable) override;
+
   bool PresentClone(NativeDisplay * /*display*/) override;
 
   bool GetDisplayAttribute(uint32_t /*config*/, HWCDisplayAttribute attribute,
@@ -212,11 +221,17 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
   virtual void NotifyClientsOfDisplayChangeStatus() = 0;
 
   /**
-   * API for setting the color of the pipe canvas.
+   * API for setting the color of the pipe canvas. Takes effect with the
+   * next Commit.
    */
   virtual void SetPipeCanvasColor(uint16_t bpc, uint16_t red, uint16_t green,
                                   uint16_t blue, uint16_t alpha) const = 0;
 
+  /**
+   * API for querying if the pipe canvas color can be set.
+   */
+  virtual bool SupportsPipeCanvasColor() const = 0;
+
   /**
    * API for setting the colordepth of the pipe.
    */
@@ -315,6 +330,9 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
   std::vector<NativeDisplay *> cloned_displays_;
   std::vector<NativeDisplay *> clones_;
   uint32_t config_ = DEFAULT_CONFIG_ID;
+  bool scaled_clones_ = false;
+  // Set when presented along with other displays showing the same layers.
+  PresentTurn *present_turn_ = NULL;
 };
 
 }  // namespace hwcomposer
@@ -53,7 +53,9 @@ LOCAL_SRC_FILES := os/alios/hwf_alioshal.cpp \
     common/display/displayplanestate.cpp \
     common/display/displayplanemanager.cpp \
     common/display/vblankeventhandler.cpp \
+    common/display/presentsequencer.cpp \
     common/compositor/compositor.cpp \
+    common/compositor/compositorpool.cpp \
     common/compositor/compositorthread.cpp \
     common/compositor/nativesurface.cpp \
     common/compositor/factory.cpp \
@@ -64,6 +66,8 @@ LOCAL_SRC_FILES := os/alios/hwf_alioshal.cpp \
     common/compositor/gl/egloffscreencontext.cpp \
     common/compositor/gl/nativeglresource.cpp \
     common/compositor/gl/glprogram.cpp \
+    common/compositor/gl/glprogramcache.cpp \
+    common/compositor/gl/glprogramwarmer.cpp \
     common/compositor/va/varenderer.cpp \
     common/compositor/va/vautils.cpp \
     wsi/drm/drmdisplaymanager.cpp \